@@ -0,0 +1,112 @@
+//! Runs concurrent jobs of multiplications on the flat scheduler, whose jobs share rayon's global
+//! pool, and on a scheduler with a pool of threads pinned to each NUMA node.
+//!
+//! Each job creates its keys and ciphertexts on the threads that will compute it, as servers do.
+
+use bpce_fhe::scheduler::{Chunk, JobSpec, Placement, Scheduler};
+use bpce_fhe::{numa, protocol};
+use criterion::{BatchSize, Criterion, criterion_group, criterion_main};
+use fhe_core::api::CryptoSystem as _;
+use rayon::prelude::*;
+use seal_lib::{BfvHOperation2, Ciphertext, SealBfvCS};
+use std::sync::Arc;
+
+/// Jobs running at once.
+const JOBS: usize = 8;
+const CHUNKS: usize = 4;
+/// Multiplications of each chunk.
+const ITEMS: usize = 64;
+
+struct Job {
+    placement: Placement,
+    bfv_cs: Arc<SealBfvCS>,
+    operands: Arc<Vec<(Ciphertext, Ciphertext)>>,
+}
+
+fn prepare(scheduler: &Scheduler) -> Vec<Job> {
+    (0..JOBS)
+        .map(|_| {
+            let placement = scheduler.place();
+            let (bfv_cs, operands) = placement.install(|| {
+                let bfv_ctx = protocol::bfv_context();
+                let bfv_cs = match placement.memory_pool() {
+                    Some(pool) => SealBfvCS::with_pool(&bfv_ctx, pool),
+                    None => SealBfvCS::new(&bfv_ctx),
+                };
+                let operands = (0..ITEMS)
+                    .into_par_iter()
+                    .map(|i| (bfv_cs.cipher(&(i as u64)), bfv_cs.cipher(&3)))
+                    .collect::<Vec<_>>();
+                (Arc::new(bfv_cs), Arc::new(operands))
+            });
+            Job {
+                placement,
+                bfv_cs,
+                operands,
+            }
+        })
+        .collect()
+}
+
+fn run(runtime: &tokio::runtime::Runtime, jobs: Vec<Job>) {
+    let handles = jobs
+        .into_iter()
+        .map(|job| {
+            let chunks = (0..CHUNKS)
+                .map(|_| {
+                    let bfv_cs = Arc::clone(&job.bfv_cs);
+                    let operands = Arc::clone(&job.operands);
+                    Box::new(move || {
+                        operands
+                            .par_iter()
+                            .map(|(lhs, rhs)| bfv_cs.operate2(BfvHOperation2::Mul, lhs, rhs))
+                            .collect()
+                    }) as Chunk
+                })
+                .collect();
+            job.placement.submit(JobSpec {
+                priority: protocol::Priority::Normal,
+                tenant: String::new(),
+                deadline: None,
+                chunks,
+                merge: Box::new(|outputs| outputs),
+                stream: None,
+            })
+        })
+        .collect::<Vec<_>>();
+
+    runtime.block_on(async {
+        for handle in handles {
+            handle.wait().await.unwrap();
+        }
+    });
+}
+
+fn benchmark_numa(c: &mut Criterion) {
+    let runtime = tokio::runtime::Runtime::new().unwrap();
+    let nodes = numa::nodes();
+    println!("NUMA nodes: {nodes:?}");
+
+    let mut schedulers = vec![("flat", Scheduler::start())];
+    if nodes.is_empty() {
+        println!("NUMA topology unknown, only running the flat scheduler");
+    } else {
+        schedulers.push(("numa", Scheduler::start_numa(&nodes).unwrap()));
+    }
+
+    let mut group = c.benchmark_group("numa");
+    group.sample_size(10);
+    for (name, scheduler) in &schedulers {
+        group.bench_function(format!("{JOBS} jobs ({name})"), |b| {
+            b.iter_batched(
+                || prepare(scheduler),
+                |jobs| run(&runtime, jobs),
+                BatchSize::PerIteration,
+            );
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(numa_benchmarks, benchmark_numa);
+criterion_main!(numa_benchmarks);
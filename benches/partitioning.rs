@@ -0,0 +1,117 @@
+//! Runs operation mixes whose multiplications are clustered, sharing items evenly between threads
+//! or running the costliest ones first.
+//!
+//! Also runs batches of TFHE multiplications, which are parallel themselves, with a thread per
+//! item or with threads shared between items and operations.
+
+use bpce_fhe::cost::{self, CostModel};
+use bpce_fhe::protocol;
+use criterion::{Criterion, criterion_group, criterion_main};
+use fhe_core::api::CryptoSystem as _;
+use fhe_operations::seq_ops::SeqOpItem;
+use rayon::prelude::*;
+use seal_lib::{BfvHOperation2, SealBfvCS};
+use zama_lib::{FheUint16, TfheHOperation2, ZamaTfheCS, config::ZamaTfheContext};
+
+type TfheCiphertext = zama_lib::Ciphertext<u16, FheUint16>;
+
+const ITEMS: usize = 512;
+/// One item out of `MUL_RATIO` is a multiplication.
+const MUL_RATIO: usize = 8;
+
+fn mix(bfv_cs: &SealBfvCS, is_mul: impl Fn(usize) -> bool) -> Vec<SeqOpItem<SealBfvCS>> {
+    let (lhs, rhs) = (bfv_cs.cipher(&3), bfv_cs.cipher(&5));
+    (0..ITEMS)
+        .map(|i| {
+            let op = if is_mul(i) {
+                BfvHOperation2::Mul
+            } else {
+                BfvHOperation2::Add
+            };
+            SeqOpItem::new(lhs.clone(), rhs.clone(), op)
+        })
+        .collect()
+}
+
+fn benchmark_partitioning(c: &mut Criterion) {
+    let bfv_ctx = protocol::bfv_context();
+    let bfv_cs = SealBfvCS::new(&bfv_ctx);
+
+    let (lhs, rhs) = (bfv_cs.cipher(&3), bfv_cs.cipher(&5));
+    let costs = CostModel::measure(&[BfvHOperation2::Add, BfvHOperation2::Mul], |op| {
+        bfv_cs.operate2(op, &lhs, &rhs);
+    });
+    println!("Relative cost of operations: {costs}");
+    std::fs::create_dir_all("target").unwrap();
+    std::fs::write("target/cost-model.toml", costs.to_toml()).unwrap();
+
+    let muls = ITEMS / MUL_RATIO;
+    let mixes = [
+        ("muls last", mix(&bfv_cs, |i| i >= ITEMS - muls)),
+        ("muls first", mix(&bfv_cs, |i| i < muls)),
+        ("muls spread", mix(&bfv_cs, |i| i % MUL_RATIO == 0)),
+    ];
+
+    let mut group = c.benchmark_group("partitioning");
+    group.sample_size(10);
+    for (name, items) in &mixes {
+        group.bench_function(format!("{name} (even)"), |b| {
+            b.iter(|| {
+                items
+                    .par_iter()
+                    .map(|item| item.execute(&bfv_cs))
+                    .collect::<Vec<_>>()
+            });
+        });
+        group.bench_function(format!("{name} (costliest first)"), |b| {
+            b.iter(|| {
+                cost::par_map_costliest_first(
+                    items,
+                    |item| costs.cost(item.op()),
+                    |item| item.execute(&bfv_cs),
+                )
+            });
+        });
+    }
+    group.finish();
+}
+
+fn benchmark_thread_budget(c: &mut Criterion) {
+    let tfhe_cs = ZamaTfheCS::<u16, FheUint16>::new(&ZamaTfheContext::new());
+    let (lhs, rhs) = (tfhe_cs.cipher(&300), tfhe_cs.cipher(&2));
+    let costs = CostModel::measure(&[TfheHOperation2::Mul], |op| {
+        let _ = tfhe_cs.operate2(op, &lhs, &rhs);
+    });
+
+    let op_pools = cost::OpPools::new(rayon::current_num_threads(), None);
+    let mut group = c.benchmark_group("thread budget");
+    group.sample_size(10);
+    for batch in [2, 4 * rayon::current_num_threads()] {
+        let items = vec![(lhs.clone(), rhs.clone()); batch];
+        let mul = |(lhs, rhs): &(TfheCiphertext, TfheCiphertext)| {
+            tfhe_cs.operate2(TfheHOperation2::Mul, lhs, rhs)
+        };
+        group.bench_function(format!("{batch} tfhe muls (per item)"), |b| {
+            b.iter(|| items.par_iter().map(mul).collect::<Vec<_>>());
+        });
+        group.bench_function(format!("{batch} tfhe muls (budgeted)"), |b| {
+            b.iter(|| {
+                cost::par_map_budgeted(
+                    &items,
+                    |_| costs.max_cost(),
+                    tfhe_cs.op_threads(),
+                    &op_pools,
+                    mul,
+                )
+            });
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(
+    partitioning_benchmarks,
+    benchmark_partitioning,
+    benchmark_thread_budget
+);
+criterion_main!(partitioning_benchmarks);
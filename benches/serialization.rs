@@ -0,0 +1,71 @@
+//! Encodes and decodes arrays of ciphertexts one at a time, as bincode does, or over all threads.
+//!
+//! Also copies a payload into a buffer allocated for it, as received payloads were, or taken
+//! from the pool of buffers.
+
+use bpce_fhe::buffers::BufferPool;
+use bpce_fhe::protocol;
+use criterion::{BatchSize, Criterion, Throughput, criterion_group, criterion_main};
+use fhe_core::api::CryptoSystem as _;
+use seal_lib::{Ciphertext, SealBfvCS};
+
+const CONFIGURATION: bincode::config::Configuration = bincode::config::standard();
+const CIPHERTEXTS: u64 = 4096;
+
+fn benchmark_serialization(c: &mut Criterion) {
+    let bfv_ctx = protocol::bfv_context();
+    let bfv_cs = SealBfvCS::new(&bfv_ctx);
+    let ciphertexts = (0..CIPHERTEXTS)
+        .map(|i| bfv_cs.cipher(&i))
+        .collect::<Vec<_>>();
+    let encoded = bincode::encode_to_vec(&ciphertexts, CONFIGURATION).unwrap();
+
+    let mut group = c.benchmark_group(format!("serialization of {CIPHERTEXTS} ciphertexts"));
+    group.throughput(Throughput::Bytes(encoded.len() as u64));
+    group.sample_size(10);
+
+    group.bench_function("encode (sequential)", |b| {
+        b.iter(|| bincode::encode_to_vec(&ciphertexts, CONFIGURATION).unwrap());
+    });
+    group.bench_function("encode (parallel)", |b| {
+        b.iter(|| protocol::encode_ciphertexts(&ciphertexts).unwrap());
+    });
+    // Decoding with bincode takes the context by value.
+    group.bench_function("decode (sequential)", |b| {
+        b.iter_batched(
+            protocol::bfv_context,
+            |bfv_ctx| {
+                let (decoded, _): (Vec<Ciphertext>, _) =
+                    bincode::decode_from_slice_with_context(&encoded, CONFIGURATION, bfv_ctx)
+                        .unwrap();
+                decoded
+            },
+            BatchSize::LargeInput,
+        );
+    });
+    group.bench_function("decode (parallel)", |b| {
+        b.iter(|| protocol::decode_ciphertexts(&encoded, &bfv_ctx).unwrap());
+    });
+    group.finish();
+
+    let mut group = c.benchmark_group("payload buffers");
+    group.throughput(Throughput::Bytes(encoded.len() as u64));
+    group.bench_function("receive (allocated)", |b| {
+        b.iter(|| {
+            let mut buffer = vec![0_u8; encoded.len()];
+            buffer.copy_from_slice(&encoded);
+            buffer
+        });
+    });
+    group.bench_function("receive (pooled)", |b| {
+        b.iter(|| {
+            let mut buffer = BufferPool::global().take(encoded.len());
+            buffer.extend_from_slice(&encoded);
+            buffer
+        });
+    });
+    group.finish();
+}
+
+criterion_group!(serialization_benchmarks, benchmark_serialization);
+criterion_main!(serialization_benchmarks);
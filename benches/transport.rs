@@ -0,0 +1,81 @@
+use bpce_fhe::transport::{Endpoint, Listener, Stream};
+use criterion::{Criterion, Throughput, criterion_group, criterion_main};
+use std::path::PathBuf;
+use tokio::runtime::Runtime;
+
+const PAYLOAD_SIZE: usize = 1 << 30; // 1 GB
+const PAGE_SIZE: usize = 4096;
+
+/// Start a server that acknowledges each payload with a checksum of its pages,
+/// so that every page of the payload is actually brought in by the receiver.
+async fn start_echo(endpoint: &Endpoint) {
+    let listener = Listener::bind(endpoint).await.unwrap();
+
+    tokio::spawn(async move {
+        let (mut stream, _) = listener.accept().await.unwrap();
+        while let Ok(payload) = stream.recv().await {
+            let checksum = payload
+                .iter()
+                .step_by(PAGE_SIZE)
+                .fold(0_u64, |acc, &b| acc.wrapping_add(u64::from(b)));
+            stream.send(&checksum.to_le_bytes()).await.unwrap();
+        }
+    });
+}
+
+fn bench_endpoint(c: &mut Criterion, name: &str, endpoint: &Endpoint, shm_threshold: usize) {
+    let rt = Runtime::new().unwrap();
+    let payload = vec![1_u8; PAYLOAD_SIZE];
+
+    let mut stream = rt.block_on(async {
+        start_echo(endpoint).await;
+        Stream::connect(endpoint)
+            .await
+            .unwrap()
+            .with_shm_threshold(shm_threshold)
+    });
+
+    let mut group = c.benchmark_group("transport 1GB");
+    group.throughput(Throughput::Bytes(PAYLOAD_SIZE as u64));
+    group.sample_size(10);
+
+    group.bench_function(name, |b| {
+        b.iter(|| {
+            rt.block_on(async {
+                stream.send(&payload).await.unwrap();
+                stream.recv().await.unwrap()
+            })
+        });
+    });
+
+    group.finish();
+}
+
+fn benchmark_transports(c: &mut Criterion) {
+    let tcp = Endpoint::Tcp("127.0.0.1:18080".parse().unwrap());
+    bench_endpoint(c, "loopback tcp", &tcp, usize::MAX);
+
+    #[cfg(feature = "io-uring")]
+    {
+        let uring = Endpoint::Uring("127.0.0.1:18081".parse().unwrap());
+        bench_endpoint(c, "loopback tcp (io_uring)", &uring, usize::MAX);
+    }
+
+    let unix = Endpoint::Unix(PathBuf::from("/tmp/bpce-fhe-bench-inline.sock"));
+    bench_endpoint(c, "unix socket", &unix, usize::MAX);
+
+    let unix_shm = Endpoint::Unix(PathBuf::from("/tmp/bpce-fhe-bench-shm.sock"));
+    bench_endpoint(
+        c,
+        "unix shared memory",
+        &unix_shm,
+        bpce_fhe::transport::DEFAULT_SHM_THRESHOLD,
+    );
+}
+
+criterion_group!(
+    name = transport_benchmarks;
+    config = Criterion::default().measurement_time(core::time::Duration::from_secs(30));
+    targets = benchmark_transports
+);
+criterion_main!(transport_benchmarks);
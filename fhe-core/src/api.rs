@@ -45,6 +45,24 @@ pub trait CryptoSystem {
         rhs: &Self::Ciphertext,
     ) -> Self::Ciphertext;
 
+    #[must_use = "This method does not modify the input ciphertexts."]
+    /// Performs the same operation on many pairs of ciphertexts, returning the results in order.
+    ///
+    /// Implementations can override it to dispatch the operation once for the whole batch.
+    fn operate2_many(
+        &self,
+        operation: Self::Operation2,
+        pairs: &[(&Self::Ciphertext, &Self::Ciphertext)],
+    ) -> Vec<Self::Ciphertext>
+    where
+        Self::Operation2: Copy,
+    {
+        pairs
+            .iter()
+            .map(|(lhs, rhs)| self.operate2(operation, lhs, rhs))
+            .collect()
+    }
+
     /// Performs an operation on one ciphertext in place.
     fn operate1_inplace(&self, operation: Self::Operation1, lhs: &mut Self::Ciphertext) {
         *lhs = self.operate1(operation, lhs);
@@ -62,6 +80,16 @@ pub trait CryptoSystem {
 
     /// Relinearizes a ciphertext.
     fn relinearize(&self, ciphertext: &mut Self::Ciphertext);
+
+    #[must_use]
+    /// Number of threads a single operation can keep busy, 1 if operations run on the calling
+    /// thread only.
+    ///
+    /// Callers running operations on many items in parallel use it to share their threads
+    /// between items and operations, see [`ThreadBudget`](crate::parallelism::ThreadBudget).
+    fn op_threads(&self) -> usize {
+        1
+    }
 }
 
 #[allow(dead_code)]
@@ -5,3 +5,4 @@
 
 pub mod api;
 pub mod f64;
+pub mod parallelism;
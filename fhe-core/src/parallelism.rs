@@ -0,0 +1,105 @@
+//! Sharing threads between the items of a batch and the operations on each item.
+//!
+//! Some backends parallelize each operation, e.g. TFHE processes the blocks of a radix integer
+//! in parallel. Running such operations on many items in parallel as well asks for more threads
+//! than there are cores. [`ThreadBudget::split`] chooses how many items run at once, and how
+//! many threads each of them uses.
+
+/// Share of an operation that parallelizes, in percent. The rest, e.g. propagating carries
+/// between blocks, is sequential.
+const PARALLEL_PERCENT: u64 = 90;
+/// Cost of spreading an operation over several threads, in nanoseconds.
+const FORK_COST: u64 = 20_000;
+
+/// How the threads of a batch are shared between its items and their operations.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct ThreadBudget {
+    /// Items processed at once.
+    pub items: usize,
+    /// Threads of each operation.
+    pub op_threads: usize,
+}
+
+impl ThreadBudget {
+    #[must_use]
+    /// Share `threads` between `items` operations, each costing `op_cost` nanoseconds on a single
+    /// thread and able to keep up to `op_threads` threads busy (see
+    /// [`CryptoSystem::op_threads`](crate::api::CryptoSystem::op_threads)).
+    ///
+    /// Small batches of costly operations get several threads per operation, large batches and
+    /// cheap operations a thread per item.
+    pub fn split(threads: usize, items: usize, op_threads: usize, op_cost: u64) -> Self {
+        let threads = threads.max(1);
+        // On ties, the fewest threads per operation.
+        (1..=op_threads.clamp(1, threads))
+            .map(|op_threads| Self {
+                items: (threads / op_threads).min(items.max(1)),
+                op_threads,
+            })
+            .min_by_key(|budget| budget.duration(items, op_cost))
+            .unwrap_or(Self {
+                items: threads,
+                op_threads: 1,
+            })
+    }
+
+    /// Estimated time to run `items` operations, in nanoseconds.
+    fn duration(self, items: usize, op_cost: u64) -> u64 {
+        let rounds = u64::try_from(items.div_ceil(self.items)).unwrap_or(u64::MAX);
+        let threads = u64::try_from(self.op_threads).unwrap_or(u64::MAX);
+        let op = if threads == 1 {
+            op_cost
+        } else {
+            let parallel = op_cost / 100 * PARALLEL_PERCENT;
+            op_cost - parallel + parallel / threads + FORK_COST
+        };
+        rounds.saturating_mul(op)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const MUL: u64 = 10_000_000;
+    const ADD: u64 = 100_000;
+
+    #[test]
+    fn test_sequential_operations() {
+        assert_eq!(
+            ThreadBudget::split(16, 2, 1, MUL),
+            ThreadBudget {
+                items: 2,
+                op_threads: 1
+            }
+        );
+    }
+
+    #[test]
+    fn test_small_batch_of_costly_operations() {
+        let budget = ThreadBudget::split(16, 2, 16, MUL);
+        assert_eq!(budget.items, 2);
+        assert_eq!(budget.op_threads, 8);
+    }
+
+    #[test]
+    fn test_large_batch_or_cheap_operations() {
+        let per_item = ThreadBudget {
+            items: 16,
+            op_threads: 1,
+        };
+        assert_eq!(ThreadBudget::split(16, 64, 16, MUL), per_item);
+        assert_eq!(ThreadBudget::split(16, 16, 16, MUL), per_item);
+        assert_eq!(ThreadBudget::split(16, 64, 16, ADD), per_item);
+        assert_eq!(ThreadBudget::split(16, 0, 16, MUL).op_threads, 1);
+    }
+
+    #[test]
+    fn test_within_threads() {
+        for items in 1..40 {
+            let budget = ThreadBudget::split(12, items, 32, MUL);
+            assert!(budget.items * budget.op_threads <= 12);
+            assert!(budget.items <= items);
+        }
+    }
+}
@@ -2,6 +2,97 @@
 #![warn(clippy::nursery, clippy::pedantic)]
 #![forbid(unsafe_code)]
 
+pub mod program;
 pub mod selectable_collection;
 pub mod seq_ops;
+pub mod shared;
 pub mod sign;
+pub mod sql;
+
+/// Lengths of at most `parts` contiguous chunks of `len` items, in order, which differ by at
+/// most one.
+pub(crate) fn even_lengths(len: usize, parts: usize) -> Vec<usize> {
+    let parts = parts.clamp(1, len.max(1));
+    let (base, extra) = (len / parts, len % parts);
+    (0..parts).map(|i| base + usize::from(i < extra)).collect()
+}
+
+/// Lengths of contiguous chunks of items of the given `costs`, in order, each as long as its
+/// total cost does not exceed `budget`. An item costing more than `budget` gets a chunk of its
+/// own.
+pub(crate) fn cost_lengths(costs: impl IntoIterator<Item = u64>, budget: u64) -> Vec<usize> {
+    let mut lengths = Vec::new();
+    let (mut len, mut chunk_cost) = (0, 0_u64);
+    for cost in costs {
+        if len > 0 && chunk_cost.saturating_add(cost) > budget {
+            lengths.push(len);
+            (len, chunk_cost) = (0, 0);
+        }
+        chunk_cost = chunk_cost.saturating_add(cost);
+        len += 1;
+    }
+    if len > 0 {
+        lengths.push(len);
+    }
+    lengths
+}
+
+/// Splits `items` into contiguous chunks of the given `lengths`, which add up to its length.
+pub(crate) fn split_at_lengths<T>(mut items: Vec<T>, lengths: &[usize]) -> Vec<Vec<T>> {
+    let mut chunks = lengths
+        .iter()
+        .rev()
+        .map(|&len| items.split_off(items.len() - len))
+        .collect::<Vec<_>>();
+    chunks.reverse();
+    chunks
+}
+
+/// Splits `items` into at most `parts` contiguous chunks, in order, whose sizes
+/// differ by at most one.
+pub(crate) fn split_evenly<T>(items: Vec<T>, parts: usize) -> Vec<Vec<T>> {
+    let lengths = even_lengths(items.len(), parts);
+    split_at_lengths(items, &lengths)
+}
+
+/// Splits `items` into contiguous chunks, in order, each as long as its total `cost` does not
+/// exceed `budget`. An item costing more than `budget` gets a chunk of its own.
+pub(crate) fn split_by_cost<T>(
+    items: Vec<T>,
+    budget: u64,
+    cost: impl Fn(&T) -> u64,
+) -> Vec<Vec<T>> {
+    let lengths = cost_lengths(items.iter().map(cost), budget);
+    split_at_lengths(items, &lengths)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::{split_by_cost, split_evenly};
+
+    #[test]
+    fn test_split_evenly() {
+        let chunks = split_evenly((0..10).collect(), 3);
+        assert_eq!(chunks, vec![vec![0, 1, 2, 3], vec![4, 5, 6], vec![7, 8, 9]]);
+    }
+
+    #[test]
+    fn test_split_evenly_more_parts_than_items() {
+        let chunks = split_evenly(vec![1, 2], 5);
+        assert_eq!(chunks, vec![vec![1], vec![2]]);
+
+        let chunks = split_evenly(Vec::<u8>::new(), 5);
+        assert_eq!(chunks, vec![Vec::<u8>::new()]);
+    }
+
+    #[test]
+    fn test_split_by_cost() {
+        let chunks = split_by_cost(vec![1, 1, 1, 5, 1, 9, 2, 2], 5, |&cost| cost);
+        assert_eq!(
+            chunks,
+            vec![vec![1, 1, 1], vec![5], vec![1], vec![9], vec![2, 2]]
+        );
+
+        assert!(split_by_cost(Vec::<u64>::new(), 5, |&cost| cost).is_empty());
+    }
+}
@@ -0,0 +1,409 @@
+//! Programs run on every row of encrypted columns.
+//!
+//! A [`Program`] is a sequence of stack [`Instruction`]s, run independently on every row of a
+//! [`ProgramData`]: e.g. `lhs * rhs + 5` is `Load(0), Load(1), Op2(Mul), Op1(AddPlain(5))`. The
+//! value left on the stack is the result of the row. A whole expression thus runs in a single
+//! request, without sending intermediate results back and forth.
+
+use bincode::{Decode, Encode};
+use fhe_core::api::CryptoSystem;
+
+/// An instruction of a [`Program`].
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Encode, Decode)]
+pub enum Instruction<Op1, Op2> {
+    /// Pushes the ciphertext of the row in the given column.
+    Load(u8),
+    /// Replaces the value on top of the stack by the result of the operation.
+    Op1(Op1),
+    /// Replaces the two values on top of the stack by the result of the operation, the value on
+    /// top being the right-hand side.
+    Op2(Op2),
+    /// Relinearizes the value on top of the stack.
+    Relinearize,
+}
+
+/// Why a sequence of instructions is not a valid program.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum ProgramError {
+    /// The instruction at this position needs more values than the stack holds.
+    StackUnderflow(usize),
+    /// The instruction at this position loads a column the data does not have.
+    UnknownColumn(usize),
+    /// The program leaves this number of values on the stack, instead of one.
+    ResultCount(usize),
+    /// The columns do not all have the same number of rows.
+    UnevenColumns,
+}
+
+impl core::fmt::Display for ProgramError {
+    fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+        match self {
+            Self::StackUnderflow(at) => write!(f, "instruction {at} needs more values"),
+            Self::UnknownColumn(at) => write!(f, "instruction {at} loads an unknown column"),
+            Self::ResultCount(count) => write!(f, "program leaves {count} values instead of 1"),
+            Self::UnevenColumns => f.write_str("columns have different numbers of rows"),
+        }
+    }
+}
+
+impl std::error::Error for ProgramError {}
+
+/// A value on the stack of a program: a ciphertext of the data, or a computed one.
+pub enum Register<'a, T> {
+    Column(&'a T),
+    Computed(T),
+}
+
+/// A valid sequence of instructions, leaving a single value on the stack.
+pub struct Program<C: CryptoSystem> {
+    instructions: Vec<Instruction<C::Operation1, C::Operation2>>,
+    /// Largest number of values on the stack while running.
+    depth: usize,
+}
+
+impl<C: CryptoSystem> Program<C> {
+    /// Checks that `instructions` only load the given number of `columns`, and leave a single
+    /// value on the stack.
+    ///
+    /// # Errors
+    ///
+    /// The first reason why the instructions are not a valid program.
+    pub fn new(
+        instructions: Vec<Instruction<C::Operation1, C::Operation2>>,
+        columns: usize,
+    ) -> Result<Self, ProgramError> {
+        let (mut len, mut depth) = (0_usize, 0);
+        for (at, instruction) in instructions.iter().enumerate() {
+            let (pops, pushes) = match instruction {
+                Instruction::Load(column) if usize::from(*column) >= columns => {
+                    return Err(ProgramError::UnknownColumn(at));
+                }
+                Instruction::Load(_) => (0, 1),
+                Instruction::Op1(_) | Instruction::Relinearize => (1, 1),
+                Instruction::Op2(_) => (2, 1),
+            };
+            len = len
+                .checked_sub(pops)
+                .ok_or(ProgramError::StackUnderflow(at))?
+                + pushes;
+            depth = depth.max(len);
+        }
+        if len != 1 {
+            return Err(ProgramError::ResultCount(len));
+        }
+        Ok(Self {
+            instructions,
+            depth,
+        })
+    }
+
+    #[must_use]
+    #[inline]
+    pub fn instructions(&self) -> &[Instruction<C::Operation1, C::Operation2>] {
+        &self.instructions
+    }
+
+    #[must_use]
+    #[inline]
+    /// Capacity of the stack needed to run the program, e.g. to allocate it once per thread.
+    pub const fn depth(&self) -> usize {
+        self.depth
+    }
+
+    /// Runs the program on a row of `columns`, with `stack` as the stack, left empty.
+    ///
+    /// Computed values are updated in place rather than allocated for every instruction.
+    pub fn run<'a>(
+        &self,
+        cs: &C,
+        columns: &'a [Vec<C::Ciphertext>],
+        row: usize,
+        stack: &mut Vec<Register<'a, C::Ciphertext>>,
+    ) -> C::Ciphertext
+    where
+        C::Operation1: Copy,
+        C::Operation2: Copy,
+        C::Ciphertext: Clone,
+    {
+        for instruction in &self.instructions {
+            let value = match *instruction {
+                Instruction::Load(column) => Register::Column(&columns[usize::from(column)][row]),
+                Instruction::Op1(op) => match pop(stack) {
+                    Register::Column(value) => Register::Computed(cs.operate1(op, value)),
+                    Register::Computed(mut value) => {
+                        cs.operate1_inplace(op, &mut value);
+                        Register::Computed(value)
+                    }
+                },
+                Instruction::Op2(op) => {
+                    let rhs = pop(stack);
+                    let rhs = match &rhs {
+                        Register::Column(value) => *value,
+                        Register::Computed(value) => value,
+                    };
+                    match pop(stack) {
+                        Register::Column(lhs) => Register::Computed(cs.operate2(op, lhs, rhs)),
+                        Register::Computed(mut lhs) => {
+                            cs.operate2_inplace(op, &mut lhs, rhs);
+                            Register::Computed(lhs)
+                        }
+                    }
+                }
+                Instruction::Relinearize => {
+                    let mut value = match pop(stack) {
+                        Register::Column(value) => value.clone(),
+                        Register::Computed(value) => value,
+                    };
+                    cs.relinearize(&mut value);
+                    Register::Computed(value)
+                }
+            };
+            stack.push(value);
+        }
+
+        match pop(stack) {
+            Register::Column(value) => value.clone(),
+            Register::Computed(value) => value,
+        }
+    }
+}
+
+/// Pops a value pushed by a previous instruction, which the program was checked to have.
+fn pop<'a, T>(stack: &mut Vec<Register<'a, T>>) -> Register<'a, T> {
+    stack.pop().expect("program was checked")
+}
+
+/// A program, and the columns of ciphertexts it runs on.
+pub struct ProgramData<C: CryptoSystem> {
+    program: Program<C>,
+    columns: Vec<Vec<C::Ciphertext>>,
+}
+
+impl<C: CryptoSystem> ProgramData<C> {
+    /// Checks that the columns have the same length, and that the program is valid for them.
+    ///
+    /// # Errors
+    ///
+    /// Why the program cannot run on the columns.
+    pub fn new(
+        instructions: Vec<Instruction<C::Operation1, C::Operation2>>,
+        columns: Vec<Vec<C::Ciphertext>>,
+    ) -> Result<Self, ProgramError> {
+        let rows = columns.first().map_or(0, Vec::len);
+        if columns.iter().any(|column| column.len() != rows) {
+            return Err(ProgramError::UnevenColumns);
+        }
+        Ok(Self {
+            program: Program::new(instructions, columns.len())?,
+            columns,
+        })
+    }
+
+    #[must_use]
+    #[inline]
+    pub const fn program(&self) -> &Program<C> {
+        &self.program
+    }
+
+    #[must_use]
+    #[inline]
+    pub fn columns(&self) -> &[Vec<C::Ciphertext>] {
+        &self.columns
+    }
+
+    #[must_use]
+    #[inline]
+    /// Returns the number of rows.
+    pub fn rows(&self) -> usize {
+        self.columns.first().map_or(0, Vec::len)
+    }
+
+    #[must_use]
+    /// Runs the program on every row, in order.
+    pub fn execute(&self, cs: &C) -> Vec<C::Ciphertext>
+    where
+        C::Operation1: Copy,
+        C::Operation2: Copy,
+        C::Ciphertext: Clone,
+    {
+        let mut stack = Vec::with_capacity(self.program.depth());
+        (0..self.rows())
+            .map(|row| self.program.run(cs, &self.columns, row, &mut stack))
+            .collect()
+    }
+
+    #[must_use]
+    /// Splits the rows into at most `shards` contiguous parts of nearly equal sizes, each with
+    /// the program.
+    ///
+    /// Concatenating the parts, in order, gives back the original rows.
+    pub fn split(self, shards: usize) -> Vec<Self>
+    where
+        C::Operation1: Clone,
+        C::Operation2: Clone,
+    {
+        let lengths = crate::even_lengths(self.rows(), shards);
+        let mut parts = lengths.iter().map(|_| Vec::new()).collect::<Vec<_>>();
+        for column in self.columns {
+            for (part, column) in parts
+                .iter_mut()
+                .zip(crate::split_at_lengths(column, &lengths))
+            {
+                part.push(column);
+            }
+        }
+        parts
+            .into_iter()
+            .map(|columns| Self {
+                program: Program {
+                    instructions: self.program.instructions.clone(),
+                    depth: self.program.depth,
+                },
+                columns,
+            })
+            .collect()
+    }
+}
+
+impl<C: CryptoSystem> Encode for ProgramData<C>
+where
+    C::Ciphertext: Encode,
+    C::Operation1: Encode,
+    C::Operation2: Encode,
+{
+    fn encode<E: bincode::enc::Encoder>(
+        &self,
+        encoder: &mut E,
+    ) -> Result<(), bincode::error::EncodeError> {
+        self.program.instructions.encode(encoder)?;
+        self.columns.encode(encoder)
+    }
+}
+
+impl<C: CryptoSystem, Context> Decode<Context> for ProgramData<C>
+where
+    C::Ciphertext: Decode<Context>,
+    C::Operation1: Decode<Context>,
+    C::Operation2: Decode<Context>,
+{
+    fn decode<D: bincode::de::Decoder<Context = Context>>(
+        decoder: &mut D,
+    ) -> Result<Self, bincode::error::DecodeError> {
+        let instructions = Vec::decode(decoder)?;
+        let columns = Vec::decode(decoder)?;
+        Self::new(instructions, columns)
+            .map_err(|_| bincode::error::DecodeError::Other("invalid program"))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use fhe_core::api::{Arity1Operation, Arity2Operation, Operation};
+
+    #[derive(Clone, Encode, Decode)]
+    struct TestCiphertext(u64);
+
+    #[derive(Clone, Copy, Debug, Encode, Decode)]
+    struct AddPlain(u64);
+    impl Operation for AddPlain {}
+    impl Arity1Operation for AddPlain {}
+
+    #[derive(Clone, Copy, Debug, Encode, Decode)]
+    enum Op {
+        Add,
+        Mul,
+    }
+    impl Operation for Op {}
+    impl Arity2Operation for Op {}
+
+    struct TestCryptoSystem;
+
+    impl CryptoSystem for TestCryptoSystem {
+        type Plaintext = u64;
+        type Ciphertext = TestCiphertext;
+        type Operation1 = AddPlain;
+        type Operation2 = Op;
+
+        fn cipher(&self, plaintext: &Self::Plaintext) -> Self::Ciphertext {
+            TestCiphertext(*plaintext)
+        }
+        fn decipher(&self, ciphertext: &Self::Ciphertext) -> Self::Plaintext {
+            ciphertext.0
+        }
+        fn operate1(
+            &self,
+            AddPlain(plain): Self::Operation1,
+            lhs: &Self::Ciphertext,
+        ) -> Self::Ciphertext {
+            TestCiphertext(lhs.0 + plain)
+        }
+        fn operate2(
+            &self,
+            operation: Self::Operation2,
+            lhs: &Self::Ciphertext,
+            rhs: &Self::Ciphertext,
+        ) -> Self::Ciphertext {
+            match operation {
+                Op::Add => TestCiphertext(lhs.0 + rhs.0),
+                Op::Mul => TestCiphertext(lhs.0 * rhs.0),
+            }
+        }
+        fn relinearize(&self, _ciphertext: &mut Self::Ciphertext) {}
+    }
+
+    type TestInstruction = Instruction<AddPlain, Op>;
+
+    #[test]
+    fn test_program() {
+        let cs = TestCryptoSystem;
+        // lhs * rhs + 5, then + lhs
+        let instructions: Vec<TestInstruction> = vec![
+            Instruction::Load(0),
+            Instruction::Load(1),
+            Instruction::Op2(Op::Mul),
+            Instruction::Relinearize,
+            Instruction::Op1(AddPlain(5)),
+            Instruction::Load(0),
+            Instruction::Op2(Op::Add),
+        ];
+        let columns = vec![
+            (0..5).map(|i| cs.cipher(&i)).collect(),
+            (0..5).map(|_| cs.cipher(&3)).collect(),
+        ];
+        let data = ProgramData::<TestCryptoSystem>::new(instructions, columns).unwrap();
+        assert_eq!(data.program().depth(), 2);
+
+        let encoded = bincode::encode_to_vec(&data, bincode::config::standard()).unwrap();
+        let (data, _): (ProgramData<TestCryptoSystem>, _) =
+            bincode::decode_from_slice(&encoded, bincode::config::standard()).unwrap();
+
+        let results: Vec<_> = data
+            .split(2)
+            .iter()
+            .flat_map(|part| part.execute(&cs))
+            .map(|result| cs.decipher(&result))
+            .collect();
+        assert_eq!(results, vec![5, 9, 13, 17, 21]);
+    }
+
+    #[test]
+    fn test_invalid_programs() {
+        let check = |instructions: Vec<TestInstruction>| {
+            Program::<TestCryptoSystem>::new(instructions, 2).err()
+        };
+        assert_eq!(
+            check(vec![Instruction::Load(0), Instruction::Op2(Op::Add)]),
+            Some(ProgramError::StackUnderflow(1))
+        );
+        assert_eq!(
+            check(vec![Instruction::Load(2)]),
+            Some(ProgramError::UnknownColumn(0))
+        );
+        assert_eq!(
+            check(vec![Instruction::Load(0), Instruction::Load(1)]),
+            Some(ProgramError::ResultCount(2))
+        );
+        assert_eq!(check(Vec::new()), Some(ProgramError::ResultCount(0)));
+    }
+}
@@ -1,5 +1,6 @@
 //! SQL-like operations on encrypted data.
 
+use crate::shared::Shared;
 use bincode::{Decode, Encode};
 use fhe_core::api::CryptoSystem;
 
@@ -14,6 +15,19 @@ pub trait SelectableCS: CryptoSystem {
     const NEUTRAL_ADD: Self::Plaintext;
     /// The plaintext that is neutral with respect to multiplication.
     const NEUTRAL_MUL: Self::Plaintext;
+
+    #[must_use = "This method does not modify the input ciphertext."]
+    /// The opposite of a ciphertext, e.g. to compute `1 - flag`.
+    fn negate(&self, ciphertext: &Self::Ciphertext) -> Self::Ciphertext;
+
+    #[must_use = "This method does not modify the input ciphertext."]
+    /// The sum of a ciphertext and a plaintext, computed without the secret key, e.g. to compute
+    /// `1 - flag` on a server.
+    fn add_plain(
+        &self,
+        ciphertext: &Self::Ciphertext,
+        plaintext: &Self::Plaintext,
+    ) -> Self::Ciphertext;
 }
 
 /// A flag that can be used to select items.
@@ -23,10 +37,111 @@ pub enum Flag {
     Off,
 }
 
+/// A condition on the flags of an item, evaluated to an encrypted `NEUTRAL_MUL` (true) or
+/// `NEUTRAL_ADD` (false).
+#[derive(Clone, Debug, PartialEq, Eq, Encode, Decode)]
+pub enum Predicate {
+    /// The flag at the given index is on.
+    Flag(u8),
+    /// `1 - p`.
+    Not(Box<Predicate>),
+    /// `p * q`.
+    And(Box<Predicate>, Box<Predicate>),
+    /// `p + q - p * q`.
+    Or(Box<Predicate>, Box<Predicate>),
+}
+
+impl Predicate {
+    #[must_use]
+    /// Number of successive multiplications needed to evaluate the predicate.
+    pub fn depth(&self) -> u32 {
+        match self {
+            Self::Flag(_) => 0,
+            Self::Not(predicate) => predicate.depth(),
+            Self::And(lhs, rhs) | Self::Or(lhs, rhs) => lhs.depth().max(rhs.depth()) + 1,
+        }
+    }
+
+    #[must_use]
+    /// Number of multiplications needed to evaluate the predicate.
+    pub fn multiplications(&self) -> u32 {
+        match self {
+            Self::Flag(_) => 0,
+            Self::Not(predicate) => predicate.multiplications(),
+            Self::And(lhs, rhs) | Self::Or(lhs, rhs) => {
+                lhs.multiplications() + rhs.multiplications() + 1
+            }
+        }
+    }
+
+    #[must_use]
+    /// Highest index of the flags the predicate reads.
+    pub fn max_flag(&self) -> u8 {
+        match self {
+            Self::Flag(index) => *index,
+            Self::Not(predicate) => predicate.max_flag(),
+            Self::And(lhs, rhs) | Self::Or(lhs, rhs) => lhs.max_flag().max(rhs.max_flag()),
+        }
+    }
+
+    /// Evaluates the predicate on the flags of an item. A flag alone is shared with the item
+    /// rather than copied.
+    ///
+    /// Only the flags are ciphertexts: `1 - p` is the plaintext `NEUTRAL_MUL` added to `-p`, so
+    /// that a server without the secret key can evaluate it.
+    fn evaluate<const F: usize, C: SelectableCS>(
+        &self,
+        item: &SelectableItem<F, C>,
+        cs: &C,
+    ) -> Shared<C::Ciphertext>
+    where
+        C::Operation2: Copy,
+    {
+        let value = match self {
+            Self::Flag(index) => return item.flags[usize::from(*index)].clone(),
+            Self::Not(predicate) => {
+                cs.add_plain(&cs.negate(&predicate.evaluate(item, cs)), &C::NEUTRAL_MUL)
+            }
+            Self::And(lhs, rhs) => {
+                cs.operate2(C::MUL_OPP, &lhs.evaluate(item, cs), &rhs.evaluate(item, cs))
+            }
+            Self::Or(lhs, rhs) => {
+                let (lhs, rhs) = (lhs.evaluate(item, cs), rhs.evaluate(item, cs));
+                let both = cs.operate2(C::MUL_OPP, &lhs, &rhs);
+                let either = cs.operate2(C::ADD_OPP, &lhs, &rhs);
+                cs.operate2(C::ADD_OPP, &either, &cs.negate(&both))
+            }
+        };
+        Shared::new(value)
+    }
+}
+
+/// What is computed over the selected items of a collection.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Encode, Decode)]
+pub enum Aggregate {
+    /// The sum of their values.
+    Sum,
+    /// Their number: the sum of their flags selecting them, or without a predicate the sum of
+    /// their values, which the client encrypts as `NEUTRAL_MUL` to count every item.
+    Count,
+}
+
 /// A selectable item that can be used in a collection.
+///
+/// Its ciphertexts are [`Shared`]: collections and threads reading an item, e.g. the parts of
+/// a collection evaluating their predicates, do not copy them.
 pub struct SelectableItem<const F: usize, C: CryptoSystem> {
-    ciphertext: C::Ciphertext,
-    flags: [C::Ciphertext; F],
+    ciphertext: Shared<C::Ciphertext>,
+    flags: [Shared<C::Ciphertext>; F],
+}
+
+impl<const F: usize, C: CryptoSystem> Clone for SelectableItem<F, C> {
+    fn clone(&self) -> Self {
+        Self {
+            ciphertext: self.ciphertext.clone(),
+            flags: self.flags.clone(),
+        }
+    }
 }
 
 impl<C: CryptoSystem, const F: usize> Encode for SelectableItem<F, C>
@@ -49,8 +164,8 @@ where
     fn decode<D: bincode::de::Decoder<Context = Context>>(
         decoder: &mut D,
     ) -> Result<Self, bincode::error::DecodeError> {
-        let ciphertext = C::Ciphertext::decode(decoder)?;
-        let flags = <[C::Ciphertext; F]>::decode(decoder)?;
+        let ciphertext = Shared::decode(decoder)?;
+        let flags = <[Shared<C::Ciphertext>; F]>::decode(decoder)?;
         Ok(Self { ciphertext, flags })
     }
 }
@@ -64,21 +179,40 @@ const fn flag_to_plaintext<C: SelectableCS>(flag: Flag) -> C::Plaintext {
     }
 }
 
+impl<const F: usize, C: CryptoSystem> SelectableItem<F, C> {
+    #[must_use]
+    #[inline]
+    /// Create an item from its already ciphered value and flags.
+    pub fn from_parts(ciphertext: C::Ciphertext, flags: [C::Ciphertext; F]) -> Self {
+        Self::from_shared(Shared::new(ciphertext), flags.map(Shared::new))
+    }
+
+    #[must_use]
+    #[inline]
+    /// Create an item from a value and flags it shares, e.g. with items of other collections.
+    pub const fn from_shared(
+        ciphertext: Shared<C::Ciphertext>,
+        flags: [Shared<C::Ciphertext>; F],
+    ) -> Self {
+        Self { ciphertext, flags }
+    }
+}
+
 impl<const F: usize, C: SelectableCS> SelectableItem<F, C> {
     #[must_use]
     pub fn new(value: &C::Plaintext, cs: &C) -> Self {
         const DEFAULT_FLAG: Flag = Flag::Off;
         let default_flag = flag_to_plaintext::<C>(DEFAULT_FLAG);
         Self {
-            ciphertext: cs.cipher(value),
-            flags: core::array::from_fn(|_| cs.cipher(&default_flag)),
+            ciphertext: Shared::new(cs.cipher(value)),
+            flags: core::array::from_fn(|_| Shared::new(cs.cipher(&default_flag))),
         }
     }
 
     #[must_use]
     #[inline]
     fn get_flag(&self, index: usize) -> Option<&C::Ciphertext> {
-        self.flags.get(index)
+        self.flags.get(index).map(|flag| &**flag)
     }
 
     #[must_use]
@@ -90,7 +224,7 @@ impl<const F: usize, C: SelectableCS> SelectableItem<F, C> {
 
     #[inline]
     pub fn set_flag_plain(&mut self, index: usize, flag: Flag, cs: &C) {
-        self.flags[index] = cs.cipher(&flag_to_plaintext::<C>(flag));
+        self.flags[index] = Shared::new(cs.cipher(&flag_to_plaintext::<C>(flag)));
     }
 }
 
@@ -134,6 +268,13 @@ impl<const F: usize, C: SelectableCS<Ciphertext: Clone>> SelectableCollection<F,
         Self { items: Vec::new() }
     }
 
+    #[must_use]
+    #[inline]
+    /// Create a collection from its items.
+    pub const fn from_vec(items: Vec<SelectableItem<F, C>>) -> Self {
+        Self { items }
+    }
+
     #[must_use]
     #[inline]
     /// Get the number of items in the collection.
@@ -161,17 +302,68 @@ impl<const F: usize, C: SelectableCS<Ciphertext: Clone>> SelectableCollection<F,
         self.items.push(SelectableItem::new(item, cs));
     }
 
+    #[must_use]
+    /// Split the collection into at most `shards` contiguous row ranges of nearly equal sizes.
+    pub fn split(self, shards: usize) -> Vec<Self> {
+        crate::split_evenly(self.items, shards)
+            .into_iter()
+            .map(|items| Self { items })
+            .collect()
+    }
+
     #[must_use]
     /// Operates on all items in the collection.
+    ///
+    /// The value of the first item is only copied once, to be updated in place.
     pub fn operate_many(&self, op: C::Operation2, cs: &C) -> C::Ciphertext
     where
         C::Operation2: Copy,
     {
-        let mut sum: C::Ciphertext = self.items[0].ciphertext.clone();
-        for i in 1..self.items.len() {
-            sum = cs.operate2(op, &sum, &self.items[i].ciphertext).clone();
+        let mut sum = self.items[0].ciphertext.clone();
+        for item in &self.items[1..] {
+            cs.operate2_inplace(op, sum.make_mut(), &item.ciphertext);
         }
-        sum
+        sum.into_owned()
+    }
+
+    #[must_use]
+    /// Aggregates the items for which `predicate` holds, or every item without a predicate.
+    ///
+    /// Returns `None` if the collection is empty.
+    ///
+    /// ## Panics
+    ///
+    /// Panics if the predicate reads a flag the items do not have.
+    pub fn aggregate_where(
+        &self,
+        aggregate: Aggregate,
+        predicate: Option<&Predicate>,
+        cs: &C,
+    ) -> Option<C::Ciphertext>
+    where
+        C::Operation2: Copy,
+    {
+        assert!(predicate.is_none_or(|predicate| usize::from(predicate.max_flag()) < F));
+
+        self.items
+            .iter()
+            .map(|item| {
+                let selected = predicate.map(|predicate| predicate.evaluate(item, cs));
+                match (aggregate, selected) {
+                    (Aggregate::Sum, None) => item.ciphertext.clone(),
+                    (Aggregate::Sum, Some(selected)) => {
+                        Shared::new(cs.operate2(C::MUL_OPP, &item.ciphertext, &selected))
+                    }
+                    (Aggregate::Count, None) => item.ciphertext.clone(),
+                    (Aggregate::Count, Some(selected)) => selected,
+                }
+            })
+            // Values shared with the items are only copied to start the sum.
+            .reduce(|mut sum, value| {
+                cs.operate2_inplace(C::ADD_OPP, sum.make_mut(), &value);
+                sum
+            })
+            .map(Shared::into_owned)
     }
 
     #[must_use]
@@ -193,7 +385,7 @@ impl<const F: usize, C: SelectableCS<Ciphertext: Clone>> SelectableCollection<F,
         for item in self.items.iter().skip(1) {
             let flag = item.get_flag(flag_index).unwrap();
             let product = cs.operate2(C::MUL_OPP, &item.ciphertext, flag);
-            sum = cs.operate2(C::ADD_OPP, &sum, &product).clone();
+            cs.operate2_inplace(C::ADD_OPP, &mut sum, &product);
         }
         sum
     }
@@ -256,10 +448,10 @@ mod tests {
         ) -> Self::Ciphertext {
             match operation {
                 Op::Add => TestCiphertext {
-                    data: TestPlaintext(lhs.data.0 + rhs.data.0),
+                    data: TestPlaintext(lhs.data.0.wrapping_add(rhs.data.0)),
                 },
                 Op::Mul => TestCiphertext {
-                    data: TestPlaintext(lhs.data.0 * rhs.data.0),
+                    data: TestPlaintext(lhs.data.0.wrapping_mul(rhs.data.0)),
                 },
             }
         }
@@ -272,6 +464,22 @@ mod tests {
 
         const NEUTRAL_ADD: Self::Plaintext = TestPlaintext(0);
         const NEUTRAL_MUL: Self::Plaintext = TestPlaintext(1);
+
+        fn negate(&self, ciphertext: &Self::Ciphertext) -> Self::Ciphertext {
+            TestCiphertext {
+                data: TestPlaintext(ciphertext.data.0.wrapping_neg()),
+            }
+        }
+
+        fn add_plain(
+            &self,
+            ciphertext: &Self::Ciphertext,
+            plaintext: &Self::Plaintext,
+        ) -> Self::Ciphertext {
+            TestCiphertext {
+                data: TestPlaintext(ciphertext.data.0.wrapping_add(plaintext.0)),
+            }
+        }
     }
 
     #[test]
@@ -331,6 +539,10 @@ mod tests {
         let sum = collection.operate_many(Op::Add, &cs);
         let decrypted = cs.decipher(&sum);
         assert_eq!(decrypted.0, 3);
+
+        // The sum was computed on a copy of the first value, not on the item.
+        let sum = collection.operate_many(Op::Add, &cs);
+        assert_eq!(cs.decipher(&sum).0, 3);
     }
 
     #[test]
@@ -366,4 +578,73 @@ mod tests {
 
         assert_eq!(decrypted, expected);
     }
+
+    #[test]
+    fn test_split() {
+        let cs = TestCryptoSystem {};
+        let mut collection = SelectableCollection::<F, _>::new();
+        for i in 1..=5 {
+            collection.push_plain(&TestPlaintext(i), &cs);
+        }
+
+        let shards = collection.split(2);
+        assert_eq!(shards.len(), 2);
+
+        let partial_sums: Vec<_> = shards
+            .iter()
+            .map(|shard| cs.decipher(&shard.operate_many(Op::Add, &cs)).0)
+            .collect();
+        assert_eq!(partial_sums, vec![6, 9]);
+    }
+
+    #[test]
+    fn test_aggregate_where() {
+        let cs = TestCryptoSystem {};
+        let mut collection = SelectableCollection::<F, _>::new();
+        // (value, flag 0, flag 1)
+        for (value, flags) in [
+            (1, [true, false]),
+            (2, [true, true]),
+            (4, [false, true]),
+            (8, [false, false]),
+        ] {
+            collection.push_plain(&TestPlaintext(value), &cs);
+            for (index, on) in flags.into_iter().enumerate() {
+                let flag = if on { Flag::On } else { Flag::Off };
+                collection
+                    .items
+                    .last_mut()
+                    .unwrap()
+                    .set_flag_plain(index, flag, &cs);
+            }
+        }
+
+        let flag = |index| Box::new(Predicate::Flag(index));
+        let sum = |predicate: Option<Predicate>| {
+            let sum = collection.aggregate_where(Aggregate::Sum, predicate.as_ref(), &cs);
+            cs.decipher(&sum.unwrap()).0
+        };
+        assert_eq!(sum(None), 15);
+        assert_eq!(sum(Some(Predicate::Flag(0))), 3);
+        assert_eq!(sum(Some(Predicate::Not(flag(0)))), 12);
+        assert_eq!(sum(Some(Predicate::And(flag(0), flag(1)))), 2);
+        assert_eq!(sum(Some(Predicate::Or(flag(0), flag(1)))), 7);
+
+        let count = collection
+            .aggregate_where(
+                Aggregate::Count,
+                Some(&Predicate::Or(flag(0), flag(1))),
+                &cs,
+            )
+            .unwrap();
+        assert_eq!(cs.decipher(&count).0, 3);
+        let count = collection
+            .aggregate_where(Aggregate::Count, Some(&Predicate::Not(flag(1))), &cs)
+            .unwrap();
+        assert_eq!(cs.decipher(&count).0, 2);
+        assert_eq!(
+            Predicate::Or(flag(0), Box::new(Predicate::And(flag(0), flag(1)))).depth(),
+            2
+        );
+    }
 }
@@ -1,7 +1,9 @@
 //! Sequentially executed operations.
 
+use crate::shared::Shared;
 use bincode::{Decode, Encode};
 use fhe_core::api::CryptoSystem;
+use std::sync::Arc;
 
 pub struct SeqOpItem<C: CryptoSystem> {
     lhs: C::Ciphertext,
@@ -128,6 +130,36 @@ impl<C: CryptoSystem> SeqOpsData<C> {
     pub fn iter_over_data(&self) -> impl Iterator<Item = &SeqOpItem<C>> {
         self.0.iter()
     }
+
+    #[must_use]
+    #[inline]
+    /// Returns the exchanged data as a slice, e.g. to process it in parallel.
+    pub fn as_slice(&self) -> &[SeqOpItem<C>] {
+        &self.0
+    }
+
+    #[must_use]
+    /// Splits the exchanged data into at most `shards` contiguous parts of nearly equal sizes.
+    ///
+    /// Concatenating the parts, in order, gives back the original data.
+    pub fn split(self, shards: usize) -> Vec<Self> {
+        crate::split_evenly(self.0, shards)
+            .into_iter()
+            .map(Self)
+            .collect()
+    }
+
+    #[must_use]
+    /// Splits the exchanged data into contiguous parts whose total `cost` is at most `budget`,
+    /// unless a single item costs more.
+    ///
+    /// Concatenating the parts, in order, gives back the original data.
+    pub fn split_by_cost(self, budget: u64, cost: impl Fn(&SeqOpItem<C>) -> u64) -> Vec<Self> {
+        crate::split_by_cost(self.0, budget, cost)
+            .into_iter()
+            .map(Self)
+            .collect()
+    }
 }
 
 impl<C: CryptoSystem> Encode for SeqOpsData<C>
@@ -156,6 +188,323 @@ where
     }
 }
 
+/// Why columns cannot form a [`SeqOpsColumns`].
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum ColumnsError {
+    /// The columns of operations and indices do not have the same length.
+    UnevenColumns,
+    /// An index is not that of an operand.
+    OperandOutOfRange,
+}
+
+impl core::fmt::Display for ColumnsError {
+    fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+        match self {
+            Self::UnevenColumns => f.write_str("columns of different lengths"),
+            Self::OperandOutOfRange => f.write_str("operand index out of range"),
+        }
+    }
+}
+
+impl std::error::Error for ColumnsError {}
+
+/// The same data as a [`SeqOpsData`], stored by column rather than by item.
+///
+/// Items of the same operation can then be run as a single batch, e.g. with
+/// [`CryptoSystem::operate2_many`], instead of matching the operation of every item.
+///
+/// Items refer to their ciphertexts by index in a table of operands, so that a ciphertext used
+/// by many items, e.g. an encrypted rate multiplying every value, is only stored, sent and
+/// decoded once. The table is shared, read-only, by the parts the data is split into, and its
+/// operands by the tables of compacted parts. It is encoded column by column as well: the
+/// operations first, then the operands, then the indices of the left-hand and right-hand
+/// ciphertexts.
+pub struct SeqOpsColumns<C: CryptoSystem> {
+    operands: Arc<Vec<Shared<C::Ciphertext>>>,
+    lhs: Vec<usize>,
+    rhs: Vec<usize>,
+    ops: Vec<C::Operation2>,
+}
+
+impl<C: CryptoSystem> Default for SeqOpsColumns<C> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl<C: CryptoSystem> SeqOpsColumns<C> {
+    #[must_use]
+    #[inline]
+    pub fn new() -> Self {
+        Self {
+            operands: Arc::default(),
+            lhs: Vec::new(),
+            rhs: Vec::new(),
+            ops: Vec::new(),
+        }
+    }
+
+    /// Creates the data from its columns, as they are encoded: the operation of every item, the
+    /// table of operands, and the indices of the left-hand and right-hand operands of every
+    /// item.
+    ///
+    /// # Errors
+    ///
+    /// If the columns do not have the same length, or an index is not that of an operand.
+    pub fn from_parts(
+        ops: Vec<C::Operation2>,
+        operands: Vec<C::Ciphertext>,
+        lhs: Vec<usize>,
+        rhs: Vec<usize>,
+    ) -> Result<Self, ColumnsError> {
+        if lhs.len() != ops.len() || rhs.len() != ops.len() {
+            return Err(ColumnsError::UnevenColumns);
+        }
+        if lhs.iter().chain(&rhs).any(|&i| i >= operands.len()) {
+            return Err(ColumnsError::OperandOutOfRange);
+        }
+        Ok(Self {
+            operands: Arc::new(operands.into_iter().map(Shared::new).collect()),
+            lhs,
+            rhs,
+            ops,
+        })
+    }
+
+    /// Adds a ciphertext to the table of operands, and returns its index.
+    ///
+    /// A table shared with other parts is copied first, though not its operands.
+    pub fn push_operand(&mut self, operand: C::Ciphertext) -> usize {
+        let operands = Arc::make_mut(&mut self.operands);
+        operands.push(Shared::new(operand));
+        operands.len() - 1
+    }
+
+    #[inline]
+    /// Adds an item whose ciphertexts are operands at the given indices.
+    ///
+    /// # Panics
+    ///
+    /// If an index is not that of an operand.
+    pub fn push_indexed(&mut self, lhs: usize, rhs: usize, operation: C::Operation2) {
+        assert!(
+            lhs < self.operands.len() && rhs < self.operands.len(),
+            "operand index out of range"
+        );
+        self.lhs.push(lhs);
+        self.rhs.push(rhs);
+        self.ops.push(operation);
+    }
+
+    #[inline]
+    /// Adds an item with ciphertexts of its own.
+    pub fn push(&mut self, lhs: C::Ciphertext, rhs: C::Ciphertext, operation: C::Operation2) {
+        let lhs = self.push_operand(lhs);
+        let rhs = self.push_operand(rhs);
+        self.push_indexed(lhs, rhs, operation);
+    }
+
+    #[must_use]
+    #[inline]
+    /// Returns the number of items.
+    pub fn len(&self) -> usize {
+        self.ops.len()
+    }
+
+    #[must_use]
+    #[inline]
+    /// Returns `true` if there is no item.
+    pub fn is_empty(&self) -> bool {
+        self.ops.is_empty()
+    }
+
+    #[must_use]
+    #[inline]
+    /// The operation of every item.
+    pub fn ops(&self) -> &[C::Operation2] {
+        &self.ops
+    }
+
+    #[must_use]
+    #[inline]
+    /// The table of operands, which may hold operands of other parts of the data.
+    pub fn operands(&self) -> &[Shared<C::Ciphertext>] {
+        &self.operands
+    }
+
+    #[must_use]
+    /// The indices of the items of each operation, operations in order of first appearance.
+    pub fn groups(&self) -> Vec<(C::Operation2, Vec<usize>)>
+    where
+        C::Operation2: Copy,
+    {
+        let mut groups: Vec<(C::Operation2, Vec<usize>)> = Vec::new();
+        for (i, op) in self.ops.iter().enumerate() {
+            let op_kind = core::mem::discriminant(op);
+            match groups
+                .iter_mut()
+                .find(|(group_op, _)| core::mem::discriminant(group_op) == op_kind)
+            {
+                Some((_, indices)) => indices.push(i),
+                None => groups.push((*op, vec![i])),
+            }
+        }
+        groups
+    }
+
+    /// Runs the items one operation at a time, `run` computing a batch of pairs of the same
+    /// operation, and returns the results in the order of the items.
+    pub fn execute_with(
+        &self,
+        mut run: impl FnMut(C::Operation2, &[(&C::Ciphertext, &C::Ciphertext)]) -> Vec<C::Ciphertext>,
+    ) -> Vec<C::Ciphertext>
+    where
+        C::Operation2: Copy,
+    {
+        let mut results: Vec<Option<C::Ciphertext>> = self.ops.iter().map(|_| None).collect();
+        for (op, indices) in self.groups() {
+            let pairs = indices
+                .iter()
+                .map(|&i| (&*self.operands[self.lhs[i]], &*self.operands[self.rhs[i]]))
+                .collect::<Vec<_>>();
+            for (i, result) in indices.into_iter().zip(run(op, &pairs)) {
+                results[i] = Some(result);
+            }
+        }
+        results
+            .into_iter()
+            .map(|result| result.expect("every item was run"))
+            .collect()
+    }
+
+    #[must_use]
+    /// Runs the items one operation at a time, with [`CryptoSystem::operate2_many`].
+    pub fn execute(&self, cs: &C) -> Vec<C::Ciphertext>
+    where
+        C::Operation2: Copy,
+    {
+        self.execute_with(|op, pairs| cs.operate2_many(op, pairs))
+    }
+
+    /// Splits the columns into contiguous parts of the given lengths, sharing the operands.
+    fn split_at_lengths(self, lengths: &[usize]) -> Vec<Self> {
+        let lhs = crate::split_at_lengths(self.lhs, lengths);
+        let rhs = crate::split_at_lengths(self.rhs, lengths);
+        let ops = crate::split_at_lengths(self.ops, lengths);
+        lhs.into_iter()
+            .zip(rhs)
+            .zip(ops)
+            .map(|((lhs, rhs), ops)| Self {
+                operands: Arc::clone(&self.operands),
+                lhs,
+                rhs,
+                ops,
+            })
+            .collect()
+    }
+
+    #[must_use]
+    /// Splits the data into at most `shards` contiguous parts of nearly equal sizes.
+    ///
+    /// Concatenating the parts, in order, gives back the original data.
+    pub fn split(self, shards: usize) -> Vec<Self> {
+        let lengths = crate::even_lengths(self.len(), shards);
+        self.split_at_lengths(&lengths)
+    }
+
+    #[must_use]
+    /// Splits the data into contiguous parts whose total `cost` is at most `budget`, unless a
+    /// single item costs more.
+    ///
+    /// Concatenating the parts, in order, gives back the original data.
+    pub fn split_by_cost(self, budget: u64, cost: impl Fn(&C::Operation2) -> u64) -> Vec<Self> {
+        let lengths = crate::cost_lengths(self.ops.iter().map(cost), budget);
+        self.split_at_lengths(&lengths)
+    }
+
+    #[must_use]
+    /// Only keeps the operands used by the items, e.g. before sending a part of the data. The
+    /// operands kept are shared with the original table, not copied.
+    pub fn compact(self) -> Self {
+        let mut remap = vec![None; self.operands.len()];
+        let mut operands = Vec::new();
+        let mut reindex = |index: usize| {
+            *remap[index].get_or_insert_with(|| {
+                operands.push(self.operands[index].clone());
+                operands.len() - 1
+            })
+        };
+        let lhs = self.lhs.iter().map(|&i| reindex(i)).collect();
+        let rhs = self.rhs.iter().map(|&i| reindex(i)).collect();
+        Self {
+            operands: Arc::new(operands),
+            lhs,
+            rhs,
+            ops: self.ops,
+        }
+    }
+}
+
+impl<C: CryptoSystem> From<SeqOpsData<C>> for SeqOpsColumns<C> {
+    fn from(data: SeqOpsData<C>) -> Self {
+        let mut operands = Vec::with_capacity(2 * data.len());
+        let mut columns = Self {
+            operands: Arc::default(),
+            lhs: Vec::with_capacity(data.len()),
+            rhs: Vec::with_capacity(data.len()),
+            ops: Vec::with_capacity(data.len()),
+        };
+        for item in data.0 {
+            columns.lhs.push(operands.len());
+            operands.push(Shared::new(item.lhs));
+            columns.rhs.push(operands.len());
+            operands.push(Shared::new(item.rhs));
+            columns.ops.push(item.operation);
+        }
+        columns.operands = Arc::new(operands);
+        columns
+    }
+}
+
+impl<C: CryptoSystem> Encode for SeqOpsColumns<C>
+where
+    C::Ciphertext: Encode,
+    C::Operation2: Encode,
+{
+    fn encode<E: bincode::enc::Encoder>(
+        &self,
+        encoder: &mut E,
+    ) -> Result<(), bincode::error::EncodeError> {
+        self.ops.encode(encoder)?;
+        self.operands.encode(encoder)?;
+        self.lhs.encode(encoder)?;
+        self.rhs.encode(encoder)
+    }
+}
+
+impl<C: CryptoSystem, Context> Decode<Context> for SeqOpsColumns<C>
+where
+    C::Ciphertext: Decode<Context> + Encode,
+    C::Operation2: Decode<Context> + Encode,
+{
+    fn decode<D: bincode::de::Decoder<Context = Context>>(
+        decoder: &mut D,
+    ) -> Result<Self, bincode::error::DecodeError> {
+        let ops: Vec<C::Operation2> = Vec::decode(decoder)?;
+        let operands: Vec<C::Ciphertext> = Vec::decode(decoder)?;
+        let lhs: Vec<usize> = Vec::decode(decoder)?;
+        let rhs: Vec<usize> = Vec::decode(decoder)?;
+        Self::from_parts(ops, operands, lhs, rhs).map_err(|err| match err {
+            ColumnsError::UnevenColumns => {
+                bincode::error::DecodeError::Other("columns of different lengths")
+            }
+            ColumnsError::OperandOutOfRange => {
+                bincode::error::DecodeError::Other("operand index out of range")
+            }
+        })
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -174,7 +523,7 @@ mod tests {
 
     struct TestCryptoSystem {}
 
-    #[derive(Clone, Copy, Debug)]
+    #[derive(Clone, Copy, Debug, Encode, Decode)]
     #[allow(dead_code)]
     enum Op {
         Add,
@@ -242,4 +591,111 @@ mod tests {
 
         assert_eq!(a_final, TestPlaintext(1));
     }
+
+    #[test]
+    fn test_split() {
+        let cs = TestCryptoSystem {};
+
+        let data = SeqOpsData::<TestCryptoSystem>::from_vec(
+            (0..5)
+                .map(|i| {
+                    SeqOpItem::new(
+                        cs.cipher(&TestPlaintext(i)),
+                        cs.cipher(&TestPlaintext(1)),
+                        Op::Add,
+                    )
+                })
+                .collect(),
+        );
+
+        let shards = data.split(2);
+        assert_eq!(shards.len(), 2);
+        assert_eq!(shards[0].len(), 3);
+        assert_eq!(shards[1].len(), 2);
+
+        let results: Vec<_> = shards
+            .iter()
+            .flat_map(SeqOpsData::iter_over_data)
+            .map(|item| cs.decipher(&item.execute(&cs)).0)
+            .collect();
+        assert_eq!(results, vec![1, 2, 3, 4, 5]);
+    }
+
+    #[test]
+    fn test_columns() {
+        let cs = TestCryptoSystem {};
+
+        let data = SeqOpsData::<TestCryptoSystem>::from_vec(
+            (0..6)
+                .map(|i| {
+                    let op = if i % 3 == 0 { Op::Mul } else { Op::Add };
+                    SeqOpItem::new(
+                        cs.cipher(&TestPlaintext(i)),
+                        cs.cipher(&TestPlaintext(2)),
+                        op,
+                    )
+                })
+                .collect(),
+        );
+        let expected: Vec<_> = data
+            .iter_over_data()
+            .map(|item| cs.decipher(&item.execute(&cs)).0)
+            .collect();
+        assert_eq!(expected, vec![0, 3, 4, 6, 6, 7]);
+
+        let columns = SeqOpsColumns::from(data);
+        let groups: Vec<_> = columns
+            .groups()
+            .into_iter()
+            .map(|(_, indices)| indices)
+            .collect();
+        assert_eq!(groups, vec![vec![0, 3], vec![1, 2, 4, 5]]);
+
+        let encoded = bincode::encode_to_vec(&columns, CONFIG).unwrap();
+        let (columns, _): (SeqOpsColumns<TestCryptoSystem>, _) =
+            bincode::decode_from_slice(&encoded, CONFIG).unwrap();
+        let results: Vec<_> = columns
+            .split_by_cost(4, |op| match op {
+                Op::Add => 1,
+                Op::Mul => 3,
+            })
+            .iter()
+            .flat_map(|chunk| chunk.execute(&cs))
+            .map(|result| cs.decipher(&result).0)
+            .collect();
+        assert_eq!(results, expected);
+    }
+
+    #[test]
+    fn test_shared_operands() {
+        let cs = TestCryptoSystem {};
+
+        // Every value is multiplied by the same rate.
+        let mut columns = SeqOpsColumns::<TestCryptoSystem>::new();
+        let rate = columns.push_operand(cs.cipher(&TestPlaintext(3)));
+        for i in 0..4 {
+            let value = columns.push_operand(cs.cipher(&TestPlaintext(i)));
+            columns.push_indexed(value, rate, Op::Mul);
+        }
+        assert_eq!(columns.operands().len(), 5);
+
+        let mut shards = columns.split(2);
+        let last = shards.pop().unwrap().compact();
+        assert_eq!(last.operands().len(), 3);
+        assert!(Shared::ptr_eq(
+            &last.operands()[2],
+            &shards[0].operands()[rate]
+        ));
+        let encoded = bincode::encode_to_vec(&last, CONFIG).unwrap();
+        let (last, _): (SeqOpsColumns<TestCryptoSystem>, _) =
+            bincode::decode_from_slice(&encoded, CONFIG).unwrap();
+
+        let results: Vec<_> = shards[0]
+            .execute(&cs)
+            .iter()
+            .chain(&last.execute(&cs))
+            .map(|result| cs.decipher(result).0)
+            .collect();
+        assert_eq!(results, vec![0, 3, 6, 9]);
+    }
 }
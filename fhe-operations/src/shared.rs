@@ -0,0 +1,134 @@
+//! Ciphertexts shared without being copied.
+
+use bincode::{Decode, Encode};
+use std::sync::Arc;
+
+/// A ciphertext, or any value, shared by reference counting.
+///
+/// Cloning a `Shared` only increments a reference count, whereas cloning a ciphertext usually
+/// copies all of its polynomials. Threads and collections can thus hold the same ciphertext
+/// for reading. A value is only copied when it is updated in place while shared, see
+/// [`Shared::make_mut`].
+///
+/// It is encoded exactly like the value it holds.
+#[derive(Debug, Default, PartialEq, Eq)]
+pub struct Shared<T>(Arc<T>);
+
+impl<T> Shared<T> {
+    #[must_use]
+    #[inline]
+    pub fn new(value: T) -> Self {
+        Self(Arc::new(value))
+    }
+
+    #[must_use]
+    #[inline]
+    /// Returns `true` if both hold the same value, rather than equal ones.
+    pub fn ptr_eq(this: &Self, other: &Self) -> bool {
+        Arc::ptr_eq(&this.0, &other.0)
+    }
+
+    #[inline]
+    /// Mutable access to the value, e.g. to update it with
+    /// [`CryptoSystem::operate2_inplace`](fhe_core::api::CryptoSystem::operate2_inplace). The
+    /// value is copied first if it is shared, the other holders keeping the original.
+    pub fn make_mut(&mut self) -> &mut T
+    where
+        T: Clone,
+    {
+        Arc::make_mut(&mut self.0)
+    }
+
+    #[must_use]
+    #[inline]
+    /// Returns the value, which is only copied if it is shared.
+    pub fn into_owned(self) -> T
+    where
+        T: Clone,
+    {
+        Arc::unwrap_or_clone(self.0)
+    }
+}
+
+impl<T> Clone for Shared<T> {
+    #[inline]
+    fn clone(&self) -> Self {
+        Self(Arc::clone(&self.0))
+    }
+}
+
+impl<T> core::ops::Deref for Shared<T> {
+    type Target = T;
+
+    #[inline]
+    fn deref(&self) -> &T {
+        &self.0
+    }
+}
+
+impl<T> From<T> for Shared<T> {
+    #[inline]
+    fn from(value: T) -> Self {
+        Self::new(value)
+    }
+}
+
+impl<T: Encode> Encode for Shared<T> {
+    fn encode<E: bincode::enc::Encoder>(
+        &self,
+        encoder: &mut E,
+    ) -> Result<(), bincode::error::EncodeError> {
+        self.0.encode(encoder)
+    }
+}
+
+impl<T: Decode<Context>, Context> Decode<Context> for Shared<T> {
+    fn decode<D: bincode::de::Decoder<Context = Context>>(
+        decoder: &mut D,
+    ) -> Result<Self, bincode::error::DecodeError> {
+        T::decode(decoder).map(Self::new)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_clone_shares() {
+        let value = Shared::new(vec![1, 2, 3]);
+        let copy = value.clone();
+        assert!(Shared::ptr_eq(&value, &copy));
+        assert_eq!(copy.into_owned(), [1, 2, 3]);
+    }
+
+    #[test]
+    fn test_copy_on_write() {
+        let mut value = Shared::new(vec![1, 2, 3]);
+        let copy = value.clone();
+        value.make_mut().push(4);
+        assert!(!Shared::ptr_eq(&value, &copy));
+        assert_eq!(*copy, [1, 2, 3]);
+
+        // No longer shared: updated in place.
+        let address = value.as_ptr();
+        value.make_mut().push(5);
+        assert_eq!(value.as_ptr(), address);
+        assert_eq!(*value, [1, 2, 3, 4, 5]);
+    }
+
+    #[test]
+    fn test_encoding() {
+        const CONFIG: bincode::config::Configuration = bincode::config::standard();
+
+        let value = Shared::new(vec![1_u64, 2, 3]);
+        let encoded = bincode::encode_to_vec(&value, CONFIG).unwrap();
+        assert_eq!(
+            encoded,
+            bincode::encode_to_vec(vec![1_u64, 2, 3], CONFIG).unwrap()
+        );
+        let (decoded, _): (Shared<Vec<u64>>, _) =
+            bincode::decode_from_slice(&encoded, CONFIG).unwrap();
+        assert_eq!(decoded, value);
+    }
+}
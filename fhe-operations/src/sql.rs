@@ -0,0 +1,720 @@
+//! A subset of SQL, compiled to selections over a [`SelectableCollection`].
+//!
+//! ```text
+//! SELECT SUM(amount) FROM sales WHERE status = 'paid' AND NOT (refunded OR region = 'eu') GROUP BY region
+//! ```
+//!
+//! The server cannot compare ciphertexts: each condition of a query is thus a flag of the items,
+//! set by the client from its plaintext rows (see [`QueryPlan::flags`]). The `WHERE` clause and
+//! the groups then compile to a [`Predicate`] over these flags per group, which the server
+//! evaluates with [`SelectableCollection::aggregate_where`]. The server only receives these
+//! predicates, as a [`WirePlan`]: neither the constants of the conditions nor the values of the
+//! groups.
+//!
+//! Every `AND` and `OR` costs a multiplication, and so does summing the selected values: the
+//! planner refuses queries deeper than the encryption parameters allow, or needing more flags
+//! than the items carry.
+//!
+//! [`SelectableCollection`]: crate::selectable_collection::SelectableCollection
+//! [`SelectableCollection::aggregate_where`]: crate::selectable_collection::SelectableCollection::aggregate_where
+
+use crate::selectable_collection::{Aggregate, Predicate};
+use bincode::{Decode, Encode};
+
+/// Why a query cannot be run.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub enum SqlError {
+    /// The query is not in the supported subset, the message telling what was expected.
+    Syntax(String),
+    /// The query needs this number of flags, more than the items carry.
+    TooManyFlags(usize),
+    /// The query needs this multiplicative depth, more than the parameters allow.
+    TooDeep(u32),
+    /// The query groups rows, but there are none.
+    NoGroups,
+}
+
+impl core::fmt::Display for SqlError {
+    fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+        match self {
+            Self::Syntax(expected) => write!(f, "syntax error, expected {expected}"),
+            Self::TooManyFlags(flags) => write!(f, "query needs {flags} flags, too many"),
+            Self::TooDeep(depth) => write!(f, "query needs a multiplicative depth of {depth}"),
+            Self::NoGroups => f.write_str("query groups no rows"),
+        }
+    }
+}
+
+impl std::error::Error for SqlError {}
+
+/// A condition on a single column of a row: `column = 'value'`, or `column` alone for a boolean
+/// column.
+#[derive(Clone, Debug, PartialEq, Eq, Encode, Decode)]
+pub struct Condition {
+    pub column: String,
+    pub value: Option<String>,
+}
+
+impl Condition {
+    #[must_use]
+    /// Whether the condition holds for a row whose column has the given value.
+    pub fn holds(&self, value: &str) -> bool {
+        let value = value.trim();
+        match &self.value {
+            Some(expected) => value == expected,
+            None => matches!(value.to_ascii_lowercase().as_str(), "1" | "true" | "yes"),
+        }
+    }
+}
+
+impl core::fmt::Display for Condition {
+    fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+        match &self.value {
+            Some(value) => write!(f, "{} = '{value}'", self.column),
+            None => f.write_str(&self.column),
+        }
+    }
+}
+
+/// The `WHERE` clause of a query.
+#[derive(Clone, Debug, PartialEq, Eq)]
+enum Filter {
+    Is(Condition),
+    Not(Box<Filter>),
+    And(Box<Filter>, Box<Filter>),
+    Or(Box<Filter>, Box<Filter>),
+}
+
+impl Filter {
+    /// Compiles the filter, allocating a flag to each distinct condition.
+    fn compile(&self, flags: &mut Vec<Condition>) -> Predicate {
+        match self {
+            Self::Is(condition) => Predicate::Flag(flag(flags, condition)),
+            Self::Not(filter) => Predicate::Not(Box::new(filter.compile(flags))),
+            Self::And(lhs, rhs) => {
+                Predicate::And(Box::new(lhs.compile(flags)), Box::new(rhs.compile(flags)))
+            }
+            Self::Or(lhs, rhs) => {
+                Predicate::Or(Box::new(lhs.compile(flags)), Box::new(rhs.compile(flags)))
+            }
+        }
+    }
+}
+
+/// The flag of a condition, allocating it if needed.
+fn flag(flags: &mut Vec<Condition>, condition: &Condition) -> u8 {
+    let index = flags
+        .iter()
+        .position(|flag| flag == condition)
+        .unwrap_or_else(|| {
+            flags.push(condition.clone());
+            flags.len() - 1
+        });
+    // More flags than items carry are refused after compiling.
+    u8::try_from(index).unwrap_or(u8::MAX)
+}
+
+/// A parsed query.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct Query {
+    aggregate: Aggregate,
+    /// The summed column, `None` for `COUNT(*)`.
+    column: Option<String>,
+    table: String,
+    filter: Option<Filter>,
+    group_by: Option<String>,
+}
+
+/// Limits of the server a query is planned for.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct Limits {
+    /// Number of flags carried by each item.
+    pub flags: usize,
+    /// Largest multiplicative depth the encryption parameters allow.
+    pub depth: u32,
+    /// Number of rows from which the rows are spread over the threads of the server, rather
+    /// than the groups.
+    pub parallel_rows: usize,
+}
+
+/// How the server runs a query.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Encode, Decode)]
+pub enum Strategy {
+    /// The rows are aggregated one after the other, the groups in parallel: a small table is
+    /// not worth summing the partial aggregates of each thread.
+    Sequential,
+    /// The rows are spread over the threads, and their partial aggregates summed.
+    Parallel,
+}
+
+/// A group of the result, and the predicate selecting its rows.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct Group {
+    /// The value of the `GROUP BY` column, `None` without grouping.
+    pub label: Option<String>,
+    /// `None` if every row is selected.
+    pub predicate: Option<Predicate>,
+}
+
+/// A query compiled for a table, kept by the client.
+///
+/// The conditions of the flags and the labels of the groups are plaintext values of the table:
+/// only its [`WirePlan`] is sent to the server.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct QueryPlan {
+    pub aggregate: Aggregate,
+    /// Flag `i` of a row is on when `flags[i]` holds for it.
+    pub flags: Vec<Condition>,
+    /// One aggregate is returned per group, in order.
+    pub groups: Vec<Group>,
+    pub strategy: Strategy,
+}
+
+impl QueryPlan {
+    #[must_use]
+    /// The plan the server runs, without the conditions nor the labels.
+    pub fn wire(&self) -> WirePlan {
+        WirePlan {
+            aggregate: self.aggregate,
+            predicates: self
+                .groups
+                .iter()
+                .map(|group| group.predicate.clone())
+                .collect(),
+            strategy: self.strategy,
+        }
+    }
+}
+
+/// What the server needs of a [`QueryPlan`], sent ahead of its collection: the flags it reads,
+/// but not what they mean.
+#[derive(Clone, Debug, PartialEq, Eq, Encode, Decode)]
+pub struct WirePlan {
+    pub aggregate: Aggregate,
+    /// The predicate of each group, in order, `None` if every row is selected. One aggregate
+    /// is returned per group.
+    pub predicates: Vec<Option<Predicate>>,
+    pub strategy: Strategy,
+}
+
+impl WirePlan {
+    #[must_use]
+    /// Multiplicative depth of the query, selecting values included.
+    pub fn depth(&self) -> u32 {
+        self.predicates
+            .iter()
+            .flatten()
+            .map(|predicate| predicate.depth() + u32::from(self.aggregate == Aggregate::Sum))
+            .max()
+            .unwrap_or(0)
+    }
+
+    #[must_use]
+    /// Number of multiplications and additions needed for each row, over all groups.
+    pub fn operations_per_row(&self) -> (u64, u64) {
+        self.predicates
+            .iter()
+            .fold((0, 0), |(muls, adds), predicate| {
+                let Some(predicate) = predicate else {
+                    return (muls, adds + 1);
+                };
+                let selecting = u64::from(self.aggregate == Aggregate::Sum);
+                let muls = muls + u64::from(predicate.multiplications()) + selecting;
+                (muls, adds + predicate_additions(predicate) + 1)
+            })
+    }
+
+    #[must_use]
+    /// Highest flag index read by the groups, if any.
+    pub fn max_flag(&self) -> Option<u8> {
+        self.predicates
+            .iter()
+            .flatten()
+            .map(Predicate::max_flag)
+            .max()
+    }
+}
+
+/// Number of additions (or negations) needed to evaluate a predicate.
+fn predicate_additions(predicate: &Predicate) -> u64 {
+    match predicate {
+        Predicate::Flag(_) => 0,
+        Predicate::Not(predicate) => predicate_additions(predicate) + 1,
+        Predicate::And(lhs, rhs) => predicate_additions(lhs) + predicate_additions(rhs),
+        Predicate::Or(lhs, rhs) => predicate_additions(lhs) + predicate_additions(rhs) + 2,
+    }
+}
+
+impl Query {
+    /// Parses a query of the form
+    /// `SELECT SUM(column) | COUNT(*) FROM table [WHERE condition] [GROUP BY column]`, where a
+    /// condition combines `column = value`, `column != value` and boolean `column`s with `NOT`,
+    /// `AND`, `OR` and parentheses.
+    ///
+    /// # Errors
+    ///
+    /// What the parser expected where the query is not in the supported subset.
+    pub fn parse(text: &str) -> Result<Self, SqlError> {
+        let mut parser = Parser {
+            tokens: tokenize(text)?,
+            at: 0,
+        };
+
+        parser.keyword("SELECT")?;
+        let (aggregate, column) = if parser.eat_keyword("SUM") {
+            parser.symbol('(')?;
+            let column = parser.identifier()?;
+            parser.symbol(')')?;
+            (Aggregate::Sum, Some(column))
+        } else if parser.eat_keyword("COUNT") {
+            parser.symbol('(')?;
+            parser.symbol('*')?;
+            parser.symbol(')')?;
+            (Aggregate::Count, None)
+        } else {
+            return Err(parser.expected("SUM or COUNT"));
+        };
+
+        parser.keyword("FROM")?;
+        let table = parser.identifier()?;
+
+        let filter = if parser.eat_keyword("WHERE") {
+            Some(parser.or()?)
+        } else {
+            None
+        };
+
+        let group_by = if parser.eat_keyword("GROUP") {
+            parser.keyword("BY")?;
+            Some(parser.identifier()?)
+        } else {
+            None
+        };
+
+        parser.eat_symbol(';');
+        if parser.at < parser.tokens.len() {
+            return Err(parser.expected("the end of the query"));
+        }
+
+        Ok(Self {
+            aggregate,
+            column,
+            table,
+            filter,
+            group_by,
+        })
+    }
+
+    #[must_use]
+    #[inline]
+    pub const fn aggregate(&self) -> Aggregate {
+        self.aggregate
+    }
+
+    #[must_use]
+    #[inline]
+    /// The summed column, `None` for `COUNT(*)`.
+    pub fn column(&self) -> Option<&str> {
+        self.column.as_deref()
+    }
+
+    #[must_use]
+    #[inline]
+    pub fn table(&self) -> &str {
+        &self.table
+    }
+
+    #[must_use]
+    #[inline]
+    /// The column the rows are grouped by, if any.
+    pub fn group_by(&self) -> Option<&str> {
+        self.group_by.as_deref()
+    }
+
+    /// Compiles the query for a table of `rows` rows, whose `GROUP BY` column takes the given
+    /// values (ignored without grouping).
+    ///
+    /// # Errors
+    ///
+    /// If the query needs more flags or depth than the `limits`, or groups no rows.
+    pub fn plan(
+        &self,
+        group_values: &[String],
+        rows: usize,
+        limits: &Limits,
+    ) -> Result<QueryPlan, SqlError> {
+        let mut flags = Vec::new();
+        let filter = self
+            .filter
+            .as_ref()
+            .map(|filter| filter.compile(&mut flags));
+
+        let groups = match &self.group_by {
+            None => vec![Group {
+                label: None,
+                predicate: filter,
+            }],
+            Some(_) if group_values.is_empty() => return Err(SqlError::NoGroups),
+            Some(column) => group_values
+                .iter()
+                .map(|value| {
+                    let condition = Condition {
+                        column: column.clone(),
+                        value: Some(value.clone()),
+                    };
+                    let group = Predicate::Flag(flag(&mut flags, &condition));
+                    Group {
+                        label: Some(value.clone()),
+                        predicate: Some(match &filter {
+                            Some(filter) => {
+                                Predicate::And(Box::new(filter.clone()), Box::new(group))
+                            }
+                            None => group,
+                        }),
+                    }
+                })
+                .collect(),
+        };
+
+        if flags.len() > limits.flags {
+            return Err(SqlError::TooManyFlags(flags.len()));
+        }
+
+        let strategy = if rows < limits.parallel_rows {
+            Strategy::Sequential
+        } else {
+            Strategy::Parallel
+        };
+        let plan = QueryPlan {
+            aggregate: self.aggregate,
+            flags,
+            groups,
+            strategy,
+        };
+        let depth = plan.wire().depth();
+        if depth > limits.depth {
+            return Err(SqlError::TooDeep(depth));
+        }
+        Ok(plan)
+    }
+}
+
+#[derive(Clone, Debug, PartialEq, Eq)]
+enum Token {
+    /// A keyword, an identifier or a number.
+    Word(String),
+    /// A quoted string.
+    Text(String),
+    Symbol(char),
+    /// `!=` or `<>`.
+    NotEqual,
+}
+
+fn tokenize(text: &str) -> Result<Vec<Token>, SqlError> {
+    let mut tokens = Vec::new();
+    let mut chars = text.chars().peekable();
+    while let Some(c) = chars.next() {
+        match c {
+            _ if c.is_whitespace() => {}
+            '(' | ')' | ',' | '*' | '=' | ';' => tokens.push(Token::Symbol(c)),
+            '!' if chars.next_if_eq(&'=').is_some() => tokens.push(Token::NotEqual),
+            '<' if chars.next_if_eq(&'>').is_some() => tokens.push(Token::NotEqual),
+            '\'' => {
+                let mut text = String::new();
+                loop {
+                    match chars.next() {
+                        // A quote is escaped by doubling it.
+                        Some('\'') if chars.next_if_eq(&'\'').is_some() => text.push('\''),
+                        Some('\'') => break,
+                        Some(c) => text.push(c),
+                        None => return Err(SqlError::Syntax("a closing quote".to_string())),
+                    }
+                }
+                tokens.push(Token::Text(text));
+            }
+            _ if c.is_alphanumeric() || c == '_' => {
+                let mut word = c.to_string();
+                while let Some(c) = chars.next_if(|c| c.is_alphanumeric() || matches!(c, '_' | '.'))
+                {
+                    word.push(c);
+                }
+                tokens.push(Token::Word(word));
+            }
+            _ => return Err(SqlError::Syntax(format!("a token instead of '{c}'"))),
+        }
+    }
+    Ok(tokens)
+}
+
+/// Words that cannot be used as identifiers.
+const KEYWORDS: [&str; 11] = [
+    "SELECT", "SUM", "COUNT", "FROM", "WHERE", "GROUP", "BY", "NOT", "AND", "OR", "AS",
+];
+
+struct Parser {
+    tokens: Vec<Token>,
+    at: usize,
+}
+
+impl Parser {
+    fn expected(&self, what: &str) -> SqlError {
+        match self.tokens.get(self.at) {
+            Some(token) => {
+                SqlError::Syntax(format!("{what} at token {}, found {token:?}", self.at))
+            }
+            None => SqlError::Syntax(format!("{what} at the end of the query")),
+        }
+    }
+
+    fn eat_keyword(&mut self, keyword: &str) -> bool {
+        let found = matches!(
+            self.tokens.get(self.at),
+            Some(Token::Word(word)) if word.eq_ignore_ascii_case(keyword)
+        );
+        self.at += usize::from(found);
+        found
+    }
+
+    fn keyword(&mut self, keyword: &str) -> Result<(), SqlError> {
+        if self.eat_keyword(keyword) {
+            Ok(())
+        } else {
+            Err(self.expected(keyword))
+        }
+    }
+
+    fn eat_symbol(&mut self, symbol: char) -> bool {
+        let found = self.tokens.get(self.at) == Some(&Token::Symbol(symbol));
+        self.at += usize::from(found);
+        found
+    }
+
+    fn symbol(&mut self, symbol: char) -> Result<(), SqlError> {
+        if self.eat_symbol(symbol) {
+            Ok(())
+        } else {
+            Err(self.expected(&format!("'{symbol}'")))
+        }
+    }
+
+    fn identifier(&mut self) -> Result<String, SqlError> {
+        match self.tokens.get(self.at) {
+            Some(Token::Word(word))
+                if !KEYWORDS
+                    .iter()
+                    .any(|keyword| word.eq_ignore_ascii_case(keyword)) =>
+            {
+                self.at += 1;
+                Ok(word.clone())
+            }
+            _ => Err(self.expected("a column or table name")),
+        }
+    }
+
+    /// `and (OR and)*`
+    fn or(&mut self) -> Result<Filter, SqlError> {
+        let mut filter = self.and()?;
+        while self.eat_keyword("OR") {
+            filter = Filter::Or(Box::new(filter), Box::new(self.and()?));
+        }
+        Ok(filter)
+    }
+
+    /// `not (AND not)*`
+    fn and(&mut self) -> Result<Filter, SqlError> {
+        let mut filter = self.not()?;
+        while self.eat_keyword("AND") {
+            filter = Filter::And(Box::new(filter), Box::new(self.not()?));
+        }
+        Ok(filter)
+    }
+
+    /// `NOT not | '(' or ')' | column [(= | != | <>) value]`
+    fn not(&mut self) -> Result<Filter, SqlError> {
+        if self.eat_keyword("NOT") {
+            return Ok(Filter::Not(Box::new(self.not()?)));
+        }
+        if self.eat_symbol('(') {
+            let filter = self.or()?;
+            self.symbol(')')?;
+            return Ok(filter);
+        }
+
+        let column = self.identifier()?;
+        let negated = match self.tokens.get(self.at) {
+            Some(Token::Symbol('=')) => false,
+            Some(Token::NotEqual) => true,
+            _ => {
+                return Ok(Filter::Is(Condition {
+                    column,
+                    value: None,
+                }));
+            }
+        };
+        self.at += 1;
+        let value = match self.tokens.get(self.at) {
+            Some(Token::Word(value) | Token::Text(value)) => value.clone(),
+            _ => return Err(self.expected("a value")),
+        };
+        self.at += 1;
+
+        let condition = Filter::Is(Condition {
+            column,
+            value: Some(value),
+        });
+        Ok(if negated {
+            Filter::Not(Box::new(condition))
+        } else {
+            condition
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const LIMITS: Limits = Limits {
+        flags: 4,
+        depth: 3,
+        parallel_rows: 1000,
+    };
+
+    fn is(column: &str, value: Option<&str>) -> Filter {
+        Filter::Is(Condition {
+            column: column.to_string(),
+            value: value.map(str::to_string),
+        })
+    }
+
+    #[test]
+    fn test_parse() {
+        let query = Query::parse(
+            "select SUM(amount) FROM sales WHERE status = 'paid' AND NOT (refunded OR region <> eu) GROUP BY region;",
+        )
+        .unwrap();
+        assert_eq!(query.aggregate(), Aggregate::Sum);
+        assert_eq!(query.column(), Some("amount"));
+        assert_eq!(query.table(), "sales");
+        assert_eq!(query.group_by(), Some("region"));
+        assert_eq!(
+            query.filter,
+            Some(Filter::And(
+                Box::new(is("status", Some("paid"))),
+                Box::new(Filter::Not(Box::new(Filter::Or(
+                    Box::new(is("refunded", None)),
+                    Box::new(Filter::Not(Box::new(is("region", Some("eu"))))),
+                )))),
+            ))
+        );
+    }
+
+    #[test]
+    fn test_parse_precedence() {
+        let query = Query::parse("SELECT COUNT(*) FROM t WHERE a OR b AND c = 'it''s'").unwrap();
+        assert_eq!(query.aggregate(), Aggregate::Count);
+        assert_eq!(query.column(), None);
+        assert_eq!(
+            query.filter,
+            Some(Filter::Or(
+                Box::new(is("a", None)),
+                Box::new(Filter::And(
+                    Box::new(is("b", None)),
+                    Box::new(is("c", Some("it's")))
+                )),
+            ))
+        );
+    }
+
+    #[test]
+    fn test_parse_errors() {
+        for text in [
+            "SELECT AVG(x) FROM t",
+            "SELECT SUM(x) FROM t WHERE",
+            "SELECT COUNT(x) FROM t",
+            "SELECT SUM(x) FROM t WHERE (a",
+            "SELECT SUM(x) FROM t WHERE a = 'b",
+            "SELECT SUM(x) FROM t WHERE a < 3",
+            "SELECT SUM(x) FROM t GROUP region",
+            "SELECT SUM(where) FROM t",
+            "SELECT SUM(x) FROM t LIMIT 3",
+        ] {
+            assert!(
+                matches!(Query::parse(text), Err(SqlError::Syntax(_))),
+                "{text}"
+            );
+        }
+    }
+
+    #[test]
+    fn test_plan() {
+        let query =
+            Query::parse("SELECT SUM(x) FROM t WHERE a = 1 OR NOT a = 1 GROUP BY g").unwrap();
+        let plan = query
+            .plan(&["x".to_string(), "y".to_string()], 10, &LIMITS)
+            .unwrap();
+
+        assert_eq!(plan.flags.len(), 3);
+        assert_eq!(plan.flags[2].to_string(), "g = 'y'");
+        assert_eq!(plan.groups.len(), 2);
+        assert_eq!(plan.groups[1].label.as_deref(), Some("y"));
+        let filter = Predicate::Or(
+            Box::new(Predicate::Flag(0)),
+            Box::new(Predicate::Not(Box::new(Predicate::Flag(0)))),
+        );
+        assert_eq!(
+            plan.groups[1].predicate,
+            Some(Predicate::And(
+                Box::new(filter),
+                Box::new(Predicate::Flag(2))
+            ))
+        );
+        let wire = plan.wire();
+        assert_eq!(wire.predicates[1], plan.groups[1].predicate);
+        assert_eq!(wire.max_flag(), Some(2));
+        assert_eq!(wire.depth(), 3);
+        assert_eq!(wire.operations_per_row(), (6, 8));
+        assert_eq!(wire.strategy, Strategy::Sequential);
+    }
+
+    #[test]
+    fn test_plan_limits() {
+        let query = Query::parse("SELECT COUNT(*) FROM t GROUP BY g").unwrap();
+        let values = |count| (0..count).map(|i: u32| i.to_string()).collect::<Vec<_>>();
+        assert!(query.plan(&values(4), 10, &LIMITS).is_ok());
+        assert_eq!(
+            query.plan(&values(5), 10, &LIMITS),
+            Err(SqlError::TooManyFlags(5))
+        );
+        assert_eq!(query.plan(&[], 0, &LIMITS), Err(SqlError::NoGroups));
+
+        let query = Query::parse("SELECT SUM(x) FROM t WHERE a AND b AND c AND d").unwrap();
+        assert_eq!(query.plan(&[], 10, &LIMITS), Err(SqlError::TooDeep(4)));
+
+        let plan = Query::parse("SELECT SUM(x) FROM t")
+            .unwrap()
+            .plan(&[], 1000, &LIMITS)
+            .unwrap()
+            .wire();
+        assert_eq!(plan.depth(), 0);
+        assert_eq!(plan.operations_per_row(), (0, 1));
+        assert_eq!(plan.strategy, Strategy::Parallel);
+    }
+
+    #[test]
+    fn test_condition_holds() {
+        let condition = Condition {
+            column: "a".to_string(),
+            value: None,
+        };
+        assert!(condition.holds("true"));
+        assert!(condition.holds(" 1"));
+        assert!(!condition.holds("0"));
+        let condition = Condition {
+            column: "a".to_string(),
+            value: Some("eu".to_string()),
+        };
+        assert!(condition.holds("eu"));
+        assert!(!condition.holds("us"));
+    }
+}
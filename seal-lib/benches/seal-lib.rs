@@ -1,8 +1,8 @@
-use criterion::{Criterion, criterion_group, criterion_main};
+use criterion::{Criterion, Throughput, criterion_group, criterion_main};
 use fhe_core::api::CryptoSystem;
 use seal_lib::{
-    BfvHOperation2, BgvHOperation2, CkksHOperation2, DegreeType, SealBfvCS, SealBgvCS, SealCkksCS,
-    SecurityLevel,
+    BfvHOperation2, BgvHOperation2, CkksHOperation2, DegreeType, MemoryPool, SealBfvCS, SealBgvCS,
+    SealCkksCS, SecurityLevel,
     context::{SealBFVContext, SealBGVContext, SealCkksContext},
 };
 
@@ -39,6 +39,23 @@ fn benchmark_bfv(c: &mut Criterion) {
             cipher.decipher(&ciphered_input);
         })
     });
+
+    let config = bincode::config::standard();
+    let encoded = bincode::encode_to_vec(&ciphered_input, config).unwrap();
+    let (bytes, _): (Vec<u8>, _) = bincode::decode_from_slice(&encoded, config).unwrap();
+
+    c.bench_function("bfv load", |b| {
+        b.iter(|| {
+            ctx.load_ciphertext(&bytes).unwrap();
+        })
+    });
+
+    c.bench_function("bfv load (trusted)", |b| {
+        b.iter(|| {
+            // SAFETY: the bytes were serialized from a ciphertext of this context.
+            unsafe { ctx.load_trusted_ciphertext(&bytes) }.unwrap();
+        })
+    });
 }
 
 fn benchmark_bgv(c: &mut Criterion) {
@@ -111,9 +128,57 @@ fn benchmark_ckks(c: &mut Criterion) {
     });
 }
 
+/// Multiplications of each iteration of the huge pages benchmark.
+const MULS: usize = 16;
+
+/// Runs BFV multiplications at a degree whose polynomials span many pages, allocating from
+/// SEAL's global pool and from a pool of huge pages. TLB misses can be compared with e.g.
+/// `perf stat -e dTLB-load-misses cargo bench --bench seal-lib -- "huge pages"`.
+fn benchmark_huge_pages(c: &mut Criterion) {
+    let ctx = SealBFVContext::new(DegreeType::D8192, SecurityLevel::TC128, 20);
+    let pool = MemoryPool::with_huge_pages().unwrap();
+    let systems = [
+        ("global pool", SealBfvCS::new(&ctx)),
+        ("huge pages", SealBfvCS::with_pool(&ctx, &pool)),
+    ];
+
+    let mut group = c.benchmark_group("huge pages");
+    group.throughput(Throughput::Elements(MULS as u64));
+    for (name, cipher) in &systems {
+        let operands = (0..MULS)
+            .map(|i| (cipher.cipher(&(i as u64)), cipher.cipher(&3)))
+            .collect::<Vec<_>>();
+        group.bench_function(format!("bfv mul d8192 ({name})"), |b| {
+            b.iter(|| {
+                for (lhs, rhs) in &operands {
+                    let _ = cipher.operate2(BfvHOperation2::Mul, lhs, rhs);
+                }
+            })
+        });
+    }
+    group.finish();
+
+    println!(
+        "huge pages pool: {} of {} bytes in huge page arenas",
+        pool.huge_page_byte_count().unwrap(),
+        pool.pool_allocated_byte_count().unwrap()
+    );
+    if let Some(line) = std::fs::read_to_string("/proc/self/smaps_rollup")
+        .ok()
+        .and_then(|smaps| {
+            smaps
+                .lines()
+                .find(|line| line.starts_with("AnonHugePages"))
+                .map(str::to_owned)
+        })
+    {
+        println!("{line}");
+    }
+}
+
 criterion_group!(
     name = seal_lib_benchmarks;
     config = Criterion::default().measurement_time(core::time::Duration::from_secs(5));
-    targets = benchmark_bfv,benchmark_bgv,benchmark_ckks
+    targets = benchmark_bfv,benchmark_bgv,benchmark_ckks,benchmark_huge_pages
 );
 criterion_main!(seal_lib_benchmarks);
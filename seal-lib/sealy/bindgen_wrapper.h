@@ -22,3 +22,5 @@
 #include "seal/c/serialization.h"
 #include "seal/c/stdafx.h"
 #include "seal/c/valcheck.h"
+#include "data.h"
+#include "hugepagepool.h"
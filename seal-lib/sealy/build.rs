@@ -74,6 +74,20 @@ fn compile_native(profile: &str, out_path: &Path) {
         ""
     };
 
+    // The shim uses SEAL's C++ classes: the huge page memory pool implements SEAL's memory pool
+    // interface, and the coefficients of ciphertexts and plaintexts are read from their own
+    // buffers. It is built against the headers of SEAL, including the configuration generated
+    // by cmake. Its library must come before SEAL's on the link line.
+    cc::Build::new()
+        .cpp(true)
+        .std("c++17")
+        .file("shim/hugepagepool.cpp")
+        .file("shim/data.cpp")
+        .include("shim")
+        .include("SEAL/native/src")
+        .include(dst.join("include/SEAL-4.1"))
+        .compile("sealy_shim");
+
     // Tell cargo to look for shared libraries in the specified directory
     println!(
         "cargo:rustc-link-search=native={}/build/lib/{}",
@@ -96,6 +110,7 @@ fn main() {
 
     println!("cargo:rerun-if-changed=SEAL");
     println!("cargo:rerun-if-changed=src");
+    println!("cargo:rerun-if-changed=shim");
     println!("cargo:rerun-if-changed=bingen_wrapper.h");
 
     let profile = if profile == "release" {
@@ -111,6 +126,7 @@ fn main() {
     let mut builder = bindgen::builder()
         .clang_arg(format!("-I{}", out_path.join("include/SEAL-3.7").display()))
         .clang_arg("-ISEAL/native/src")
+        .clang_arg("-Ishim")
         .clang_arg("-xc++")
         .clang_arg("-std=c++17");
 
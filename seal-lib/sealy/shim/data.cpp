@@ -0,0 +1,33 @@
+#include "data.h"
+#include "seal/ciphertext.h"
+#include "seal/plaintext.h"
+#include <cstdint>
+
+using namespace seal;
+
+SEAL_C_FUNC Ciphertext_Data(void *thisptr, uint64_t **data, uint64_t *count)
+{
+    auto cipher = static_cast<Ciphertext *>(thisptr);
+    if (!cipher || !data || !count)
+    {
+        return E_POINTER;
+    }
+
+    // Polynomial by polynomial, and within a polynomial RNS limb by RNS limb.
+    *data = cipher->data();
+    *count = static_cast<uint64_t>(cipher->dyn_array().size());
+    return S_OK;
+}
+
+SEAL_C_FUNC Plaintext_Data(void *thisptr, uint64_t **data, uint64_t *count)
+{
+    auto plain = static_cast<Plaintext *>(thisptr);
+    if (!plain || !data || !count)
+    {
+        return E_POINTER;
+    }
+
+    *data = plain->data();
+    *count = static_cast<uint64_t>(plain->coeff_count());
+    return S_OK;
+}
@@ -0,0 +1,14 @@
+// Borrowed views of the coefficients of ciphertexts and plaintexts.
+//
+// SEAL's C API only copies coefficients out one at a time. These functions
+// return a pointer to SEAL's own buffer, and its length in 64-bit words,
+// valid until the object is modified or destroyed.
+
+#pragma once
+
+#include "seal/c/defines.h"
+#include <stdint.h>
+
+SEAL_C_FUNC Ciphertext_Data(void *thisptr, uint64_t **data, uint64_t *count);
+
+SEAL_C_FUNC Plaintext_Data(void *thisptr, uint64_t **data, uint64_t *count);
@@ -0,0 +1,327 @@
+#include "hugepagepool.h"
+#include "seal/memorymanager.h"
+#include "seal/util/common.h"
+#include "seal/util/mempool.h"
+#include "seal/util/pointer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <stdexcept>
+#include <vector>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+using namespace seal;
+using namespace seal::util;
+
+namespace
+{
+    constexpr std::size_t huge_page_byte_count = std::size_t(2) << 20;
+
+    // Items carved from an arena at most, so that pools of large items do not
+    // reserve much more than they use.
+    constexpr std::size_t max_arena_item_count = 16;
+
+    struct Arena
+    {
+        seal_byte *data;
+        std::size_t byte_count;
+        bool huge;
+    };
+
+    std::size_t round_to_huge_pages(std::size_t byte_count)
+    {
+        return (byte_count + huge_page_byte_count - 1) / huge_page_byte_count * huge_page_byte_count;
+    }
+
+    // Reserves an arena of byte_count bytes, a multiple of the huge page size,
+    // aligned to a huge page: from hugetlbfs if huge pages are reserved, else
+    // advised for transparent huge pages, else of normal pages.
+    Arena map_arena(std::size_t byte_count)
+    {
+#if defined(__linux__)
+        void *data =
+            mmap(nullptr, byte_count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED)
+        {
+            return { static_cast<seal_byte *>(data), byte_count, true };
+        }
+
+        // Map an extra huge page to align the arena, and unmap the margins.
+        std::size_t padded_byte_count = byte_count + huge_page_byte_count;
+        data = mmap(nullptr, padded_byte_count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+        auto start = reinterpret_cast<std::uintptr_t>(data);
+        auto aligned = (start + huge_page_byte_count - 1) & ~(huge_page_byte_count - 1);
+        if (aligned != start)
+        {
+            munmap(data, aligned - start);
+        }
+        std::size_t tail_byte_count = start + padded_byte_count - (aligned + byte_count);
+        if (tail_byte_count)
+        {
+            munmap(reinterpret_cast<void *>(aligned + byte_count), tail_byte_count);
+        }
+        bool huge = madvise(reinterpret_cast<void *>(aligned), byte_count, MADV_HUGEPAGE) == 0;
+        return { reinterpret_cast<seal_byte *>(aligned), byte_count, huge };
+#else
+        auto data = static_cast<seal_byte *>(std::aligned_alloc(huge_page_byte_count, byte_count));
+        if (!data)
+        {
+            throw std::bad_alloc();
+        }
+        return { data, byte_count, false };
+#endif
+    }
+
+    void unmap_arena(const Arena &arena, bool clear)
+    {
+        if (clear)
+        {
+            seal_memzero(arena.data, arena.byte_count);
+        }
+#if defined(__linux__)
+        munmap(arena.data, arena.byte_count);
+#else
+        std::free(arena.data);
+#endif
+    }
+
+    // Items of one size, carved from arenas. Returned items are kept in a free
+    // list and reused; arenas are only released with the pool.
+    class HugePageMemoryPoolHead : public MemoryPoolHead
+    {
+    public:
+        HugePageMemoryPoolHead(std::size_t item_byte_count, bool clear_on_destruction)
+            : item_byte_count_(item_byte_count), clear_on_destruction_(clear_on_destruction)
+        {}
+
+        HugePageMemoryPoolHead(const HugePageMemoryPoolHead &copy) = delete;
+
+        HugePageMemoryPoolHead &operator=(const HugePageMemoryPoolHead &assign) = delete;
+
+        ~HugePageMemoryPoolHead() noexcept override
+        {
+            for (auto item : items_)
+            {
+                delete item;
+            }
+            for (const auto &arena : arenas_)
+            {
+                unmap_arena(arena, clear_on_destruction_);
+            }
+        }
+
+        std::size_t item_byte_count() const noexcept override
+        {
+            return item_byte_count_;
+        }
+
+        std::size_t item_count() const noexcept override
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return items_.size();
+        }
+
+        MemoryPoolItem *get() override
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (first_item_)
+            {
+                MemoryPoolItem *item = first_item_;
+                first_item_ = item->next();
+                item->next() = nullptr;
+                return item;
+            }
+
+            if (free_byte_count_ < item_byte_count_)
+            {
+                std::size_t item_count = std::max<std::size_t>(
+                    1, std::min(max_arena_item_count, huge_page_byte_count / item_byte_count_));
+                arenas_.push_back(map_arena(round_to_huge_pages(item_count * item_byte_count_)));
+                next_ = arenas_.back().data;
+                free_byte_count_ = arenas_.back().byte_count;
+            }
+
+            auto item = new MemoryPoolItem(next_);
+            items_.push_back(item);
+            next_ += item_byte_count_;
+            free_byte_count_ -= item_byte_count_;
+            return item;
+        }
+
+        void add(MemoryPoolItem *new_first) noexcept override
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            new_first->next() = first_item_;
+            first_item_ = new_first;
+        }
+
+        std::size_t alloc_byte_count(bool huge_only) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::size_t byte_count = 0;
+            for (const auto &arena : arenas_)
+            {
+                if (arena.huge || !huge_only)
+                {
+                    byte_count += arena.byte_count;
+                }
+            }
+            return byte_count;
+        }
+
+    private:
+        const std::size_t item_byte_count_;
+
+        const bool clear_on_destruction_;
+
+        mutable std::mutex mutex_;
+
+        std::vector<Arena> arenas_;
+
+        std::vector<MemoryPoolItem *> items_;
+
+        MemoryPoolItem *first_item_ = nullptr;
+
+        seal_byte *next_ = nullptr;
+
+        std::size_t free_byte_count_ = 0;
+    };
+
+    class HugePageMemoryPool : public MemoryPool
+    {
+    public:
+        explicit HugePageMemoryPool(bool clear_on_destruction) : clear_on_destruction_(clear_on_destruction)
+        {}
+
+        Pointer<seal_byte> get_for_byte_count(std::size_t byte_count) override
+        {
+            if (byte_count > max_single_alloc_byte_count)
+            {
+                throw std::invalid_argument("invalid allocation size");
+            }
+            if (!byte_count)
+            {
+                return {};
+            }
+
+            {
+                std::shared_lock<std::shared_mutex> lock(mutex_);
+                if (auto head = find(byte_count))
+                {
+                    return Pointer<seal_byte>(head);
+                }
+            }
+
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            if (auto head = find(byte_count))
+            {
+                return Pointer<seal_byte>(head);
+            }
+            if (heads_.size() >= max_pool_head_count)
+            {
+                throw std::runtime_error("maximum pool head count reached");
+            }
+            auto position = std::lower_bound(
+                heads_.begin(), heads_.end(), byte_count,
+                [](const auto &head, std::size_t count) { return head->item_byte_count() < count; });
+            auto head = heads_.insert(
+                position, std::make_unique<HugePageMemoryPoolHead>(byte_count, clear_on_destruction_));
+            return Pointer<seal_byte>(head->get());
+        }
+
+        std::size_t pool_count() const override
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            return heads_.size();
+        }
+
+        std::size_t alloc_byte_count() const override
+        {
+            return byte_count(false);
+        }
+
+        // Bytes of arenas backed by hugetlbfs, or advised for transparent
+        // huge pages: the kernel may still back the latter by normal pages.
+        std::size_t huge_page_byte_count() const
+        {
+            return byte_count(true);
+        }
+
+    private:
+        HugePageMemoryPoolHead *find(std::size_t byte_count) const
+        {
+            auto position = std::lower_bound(
+                heads_.begin(), heads_.end(), byte_count,
+                [](const auto &head, std::size_t count) { return head->item_byte_count() < count; });
+            return position != heads_.end() && (*position)->item_byte_count() == byte_count ? position->get()
+                                                                                              : nullptr;
+        }
+
+        std::size_t byte_count(bool huge_only) const
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            std::size_t byte_count = 0;
+            for (const auto &head : heads_)
+            {
+                byte_count += head->alloc_byte_count(huge_only);
+            }
+            return byte_count;
+        }
+
+        const bool clear_on_destruction_;
+
+        mutable std::shared_mutex mutex_;
+
+        // Sorted by item size.
+        std::vector<std::unique_ptr<HugePageMemoryPoolHead>> heads_;
+    };
+} // namespace
+
+SEAL_C_FUNC MemoryPoolHandle_NewHugePage(bool clear_on_destruction, void **pool)
+{
+    if (!pool)
+    {
+        return E_POINTER;
+    }
+
+    try
+    {
+        *pool = new MemoryPoolHandle(std::make_shared<HugePageMemoryPool>(clear_on_destruction));
+        return S_OK;
+    }
+    catch (const std::bad_alloc &)
+    {
+        return E_OUTOFMEMORY;
+    }
+}
+
+SEAL_C_FUNC MemoryPoolHandle_HugePageByteCount(void *thisptr, uint64_t *count)
+{
+    auto handle = static_cast<MemoryPoolHandle *>(thisptr);
+    if (!handle || !count)
+    {
+        return E_POINTER;
+    }
+
+    try
+    {
+        const MemoryPool &pool = *handle;
+        auto huge_page_pool = dynamic_cast<const HugePageMemoryPool *>(&pool);
+        *count = huge_page_pool ? static_cast<uint64_t>(huge_page_pool->huge_page_byte_count()) : 0;
+        return S_OK;
+    }
+    catch (const std::logic_error &)
+    {
+        return COR_E_INVALIDOPERATION;
+    }
+}
@@ -0,0 +1,16 @@
+// Memory pool for SEAL allocating from arenas aligned to 2 MiB huge pages.
+//
+// SEAL's C API only creates pools that allocate with the global allocator.
+// This pool implements SEAL's memory pool interface on arenas reserved from
+// hugetlbfs, or advised for transparent huge pages, or of normal pages when
+// neither is available.
+
+#pragma once
+
+#include "seal/c/defines.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+SEAL_C_FUNC MemoryPoolHandle_NewHugePage(bool clear_on_destruction, void **pool);
+
+SEAL_C_FUNC MemoryPoolHandle_HugePageByteCount(void *thisptr, uint64_t *count);
@@ -3,7 +3,8 @@ use std::fmt::Debug;
 use std::ptr::null_mut;
 use std::sync::atomic::{AtomicPtr, Ordering};
 
-use crate::{Context, FromBytes, ToBytes, bindgen, serialization::CompressionType};
+use crate::serialization::CompressionType;
+use crate::{Context, FromBytes, MemoryPool, ToBytes, bindgen};
 use crate::{error::Result, try_seal};
 
 /// Class to store a ciphertext element.
@@ -23,6 +24,18 @@ impl Ciphertext {
         })
     }
 
+    /// Creates a new empty ciphertext, whose data is allocated from the given
+    /// memory pool.
+    pub fn new_with_pool(memory: &MemoryPool) -> Result<Self> {
+        let mut handle: *mut c_void = null_mut();
+
+        try_seal!(unsafe { bindgen::Ciphertext_Create1(memory.get_handle(), &mut handle) })?;
+
+        Ok(Self {
+            handle: AtomicPtr::new(handle),
+        })
+    }
+
     /// Returns the handle to the underlying SEAL object.
     pub(crate) unsafe fn get_handle(&self) -> *mut c_void {
         self.handle.load(Ordering::SeqCst)
@@ -47,6 +60,39 @@ impl Ciphertext {
         size
     }
 
+    /// Returns the degree of the polynomials, i.e. their number of coefficients.
+    pub fn poly_modulus_degree(&self) -> u64 {
+        let mut degree: u64 = 0;
+
+        try_seal!(unsafe { bindgen::Ciphertext_PolyModulusDegree(self.get_handle(), &mut degree) })
+            .unwrap();
+
+        degree
+    }
+
+    /// Returns the coefficients of all polynomials, borrowed from SEAL's buffer
+    /// rather than copied out one by one as with [`Self::get_coefficient`].
+    pub fn data(&self) -> CiphertextData<'_> {
+        let mut data = null_mut();
+        let mut count: u64 = 0;
+
+        try_seal!(unsafe { bindgen::Ciphertext_Data(self.get_handle(), &mut data, &mut count) })
+            .expect("Fatal error in Ciphertext::data().");
+
+        let data = if count == 0 {
+            &[]
+        } else {
+            // The buffer is only modified or freed through `&mut self`, or on drop.
+            unsafe { std::slice::from_raw_parts(data, usize::try_from(count).unwrap()) }
+        };
+
+        CiphertextData {
+            data,
+            limbs: usize::try_from(self.coeff_modulus_size()).unwrap(),
+            degree: usize::try_from(self.poly_modulus_degree()).unwrap(),
+        }
+    }
+
     /// Returns the value at a specific point in the coefficient array. This is
     /// not publically exported as it leaks the encoding of the array.
     #[allow(dead_code)]
@@ -87,6 +133,64 @@ impl Ciphertext {
         Ok(data.clone())
     }
 
+    /// Loads a ciphertext from bytes without checking that its data is valid
+    /// for the context, as SEAL's `unsafe_load` does. Loading skips the pass
+    /// over every coefficient that [`FromBytes::from_bytes`] makes to check
+    /// they are reduced, and the checks of the metadata against the encryption
+    /// parameters.
+    ///
+    /// # Safety
+    /// The bytes must have been produced by [`ToBytes::as_bytes`] for a
+    /// ciphertext of a context with the same encryption parameters, and not
+    /// altered since, e.g. because they were kept in local storage checked for
+    /// integrity. Evaluating a ciphertext loaded from other bytes may read or
+    /// write out of bounds.
+    pub unsafe fn from_bytes_unchecked(context: &Context, bytes: &[u8]) -> Result<Self> {
+        let ciphertext = Self::new()?;
+        let mut bytes_read = 0_i64;
+
+        try_seal!(unsafe {
+            bindgen::Ciphertext_UnsafeLoad(
+                ciphertext.get_handle(),
+                context.get_handle(),
+                bytes.as_ptr().cast_mut(),
+                u64::try_from(bytes.len()).unwrap(),
+                &mut bytes_read,
+            )
+        })?;
+
+        Ok(ciphertext)
+    }
+
+    /// Loads a ciphertext from bytes, like [`FromBytes::from_bytes`], allocating its data
+    /// from the given memory pool rather than from SEAL's global pool.
+    pub fn from_bytes_with_pool(
+        context: &Context,
+        bytes: &[u8],
+        memory: &MemoryPool,
+    ) -> Result<Self> {
+        let ciphertext = Self::new_with_pool(memory)?;
+        ciphertext.load(context, bytes)?;
+
+        Ok(ciphertext)
+    }
+
+    /// Replaces the ciphertext by the one serialized in `bytes`, checked against the context.
+    /// SEAL allocates the loaded data from the pool of the ciphertext.
+    fn load(&self, context: &Context, bytes: &[u8]) -> Result<()> {
+        let mut bytes_read = 0_i64;
+
+        try_seal!(unsafe {
+            bindgen::Ciphertext_Load(
+                self.get_handle(),
+                context.get_handle(),
+                bytes.as_ptr().cast_mut(),
+                u64::try_from(bytes.len()).unwrap(),
+                &mut bytes_read,
+            )
+        })
+    }
+
     /// Returns whether the ciphertext is in NTT form.
     pub fn is_ntt_form(&self) -> bool {
         let mut result = false;
@@ -96,6 +200,37 @@ impl Ciphertext {
 
         result
     }
+
+    /// Returns the id of the encryption parameters the ciphertext is valid for,
+    /// i.e. its level in the modulus switching chain.
+    pub fn parms_id(&self) -> [u64; 4] {
+        let mut parms_id = [0; 4];
+
+        try_seal!(unsafe { bindgen::Ciphertext_ParmsId(self.get_handle(), parms_id.as_mut_ptr()) })
+            .expect("Fatal error in Ciphertext::parms_id().");
+
+        parms_id
+    }
+
+    /// Returns the scale of the ciphertext. Only meaningful with CKKS.
+    pub fn scale(&self) -> f64 {
+        let mut scale = 0.0;
+
+        try_seal!(unsafe { bindgen::Ciphertext_Scale(self.get_handle(), &mut scale) })
+            .expect("Fatal error in Ciphertext::scale().");
+
+        scale
+    }
+
+    /// Returns the correction factor of the ciphertext. Only meaningful with BGV.
+    pub fn correction_factor(&self) -> u64 {
+        let mut factor: u64 = 0;
+
+        try_seal!(unsafe { bindgen::Ciphertext_CorrectionFactor(self.get_handle(), &mut factor) })
+            .expect("Fatal error in Ciphertext::correction_factor().");
+
+        factor
+    }
 }
 
 impl Debug for Ciphertext {
@@ -126,21 +261,23 @@ impl AsRef<Self> for Ciphertext {
 }
 
 impl PartialEq for Ciphertext {
+    /// Compares the metadata SEAL serializes with the ciphertext, then its coefficients.
     fn eq(&self, other: &Self) -> bool {
-        self.as_bytes() == other.as_bytes()
+        self.parms_id() == other.parms_id()
+            && self.is_ntt_form() == other.is_ntt_form()
+            && self.scale().to_bits() == other.scale().to_bits()
+            && self.correction_factor() == other.correction_factor()
+            && self.data() == other.data()
     }
 }
 
-impl ToBytes for Ciphertext {
-    fn as_bytes(&self) -> Result<Vec<u8>> {
+impl Ciphertext {
+    /// Saves the ciphertext as SEAL does, with the given compression.
+    fn save(&self, compression: CompressionType) -> Result<Vec<u8>> {
         let mut num_bytes: i64 = 0;
 
         try_seal!(unsafe {
-            bindgen::Ciphertext_SaveSize(
-                self.get_handle(),
-                CompressionType::ZStd as u8,
-                &mut num_bytes,
-            )
+            bindgen::Ciphertext_SaveSize(self.get_handle(), compression as u8, &mut num_bytes)
         })?;
 
         let mut data: Vec<u8> = Vec::with_capacity(usize::try_from(num_bytes).unwrap());
@@ -153,7 +290,7 @@ impl ToBytes for Ciphertext {
                 self.get_handle(),
                 data_ptr,
                 u64::try_from(num_bytes).unwrap(),
-                CompressionType::ZStd as u8,
+                compression as u8,
                 &mut bytes_written,
             )
         })?;
@@ -164,26 +301,80 @@ impl ToBytes for Ciphertext {
     }
 }
 
+impl ToBytes for Ciphertext {
+    fn as_bytes(&self) -> Result<Vec<u8>> {
+        self.save(CompressionType::ZStd)
+    }
+}
+
 impl FromBytes for Ciphertext {
     type State = Context;
     fn from_bytes(context: &Context, bytes: &[u8]) -> Result<Self> {
         let ciphertext = Self::new()?;
-        let mut bytes_read = 0_i64;
-
-        try_seal!(unsafe {
-            bindgen::Ciphertext_Load(
-                ciphertext.get_handle(),
-                context.get_handle(),
-                bytes.as_ptr().cast_mut(),
-                u64::try_from(bytes.len()).unwrap(),
-                &mut bytes_read,
-            )
-        })?;
+        ciphertext.load(context, bytes)?;
 
         Ok(ciphertext)
     }
 }
 
+/// The coefficients of the polynomials of a [`Ciphertext`], borrowed from it, e.g. to compare,
+/// hash or checksum them, or to run kernels over them in Rust.
+///
+/// They are stored polynomial by polynomial, and within a polynomial RNS limb by RNS limb (one
+/// per component of the coefficient modulus), as in SEAL.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct CiphertextData<'a> {
+    data: &'a [u64],
+    limbs: usize,
+    degree: usize,
+}
+
+impl<'a> CiphertextData<'a> {
+    /// Returns the coefficients of all polynomials.
+    pub const fn as_slice(&self) -> &'a [u64] {
+        self.data
+    }
+
+    /// Returns the number of polynomials.
+    pub fn num_polynomials(&self) -> usize {
+        self.data.len() / (self.limbs * self.degree).max(1)
+    }
+
+    /// Returns the number of RNS limbs of each polynomial.
+    pub const fn coeff_modulus_size(&self) -> usize {
+        self.limbs
+    }
+
+    /// Returns the number of coefficients of each RNS limb.
+    pub const fn poly_modulus_degree(&self) -> usize {
+        self.degree
+    }
+
+    /// Returns the coefficients of a polynomial, RNS limb by RNS limb.
+    ///
+    /// # Panics
+    /// Panics if `poly_index` is not less than [`Self::num_polynomials`].
+    pub fn polynomial(&self, poly_index: usize) -> &'a [u64] {
+        let len = self.limbs * self.degree;
+        &self.data[poly_index * len..(poly_index + 1) * len]
+    }
+
+    /// Returns the coefficients of a polynomial modulo a component of the coefficient
+    /// modulus.
+    ///
+    /// # Panics
+    /// Panics if `poly_index` or `limb_index` are out of bounds.
+    pub fn limb(&self, poly_index: usize, limb_index: usize) -> &'a [u64] {
+        assert!(
+            limb_index < self.limbs,
+            "Index {limb_index} out of bounds {}",
+            self.limbs
+        );
+        let start = limb_index * self.degree;
+        &self.polynomial(poly_index)[start..start + self.degree]
+    }
+}
+
 impl Drop for Ciphertext {
     fn drop(&mut self) {
         try_seal!(unsafe { bindgen::Ciphertext_Destroy(self.get_handle()) })
@@ -194,6 +385,10 @@ impl Drop for Ciphertext {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use crate::{
+        BFVEncryptionParametersBuilder, CoefficientModulusFactory, DegreeType, Encryptor,
+        KeyGenerator, Plaintext, SecurityLevel,
+    };
 
     #[test]
     fn can_create_and_destroy_ciphertext() {
@@ -201,4 +396,72 @@ mod tests {
 
         std::mem::drop(ciphertext);
     }
+
+    #[test]
+    fn can_create_ciphertext_with_pool() {
+        let memory_pool = MemoryPool::new().unwrap();
+        let ciphertext = Ciphertext::new_with_pool(&memory_pool).unwrap();
+
+        // The ciphertext keeps the pool alive.
+        std::mem::drop(memory_pool);
+        std::mem::drop(ciphertext);
+    }
+
+    #[test]
+    fn data_matches_coefficients() {
+        let params = BFVEncryptionParametersBuilder::new()
+            .set_poly_modulus_degree(DegreeType::D4096)
+            .set_coefficient_modulus(
+                CoefficientModulusFactory::build(DegreeType::D4096, &[36, 36, 37]).unwrap(),
+            )
+            .set_plain_modulus_u64(1234)
+            .build()
+            .unwrap();
+        let ctx = Context::new(&params, false, SecurityLevel::TC128).unwrap();
+        let key_gen = KeyGenerator::new(&ctx).unwrap();
+        let encryptor = Encryptor::with_public_key(&ctx, &key_gen.create_public_key()).unwrap();
+        let plaintext = Plaintext::from_hex_string("12x^2 + 43").unwrap();
+        let ciphertext = encryptor.encrypt(&plaintext).unwrap();
+
+        let data = ciphertext.data();
+        assert_eq!(data.num_polynomials(), 2);
+        assert_eq!(data.coeff_modulus_size(), 2);
+        assert_eq!(data.poly_modulus_degree(), 4096);
+        assert_eq!(data.as_slice().len(), 2 * 2 * 4096);
+        for poly in 0..2 {
+            for coeff in [0, 1, 4095] {
+                let rns = ciphertext.get_coefficient(poly, coeff).unwrap();
+                assert_eq!(data.limb(poly, 0)[coeff], rns[0]);
+                assert_eq!(data.limb(poly, 1)[coeff], rns[1]);
+            }
+        }
+
+        assert!(ciphertext == ciphertext.clone());
+        assert!(ciphertext != encryptor.encrypt(&plaintext).unwrap());
+    }
+
+    #[test]
+    fn equality_covers_metadata() {
+        let params = BFVEncryptionParametersBuilder::new()
+            .set_poly_modulus_degree(DegreeType::D4096)
+            .set_coefficient_modulus(
+                CoefficientModulusFactory::build(DegreeType::D4096, &[36, 36, 37]).unwrap(),
+            )
+            .set_plain_modulus_u64(1234)
+            .build()
+            .unwrap();
+        let ctx = Context::new(&params, false, SecurityLevel::TC128).unwrap();
+        let key_gen = KeyGenerator::new(&ctx).unwrap();
+        let encryptor = Encryptor::with_public_key(&ctx, &key_gen.create_public_key()).unwrap();
+        let ciphertext = encryptor
+            .encrypt(&Plaintext::from_hex_string("12x^2 + 43").unwrap())
+            .unwrap();
+        assert_eq!(ciphertext.parms_id(), ctx.get_first_parms_id().unwrap()[..]);
+
+        // Same coefficients, different scale.
+        let scaled = ciphertext.clone();
+        try_seal!(unsafe { bindgen::Ciphertext_SetScale(scaled.get_handle(), 2.0) }).unwrap();
+        assert_eq!(scaled.data(), ciphertext.data());
+        assert!(scaled != ciphertext);
+    }
 }
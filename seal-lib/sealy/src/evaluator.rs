@@ -98,14 +98,14 @@ pub trait Evaluator {
     /// If you haven't set up a modulus chain, don't use this.
     ///
     /// TODO: what does this mean for CKKS?
-    fn mod_switch_to_next_inplace(&self, a: &Self::Ciphertext) -> Result<()>;
+    fn mod_switch_to_next_inplace(&self, a: &mut Self::Ciphertext) -> Result<()>;
 
     /// Modulus switches an NTT transformed plaintext from modulo q_1...q_k down to modulo q_1...q_{k-1}.
     fn mod_switch_to_next_plaintext(&self, a: &Self::Plaintext) -> Result<Self::Plaintext>;
 
     /// Modulus switches an NTT transformed plaintext from modulo q_1...q_k down to modulo q_1...q_{k-1}.
     /// This variant does so in-place.
-    fn mod_switch_to_next_inplace_plaintext(&self, a: &Self::Plaintext) -> Result<()>;
+    fn mod_switch_to_next_inplace_plaintext(&self, a: &mut Self::Plaintext) -> Result<()>;
 
     /// This functions raises encrypted to a power and stores the result in the destination parameter. Dynamic
     /// memory allocations in the process are allocated from the memory pool pointed to by the given
@@ -126,7 +126,7 @@ pub trait Evaluator {
     /// are used.
     fn exponentiate_inplace(
         &self,
-        a: &Self::Ciphertext,
+        a: &mut Self::Ciphertext,
         exponent: u64,
         relin_keys: &RelinearizationKey,
     ) -> Result<()>;
@@ -207,7 +207,7 @@ pub trait Evaluator {
     /// * `galois_keys` - The Galois keys
     fn rotate_rows_inplace(
         &self,
-        a: &Self::Ciphertext,
+        a: &mut Self::Ciphertext,
         steps: i32,
         galois_keys: &GaloisKey,
     ) -> Result<()>;
@@ -236,5 +236,9 @@ pub trait Evaluator {
     ///
     /// * `encrypted` - The ciphertext to rotate
     /// * `galoisKeys` - The Galois keys
-    fn rotate_columns_inplace(&self, a: &Self::Ciphertext, galois_keys: &GaloisKey) -> Result<()>;
+    fn rotate_columns_inplace(
+        &self,
+        a: &mut Self::Ciphertext,
+        galois_keys: &GaloisKey,
+    ) -> Result<()>;
 }
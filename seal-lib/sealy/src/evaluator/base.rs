@@ -6,10 +6,12 @@ use std::sync::atomic::Ordering;
 use crate::bindgen;
 use crate::error::Result;
 use crate::try_seal;
-use crate::{Ciphertext, Context, Plaintext, RelinearizationKey};
+use crate::{Ciphertext, Context, MemoryPool, Plaintext, RelinearizationKey};
 
 pub struct EvaluatorBase {
     handle: AtomicPtr<c_void>,
+    /// Pool of the results and temporaries, SEAL's global pool if `None`.
+    pool: Option<MemoryPool>,
 }
 
 impl EvaluatorBase {
@@ -22,14 +24,41 @@ impl EvaluatorBase {
 
         Ok(Self {
             handle: AtomicPtr::new(handle),
+            pool: None,
         })
     }
 
+    /// Creates an Evaluator instance that allocates the ciphertexts it returns, and its
+    /// temporaries, from the given memory pool rather than from SEAL's global pool.
+    /// * `ctx` - The context.
+    /// * `pool` - The memory pool.
+    pub(crate) fn with_pool(ctx: &Context, pool: MemoryPool) -> Result<Self> {
+        let mut evaluator = Self::new(ctx)?;
+        evaluator.pool = Some(pool);
+
+        Ok(evaluator)
+    }
+
     /// Gets the handle to the internal SEAL object.
     pub(crate) unsafe fn get_handle(&self) -> *mut c_void {
         self.handle.load(Ordering::SeqCst)
     }
 
+    /// Gets the handle to the memory pool, null for SEAL's global pool.
+    pub(crate) unsafe fn pool_handle(&self) -> *mut c_void {
+        self.pool
+            .as_ref()
+            .map_or(null_mut(), |pool| unsafe { pool.get_handle() })
+    }
+
+    /// Creates an empty ciphertext to hold a result.
+    pub(crate) fn ciphertext(&self) -> Result<Ciphertext> {
+        match &self.pool {
+            Some(pool) => Ciphertext::new_with_pool(pool),
+            None => Ciphertext::new(),
+        }
+    }
+
     /// Negates a ciphertext and stores the result inplace.
     pub(crate) fn negate_inplace(&self, a: &Ciphertext) -> Result<()> {
         try_seal!(unsafe {
@@ -40,7 +69,7 @@ impl EvaluatorBase {
     }
 
     pub(crate) fn negate(&self, a: &Ciphertext) -> Result<Ciphertext> {
-        let out = Ciphertext::new()?;
+        let out = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_Negate(self.get_handle(), a.get_handle(), out.get_handle())
@@ -63,7 +92,7 @@ impl EvaluatorBase {
     }
 
     pub(crate) fn add(&self, a: &Ciphertext, b: &Ciphertext) -> Result<Ciphertext> {
-        let c = Ciphertext::new()?;
+        let c = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_Add(
@@ -78,7 +107,7 @@ impl EvaluatorBase {
     }
 
     pub(crate) fn add_many(&self, a: &[Ciphertext]) -> Result<Ciphertext> {
-        let c = Ciphertext::new()?;
+        let c = self.ciphertext()?;
 
         let mut a_ptr = unsafe {
             a.iter()
@@ -103,7 +132,7 @@ impl EvaluatorBase {
         a: &[Ciphertext],
         relin_keys: &RelinearizationKey,
     ) -> Result<Ciphertext> {
-        let c = Ciphertext::new()?;
+        let c = self.ciphertext()?;
 
         let mut a_ptr = unsafe {
             a.iter()
@@ -111,8 +140,6 @@ impl EvaluatorBase {
                 .collect::<Vec<*mut c_void>>()
         };
 
-        // let mem = MemoryPool::new()?;
-
         try_seal!(unsafe {
             bindgen::Evaluator_MultiplyMany(
                 self.get_handle(),
@@ -120,8 +147,7 @@ impl EvaluatorBase {
                 a_ptr.as_mut_ptr(),
                 relin_keys.get_handle(),
                 c.get_handle(),
-                null_mut(),
-                // mem.get_handle(),
+                self.pool_handle(),
             )
         })?;
 
@@ -142,7 +168,7 @@ impl EvaluatorBase {
     }
 
     pub(crate) fn sub(&self, a: &Ciphertext, b: &Ciphertext) -> Result<Ciphertext> {
-        let c = Ciphertext::new()?;
+        let c = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_Sub(
@@ -163,7 +189,7 @@ impl EvaluatorBase {
                 a.get_handle(),
                 b.get_handle(),
                 a.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -171,7 +197,7 @@ impl EvaluatorBase {
     }
 
     pub(crate) fn multiply(&self, a: &Ciphertext, b: &Ciphertext) -> Result<Ciphertext> {
-        let c = Ciphertext::new()?;
+        let c = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_Multiply(
@@ -179,7 +205,7 @@ impl EvaluatorBase {
                 a.get_handle(),
                 b.get_handle(),
                 c.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -192,7 +218,7 @@ impl EvaluatorBase {
                 self.get_handle(),
                 a.get_handle(),
                 a.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -200,14 +226,14 @@ impl EvaluatorBase {
     }
 
     pub(crate) fn square(&self, a: &Ciphertext) -> Result<Ciphertext> {
-        let c = Ciphertext::new()?;
+        let c = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_Square(
                 self.get_handle(),
                 a.get_handle(),
                 c.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -215,14 +241,14 @@ impl EvaluatorBase {
     }
 
     pub(crate) fn mod_switch_to_next(&self, a: &Ciphertext) -> Result<Ciphertext> {
-        let c = Ciphertext::new()?;
+        let c = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_ModSwitchToNext1(
                 self.get_handle(),
                 a.get_handle(),
                 c.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -235,7 +261,7 @@ impl EvaluatorBase {
                 self.get_handle(),
                 a.get_handle(),
                 a.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -266,7 +292,7 @@ impl EvaluatorBase {
         exponent: u64,
         relin_keys: &RelinearizationKey,
     ) -> Result<Ciphertext> {
-        let c = Ciphertext::new()?;
+        let c = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_Exponentiate(
@@ -275,7 +301,7 @@ impl EvaluatorBase {
                 exponent,
                 relin_keys.get_handle(),
                 c.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -295,7 +321,7 @@ impl EvaluatorBase {
                 exponent,
                 relin_keys.get_handle(),
                 a.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -303,7 +329,7 @@ impl EvaluatorBase {
     }
 
     pub(crate) fn add_plain(&self, a: &Ciphertext, b: &Plaintext) -> Result<Ciphertext> {
-        let c = Ciphertext::new()?;
+        let c = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_AddPlain(
@@ -331,7 +357,7 @@ impl EvaluatorBase {
     }
 
     pub(crate) fn sub_plain(&self, a: &Ciphertext, b: &Plaintext) -> Result<Ciphertext> {
-        let c = Ciphertext::new()?;
+        let c = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_SubPlain(
@@ -359,7 +385,7 @@ impl EvaluatorBase {
     }
 
     pub(crate) fn multiply_plain(&self, a: &Ciphertext, b: &Plaintext) -> Result<Ciphertext> {
-        let c = Ciphertext::new()?;
+        let c = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_MultiplyPlain(
@@ -367,7 +393,7 @@ impl EvaluatorBase {
                 a.get_handle(),
                 b.get_handle(),
                 c.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -381,7 +407,7 @@ impl EvaluatorBase {
                 a.get_handle(),
                 b.get_handle(),
                 a.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -1,9 +1,7 @@
-use std::ptr::null_mut;
-
 use crate::evaluator::base::EvaluatorBase;
 use crate::{
-    Ciphertext, Context, Evaluator, GaloisKey, Plaintext, RelinearizationKey, Result, bindgen,
-    try_seal,
+    Ciphertext, Context, Evaluator, GaloisKey, MemoryPool, Plaintext, RelinearizationKey, Result,
+    bindgen, try_seal,
 };
 
 /// An evaluator that contains additional operations specific to the BFV scheme.
@@ -23,6 +21,15 @@ impl BFVEvaluator {
     pub fn new(ctx: &Context) -> Result<Self> {
         Ok(Self(EvaluatorBase::new(ctx)?))
     }
+
+    /// Creates a BFVEvaluator instance that allocates its results and
+    /// temporaries from the given memory pool, e.g. to keep them on the NUMA
+    /// node of the threads using it.
+    ///  * `ctx` - The context.
+    ///  * `pool` - The memory pool.
+    pub fn with_pool(ctx: &Context, pool: MemoryPool) -> Result<Self> {
+        Ok(Self(EvaluatorBase::with_pool(ctx, pool)?))
+    }
 }
 
 impl Evaluator for BFVEvaluator {
@@ -85,7 +92,7 @@ impl Evaluator for BFVEvaluator {
         self.0.mod_switch_to_next(a)
     }
 
-    fn mod_switch_to_next_inplace(&self, a: &Ciphertext) -> Result<()> {
+    fn mod_switch_to_next_inplace(&self, a: &mut Ciphertext) -> Result<()> {
         self.0.mod_switch_to_next_inplace(a)
     }
 
@@ -93,7 +100,7 @@ impl Evaluator for BFVEvaluator {
         self.0.mod_switch_to_next_plaintext(a)
     }
 
-    fn mod_switch_to_next_inplace_plaintext(&self, a: &Plaintext) -> Result<()> {
+    fn mod_switch_to_next_inplace_plaintext(&self, a: &mut Plaintext) -> Result<()> {
         self.0.mod_switch_to_next_inplace_plaintext(a)
     }
 
@@ -108,7 +115,7 @@ impl Evaluator for BFVEvaluator {
 
     fn exponentiate_inplace(
         &self,
-        a: &Ciphertext,
+        a: &mut Ciphertext,
         exponent: u64,
         relin_keys: &RelinearizationKey,
     ) -> Result<()> {
@@ -150,7 +157,7 @@ impl Evaluator for BFVEvaluator {
                 a.get_handle(),
                 relin_keys.get_handle(),
                 a.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -158,7 +165,7 @@ impl Evaluator for BFVEvaluator {
     }
 
     fn relinearize(&self, a: &Ciphertext, relin_keys: &RelinearizationKey) -> Result<Ciphertext> {
-        let out = Ciphertext::new()?;
+        let out = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_Relinearize(
@@ -166,7 +173,7 @@ impl Evaluator for BFVEvaluator {
                 a.get_handle(),
                 relin_keys.get_handle(),
                 out.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -179,7 +186,7 @@ impl Evaluator for BFVEvaluator {
         steps: i32,
         galois_keys: &GaloisKey,
     ) -> Result<Ciphertext> {
-        let out = Ciphertext::new()?;
+        let out = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_RotateRows(
@@ -188,7 +195,7 @@ impl Evaluator for BFVEvaluator {
                 steps,
                 galois_keys.get_handle(),
                 out.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -197,7 +204,7 @@ impl Evaluator for BFVEvaluator {
 
     fn rotate_rows_inplace(
         &self,
-        a: &Ciphertext,
+        a: &mut Ciphertext,
         steps: i32,
         galois_keys: &GaloisKey,
     ) -> Result<()> {
@@ -208,7 +215,7 @@ impl Evaluator for BFVEvaluator {
                 steps,
                 galois_keys.get_handle(),
                 a.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -216,7 +223,7 @@ impl Evaluator for BFVEvaluator {
     }
 
     fn rotate_columns(&self, a: &Ciphertext, galois_keys: &GaloisKey) -> Result<Ciphertext> {
-        let out = Ciphertext::new()?;
+        let out = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_RotateColumns(
@@ -224,21 +231,21 @@ impl Evaluator for BFVEvaluator {
                 a.get_handle(),
                 galois_keys.get_handle(),
                 out.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
         Ok(out)
     }
 
-    fn rotate_columns_inplace(&self, a: &Ciphertext, galois_keys: &GaloisKey) -> Result<()> {
+    fn rotate_columns_inplace(&self, a: &mut Ciphertext, galois_keys: &GaloisKey) -> Result<()> {
         try_seal!(unsafe {
             bindgen::Evaluator_RotateColumns(
                 self.get_handle(),
                 a.get_handle(),
                 galois_keys.get_handle(),
                 a.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -550,6 +557,75 @@ mod tests {
         });
     }
 
+    #[test]
+    fn can_multiply_with_pool() {
+        let params = BFVEncryptionParametersBuilder::new()
+            .set_poly_modulus_degree(DegreeType::D8192)
+            .set_coefficient_modulus(
+                CoefficientModulusFactory::build(DegreeType::D8192, &[50, 30, 30, 50, 50]).unwrap(),
+            )
+            .set_plain_modulus(PlainModulusFactory::batching(DegreeType::D8192, 32).unwrap())
+            .build()
+            .unwrap();
+
+        let ctx = Context::new(&params, false, SecurityLevel::TC128).unwrap();
+        let key_gen = KeyGenerator::new(&ctx).unwrap();
+        let encoder = BFVEncoder::new(&ctx).unwrap();
+        let encryptor = Encryptor::with_public_key(&ctx, &key_gen.create_public_key()).unwrap();
+        let decryptor = Decryptor::new(&ctx, &key_gen.secret_key()).unwrap();
+        let evaluator = BFVEvaluator::with_pool(&ctx, MemoryPool::new().unwrap()).unwrap();
+
+        let a = make_small_vec(&encoder);
+        let a_c = encryptor.encrypt(&encoder.encode_i64(&a).unwrap()).unwrap();
+
+        let b_c = evaluator.multiply(&a_c, &a_c).unwrap();
+        let b: Vec<i64> = encoder
+            .decode_i64(&decryptor.decrypt(&b_c).unwrap())
+            .unwrap();
+
+        for i in 0..a.len() {
+            assert_eq!(b[i], a[i] * a[i]);
+        }
+    }
+
+    #[test]
+    fn can_multiply_with_huge_page_pool() {
+        let params = BFVEncryptionParametersBuilder::new()
+            .set_poly_modulus_degree(DegreeType::D8192)
+            .set_coefficient_modulus(
+                CoefficientModulusFactory::build(DegreeType::D8192, &[50, 30, 30, 50, 50]).unwrap(),
+            )
+            .set_plain_modulus(PlainModulusFactory::batching(DegreeType::D8192, 32).unwrap())
+            .build()
+            .unwrap();
+
+        let ctx = Context::new(&params, false, SecurityLevel::TC128).unwrap();
+        let key_gen = KeyGenerator::new(&ctx).unwrap();
+        let encoder = BFVEncoder::new(&ctx).unwrap();
+        let encryptor = Encryptor::with_public_key(&ctx, &key_gen.create_public_key()).unwrap();
+        let decryptor = Decryptor::new(&ctx, &key_gen.secret_key()).unwrap();
+        let pool = MemoryPool::with_huge_pages().unwrap();
+        let evaluator = BFVEvaluator::with_pool(&ctx, pool.clone()).unwrap();
+
+        let a = make_small_vec(&encoder);
+        let a_c = encryptor.encrypt(&encoder.encode_i64(&a).unwrap()).unwrap();
+
+        let b_c = evaluator.multiply(&a_c, &a_c).unwrap();
+        let b: Vec<i64> = encoder
+            .decode_i64(&decryptor.decrypt(&b_c).unwrap())
+            .unwrap();
+
+        for i in 0..a.len() {
+            assert_eq!(b[i], a[i] * a[i]);
+        }
+
+        // Allocated by whole huge pages.
+        let allocated = pool.pool_allocated_byte_count().unwrap();
+        assert!(allocated > 0);
+        assert_eq!(allocated % (2 << 20), 0);
+        assert!(pool.huge_page_byte_count().unwrap() <= allocated);
+    }
+
     #[test]
     fn can_multiply_inplace() {
         run_bfv_test(|decryptor, encoder, encryptor, evaluator, _| {
@@ -707,10 +783,10 @@ mod tests {
 
             let a = make_small_vec(&encoder);
             let a_p = encoder.encode_i64(&a).unwrap();
-            let a_c = encryptor.encrypt(&a_p).unwrap();
+            let mut a_c = encryptor.encrypt(&a_p).unwrap();
 
             evaluator
-                .exponentiate_inplace(&a_c, 4, &relin_keys)
+                .exponentiate_inplace(&mut a_c, 4, &relin_keys)
                 .unwrap();
 
             let a_p = decryptor.decrypt(&a_c).unwrap();
@@ -906,10 +982,10 @@ mod tests {
 
             let a = make_matrix(&encoder);
             let a_p = encoder.encode_i64(&a).unwrap();
-            let a_c = encryptor.encrypt(&a_p).unwrap();
+            let mut a_c = encryptor.encrypt(&a_p).unwrap();
 
             evaluator
-                .rotate_rows_inplace(&a_c, -1, &galois_keys.unwrap())
+                .rotate_rows_inplace(&mut a_c, -1, &galois_keys.unwrap())
                 .unwrap();
 
             let a_p = decryptor.decrypt(&a_c).unwrap();
@@ -952,10 +1028,10 @@ mod tests {
 
             let a = make_matrix(&encoder);
             let a_p = encoder.encode_i64(&a).unwrap();
-            let a_c = encryptor.encrypt(&a_p).unwrap();
+            let mut a_c = encryptor.encrypt(&a_p).unwrap();
 
             evaluator
-                .rotate_columns_inplace(&a_c, &galois_keys.unwrap())
+                .rotate_columns_inplace(&mut a_c, &galois_keys.unwrap())
                 .unwrap();
 
             let a_p = decryptor.decrypt(&a_c).unwrap();
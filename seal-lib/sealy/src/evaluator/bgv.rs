@@ -1,9 +1,7 @@
-use std::ptr::null_mut;
-
 use crate::evaluator::base::EvaluatorBase;
 use crate::{
-    Ciphertext, Context, Evaluator, GaloisKey, Plaintext, RelinearizationKey, Result, bindgen,
-    try_seal,
+    Ciphertext, Context, Evaluator, GaloisKey, MemoryPool, Plaintext, RelinearizationKey, Result,
+    bindgen, try_seal,
 };
 
 /// An evaluator that contains additional operations specific to the BGV scheme.
@@ -23,6 +21,14 @@ impl BGVEvaluator {
     pub fn new(ctx: &Context) -> Result<Self> {
         Ok(Self(EvaluatorBase::new(ctx)?))
     }
+
+    /// Creates a BGVEvaluator instance that allocates its results and
+    /// temporaries from the given memory pool.
+    ///  * `ctx` - The context.
+    ///  * `pool` - The memory pool.
+    pub fn with_pool(ctx: &Context, pool: MemoryPool) -> Result<Self> {
+        Ok(Self(EvaluatorBase::with_pool(ctx, pool)?))
+    }
 }
 
 impl Evaluator for BGVEvaluator {
@@ -85,7 +91,7 @@ impl Evaluator for BGVEvaluator {
         self.0.mod_switch_to_next(a)
     }
 
-    fn mod_switch_to_next_inplace(&self, a: &Ciphertext) -> Result<()> {
+    fn mod_switch_to_next_inplace(&self, a: &mut Ciphertext) -> Result<()> {
         self.0.mod_switch_to_next_inplace(a)
     }
 
@@ -93,7 +99,7 @@ impl Evaluator for BGVEvaluator {
         self.0.mod_switch_to_next_plaintext(a)
     }
 
-    fn mod_switch_to_next_inplace_plaintext(&self, a: &Plaintext) -> Result<()> {
+    fn mod_switch_to_next_inplace_plaintext(&self, a: &mut Plaintext) -> Result<()> {
         self.0.mod_switch_to_next_inplace_plaintext(a)
     }
 
@@ -108,7 +114,7 @@ impl Evaluator for BGVEvaluator {
 
     fn exponentiate_inplace(
         &self,
-        a: &Ciphertext,
+        a: &mut Ciphertext,
         exponent: u64,
         relin_keys: &RelinearizationKey,
     ) -> Result<()> {
@@ -150,7 +156,7 @@ impl Evaluator for BGVEvaluator {
                 a.get_handle(),
                 relin_keys.get_handle(),
                 a.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -158,7 +164,7 @@ impl Evaluator for BGVEvaluator {
     }
 
     fn relinearize(&self, a: &Ciphertext, relin_keys: &RelinearizationKey) -> Result<Ciphertext> {
-        let out = Ciphertext::new()?;
+        let out = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_Relinearize(
@@ -166,7 +172,7 @@ impl Evaluator for BGVEvaluator {
                 a.get_handle(),
                 relin_keys.get_handle(),
                 out.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -179,7 +185,7 @@ impl Evaluator for BGVEvaluator {
         steps: i32,
         galois_keys: &GaloisKey,
     ) -> Result<Ciphertext> {
-        let out = Ciphertext::new()?;
+        let out = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_RotateRows(
@@ -188,7 +194,7 @@ impl Evaluator for BGVEvaluator {
                 steps,
                 galois_keys.get_handle(),
                 out.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -197,7 +203,7 @@ impl Evaluator for BGVEvaluator {
 
     fn rotate_rows_inplace(
         &self,
-        a: &Ciphertext,
+        a: &mut Ciphertext,
         steps: i32,
         galois_keys: &GaloisKey,
     ) -> Result<()> {
@@ -208,7 +214,7 @@ impl Evaluator for BGVEvaluator {
                 steps,
                 galois_keys.get_handle(),
                 a.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -216,7 +222,7 @@ impl Evaluator for BGVEvaluator {
     }
 
     fn rotate_columns(&self, a: &Ciphertext, galois_keys: &GaloisKey) -> Result<Ciphertext> {
-        let out = Ciphertext::new()?;
+        let out = self.ciphertext()?;
 
         try_seal!(unsafe {
             bindgen::Evaluator_RotateColumns(
@@ -224,21 +230,21 @@ impl Evaluator for BGVEvaluator {
                 a.get_handle(),
                 galois_keys.get_handle(),
                 out.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
         Ok(out)
     }
 
-    fn rotate_columns_inplace(&self, a: &Ciphertext, galois_keys: &GaloisKey) -> Result<()> {
+    fn rotate_columns_inplace(&self, a: &mut Ciphertext, galois_keys: &GaloisKey) -> Result<()> {
         try_seal!(unsafe {
             bindgen::Evaluator_RotateColumns(
                 self.get_handle(),
                 a.get_handle(),
                 galois_keys.get_handle(),
                 a.get_handle(),
-                null_mut(),
+                self.pool_handle(),
             )
         })?;
 
@@ -823,10 +829,10 @@ mod tests {
 
             let a = make_matrix(&encoder);
             let a_p = encoder.encode_i64(&a).unwrap();
-            let a_c = encryptor.encrypt(&a_p).unwrap();
+            let mut a_c = encryptor.encrypt(&a_p).unwrap();
 
             evaluator
-                .rotate_rows_inplace(&a_c, -1, &galois_keys.unwrap())
+                .rotate_rows_inplace(&mut a_c, -1, &galois_keys.unwrap())
                 .unwrap();
 
             let a_p = decryptor.decrypt(&a_c).unwrap();
@@ -869,10 +875,10 @@ mod tests {
 
             let a = make_matrix(&encoder);
             let a_p = encoder.encode_i64(&a).unwrap();
-            let a_c = encryptor.encrypt(&a_p).unwrap();
+            let mut a_c = encryptor.encrypt(&a_p).unwrap();
 
             evaluator
-                .rotate_columns_inplace(&a_c, &galois_keys.unwrap())
+                .rotate_columns_inplace(&mut a_c, &galois_keys.unwrap())
                 .unwrap();
 
             let a_p = decryptor.decrypt(&a_c).unwrap();
@@ -147,8 +147,8 @@ where
             .collect()
     }
 
-    fn mod_switch_to_next_inplace(&self, a: &Self::Ciphertext) -> Result<()> {
-        for value in a {
+    fn mod_switch_to_next_inplace(&self, a: &mut Self::Ciphertext) -> Result<()> {
+        for value in a.iter_mut() {
             self.evaluator.mod_switch_to_next_inplace(value)?;
         }
 
@@ -160,8 +160,8 @@ where
             .collect()
     }
 
-    fn mod_switch_to_next_inplace_plaintext(&self, a: &Self::Plaintext) -> Result<()> {
-        for value in a {
+    fn mod_switch_to_next_inplace_plaintext(&self, a: &mut Self::Plaintext) -> Result<()> {
+        for value in a.iter_mut() {
             self.evaluator.mod_switch_to_next_inplace_plaintext(value)?;
         }
 
@@ -180,11 +180,11 @@ where
 
     fn exponentiate_inplace(
         &self,
-        a: &Self::Ciphertext,
+        a: &mut Self::Ciphertext,
         exponent: u64,
         relin_keys: &RelinearizationKey,
     ) -> Result<()> {
-        for value in a {
+        for value in a.iter_mut() {
             self.evaluator
                 .exponentiate_inplace(value, exponent, relin_keys)?;
         }
@@ -266,11 +266,11 @@ where
 
     fn rotate_rows_inplace(
         &self,
-        a: &Self::Ciphertext,
+        a: &mut Self::Ciphertext,
         steps: i32,
         galois_keys: &GaloisKey,
     ) -> Result<()> {
-        for value in a {
+        for value in a.iter_mut() {
             self.evaluator
                 .rotate_rows_inplace(value, steps, galois_keys)?;
         }
@@ -287,8 +287,12 @@ where
             .collect()
     }
 
-    fn rotate_columns_inplace(&self, a: &Self::Ciphertext, galois_keys: &GaloisKey) -> Result<()> {
-        for value in a {
+    fn rotate_columns_inplace(
+        &self,
+        a: &mut Self::Ciphertext,
+        galois_keys: &GaloisKey,
+    ) -> Result<()> {
+        for value in a.iter_mut() {
             self.evaluator.rotate_columns_inplace(value, galois_keys)?;
         }
 
@@ -40,7 +40,7 @@ mod parameters;
 mod plaintext;
 mod serialization;
 
-pub use ciphertext::Ciphertext;
+pub use ciphertext::{Ciphertext, CiphertextData};
 pub use components::{Asym, Sym, SymAsym, marker as component_marker};
 pub use context::Context;
 pub use decryptor::Decryptor;
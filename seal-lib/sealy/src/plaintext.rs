@@ -4,7 +4,8 @@ use std::fmt::Debug;
 use std::ptr::null_mut;
 use std::sync::atomic::{AtomicPtr, Ordering};
 
-use crate::{Context, FromBytes, ToBytes, bindgen, serialization::CompressionType};
+use crate::serialization::CompressionType;
+use crate::{Context, FromBytes, ToBytes, bindgen};
 use crate::{MemoryPool, error::Result, try_seal};
 
 use serde::ser::Error;
@@ -107,6 +108,23 @@ impl Plaintext {
         coeff
     }
 
+    /// Returns all the coefficients, from lowest to highest degree, borrowed
+    /// from SEAL's buffer rather than copied out one by one as with
+    /// [`Self::get_coefficient`].
+    pub fn data(&self) -> &[u64] {
+        let mut data = null_mut();
+        let mut count: u64 = 0;
+
+        try_seal!(unsafe { bindgen::Plaintext_Data(self.get_handle(), &mut data, &mut count) })
+            .expect("Fatal error in Plaintext::data().");
+
+        if count == 0 {
+            return &[];
+        }
+        // The buffer is only modified or freed through `&mut self`, or on drop.
+        unsafe { std::slice::from_raw_parts(data, usize::try_from(count).unwrap()) }
+    }
+
     /// Sets the coefficient at the given location. Coefficients are ordered
     /// from lowest to highest degree, with the first value being the constant
     /// coefficient.
@@ -191,24 +209,13 @@ impl AsRef<Self> for Plaintext {
 
 impl PartialEq for Plaintext {
     fn eq(&self, other: &Self) -> bool {
-        if self.len() == other.len() {
-            for i in 0..self.len() {
-                if self.get_coefficient(i) != other.get_coefficient(i) {
-                    return false;
-                }
-            }
-
-            true
-        } else {
-            false
-        }
+        self.data() == other.data()
     }
 }
 
 impl Hash for Plaintext {
     fn hash<H: std::hash::Hasher>(&self, state: &mut H) {
-        for i in 0..self.len() {
-            let c = self.get_coefficient(i);
+        for &c in self.data() {
             state.write_u64(c);
         }
     }
@@ -262,16 +269,13 @@ impl FromBytes for Plaintext {
     }
 }
 
-impl ToBytes for Plaintext {
-    fn as_bytes(&self) -> Result<Vec<u8>> {
+impl Plaintext {
+    /// Saves the plaintext as SEAL does, with the given compression.
+    fn save(&self, compression: CompressionType) -> Result<Vec<u8>> {
         let mut num_bytes: i64 = 0;
 
         try_seal!(unsafe {
-            bindgen::Plaintext_SaveSize(
-                self.get_handle(),
-                CompressionType::ZStd as u8,
-                &mut num_bytes,
-            )
+            bindgen::Plaintext_SaveSize(self.get_handle(), compression as u8, &mut num_bytes)
         })?;
 
         let mut data: Vec<u8> = Vec::with_capacity(usize::try_from(num_bytes).unwrap());
@@ -284,7 +288,7 @@ impl ToBytes for Plaintext {
                 self.get_handle(),
                 data_ptr,
                 u64::try_from(num_bytes).unwrap(),
-                CompressionType::ZStd as u8,
+                compression as u8,
                 &mut bytes_written,
             )
         })?;
@@ -295,6 +299,12 @@ impl ToBytes for Plaintext {
     }
 }
 
+impl ToBytes for Plaintext {
+    fn as_bytes(&self) -> Result<Vec<u8>> {
+        self.save(CompressionType::ZStd)
+    }
+}
+
 impl Drop for Plaintext {
     fn drop(&mut self) {
         try_seal!(unsafe { bindgen::Plaintext_Destroy(self.get_handle()) })
@@ -320,5 +330,6 @@ mod tests {
         assert_eq!(plaintext.get_coefficient(0), 0x4321);
         assert_eq!(plaintext.get_coefficient(1), 0);
         assert_eq!(plaintext.get_coefficient(2), 0x1234);
+        assert_eq!(plaintext.data(), [0x4321, 0, 0x1234]);
     }
 }
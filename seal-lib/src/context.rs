@@ -1,7 +1,9 @@
+use crate::{Ciphertext, GaloisKeys};
+use sealy::FromBytes as _;
 use sealy::{
     Asym, BFVEncoder, BFVEncryptionParametersBuilder, BFVEvaluator, BGVEncoder, BGVEvaluator,
     CKKSEncoder, CKKSEncryptionParametersBuilder, CKKSEvaluator, CoefficientModulusFactory,
-    Context, Decryptor, Encryptor, KeyGenerator, PlainModulusFactory, PublicKey,
+    Context, Decryptor, Encryptor, KeyGenerator, MemoryPool, PlainModulusFactory, PublicKey,
     RelinearizationKey, SecretKey,
 };
 pub use sealy::{DegreeType, Evaluator, SecurityLevel};
@@ -28,6 +30,15 @@ impl SealCkksContext {
         &self.0
     }
 
+    #[inline]
+    /// Load a ciphertext from the bytes it was serialized to.
+    ///
+    /// This is what decoding a `Ciphertext` does, for callers that keep ciphertexts
+    /// serialized and only load some of them.
+    pub fn load_ciphertext(&self, bytes: &[u8]) -> sealy::Result<Ciphertext> {
+        sealy::Ciphertext::from_bytes(self.context(), bytes).map(Ciphertext)
+    }
+
     #[must_use]
     #[inline]
     /// Generate a set of secret, public and relinearization keys.
@@ -55,6 +66,14 @@ impl SealCkksContext {
         CKKSEvaluator::new(self.context()).unwrap()
     }
 
+    #[must_use]
+    #[inline]
+    /// Create a new evaluator, allocating its results and temporaries from the given memory
+    /// pool rather than from SEAL's global pool.
+    pub fn evaluator_with_pool(&self, pool: &MemoryPool) -> CKKSEvaluator {
+        CKKSEvaluator::with_pool(self.context(), pool.clone()).unwrap()
+    }
+
     #[must_use]
     #[inline]
     /// Create a new encryptor.
@@ -71,7 +90,10 @@ impl SealCkksContext {
 }
 
 /// A structure to build a BFV context.
-pub struct SealBFVContext(Context);
+///
+/// Ciphertexts loaded through it are allocated from its memory pool, if it has one, else from
+/// SEAL's global pool.
+pub struct SealBFVContext(Context, Option<MemoryPool>);
 
 impl SealBFVContext {
     #[must_use]
@@ -84,7 +106,15 @@ impl SealBFVContext {
             .build()
             .unwrap();
 
-        Self(Context::new(&params, false, sl).unwrap())
+        Self(Context::new(&params, false, sl).unwrap(), None)
+    }
+
+    #[must_use]
+    #[inline]
+    /// Load ciphertexts into the given memory pool, e.g. that of the NUMA node which will
+    /// compute on them, rather than into SEAL's global pool.
+    pub fn with_pool(self, pool: &MemoryPool) -> Self {
+        Self(self.0, Some(pool.clone()))
     }
 
     #[must_use]
@@ -93,6 +123,32 @@ impl SealBFVContext {
         &self.0
     }
 
+    #[inline]
+    /// Load a ciphertext from the bytes it was serialized to.
+    ///
+    /// This is what decoding a `Ciphertext` does, for callers that keep ciphertexts
+    /// serialized and only load some of them.
+    pub fn load_ciphertext(&self, bytes: &[u8]) -> sealy::Result<Ciphertext> {
+        match &self.1 {
+            Some(pool) => sealy::Ciphertext::from_bytes_with_pool(self.context(), bytes, pool),
+            None => sealy::Ciphertext::from_bytes(self.context(), bytes),
+        }
+        .map(Ciphertext)
+    }
+
+    #[allow(unsafe_code)]
+    #[inline]
+    /// Load a ciphertext the server serialized itself, without validating it against the
+    /// context, which takes a pass over its coefficients.
+    ///
+    /// # Safety
+    /// The bytes must come from encoding a ciphertext of this context, and not have been
+    /// altered since (see [`sealy::Ciphertext::from_bytes_unchecked`]). Bytes received
+    /// from clients must be loaded with [`Self::load_ciphertext`].
+    pub unsafe fn load_trusted_ciphertext(&self, bytes: &[u8]) -> sealy::Result<Ciphertext> {
+        unsafe { sealy::Ciphertext::from_bytes_unchecked(self.context(), bytes) }.map(Ciphertext)
+    }
+
     #[must_use]
     #[inline]
     /// Generate a pair of secret and public keys.
@@ -106,6 +162,20 @@ impl SealBFVContext {
         (sk, pk, rk)
     }
 
+    #[inline]
+    /// Load Galois keys from the bytes they were serialized to, e.g. by
+    /// [`SealBfvCS::galois_keys`](crate::SealBfvCS::galois_keys).
+    pub fn load_galois_keys(&self, bytes: &[u8]) -> sealy::Result<GaloisKeys> {
+        sealy::GaloisKey::from_bytes(self.context(), bytes).map(GaloisKeys)
+    }
+
+    #[must_use]
+    #[inline]
+    /// Number of values a ciphertext can hold.
+    pub fn slot_count(&self) -> usize {
+        self.encoder().get_slot_count()
+    }
+
     #[must_use]
     #[inline]
     /// Create a new encoder.
@@ -120,6 +190,14 @@ impl SealBFVContext {
         BFVEvaluator::new(self.context()).unwrap()
     }
 
+    #[must_use]
+    #[inline]
+    /// Create a new evaluator, allocating its results and temporaries from the given memory
+    /// pool rather than from SEAL's global pool.
+    pub fn evaluator_with_pool(&self, pool: &MemoryPool) -> BFVEvaluator {
+        BFVEvaluator::with_pool(self.context(), pool.clone()).unwrap()
+    }
+
     #[must_use]
     #[inline]
     /// Create a new encryptor.
@@ -158,6 +236,15 @@ impl SealBGVContext {
         &self.0
     }
 
+    #[inline]
+    /// Load a ciphertext from the bytes it was serialized to.
+    ///
+    /// This is what decoding a `Ciphertext` does, for callers that keep ciphertexts
+    /// serialized and only load some of them.
+    pub fn load_ciphertext(&self, bytes: &[u8]) -> sealy::Result<Ciphertext> {
+        sealy::Ciphertext::from_bytes(self.context(), bytes).map(Ciphertext)
+    }
+
     #[must_use]
     #[inline]
     /// Generate a pair of secret and public keys.
@@ -185,6 +272,14 @@ impl SealBGVContext {
         BGVEvaluator::new(self.context()).unwrap()
     }
 
+    #[must_use]
+    #[inline]
+    /// Create a new evaluator, allocating its results and temporaries from the given memory
+    /// pool rather than from SEAL's global pool.
+    pub fn evaluator_with_pool(&self, pool: &MemoryPool) -> BGVEvaluator {
+        BGVEvaluator::with_pool(self.context(), pool.clone()).unwrap()
+    }
+
     #[must_use]
     #[inline]
     /// Create a new encryptor.
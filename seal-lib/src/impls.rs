@@ -1,4 +1,4 @@
-use sealy::{Ciphertext, Plaintext, RelinearizationKey};
+use sealy::{Ciphertext, GaloisKey, Plaintext, RelinearizationKey};
 
 #[must_use]
 #[inline]
@@ -10,6 +10,15 @@ pub fn homom_add(
     evaluator.add(lhs, rhs).unwrap()
 }
 
+#[must_use]
+#[inline]
+pub fn homom_negate(
+    evaluator: &impl sealy::Evaluator<Plaintext = Plaintext, Ciphertext = Ciphertext>,
+    ciphertext: &Ciphertext,
+) -> Ciphertext {
+    evaluator.negate(ciphertext).unwrap()
+}
+
 #[must_use]
 #[inline]
 pub fn homom_add_plain(
@@ -105,3 +114,26 @@ pub fn relinearize(
 ) -> Ciphertext {
     evaluator.relinearize(ciphertext, relin_key).unwrap()
 }
+
+#[must_use]
+#[inline]
+pub fn homom_rotate_rows(
+    evaluator: &impl sealy::Evaluator<Plaintext = Plaintext, Ciphertext = Ciphertext>,
+    ciphertext: &Ciphertext,
+    steps: i32,
+    galois_keys: &GaloisKey,
+) -> Ciphertext {
+    evaluator
+        .rotate_rows(ciphertext, steps, galois_keys)
+        .unwrap()
+}
+
+#[must_use]
+#[inline]
+pub fn homom_rotate_columns(
+    evaluator: &impl sealy::Evaluator<Plaintext = Plaintext, Ciphertext = Ciphertext>,
+    ciphertext: &Ciphertext,
+    galois_keys: &GaloisKey,
+) -> Ciphertext {
+    evaluator.rotate_columns(ciphertext, galois_keys).unwrap()
+}
@@ -1,6 +1,6 @@
 //! Convenient wrapper around Microsoft SEAL library.
 #![no_std]
-#![forbid(unsafe_code)]
+#![deny(unsafe_code)]
 #![warn(clippy::nursery, clippy::pedantic)]
 #![allow(clippy::missing_panics_doc, clippy::doc_markdown)]
 
@@ -11,16 +11,19 @@ pub use bincode::{Decode, Encode};
 use fhe_core::api::{Arity1Operation, Arity2Operation, CryptoSystem, Operation};
 use fhe_operations::selectable_collection::SelectableCS;
 pub use sealy::{
-    BFVEncoder, BFVEvaluator, CKKSEncoder, CKKSEvaluator, Decryptor, DegreeType, Evaluator,
-    Plaintext, PublicKey, SecretKey, SecurityLevel,
+    BFVEncoder, BFVEvaluator, CKKSEncoder, CKKSEvaluator, Decryptor, DegreeType, Error, Evaluator,
+    MemoryPool, Plaintext, PublicKey, SecretKey, SecurityLevel,
 };
-use sealy::{FromBytes as _, ToBytes as _};
+use sealy::{FromBytes as _, KeyGenerator, ToBytes as _};
 
 pub mod context;
 mod impls;
 
 #[derive(Clone)]
 /// Ciphertext from Microsoft SEAL.
+///
+/// It is encoded as its serialized bytes, i.e. exactly like a `Vec<u8>`.
+/// Code that only routes ciphertexts may thus decode them as such.
 pub struct Ciphertext(pub sealy::Ciphertext);
 
 impl Encode for Ciphertext {
@@ -47,9 +50,26 @@ impl Decode<context::SealBFVContext> for Ciphertext {
         decoder: &mut D,
     ) -> Result<Self, bincode::error::DecodeError> {
         let raw: Vec<_> = Decode::decode(decoder)?;
-        Ok(Self(
-            sealy::Ciphertext::from_bytes(decoder.context().context(), &raw).unwrap(),
-        ))
+        Ok(decoder.context().load_ciphertext(&raw).unwrap())
+    }
+}
+
+/// Galois keys from Microsoft SEAL, with which the slots of BFV ciphertexts can be rotated
+/// (see [`SealBfvCS::pack_rows`]).
+///
+/// Like a [`Ciphertext`], they are decoded from their serialized bytes, as produced by
+/// [`SealBfvCS::galois_keys`].
+pub struct GaloisKeys(sealy::GaloisKey);
+
+impl Decode<context::SealBFVContext> for GaloisKeys {
+    fn decode<D: bincode::de::Decoder<Context = context::SealBFVContext>>(
+        decoder: &mut D,
+    ) -> Result<Self, bincode::error::DecodeError> {
+        let raw: Vec<u8> = Decode::decode(decoder)?;
+        decoder
+            .context()
+            .load_galois_keys(&raw)
+            .map_err(|_| bincode::error::DecodeError::Other("invalid Galois keys"))
     }
 }
 
@@ -64,10 +84,24 @@ pub struct SealCkksCS {
 
 impl SealCkksCS {
     pub fn new(context: &context::SealCkksContext, scale: f64) -> Self {
+        Self::with_evaluator(context, scale, context.evaluator())
+    }
+
+    #[must_use]
+    /// Like [`Self::new`], but operations allocate their results and temporaries from the given
+    /// memory pool, see [`SealBfvCS::with_pool`].
+    pub fn with_pool(context: &context::SealCkksContext, scale: f64, pool: &MemoryPool) -> Self {
+        Self::with_evaluator(context, scale, context.evaluator_with_pool(pool))
+    }
+
+    fn with_evaluator(
+        context: &context::SealCkksContext,
+        scale: f64,
+        evaluator: sealy::CKKSEvaluator,
+    ) -> Self {
         let (skey, pkey, relin_key) = context.generate_keys();
 
         let encoder = context.encoder(scale);
-        let evaluator = context.evaluator();
         let encryptor = context.encryptor(&pkey);
         let decryptor = context.decryptor(&skey);
 
@@ -176,6 +210,18 @@ impl SelectableCS for SealCkksCS {
 
     const NEUTRAL_ADD: Self::Plaintext = 0.0;
     const NEUTRAL_MUL: Self::Plaintext = 1.0;
+
+    fn negate(&self, ciphertext: &Self::Ciphertext) -> Self::Ciphertext {
+        Ciphertext(impls::homom_negate(&self.evaluator, &ciphertext.0))
+    }
+
+    fn add_plain(
+        &self,
+        ciphertext: &Self::Ciphertext,
+        plaintext: &Self::Plaintext,
+    ) -> Self::Ciphertext {
+        self.operate1(CkksHOperation1::AddPlain(*plaintext), ciphertext)
+    }
 }
 
 #[derive(Clone, Copy, Debug, Encode, Decode)]
@@ -203,14 +249,33 @@ pub struct SealBfvCS {
     encryptor: sealy::Encryptor<sealy::Asym>,
     decryptor: sealy::Decryptor,
     relin_key: Option<sealy::RelinearizationKey>,
+    /// Kept to generate Galois keys on demand, as they are large.
+    secret_key: sealy::SecretKey,
 }
 
 impl SealBfvCS {
     pub fn new(context: &context::SealBFVContext) -> Self {
+        Self::with_evaluator(context, context.evaluator())
+    }
+
+    #[must_use]
+    /// Like [`Self::new`], but operations allocate their results and temporaries from the given
+    /// memory pool instead of SEAL's global pool, which is shared by all threads.
+    ///
+    /// Memory is placed on the NUMA node of the thread that first writes it: creating the system
+    /// on the threads of a node, and operating with it and a pool of this node only from them,
+    /// keeps its keys and ciphertexts local to the node.
+    ///
+    /// A pool from [`MemoryPool::with_huge_pages`] backs large polynomials with 2 MiB pages,
+    /// which reduces TLB misses.
+    pub fn with_pool(context: &context::SealBFVContext, pool: &MemoryPool) -> Self {
+        Self::with_evaluator(context, context.evaluator_with_pool(pool))
+    }
+
+    fn with_evaluator(context: &context::SealBFVContext, evaluator: sealy::BFVEvaluator) -> Self {
         let (skey, pkey, relin_key) = context.generate_keys();
 
         let encoder = context.encoder();
-        let evaluator = context.evaluator();
         let encryptor = context.encryptor(&pkey);
         let decryptor = context.decryptor(&skey);
 
@@ -220,8 +285,79 @@ impl SealBfvCS {
             encryptor,
             decryptor,
             relin_key,
+            secret_key: skey,
         }
     }
+
+    #[must_use]
+    #[inline]
+    /// Number of values a ciphertext can hold, in a matrix of 2 rows of `slot_count() / 2`.
+    ///
+    /// `cipher` encrypts a single value, in the first slot of the first row, the others being 0.
+    pub fn slot_count(&self) -> usize {
+        self.encoder.get_slot_count()
+    }
+
+    #[must_use]
+    /// Serialize new Galois keys for this system's secret key, in a compact form that is
+    /// decoded as [`GaloisKeys`].
+    ///
+    /// They hold the rotations by powers of 2, and the swap of the rows.
+    pub fn galois_keys(&self, context: &context::SealBFVContext) -> Vec<u8> {
+        let key_gen =
+            KeyGenerator::new_from_secret_key(context.context(), &self.secret_key).unwrap();
+        key_gen
+            .create_compact_galois_keys()
+            .unwrap()
+            .as_bytes()
+            .unwrap()
+    }
+
+    #[must_use]
+    /// Merge two ciphertexts whose values are in the first slots of their first row, the
+    /// others being 0: the values of `rhs` are moved `offset` slots right, after the first
+    /// `offset` slots of `lhs`.
+    ///
+    /// A power of 2 `offset` takes a single rotation.
+    pub fn pack_rows(
+        &self,
+        lhs: &Ciphertext,
+        rhs: &Ciphertext,
+        offset: usize,
+        keys: &GaloisKeys,
+    ) -> Ciphertext {
+        let steps = -i32::try_from(offset).unwrap();
+        let rotated = impls::homom_rotate_rows(&self.evaluator, &rhs.0, steps, &keys.0);
+        Ciphertext(impls::homom_add(&self.evaluator, &lhs.0, &rotated))
+    }
+
+    #[must_use]
+    /// Merge two ciphertexts whose values are in their first row, the second being 0: the
+    /// values of `rhs` are moved to the second row.
+    pub fn pack_columns(
+        &self,
+        lhs: &Ciphertext,
+        rhs: &Ciphertext,
+        keys: &GaloisKeys,
+    ) -> Ciphertext {
+        let swapped = impls::homom_rotate_columns(&self.evaluator, &rhs.0, &keys.0);
+        Ciphertext(impls::homom_add(&self.evaluator, &lhs.0, &swapped))
+    }
+
+    #[must_use]
+    /// Decipher every slot of a ciphertext, the first row then the second.
+    pub fn decipher_slots(&self, ciphertext: &Ciphertext) -> Vec<u64> {
+        let decrypted = self.decryptor.decrypt(&ciphertext.0).unwrap();
+        self.encoder.decode_u64(&decrypted).unwrap()
+    }
+
+    #[must_use]
+    /// Bits of noise budget left in a ciphertext, which no longer deciphers correctly at 0.
+    pub fn noise_budget(&self, ciphertext: &Ciphertext) -> u32 {
+        self.decryptor
+            .invariant_noise_budget(&ciphertext.0)
+            .unwrap()
+    }
 }
 
 impl CryptoSystem for SealBfvCS {
@@ -282,6 +418,23 @@ impl CryptoSystem for SealBfvCS {
         }
     }
 
+    fn operate2_many(
+        &self,
+        operation: Self::Operation2,
+        pairs: &[(&Self::Ciphertext, &Self::Ciphertext)],
+    ) -> Vec<Self::Ciphertext> {
+        // Matched once for the whole batch.
+        let operate: fn(&sealy::BFVEvaluator, &sealy::Ciphertext, &sealy::Ciphertext) -> _ =
+            match operation {
+                BfvHOperation2::Add => impls::homom_add,
+                BfvHOperation2::Mul => impls::homom_mul,
+            };
+        pairs
+            .iter()
+            .map(|(lhs, rhs)| Ciphertext(operate(&self.evaluator, &lhs.0, &rhs.0)))
+            .collect()
+    }
+
     fn operate1_inplace(&self, operation: Self::Operation1, lhs: &mut Self::Ciphertext) {
         match operation {
             BfvHOperation1::AddPlain(plain) => {
@@ -330,9 +483,21 @@ impl SelectableCS for SealBfvCS {
 
     const NEUTRAL_ADD: Self::Plaintext = 0;
     const NEUTRAL_MUL: Self::Plaintext = 1;
+
+    fn negate(&self, ciphertext: &Self::Ciphertext) -> Self::Ciphertext {
+        Ciphertext(impls::homom_negate(&self.evaluator, &ciphertext.0))
+    }
+
+    fn add_plain(
+        &self,
+        ciphertext: &Self::Ciphertext,
+        plaintext: &Self::Plaintext,
+    ) -> Self::Ciphertext {
+        self.operate1(BfvHOperation1::AddPlain(*plaintext), ciphertext)
+    }
 }
 
-#[derive(Clone, Copy, Debug, Encode, Decode)]
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Encode, Decode)]
 #[non_exhaustive]
 pub enum BfvHOperation1 {
     AddPlain(u64),
@@ -342,7 +507,7 @@ pub enum BfvHOperation1 {
 impl Operation for BfvHOperation1 {}
 impl Arity1Operation for BfvHOperation1 {}
 
-#[derive(Clone, Copy, Debug, Encode, Decode)]
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Encode, Decode)]
 #[non_exhaustive]
 pub enum BfvHOperation2 {
     Add,
@@ -360,10 +525,20 @@ pub struct SealBgvCS {
 
 impl SealBgvCS {
     pub fn new(context: &context::SealBGVContext) -> Self {
+        Self::with_evaluator(context, context.evaluator())
+    }
+
+    #[must_use]
+    /// Like [`Self::new`], but operations allocate their results and temporaries from the given
+    /// memory pool, see [`SealBfvCS::with_pool`].
+    pub fn with_pool(context: &context::SealBGVContext, pool: &MemoryPool) -> Self {
+        Self::with_evaluator(context, context.evaluator_with_pool(pool))
+    }
+
+    fn with_evaluator(context: &context::SealBGVContext, evaluator: sealy::BGVEvaluator) -> Self {
         let (skey, pkey, _) = context.generate_keys();
 
         let encoder = context.encoder();
-        let evaluator = context.evaluator();
         let encryptor = context.encryptor(&pkey);
         let decryptor = context.decryptor(&skey);
 
@@ -465,6 +640,18 @@ impl SelectableCS for SealBgvCS {
 
     const NEUTRAL_ADD: Self::Plaintext = 0;
     const NEUTRAL_MUL: Self::Plaintext = 1;
+
+    fn negate(&self, ciphertext: &Self::Ciphertext) -> Self::Ciphertext {
+        Ciphertext(impls::homom_negate(&self.evaluator, &ciphertext.0))
+    }
+
+    fn add_plain(
+        &self,
+        ciphertext: &Self::Ciphertext,
+        plaintext: &Self::Plaintext,
+    ) -> Self::Ciphertext {
+        self.operate1(BgvHOperation1::AddPlain(*plaintext), ciphertext)
+    }
 }
 
 #[derive(Clone, Copy, Debug, Encode, Decode)]
@@ -609,6 +796,93 @@ mod tests {
         assert_eq!(d, 16);
     }
 
+    #[test]
+    fn test_ciphertext_encodes_as_bytes() {
+        const CONFIG: bincode::config::Configuration = bincode::config::standard();
+
+        let context = SealBFVContext::new(DegreeType::D2048, SecurityLevel::TC128, 16);
+        let cs = SealBfvCS::new(&context);
+
+        let a = cs.cipher(&42);
+        let encoded = bincode::encode_to_vec(&a, CONFIG).unwrap();
+
+        let (raw, _): (Vec<u8>, _) = bincode::decode_from_slice(&encoded, CONFIG).unwrap();
+        assert_eq!(bincode::encode_to_vec(&raw, CONFIG).unwrap(), encoded);
+
+        let loaded = context.load_ciphertext(&raw).unwrap();
+        assert_eq!(cs.decipher(&loaded), 42);
+
+        // Loaded into the pool of the context, if it has one.
+        let pool = MemoryPool::new().unwrap();
+        let context = context.with_pool(&pool);
+        assert_eq!(pool.pool_allocated_byte_count().unwrap(), 0);
+        let loaded = context.load_ciphertext(&raw).unwrap();
+        assert!(pool.pool_allocated_byte_count().unwrap() > 0);
+        assert_eq!(cs.decipher(&loaded), 42);
+    }
+
+    #[test]
+    fn test_seal_bfv_cs_pack() {
+        const CONFIG: bincode::config::Configuration = bincode::config::standard();
+
+        // Rotations need a context with more than one coefficient modulus.
+        let context = SealBFVContext::new(DegreeType::D4096, SecurityLevel::TC128, 16);
+        let cs = SealBfvCS::new(&context);
+        let encoded = bincode::encode_to_vec(cs.galois_keys(&context), CONFIG).unwrap();
+        let (keys, _): (GaloisKeys, _) =
+            bincode::decode_from_slice_with_context(&encoded, CONFIG, context).unwrap();
+
+        let first = cs.pack_rows(&cs.cipher(&1), &cs.cipher(&2), 1, &keys);
+        let second = cs.pack_rows(&cs.cipher(&3), &cs.cipher(&4), 1, &keys);
+        let row = cs.pack_rows(&first, &second, 2, &keys);
+        let packed = cs.pack_columns(&row, &cs.cipher(&5), &keys);
+
+        let slots = cs.decipher_slots(&packed);
+        let width = cs.slot_count() / 2;
+        assert_eq!(slots.len(), cs.slot_count());
+        assert_eq!(slots[..5], [1, 2, 3, 4, 0]);
+        assert_eq!(slots[width..width + 2], [5, 0]);
+        assert_eq!(slots.iter().sum::<u64>(), 15);
+    }
+
+    #[test]
+    #[allow(unsafe_code)]
+    fn test_seal_bfv_trusted_load() {
+        let context = SealBFVContext::new(DegreeType::D2048, SecurityLevel::TC128, 16);
+        let cs = SealBfvCS::new(&context);
+        let bytes = cs.cipher(&42).0.as_bytes().unwrap();
+
+        // SAFETY: the bytes were just serialized from a ciphertext of this context.
+        let trusted = unsafe { context.load_trusted_ciphertext(&bytes) }.unwrap();
+        let checked = context.load_ciphertext(&bytes).unwrap();
+        assert_eq!(cs.decipher(&trusted), 42);
+        assert!(trusted.0 == checked.0);
+    }
+
+    #[test]
+    fn test_seal_bfv_pool() {
+        let context = SealBFVContext::new(DegreeType::D2048, SecurityLevel::TC128, 16);
+        let pool = MemoryPool::new().unwrap();
+        let cs = SealBfvCS::with_pool(&context, &pool);
+
+        let a = cs.cipher(&6);
+        let b = cs.cipher(&7);
+        assert_eq!(cs.decipher(&cs.operate2(BfvHOperation2::Mul, &a, &b)), 42);
+        assert_eq!(cs.decipher(&cs.operate2(BfvHOperation2::Add, &a, &b)), 13);
+    }
+
+    #[test]
+    fn test_seal_bgv_huge_page_pool() {
+        let context = SealBGVContext::new(DegreeType::D2048, SecurityLevel::TC128, 16);
+        let pool = MemoryPool::with_huge_pages().unwrap();
+        let cs = SealBgvCS::with_pool(&context, &pool);
+
+        let a = cs.cipher(&6);
+        let b = cs.cipher(&7);
+        assert_eq!(cs.decipher(&cs.operate2(BgvHOperation2::Mul, &a, &b)), 42);
+        assert!(pool.pool_allocated_byte_count().unwrap() > 0);
+    }
+
     #[test]
     fn test_seal_bgv_cs() {
         let context = SealBGVContext::new(DegreeType::D2048, SecurityLevel::TC128, 16);
@@ -0,0 +1,134 @@
+//! Memory budget of a server.
+//!
+//! A job is processed in memory only if the memory it needs fits both in the budget of a
+//! single job and in what remains of the global budget. Otherwise its payload is spilled to
+//! disk, and it is processed one window of items at a time: it runs slower, but the memory it
+//! uses no longer grows with its size.
+
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use std::sync::atomic::{AtomicU64, Ordering};
+
+/// A job held in memory needs about this many times the size of its payload: the payload
+/// itself, its decoded ciphertexts and its results.
+pub const JOB_MEMORY_FACTOR: u64 = 3;
+
+#[derive(Debug)]
+pub struct MemoryBudget {
+    /// Memory that all the jobs held in memory may use together, in bytes.
+    total: u64,
+    /// Memory that a single job held in memory may use, in bytes.
+    job: u64,
+    used: AtomicU64,
+    /// Where spilled payloads and results are written.
+    spill_dir: PathBuf,
+}
+
+/// Memory reserved for a job, given back when dropped.
+#[derive(Debug)]
+pub struct Reservation {
+    budget: Arc<MemoryBudget>,
+    bytes: u64,
+}
+
+impl MemoryBudget {
+    #[must_use]
+    #[inline]
+    /// Create a budget, in bytes, spilling to the given directory.
+    pub const fn new(total: u64, job: u64, spill_dir: PathBuf) -> Self {
+        Self {
+            total,
+            job,
+            used: AtomicU64::new(0),
+            spill_dir,
+        }
+    }
+
+    #[must_use]
+    #[inline]
+    /// A budget that never spills.
+    pub fn unlimited() -> Self {
+        Self::new(u64::MAX, u64::MAX, std::env::temp_dir())
+    }
+
+    #[must_use]
+    #[inline]
+    pub fn spill_dir(&self) -> &Path {
+        &self.spill_dir
+    }
+
+    #[must_use]
+    #[inline]
+    /// Memory currently reserved by jobs, in bytes.
+    pub fn used(&self) -> u64 {
+        self.used.load(Ordering::Relaxed)
+    }
+
+    #[must_use]
+    /// Reserve the memory needed to process a payload of the given size in memory, if it fits.
+    pub fn try_reserve(self: &Arc<Self>, payload: usize) -> Option<Reservation> {
+        let bytes = (payload as u64).saturating_mul(JOB_MEMORY_FACTOR);
+        if bytes > self.job {
+            return None;
+        }
+
+        self.used
+            .fetch_update(Ordering::Relaxed, Ordering::Relaxed, |used| {
+                used.checked_add(bytes).filter(|&used| used <= self.total)
+            })
+            .ok()?;
+
+        Some(Reservation {
+            budget: Arc::clone(self),
+            bytes,
+        })
+    }
+}
+
+impl Reservation {
+    #[must_use]
+    #[inline]
+    /// Memory reserved, in bytes.
+    pub const fn bytes(&self) -> u64 {
+        self.bytes
+    }
+}
+
+impl Drop for Reservation {
+    fn drop(&mut self) {
+        self.budget.used.fetch_sub(self.bytes, Ordering::Relaxed);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_reservations() {
+        let budget = Arc::new(MemoryBudget::new(100, 60, std::env::temp_dir()));
+
+        // Over the budget of a job.
+        assert!(budget.try_reserve(21).is_none());
+
+        let first = budget.try_reserve(20).unwrap();
+        assert_eq!(first.bytes(), 60);
+        assert_eq!(budget.used(), 60);
+        let second = budget.try_reserve(10).unwrap();
+        assert_eq!(budget.used(), 90);
+
+        // Over what remains of the global budget.
+        assert!(budget.try_reserve(4).is_none());
+
+        drop(first);
+        assert!(budget.try_reserve(4).is_some());
+        drop(second);
+        assert_eq!(budget.used(), 0);
+
+        assert!(
+            Arc::new(MemoryBudget::unlimited())
+                .try_reserve(usize::MAX)
+                .is_some()
+        );
+    }
+}
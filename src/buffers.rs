@@ -0,0 +1,212 @@
+//! Reusable buffers for payloads.
+//!
+//! Every request is received into a buffer the size of its payload, and its response encoded
+//! into another one, often megabytes each. Allocating them anew makes the allocator map fresh
+//! pages, which the kernel faults in one by one as they are written, and unmap them once the
+//! response is sent. Buffers are instead taken from a [`BufferPool`], by size class, and given
+//! back to it when dropped, their pages still mapped.
+//!
+//! Ciphertexts are decoded by borrowing their bytes from the payload, so the buffer of a
+//! request also holds all it decodes, and is recycled once the request is answered.
+
+use core::ops::{Deref, DerefMut};
+use std::sync::Mutex;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+/// Smallest size class, as a power of two: smaller buffers are cheap to allocate.
+const MIN_CLASS: u32 = 12; // 4 KiB
+/// Largest size class, as a power of two: larger buffers are allocated for each payload.
+const MAX_CLASS: u32 = 30; // 1 GiB
+const CLASSES: usize = (MAX_CLASS - MIN_CLASS + 1) as usize;
+
+/// Bytes of idle buffers the global pool keeps at most.
+pub const DEFAULT_IDLE_LIMIT: usize = 256 << 20; // 256 MiB
+
+static GLOBAL: BufferPool = BufferPool::new(DEFAULT_IDLE_LIMIT);
+
+/// Idle buffers, by size class: class `k` holds buffers of at least `2^k` bytes.
+pub struct BufferPool {
+    classes: [Mutex<Vec<Vec<u8>>>; CLASSES],
+    /// Capacity of the idle buffers, in bytes.
+    idle: AtomicUsize,
+    idle_limit: usize,
+}
+
+impl BufferPool {
+    #[must_use]
+    #[inline]
+    /// A pool keeping idle buffers up to `idle_limit` bytes, beyond which they are freed.
+    pub const fn new(idle_limit: usize) -> Self {
+        Self {
+            classes: [const { Mutex::new(Vec::new()) }; CLASSES],
+            idle: AtomicUsize::new(0),
+            idle_limit,
+        }
+    }
+
+    #[must_use]
+    #[inline]
+    /// The pool of the process, which payloads are received and encoded into.
+    pub fn global() -> &'static Self {
+        &GLOBAL
+    }
+
+    #[must_use]
+    /// An empty buffer able to hold `capacity` bytes without growing.
+    pub fn take(&'static self, capacity: usize) -> Buffer {
+        let class = capacity
+            .max(1)
+            .next_power_of_two()
+            .trailing_zeros()
+            .max(MIN_CLASS);
+        let data = if class > MAX_CLASS {
+            Vec::with_capacity(capacity)
+        } else {
+            let idle = self.classes[(class - MIN_CLASS) as usize]
+                .lock()
+                .unwrap()
+                .pop();
+            match idle {
+                Some(data) => {
+                    self.idle.fetch_sub(data.capacity(), Ordering::Relaxed);
+                    data
+                }
+                None => Vec::with_capacity(1 << class),
+            }
+        };
+        Buffer { data, pool: self }
+    }
+
+    #[must_use]
+    #[inline]
+    /// Capacity of the idle buffers, in bytes.
+    pub fn idle_bytes(&self) -> usize {
+        self.idle.load(Ordering::Relaxed)
+    }
+
+    /// Keep a buffer for reuse, unless it is too small, too large or the pool is full.
+    fn give(&self, mut data: Vec<u8>) {
+        let capacity = data.capacity();
+        if capacity < 1 << MIN_CLASS {
+            return;
+        }
+        // The largest class the buffer can serve.
+        let class = usize::BITS - 1 - capacity.leading_zeros();
+        if class > MAX_CLASS
+            || self
+                .idle
+                .fetch_update(Ordering::Relaxed, Ordering::Relaxed, |idle| {
+                    (idle + capacity <= self.idle_limit).then_some(idle + capacity)
+                })
+                .is_err()
+        {
+            return;
+        }
+        data.clear();
+        self.classes[(class - MIN_CLASS) as usize]
+            .lock()
+            .unwrap()
+            .push(data);
+    }
+}
+
+/// A buffer taken from a [`BufferPool`], given back to it when dropped.
+pub struct Buffer {
+    data: Vec<u8>,
+    pool: &'static BufferPool,
+}
+
+impl Buffer {
+    #[must_use]
+    #[inline]
+    /// The bytes of the buffer, which is then not given back to its pool.
+    pub fn into_vec(mut self) -> Vec<u8> {
+        core::mem::take(&mut self.data)
+    }
+}
+
+impl Deref for Buffer {
+    type Target = Vec<u8>;
+
+    #[inline]
+    fn deref(&self) -> &Vec<u8> {
+        &self.data
+    }
+}
+
+impl DerefMut for Buffer {
+    #[inline]
+    fn deref_mut(&mut self) -> &mut Vec<u8> {
+        &mut self.data
+    }
+}
+
+impl From<Vec<u8>> for Buffer {
+    /// Bytes allocated elsewhere, given to the global pool once dropped.
+    #[inline]
+    fn from(data: Vec<u8>) -> Self {
+        Self {
+            data,
+            pool: BufferPool::global(),
+        }
+    }
+}
+
+impl Drop for Buffer {
+    fn drop(&mut self) {
+        self.pool.give(core::mem::take(&mut self.data));
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn pool(idle_limit: usize) -> &'static BufferPool {
+        Box::leak(Box::new(BufferPool::new(idle_limit)))
+    }
+
+    #[test]
+    fn test_reuse() {
+        let pool = pool(usize::MAX);
+        let mut buffer = pool.take(100_000);
+        assert!(buffer.is_empty());
+        assert!(buffer.capacity() >= 100_000);
+        buffer.extend([1, 2, 3]);
+        let address = buffer.as_ptr();
+        drop(buffer);
+        assert_eq!(pool.idle_bytes(), 1 << 17);
+
+        // Any size of the same class gets the same buffer back, emptied.
+        let buffer = pool.take(70_000);
+        assert_eq!(buffer.as_ptr(), address);
+        assert!(buffer.is_empty());
+        assert_eq!(pool.idle_bytes(), 0);
+        assert_ne!(pool.take(200_000).as_ptr(), address);
+    }
+
+    #[test]
+    fn test_idle_limit() {
+        let pool = pool(1 << 20);
+        let buffers = (0..3).map(|_| pool.take(1 << 19)).collect::<Vec<_>>();
+        drop(buffers);
+        assert_eq!(pool.idle_bytes(), 1 << 20);
+
+        // Beyond the limit, or never given back.
+        drop(pool.take(0));
+        assert!(pool.take(1 << 19).into_vec().capacity() >= 1 << 19);
+        assert_eq!(pool.idle_bytes(), 1 << 19);
+    }
+
+    #[test]
+    fn test_foreign_buffers() {
+        // Capacity of 5000 bytes: only serves the 4 KiB class.
+        let buffer = Buffer::from(Vec::with_capacity(5000));
+        let pool = pool(usize::MAX);
+        pool.give(buffer.into_vec());
+        assert_eq!(pool.idle_bytes(), 5000);
+        let buffer = pool.take(4096);
+        assert_eq!(buffer.capacity(), 5000);
+        assert_eq!(pool.idle_bytes(), 0);
+    }
+}
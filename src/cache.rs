@@ -0,0 +1,317 @@
+//! Cache of the results of the jobs run on named datasets.
+//!
+//! Dashboards run the same aggregates over the same data again and again. The results of a
+//! request naming its dataset (see [`Request::dataset`]) are kept by tenant, dataset, version
+//! and job. The version is a digest of the ciphertexts of the job data: a client reusing its
+//! cached dataset sends the same ciphertexts for as long as its data does not change. What the
+//! job computes on them, e.g. the plan of a query, is digested apart, so that the results of
+//! different queries on a version are kept side by side. A request with a new version of a
+//! dataset drops the results of the previous ones, e.g. once rows were appended.
+//!
+//! Digests are SHA3-256: results are not served for other data, short of a collision.
+//!
+//! Results are kept serialized within a byte budget, the least recently used being evicted
+//! first.
+
+use crate::protocol::{Job, Layout, Request};
+use fhe_operations::program::Instruction;
+use fhe_operations::sql::WirePlan;
+use rayon::prelude::*;
+use seal_lib::{BfvHOperation1, BfvHOperation2};
+use sha3::{Digest as _, Sha3_256};
+use std::collections::{BTreeMap, HashMap};
+use std::sync::{Arc, Mutex};
+
+/// Job data is digested in blocks of this size, in parallel.
+const DIGEST_BLOCK: usize = 1 << 20;
+
+/// A SHA3-256 digest.
+type Digest = [u8; 32];
+
+/// What the results of a request depend on.
+#[derive(Clone, Debug, PartialEq, Eq, Hash)]
+pub struct Key {
+    tenant: String,
+    dataset: String,
+    /// Digest of the ciphertexts of the job data.
+    version: Digest,
+    job: Job,
+    layout: Layout,
+    /// Digest of what the job computes on the ciphertexts, e.g. the plan of a query.
+    computation: Digest,
+}
+
+impl Key {
+    #[must_use]
+    /// The key of a request and its job data, unless the request names no dataset.
+    pub fn new(request: &Request, data: &[u8]) -> Option<Self> {
+        if request.dataset.is_empty() {
+            return None;
+        }
+        let (computation, dataset) = split_job_data(request.job, data);
+        Some(Self {
+            tenant: request.tenant.clone(),
+            dataset: request.dataset.clone(),
+            version: digest(dataset),
+            job: request.job,
+            layout: request.layout,
+            computation: digest(computation),
+        })
+    }
+}
+
+/// Split job data into what the job computes, encoded ahead of the ciphertexts by queries and
+/// programs, and the ciphertexts. Operations are encoded along the operands of `SeqOps` jobs,
+/// which are thus digested as a whole.
+fn split_job_data(job: Job, data: &[u8]) -> (&[u8], &[u8]) {
+    let read = match job {
+        Job::Query => bincode::decode_from_slice::<WirePlan, _>(data, crate::BINCODE_CONFIG)
+            .map(|(_, read)| read),
+        Job::Program => bincode::decode_from_slice::<
+            Vec<Instruction<BfvHOperation1, BfvHOperation2>>,
+            _,
+        >(data, crate::BINCODE_CONFIG)
+        .map(|(_, read)| read),
+        _ => Ok(0),
+    };
+    // Invalid job data is refused once decoded, and its results never cached.
+    data.split_at(read.unwrap_or(0))
+}
+
+/// Digest of some data, hashing its blocks in parallel.
+fn digest(data: &[u8]) -> Digest {
+    let blocks = data
+        .par_chunks(DIGEST_BLOCK)
+        .map(Sha3_256::digest)
+        .collect::<Vec<_>>();
+
+    let mut hasher = Sha3_256::new();
+    hasher.update((data.len() as u64).to_le_bytes());
+    for block in blocks {
+        hasher.update(block);
+    }
+    hasher.finalize().into()
+}
+
+/// The results of a request, as an encoded `Vec<Ciphertext>`.
+#[derive(Debug)]
+pub struct CachedResults {
+    pub encoded: Vec<u8>,
+    /// Number of ciphertexts.
+    pub len: usize,
+}
+
+struct Entry {
+    results: Arc<CachedResults>,
+    /// Position in the eviction order.
+    used: u64,
+}
+
+#[derive(Default)]
+struct Entries {
+    entries: HashMap<Key, Entry>,
+    /// Keys by last use, the least recently used first.
+    order: BTreeMap<u64, Key>,
+    /// Bytes of the cached results.
+    bytes: u64,
+    clock: u64,
+}
+
+impl Entries {
+    fn remove(&mut self, key: &Key) {
+        if let Some(entry) = self.entries.remove(key) {
+            self.order.remove(&entry.used);
+            self.bytes -= entry.results.encoded.len() as u64;
+        }
+    }
+}
+
+/// The results of the latest jobs on named datasets, within a byte budget.
+pub struct ResultCache {
+    budget: u64,
+    entries: Mutex<Entries>,
+}
+
+impl ResultCache {
+    #[must_use]
+    #[inline]
+    /// Create a cache of at most `budget` bytes of results, none if 0.
+    pub fn new(budget: u64) -> Self {
+        Self {
+            budget,
+            entries: Mutex::default(),
+        }
+    }
+
+    #[must_use]
+    /// Bytes of the cached results.
+    pub fn used(&self) -> u64 {
+        self.entries.lock().unwrap().bytes
+    }
+
+    #[must_use]
+    /// The results cached for a key, which become the most recently used.
+    pub fn get(&self, key: &Key) -> Option<Arc<CachedResults>> {
+        let mut entries = self.entries.lock().unwrap();
+        entries.clock += 1;
+        let clock = entries.clock;
+
+        let entry = entries.entries.get_mut(key)?;
+        let previous = core::mem::replace(&mut entry.used, clock);
+        let results = Arc::clone(&entry.results);
+        entries.order.remove(&previous);
+        entries.order.insert(clock, key.clone());
+        Some(results)
+    }
+
+    /// Cache the results of a key, dropping those of the other versions of its dataset, and
+    /// evicting the least recently used results to fit in the budget.
+    pub fn insert(&self, key: Key, results: CachedResults) {
+        let mut entries = self.entries.lock().unwrap();
+
+        let stale = entries
+            .entries
+            .keys()
+            .filter(|other| {
+                other.tenant == key.tenant
+                    && other.dataset == key.dataset
+                    && other.version != key.version
+            })
+            .cloned()
+            .collect::<Vec<_>>();
+        for other in &stale {
+            entries.remove(other);
+        }
+        entries.remove(&key);
+
+        let bytes = results.encoded.len() as u64;
+        if bytes > self.budget {
+            return;
+        }
+        while entries.bytes + bytes > self.budget {
+            let Some((_, oldest)) = entries.order.pop_first() else {
+                break;
+            };
+            entries.remove(&oldest);
+        }
+
+        entries.clock += 1;
+        let used = entries.clock;
+        entries.order.insert(used, key.clone());
+        entries.bytes += bytes;
+        entries.entries.insert(
+            key,
+            Entry {
+                results: Arc::new(results),
+                used,
+            },
+        );
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn key(dataset: &str, data: &[u8]) -> Key {
+        let request = Request {
+            tenant: String::from("risk"),
+            dataset: String::from(dataset),
+            ..Request::new(Job::SeqOpsSum)
+        };
+        Key::new(&request, data).unwrap()
+    }
+
+    fn results(bytes: usize) -> CachedResults {
+        CachedResults {
+            encoded: vec![0; bytes],
+            len: 1,
+        }
+    }
+
+    #[test]
+    fn test_key() {
+        assert_eq!(Key::new(&Request::new(Job::SeqOps), &[1, 2, 3]), None);
+        assert_eq!(key("sales", &[1, 2, 3]), key("sales", &[1, 2, 3]));
+        assert_ne!(key("sales", &[1, 2, 3]), key("sales", &[1, 2, 4]));
+        assert_ne!(key("sales", &[1, 2, 3]), key("trades", &[1, 2, 3]));
+
+        // Blocks are digested in order.
+        let data = (0..3 * DIGEST_BLOCK)
+            .map(|i| (i / DIGEST_BLOCK) as u8)
+            .collect::<Vec<_>>();
+        let mut swapped = data.clone();
+        swapped.rotate_left(DIGEST_BLOCK);
+        assert_ne!(key("sales", &data), key("sales", &swapped));
+    }
+
+    #[test]
+    fn test_lru_eviction() {
+        let cache = ResultCache::new(100);
+        cache.insert(key("a", &[1]), results(40));
+        cache.insert(key("b", &[1]), results(40));
+        assert!(cache.get(&key("a", &[1])).is_some());
+
+        // `b` is the least recently used.
+        cache.insert(key("c", &[1]), results(40));
+        assert!(cache.get(&key("a", &[1])).is_some());
+        assert!(cache.get(&key("b", &[1])).is_none());
+        assert!(cache.get(&key("c", &[1])).is_some());
+        assert_eq!(cache.used(), 80);
+
+        // Larger than the whole budget.
+        cache.insert(key("d", &[1]), results(101));
+        assert!(cache.get(&key("d", &[1])).is_none());
+        assert_eq!(cache.used(), 80);
+    }
+
+    #[test]
+    fn test_queries_share_versions() {
+        let query = |text: &str, rows: &[u8]| {
+            let limits = fhe_operations::sql::Limits {
+                flags: 4,
+                depth: 3,
+                parallel_rows: 64,
+            };
+            let plan = fhe_operations::sql::Query::parse(text)
+                .unwrap()
+                .plan(&[], rows.len(), &limits)
+                .unwrap();
+            let mut data = bincode::encode_to_vec(plan.wire(), crate::BINCODE_CONFIG).unwrap();
+            data.extend_from_slice(rows);
+            let request = Request {
+                tenant: String::from("risk"),
+                dataset: String::from("sales"),
+                ..Request::new(Job::Query)
+            };
+            Key::new(&request, &data).unwrap()
+        };
+        let count = "SELECT COUNT(*) FROM sales WHERE paid";
+        let sum = "SELECT SUM(amount) FROM sales WHERE paid";
+        assert_eq!(query(count, &[1, 2]).version, query(sum, &[1, 2]).version);
+        assert_ne!(query(count, &[1, 2]), query(sum, &[1, 2]));
+
+        // Other queries on the same version are kept, until a new version.
+        let cache = ResultCache::new(100);
+        cache.insert(query(count, &[1, 2]), results(10));
+        cache.insert(query(sum, &[1, 2]), results(10));
+        assert!(cache.get(&query(count, &[1, 2])).is_some());
+        assert_eq!(cache.used(), 20);
+        cache.insert(query(sum, &[1, 2, 3]), results(10));
+        assert!(cache.get(&query(count, &[1, 2])).is_none());
+        assert_eq!(cache.used(), 10);
+    }
+
+    #[test]
+    fn test_new_version_invalidates() {
+        let cache = ResultCache::new(100);
+        cache.insert(key("a", &[1]), results(10));
+        cache.insert(key("b", &[1]), results(10));
+
+        cache.insert(key("a", &[1, 2]), results(20));
+        assert!(cache.get(&key("a", &[1])).is_none());
+        assert!(cache.get(&key("a", &[1, 2])).is_some());
+        assert!(cache.get(&key("b", &[1])).is_some());
+        assert_eq!(cache.used(), 30);
+    }
+}
@@ -1 +1,4 @@
 pub mod config;
+pub mod download;
+pub mod program;
+pub mod upload;
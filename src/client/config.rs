@@ -1,3 +1,6 @@
+use super::program::{self, BfvInstruction};
+use crate::protocol::{Job, Layout, Priority, Request};
+use fhe_operations::sql::Query;
 use std::path::{Path, PathBuf};
 use thiserror::Error;
 use toml::Table;
@@ -5,6 +8,15 @@ use toml::Table;
 #[derive(Debug)]
 pub struct ClientConfig {
     data: PathBuf,
+    output: Option<PathBuf>,
+    upload_cache: Option<PathBuf>,
+    /// Values encrypted once, and shared by the items using them.
+    shared_operands: Vec<u64>,
+    /// Instructions of the program run by `program` jobs.
+    program: Vec<BfvInstruction>,
+    /// Query run by `query` jobs.
+    query: Option<Query>,
+    request: Request,
 }
 
 #[derive(Error, Debug)]
@@ -39,7 +51,145 @@ impl ClientConfig {
             .to_string()
             .into();
 
-        Ok(Self { data })
+        let job = match table.get("job").map(toml::Value::as_str) {
+            None | Some(Some("seq_ops")) => Job::SeqOps,
+            Some(Some("sum")) => Job::SeqOpsSum,
+            Some(Some("program")) => Job::Program,
+            Some(Some("query")) => Job::Query,
+            Some(Some("repack")) => Job::Repack,
+            Some(_) => return Err(ConfigError::InvalidValue("job")),
+        };
+
+        let program = match table.get("program") {
+            None if job == Job::Program => return Err(ConfigError::MissingKey("program")),
+            None => Vec::new(),
+            Some(text) => {
+                let text = text.as_str().ok_or(ConfigError::InvalidValue("program"))?;
+                program::parse(text).map_err(|instruction| {
+                    log::error!("Invalid instruction in program: {instruction}");
+                    ConfigError::InvalidValue("program")
+                })?
+            }
+        };
+
+        let query = match table.get("query") {
+            None if job == Job::Query => return Err(ConfigError::MissingKey("query")),
+            None => None,
+            Some(text) => {
+                let text = text.as_str().ok_or(ConfigError::InvalidValue("query"))?;
+                Some(Query::parse(text).map_err(|err| {
+                    log::error!("Invalid query: {err}");
+                    ConfigError::InvalidValue("query")
+                })?)
+            }
+        };
+
+        let priority = match table.get("priority").map(toml::Value::as_str) {
+            None => Priority::default(),
+            Some(Some(priority)) => priority
+                .parse()
+                .map_err(|()| ConfigError::InvalidValue("priority"))?,
+            Some(None) => return Err(ConfigError::InvalidValue("priority")),
+        };
+
+        let layout = match table.get("layout").map(toml::Value::as_str) {
+            None => Layout::default(),
+            Some(Some(layout)) => layout
+                .parse()
+                .map_err(|()| ConfigError::InvalidValue("layout"))?,
+            Some(None) => return Err(ConfigError::InvalidValue("layout")),
+        };
+
+        let shared_operands = match table.get("shared_operands") {
+            None => Vec::new(),
+            Some(shared) => shared
+                .as_array()
+                .filter(|shared| shared.is_empty() || layout == Layout::Columns)
+                .and_then(|shared| {
+                    shared
+                        .iter()
+                        .map(|value| {
+                            value
+                                .as_integer()
+                                .and_then(|value| u64::try_from(value).ok())
+                        })
+                        .collect::<Option<Vec<_>>>()
+                })
+                .ok_or(ConfigError::InvalidValue("shared_operands"))?,
+        };
+
+        let tenant = match table.get("tenant") {
+            None => String::new(),
+            Some(tenant) => tenant
+                .as_str()
+                .ok_or(ConfigError::InvalidValue("tenant"))?
+                .to_string(),
+        };
+
+        let dataset = match table.get("dataset") {
+            None => String::new(),
+            Some(dataset) => dataset
+                .as_str()
+                .ok_or(ConfigError::InvalidValue("dataset"))?
+                .to_string(),
+        };
+
+        let deadline_ms = table
+            .get("deadline_ms")
+            .map(|deadline| {
+                deadline
+                    .as_integer()
+                    .and_then(|deadline| u64::try_from(deadline).ok())
+                    .ok_or(ConfigError::InvalidValue("deadline_ms"))
+            })
+            .transpose()?;
+
+        let stats = match table.get("stats") {
+            None => false,
+            Some(stats) => stats.as_bool().ok_or(ConfigError::InvalidValue("stats"))?,
+        };
+
+        // Only values encrypted alone are written to files.
+        let output = table
+            .get("output")
+            .map(|output| {
+                output
+                    .as_str()
+                    .filter(|_| job != Job::Repack)
+                    .map(PathBuf::from)
+                    .ok_or(ConfigError::InvalidValue("output"))
+            })
+            .transpose()?;
+
+        let upload_cache = table
+            .get("upload_cache")
+            .map(|cache| {
+                cache
+                    .as_str()
+                    .map(PathBuf::from)
+                    .ok_or(ConfigError::InvalidValue("upload_cache"))
+            })
+            .transpose()?;
+
+        Ok(Self {
+            data,
+            request: Request {
+                job,
+                priority,
+                tenant,
+                deadline_ms,
+                stats,
+                // Results written to a file are streamed, so they can be written as they arrive.
+                stream: output.is_some(),
+                layout,
+                dataset,
+            },
+            output,
+            upload_cache,
+            shared_operands,
+            program,
+            query,
+        })
     }
 
     #[must_use]
@@ -48,4 +198,47 @@ impl ClientConfig {
     pub fn data(&self) -> &Path {
         &self.data
     }
+
+    #[must_use]
+    #[inline]
+    /// The file the results are written to, if any.
+    pub fn output(&self) -> Option<&Path> {
+        self.output.as_deref()
+    }
+
+    #[must_use]
+    #[inline]
+    /// Where the encoded request is cached to be uploaded in resumable chunks, if anywhere.
+    pub fn upload_cache(&self) -> Option<&Path> {
+        self.upload_cache.as_deref()
+    }
+
+    #[must_use]
+    #[inline]
+    /// Values encrypted once, and their ciphertext shared by the items using them, while every
+    /// other operand is encrypted on its own. Only with the columnar layout.
+    pub fn shared_operands(&self) -> &[u64] {
+        &self.shared_operands
+    }
+
+    #[must_use]
+    #[inline]
+    /// Instructions of the program run on every row of the data, by `program` jobs.
+    pub fn program(&self) -> &[BfvInstruction] {
+        &self.program
+    }
+
+    #[must_use]
+    #[inline]
+    /// The query run on the table of the data, by `query` jobs.
+    pub const fn query(&self) -> Option<&Query> {
+        self.query.as_ref()
+    }
+
+    #[must_use]
+    #[inline]
+    /// The request header sent along with the loaded data.
+    pub const fn request(&self) -> &Request {
+        &self.request
+    }
 }
@@ -0,0 +1,132 @@
+//! Streamed download of results.
+//!
+//! Results are processed through a pipeline of three stages, linked by bounded channels so
+//! that a slow stage pushes back on the previous ones instead of buffering the whole result set:
+//! 1. frames are received from the server,
+//! 2. the ciphertexts of each frame are loaded and deciphered in parallel,
+//! 3. the plaintexts are written in order.
+
+use crate::output::{OutputError, ResultWriter};
+use crate::protocol::{self, ServerStats};
+use crate::transport::{Payload, Stream};
+use core::time::Duration;
+use fhe_core::api::CryptoSystem as _;
+use rayon::prelude::*;
+use seal_lib::SealBfvCS;
+use seal_lib::context::SealBFVContext;
+use std::sync::mpsc::sync_channel;
+use std::time::Instant;
+use thiserror::Error;
+
+/// Number of frames buffered between two stages.
+const PIPELINE_DEPTH: usize = 4;
+
+#[derive(Error, Debug)]
+pub enum DownloadError {
+    #[error("IO error: {0}")]
+    Io(#[from] std::io::Error),
+    #[error("Failed to decode results: {0}")]
+    Decode(#[from] bincode::error::DecodeError),
+    #[error("Failed to load result: {0}")]
+    Load(#[from] seal_lib::Error),
+    #[error("Failed to write results: {0}")]
+    Output(#[from] OutputError),
+}
+
+/// Summary of a download.
+pub struct Download {
+    pub results: u64,
+    /// From the start of the download to the first written result.
+    pub first_result: Option<Duration>,
+    /// Time spent loading and deciphering ciphertexts, over all threads.
+    pub decrypt: Duration,
+    pub server_stats: Option<ServerStats>,
+}
+
+/// Decode the ciphertexts of a frame, without copying them.
+fn decode_frame(frame: &[u8]) -> Result<(Vec<&[u8]>, usize), DownloadError> {
+    Ok(bincode::borrow_decode_from_slice(
+        frame,
+        crate::BINCODE_CONFIG,
+    )?)
+}
+
+/// Receive the frames of a streamed response, and write their deciphered results in order.
+///
+/// Must be called from a multi-threaded runtime.
+pub fn download(
+    stream: &mut Stream,
+    bfv_ctx: &SealBFVContext,
+    bfv_cs: &SealBfvCS,
+    mut writer: Box<dyn ResultWriter>,
+) -> Result<Download, DownloadError> {
+    let start = Instant::now();
+    let runtime = tokio::runtime::Handle::current();
+
+    tokio::task::block_in_place(|| {
+        std::thread::scope(|scope| {
+            let (frames_tx, frames_rx) = sync_channel::<Payload>(PIPELINE_DEPTH);
+            let (plain_tx, plain_rx) = sync_channel::<Vec<u64>>(PIPELINE_DEPTH);
+
+            let decrypter = scope.spawn(move || -> Result<Duration, DownloadError> {
+                let mut decrypt = Duration::ZERO;
+                for frame in frames_rx {
+                    let started = Instant::now();
+                    let (ciphertexts, _) = decode_frame(&frame)?;
+                    let plaintexts = ciphertexts
+                        .par_iter()
+                        .map(|raw| -> Result<u64, DownloadError> {
+                            Ok(bfv_cs.decipher(&bfv_ctx.load_ciphertext(raw)?))
+                        })
+                        .collect::<Result<Vec<_>, _>>()?;
+                    decrypt += started.elapsed();
+
+                    if plain_tx.send(plaintexts).is_err() {
+                        break; // The writer failed, its error is reported instead.
+                    }
+                }
+                Ok(decrypt)
+            });
+
+            let writer = scope.spawn(move || -> Result<(u64, Option<Duration>), DownloadError> {
+                let mut results = 0;
+                let mut first_result = None;
+                for plaintexts in plain_rx {
+                    writer.write(&plaintexts)?;
+                    results += plaintexts.len() as u64;
+                    first_result.get_or_insert_with(|| start.elapsed());
+                }
+                writer.finish()?;
+                Ok((results, first_result))
+            });
+
+            let received = (|| -> Result<Option<ServerStats>, DownloadError> {
+                loop {
+                    let frame = runtime.block_on(stream.recv())?;
+                    let (ciphertexts, read) = decode_frame(&frame)?;
+                    if ciphertexts.is_empty() {
+                        return Ok(protocol::decode_trailer(&frame[read..])?);
+                    }
+                    drop(ciphertexts);
+                    if frames_tx.send(frame).is_err() {
+                        return Ok(None); // A later stage failed, its error is reported instead.
+                    }
+                }
+            })();
+            drop(frames_tx);
+
+            let decrypt = decrypter.join().unwrap();
+            let written = writer.join().unwrap();
+            let server_stats = received?;
+            let decrypt = decrypt?;
+            let (results, first_result) = written?;
+
+            Ok(Download {
+                results,
+                first_result,
+                decrypt,
+                server_stats,
+            })
+        })
+    })
+}
@@ -0,0 +1,72 @@
+//! Text form of the programs run by `program` jobs.
+//!
+//! A program is a list of instructions separated by `;` or new lines, e.g.
+//! `load 0; load 1; mul; relin; add_plain 5`:
+//!
+//! - `load <column>` pushes the ciphertext of the row in a column of the data, from 0,
+//! - `add` and `mul` replace the two values on top of the stack by their sum or product,
+//! - `add_plain <n>`, `mul_plain <n>` and `exp <n>` replace the value on top of the stack,
+//! - `relin` relinearizes the value on top of the stack.
+//!
+//! The value left on the stack is the result of the row.
+
+use fhe_operations::program::Instruction;
+use seal_lib::{BfvHOperation1, BfvHOperation2};
+
+pub type BfvInstruction = Instruction<BfvHOperation1, BfvHOperation2>;
+
+/// Parse the instructions of a program, or return the one that is invalid.
+pub fn parse(text: &str) -> Result<Vec<BfvInstruction>, String> {
+    text.split([';', '\n'])
+        .map(str::trim)
+        .filter(|instruction| !instruction.is_empty())
+        .map(|instruction| parse_instruction(instruction).ok_or_else(|| instruction.to_string()))
+        .collect()
+}
+
+fn parse_instruction(instruction: &str) -> Option<BfvInstruction> {
+    let mut words = instruction.split_whitespace();
+    let name = words.next()?;
+    let argument = words.next();
+    if words.next().is_some() {
+        return None;
+    }
+
+    let instruction = match (name, argument) {
+        ("load", Some(column)) => Instruction::Load(column.parse().ok()?),
+        ("add", None) => Instruction::Op2(BfvHOperation2::Add),
+        ("mul", None) => Instruction::Op2(BfvHOperation2::Mul),
+        ("relin", None) => Instruction::Relinearize,
+        ("add_plain", Some(plain)) => {
+            Instruction::Op1(BfvHOperation1::AddPlain(plain.parse().ok()?))
+        }
+        ("mul_plain", Some(plain)) => {
+            Instruction::Op1(BfvHOperation1::MulPlain(plain.parse().ok()?))
+        }
+        ("exp", Some(exp)) => Instruction::Op1(BfvHOperation1::Exp(exp.parse().ok()?)),
+        _ => return None,
+    };
+    Some(instruction)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_parse() {
+        assert_eq!(
+            parse("load 0; load 1; mul\nrelin; add_plain 5;").unwrap(),
+            vec![
+                Instruction::Load(0),
+                Instruction::Load(1),
+                Instruction::Op2(BfvHOperation2::Mul),
+                Instruction::Relinearize,
+                Instruction::Op1(BfvHOperation1::AddPlain(5)),
+            ]
+        );
+        assert_eq!(parse("load 0; sub").unwrap_err(), "sub");
+        assert_eq!(parse("load").unwrap_err(), "load");
+        assert_eq!(parse("add 3").unwrap_err(), "add 3");
+    }
+}
@@ -0,0 +1,178 @@
+//! Resumable upload of requests.
+//!
+//! The encoded request is cached on disk along with the id of its upload, so that an upload
+//! interrupted by a network failure, or by the client itself, resumes from the last chunk
+//! acknowledged by the server, without loading and encrypting the data again.
+
+use crate::protocol::{self, Request};
+use crate::transport::{Endpoint, Stream};
+use crate::upload::{self, Ack, CHUNK_SIZE, ChunkHeader, HELLO, Manifest};
+use core::time::Duration;
+use std::path::{Path, PathBuf};
+use std::time::SystemTime;
+use thiserror::Error;
+
+/// Chunks sent ahead of the last acknowledged one.
+const IN_FLIGHT: u64 = 4;
+
+/// Connections tried before giving up on an upload.
+///
+/// The backoff between them outlasts the [`upload::CHUNK_TIMEOUT`] of the server, so that an
+/// upload held by a lost connection is released before the last attempt.
+const MAX_ATTEMPTS: u32 = 5;
+
+#[derive(Error, Debug)]
+pub enum UploadError {
+    #[error("IO error: {0}")]
+    Io(#[from] std::io::Error),
+    #[error("Failed to encode upload: {0}")]
+    Encode(#[from] bincode::error::EncodeError),
+    #[error("Failed to decode acknowledgement: {0}")]
+    Decode(#[from] bincode::error::DecodeError),
+    #[error("Unexpected acknowledgement of chunk {0}")]
+    UnexpectedAck(u64),
+}
+
+/// An encoded request cached on disk, and the id of its upload.
+pub struct CachedRequest {
+    payload: Vec<u8>,
+    id: String,
+    path: PathBuf,
+}
+
+/// Paths of the request and of the upload id cached for a data file.
+fn cache_paths(cache: &Path, data: &Path) -> (PathBuf, PathBuf) {
+    let name = data.file_name().unwrap_or_default().to_string_lossy();
+    (
+        cache.join(format!("{name}.request")),
+        cache.join(format!("{name}.upload-id")),
+    )
+}
+
+fn modified(path: &Path) -> Result<SystemTime, std::io::Error> {
+    std::fs::metadata(path)?.modified()
+}
+
+impl CachedRequest {
+    /// Load the request cached for `data`, if it is newer than the data and has the same header.
+    pub fn load(cache: &Path, data: &Path, request: &Request) -> Result<Option<Self>, UploadError> {
+        let (path, id_path) = cache_paths(cache, data);
+        if !path.exists() || modified(&path)? < modified(data)? {
+            return Ok(None);
+        }
+
+        let payload = std::fs::read(&path)?;
+        let Ok((header, _)) = protocol::decode_request(&payload) else {
+            return Ok(None);
+        };
+        if header != *request {
+            return Ok(None);
+        }
+
+        Ok(Some(Self {
+            payload,
+            id: std::fs::read_to_string(id_path)?,
+            path,
+        }))
+    }
+
+    /// Cache the encoded request built for `data`, under a new upload id.
+    pub fn store(cache: &Path, data: &Path, payload: Vec<u8>) -> Result<Self, UploadError> {
+        std::fs::create_dir_all(cache)?;
+        let (path, id_path) = cache_paths(cache, data);
+
+        let since_epoch = SystemTime::now()
+            .duration_since(SystemTime::UNIX_EPOCH)
+            .unwrap_or_default();
+        let id = format!("{:x}-{:x}", since_epoch.as_nanos(), std::process::id());
+        std::fs::write(id_path, &id)?;
+
+        // The request is only valid once complete.
+        let partial = path.with_extension("request.partial");
+        std::fs::write(&partial, &payload)?;
+        std::fs::rename(partial, &path)?;
+
+        Ok(Self { payload, id, path })
+    }
+
+    /// Upload the request, resuming after failures, and return the connection the response
+    /// will arrive on.
+    pub async fn upload(&self, endpoint: &Endpoint) -> Result<Stream, UploadError> {
+        let manifest = Manifest {
+            id: self.id.clone(),
+            len: self.payload.len() as u64,
+            chunk_size: CHUNK_SIZE,
+            digest: upload::digest(&self.payload),
+        };
+        let mut attempt = 1;
+        loop {
+            match self.try_upload(endpoint, &manifest).await {
+                Ok(stream) => return Ok(stream),
+                Err(err) if attempt < MAX_ATTEMPTS => {
+                    let delay = Duration::from_secs(1 << attempt);
+                    log::warn!("Upload interrupted: {err}, resuming in {delay:?}");
+                    tokio::time::sleep(delay).await;
+                    attempt += 1;
+                }
+                Err(err) => return Err(err),
+            }
+        }
+    }
+
+    async fn try_upload(
+        &self,
+        endpoint: &Endpoint,
+        manifest: &Manifest,
+    ) -> Result<Stream, UploadError> {
+        let chunks = manifest.chunks();
+
+        let mut stream = Stream::connect(endpoint).await?;
+        let mut hello = HELLO.to_vec();
+        hello.extend(bincode::encode_to_vec(manifest, crate::BINCODE_CONFIG)?);
+        stream.send(&hello).await?;
+
+        let mut acked = recv_ack(&mut stream).await?.next;
+        if acked > 0 {
+            log::info!("Resuming upload from chunk {acked} of {chunks}");
+        }
+
+        let mut pending = (0..)
+            .zip(self.payload.chunks(CHUNK_SIZE as usize))
+            .skip_while(|&(seq, _)| seq < acked);
+        let mut sent = acked;
+        while acked < chunks {
+            if sent - acked < IN_FLIGHT
+                && let Some((seq, data)) = pending.next()
+            {
+                let header = ChunkHeader {
+                    seq,
+                    checksum: crc32fast::hash(data),
+                };
+                let mut chunk = bincode::encode_to_vec(header, crate::BINCODE_CONFIG)?;
+                chunk.extend_from_slice(data);
+                stream.send(&chunk).await?;
+                sent += 1;
+                continue;
+            }
+
+            let ack = recv_ack(&mut stream).await?;
+            if ack.next != acked + 1 {
+                return Err(UploadError::UnexpectedAck(ack.next));
+            }
+            acked = ack.next;
+            log::debug!("Chunk {acked}/{chunks} acknowledged");
+        }
+
+        Ok(stream)
+    }
+
+    /// Remove the request from the cache, once answered.
+    pub fn remove(self) -> Result<(), std::io::Error> {
+        std::fs::remove_file(&self.path)
+    }
+}
+
+async fn recv_ack(stream: &mut Stream) -> Result<Ack, UploadError> {
+    let payload = stream.recv().await?;
+    Ok(bincode::decode_from_slice(&payload, crate::BINCODE_CONFIG)?.0)
+}
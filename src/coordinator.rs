@@ -0,0 +1,576 @@
+//! Coordinator spreading the jobs of clients over several worker servers.
+//!
+//! A job is split into contiguous shards, which are dispatched to the workers as regular
+//! requests. Each worker runs one shard at a time, and picks the next pending one when done,
+//! so faster workers naturally take more shards.
+//!
+//! Once every shard has been dispatched, idle workers speculatively run a copy of the
+//! shards that take much longer than the others: the first result to come back is used and
+//! the other attempt is cancelled. A worker that fails is not used anymore for this job,
+//! and its shard goes back to the pending ones.
+//!
+//! Partial results of element-wise jobs are concatenated in order, those of aggregates are
+//! summed with an add tree, group by group for queries.
+//!
+//! When the client asks for statistics, those of the workers are added up, along with the
+//! time spent by the coordinator itself to receive, split and merge the job.
+//!
+//! Like servers, coordinators accept [multiplexed](crate::mux) sessions, running the jobs of
+//! a session concurrently.
+
+pub mod config;
+
+use crate::mux::{self, Channel, Responder};
+use crate::protocol::{self, COLLECTION_FLAGS, Job, Layout, Request, ServerStats};
+use crate::transport::{Endpoint, Stream};
+use config::CoordinatorConfig;
+use core::net::SocketAddr;
+use core::time::Duration;
+use fhe_core::api::CryptoSystem;
+use fhe_operations::program::ProgramData;
+use fhe_operations::selectable_collection::{SelectableCS, SelectableCollection};
+use fhe_operations::seq_ops::{SeqOpsColumns, SeqOpsData};
+use fhe_operations::sql::WirePlan;
+use seal_lib::{BfvHOperation1, BfvHOperation2, Ciphertext, SealBfvCS};
+use std::collections::VecDeque;
+use std::sync::Arc;
+use std::time::Instant;
+use thiserror::Error;
+use tokio::task::{AbortHandle, JoinSet};
+
+/// How often running shards are checked for stragglers.
+const STRAGGLER_CHECK_INTERVAL: Duration = Duration::from_millis(100);
+
+#[derive(Error, Debug)]
+pub enum CoordinatorError {
+    #[error("Worker I/O error: {0}")]
+    Io(#[from] std::io::Error),
+    #[error("Failed to encode shard: {0}")]
+    Encode(#[from] bincode::error::EncodeError),
+    #[error("Failed to decode data: {0}")]
+    Decode(#[from] bincode::error::DecodeError),
+    #[error("Failed to load partial result: {0}")]
+    Load(#[from] seal_lib::Error),
+    #[error("Worker returned {0} partial results, expected none or {1}")]
+    UnexpectedResults(usize, usize),
+    #[error("No worker left to run the job")]
+    NoWorkerLeft,
+}
+
+/// Stand-in `CryptoSystem` whose ciphertexts are kept serialized.
+///
+/// A `Ciphertext` encodes exactly as its bytes, so jobs can be decoded and split with this
+/// system without loading any ciphertext. It cannot compute anything.
+struct Routed;
+
+impl CryptoSystem for Routed {
+    type Plaintext = u64;
+    type Ciphertext = Vec<u8>;
+    type Operation1 = BfvHOperation1;
+    type Operation2 = BfvHOperation2;
+
+    fn cipher(&self, _plaintext: &Self::Plaintext) -> Self::Ciphertext {
+        unreachable!("routed ciphertexts are never computed on")
+    }
+
+    fn decipher(&self, _ciphertext: &Self::Ciphertext) -> Self::Plaintext {
+        unreachable!("routed ciphertexts are never computed on")
+    }
+
+    fn operate1(&self, _operation: Self::Operation1, _lhs: &Self::Ciphertext) -> Self::Ciphertext {
+        unreachable!("routed ciphertexts are never computed on")
+    }
+
+    fn operate2(
+        &self,
+        _operation: Self::Operation2,
+        _lhs: &Self::Ciphertext,
+        _rhs: &Self::Ciphertext,
+    ) -> Self::Ciphertext {
+        unreachable!("routed ciphertexts are never computed on")
+    }
+
+    fn relinearize(&self, _ciphertext: &mut Self::Ciphertext) {
+        unreachable!("routed ciphertexts are never computed on")
+    }
+}
+
+impl SelectableCS for Routed {
+    const ADD_OPP: Self::Operation2 = SealBfvCS::ADD_OPP;
+    const MUL_OPP: Self::Operation2 = SealBfvCS::MUL_OPP;
+
+    const NEUTRAL_ADD: Self::Plaintext = SealBfvCS::NEUTRAL_ADD;
+    const NEUTRAL_MUL: Self::Plaintext = SealBfvCS::NEUTRAL_MUL;
+
+    fn negate(&self, _ciphertext: &Self::Ciphertext) -> Self::Ciphertext {
+        unreachable!("routed ciphertexts are never computed on")
+    }
+
+    fn add_plain(
+        &self,
+        _ciphertext: &Self::Ciphertext,
+        _plaintext: &Self::Plaintext,
+    ) -> Self::Ciphertext {
+        unreachable!("routed ciphertexts are never computed on")
+    }
+}
+
+/// Split the data of a job into at most `shards` requests.
+fn split_job(
+    request: &Request,
+    data: &[u8],
+    shards: usize,
+) -> Result<Vec<Arc<Vec<u8>>>, CoordinatorError> {
+    let encoded_shards = match request.job {
+        Job::SeqOps | Job::SeqOpsSum if request.layout == Layout::Columns => {
+            let (columns, _): (SeqOpsColumns<Routed>, _) =
+                bincode::decode_from_slice(data, crate::BINCODE_CONFIG)?;
+            // Each worker only receives the operands of its shard.
+            columns
+                .split(shards)
+                .into_iter()
+                .map(|shard| bincode::encode_to_vec(shard.compact(), crate::BINCODE_CONFIG))
+                .collect::<Result<Vec<_>, _>>()?
+        }
+        Job::SeqOps | Job::SeqOpsSum => {
+            let (exch_data, _): (SeqOpsData<Routed>, _) =
+                bincode::decode_from_slice(data, crate::BINCODE_CONFIG)?;
+            exch_data
+                .split(shards)
+                .into_iter()
+                .map(|shard| bincode::encode_to_vec(shard, crate::BINCODE_CONFIG))
+                .collect::<Result<Vec<_>, _>>()?
+        }
+        Job::Program => {
+            let (data, _): (ProgramData<Routed>, _) =
+                bincode::decode_from_slice(data, crate::BINCODE_CONFIG)?;
+            data.split(shards)
+                .into_iter()
+                .map(|shard| bincode::encode_to_vec(shard, crate::BINCODE_CONFIG))
+                .collect::<Result<Vec<_>, _>>()?
+        }
+        Job::Query => {
+            let (plan, read): (WirePlan, _) =
+                bincode::decode_from_slice(data, crate::BINCODE_CONFIG)?;
+            let (collection, _): (SelectableCollection<COLLECTION_FLAGS, Routed>, _) =
+                bincode::decode_from_slice(&data[read..], crate::BINCODE_CONFIG)?;
+            // Each worker receives the plan ahead of its shard.
+            collection
+                .split(shards)
+                .into_iter()
+                .map(|shard| {
+                    let mut encoded = bincode::encode_to_vec(&plan, crate::BINCODE_CONFIG)?;
+                    encoded.extend(bincode::encode_to_vec(shard, crate::BINCODE_CONFIG)?);
+                    Ok(encoded)
+                })
+                .collect::<Result<Vec<_>, bincode::error::EncodeError>>()?
+        }
+        Job::Repack => {
+            let ((keys, scalars), _): ((Vec<u8>, Vec<Vec<u8>>), _) =
+                bincode::decode_from_slice(data, crate::BINCODE_CONFIG)?;
+            // Each shard packs full ciphertexts but the last, and receives the keys ahead of its
+            // ciphertexts.
+            let width = protocol::repack_width();
+            let per_shard = scalars.len().div_ceil(width).div_ceil(shards.max(1)).max(1) * width;
+            let mut encoded_shards = scalars
+                .chunks(per_shard)
+                .map(|shard| bincode::encode_to_vec((&keys, shard), crate::BINCODE_CONFIG))
+                .collect::<Result<Vec<_>, _>>()?;
+            if encoded_shards.is_empty() {
+                encoded_shards.push(bincode::encode_to_vec(
+                    (&keys, &scalars),
+                    crate::BINCODE_CONFIG,
+                )?);
+            }
+            encoded_shards
+        }
+        Job::CollectionSum { .. } => {
+            let (collection, _): (SelectableCollection<COLLECTION_FLAGS, Routed>, _) =
+                bincode::decode_from_slice(data, crate::BINCODE_CONFIG)?;
+            collection
+                .split(shards)
+                .into_iter()
+                .map(|shard| bincode::encode_to_vec(shard, crate::BINCODE_CONFIG))
+                .collect::<Result<Vec<_>, _>>()?
+        }
+    };
+
+    encoded_shards
+        .iter()
+        .map(|shard| Ok(Arc::new(protocol::encode_request(request, shard)?)))
+        .collect()
+}
+
+/// What a worker returned for a shard.
+#[derive(Clone, Default)]
+struct ShardOutput {
+    /// Serialized ciphertexts.
+    results: Vec<Vec<u8>>,
+    stats: Option<ServerStats>,
+}
+
+/// Run one shard on a worker, reading all the frames of its response if `streamed`.
+///
+/// The shards of aggregate jobs must return none or `groups` partial results, one per group.
+async fn run_shard(
+    worker: SocketAddr,
+    request: Arc<Vec<u8>>,
+    streamed: bool,
+    groups: Option<usize>,
+) -> Result<ShardOutput, CoordinatorError> {
+    let mut stream = Stream::connect(&Endpoint::Tcp(worker)).await?;
+    stream.send(&request).await?;
+
+    let mut output = ShardOutput::default();
+    loop {
+        let response = stream.recv().await?;
+
+        // Ciphertexts encode as their bytes, there is no need to load them here.
+        let (results, read): (Vec<Vec<u8>>, _) =
+            bincode::decode_from_slice(&response, crate::BINCODE_CONFIG)?;
+        if !streamed || results.is_empty() {
+            output.results.extend(results);
+            output.stats = protocol::decode_trailer(&response[read..])?;
+            let count = output.results.len();
+            if let Some(groups) = groups
+                && count != 0
+                && count != groups
+            {
+                return Err(CoordinatorError::UnexpectedResults(count, groups));
+            }
+            return Ok(output);
+        }
+        output.results.extend(results);
+    }
+}
+
+/// A shard being run by a worker.
+struct Attempt {
+    shard: usize,
+    worker: usize,
+    started: Instant,
+    handle: AbortHandle,
+}
+
+/// Run every shard on the workers, and return their results in order.
+///
+/// A worker failing a shard, or returning other than none or `groups` results for a shard of
+/// an aggregate job, is not given other shards, and the shard is run again by another one.
+async fn dispatch(
+    shards: &[Arc<Vec<u8>>],
+    streamed: bool,
+    groups: Option<usize>,
+    config: &CoordinatorConfig,
+) -> Result<Vec<ShardOutput>, CoordinatorError> {
+    let workers = config.workers();
+
+    let mut pending: VecDeque<usize> = (0..shards.len()).collect();
+    let mut idle: VecDeque<usize> = (0..workers.len()).collect();
+    let mut running: Vec<Attempt> = Vec::new();
+    let mut results: Vec<Option<ShardOutput>> = vec![None; shards.len()];
+    let mut durations: Vec<Duration> = Vec::new();
+
+    let mut tasks = JoinSet::new();
+    let mut ticker = tokio::time::interval(STRAGGLER_CHECK_INTERVAL);
+
+    while durations.len() < shards.len() {
+        while let Some(worker) = idle.pop_front() {
+            let Some(shard) = pending
+                .pop_front()
+                .or_else(|| straggler(&running, &durations, shards.len(), config))
+            else {
+                idle.push_front(worker);
+                break;
+            };
+
+            if running.iter().any(|attempt| attempt.shard == shard) {
+                log::info!(
+                    "Shard {shard} is straggling, dispatching a copy to {}",
+                    workers[worker]
+                );
+            }
+
+            let request = Arc::clone(&shards[shard]);
+            let addr = workers[worker];
+            let started = Instant::now();
+            let handle = tasks.spawn(async move {
+                let result = run_shard(addr, request, streamed, groups).await;
+                (shard, worker, started.elapsed(), result)
+            });
+            running.push(Attempt {
+                shard,
+                worker,
+                started,
+                handle,
+            });
+        }
+
+        if running.is_empty() {
+            return Err(CoordinatorError::NoWorkerLeft);
+        }
+
+        tokio::select! {
+            Some(joined) = tasks.join_next() => {
+                let (shard, worker, elapsed, result) = match joined {
+                    Ok(finished) => finished,
+                    Err(err) if err.is_cancelled() => continue,
+                    Err(err) => std::panic::resume_unwind(err.into_panic()),
+                };
+                // Cancelled copies may still complete, their results are dropped.
+                let Some(position) = running
+                    .iter()
+                    .position(|attempt| attempt.shard == shard && attempt.worker == worker)
+                else {
+                    continue;
+                };
+                running.swap_remove(position);
+
+                match result {
+                    Ok(partial) => {
+                        idle.push_back(worker);
+                        if results[shard].is_some() {
+                            continue;
+                        }
+                        log::debug!("Shard {shard} done by {} in {elapsed:?}", workers[worker]);
+                        results[shard] = Some(partial);
+                        durations.push(elapsed);
+
+                        // Cancel the copies of this shard, their workers are free again.
+                        running.retain(|attempt| {
+                            if attempt.shard == shard {
+                                attempt.handle.abort();
+                                idle.push_back(attempt.worker);
+                                false
+                            } else {
+                                true
+                            }
+                        });
+                    }
+                    Err(err) => {
+                        log::warn!("Worker {} failed on shard {shard}: {err}", workers[worker]);
+                        if results[shard].is_none()
+                            && !running.iter().any(|attempt| attempt.shard == shard)
+                        {
+                            pending.push_front(shard);
+                        }
+                    }
+                }
+            }
+            _ = ticker.tick() => {}
+        }
+    }
+
+    Ok(results.into_iter().map(Option::unwrap_or_default).collect())
+}
+
+/// Pick the running shard that is the most late compared to the finished ones, if any.
+///
+/// Shards are only considered once at least half of them are done, and each shard is
+/// copied at most once.
+fn straggler(
+    running: &[Attempt],
+    durations: &[Duration],
+    shards: usize,
+    config: &CoordinatorConfig,
+) -> Option<usize> {
+    if durations.is_empty() || durations.len() * 2 < shards {
+        return None;
+    }
+
+    let mut sorted = durations.to_vec();
+    sorted.sort_unstable();
+    let threshold = sorted[sorted.len() / 2].mul_f64(config.straggler_factor());
+
+    running
+        .iter()
+        .filter(|attempt| attempt.started.elapsed() > threshold)
+        .filter(|attempt| {
+            running
+                .iter()
+                .filter(|other| other.shard == attempt.shard)
+                .count()
+                == 1
+        })
+        .min_by_key(|attempt| attempt.started)
+        .map(|attempt| attempt.shard)
+}
+
+/// Sum ciphertexts pairwise, level by level.
+fn add_tree(mut level: Vec<Ciphertext>, bfv_cs: &SealBfvCS) -> Option<Ciphertext> {
+    while level.len() > 1 {
+        level = level
+            .chunks(2)
+            .map(|pair| match pair {
+                [lhs, rhs] => bfv_cs.operate2(SealBfvCS::ADD_OPP, lhs, rhs),
+                [single] => single.clone(),
+                _ => unreachable!(),
+            })
+            .collect();
+    }
+    level.pop()
+}
+
+/// Run a job on the workers, and return the payloads of the response for the client.
+///
+/// `receive` is the time it took to receive the request, reported in the statistics.
+pub async fn run_job(
+    request: &[u8],
+    config: &CoordinatorConfig,
+    receive: Duration,
+) -> Result<Vec<Vec<u8>>, CoordinatorError> {
+    let start = Instant::now();
+    let (request, data) = protocol::decode_request(request)?;
+
+    let shards = split_job(&request, data, config.shards())?;
+    // Aggregates are one ciphertext, or one per group for queries.
+    let groups = if request.job == Job::Query {
+        let (plan, _): (WirePlan, _) = bincode::decode_from_slice(data, crate::BINCODE_CONFIG)?;
+        plan.predicates.len().max(1)
+    } else {
+        1
+    };
+    let split = start.elapsed();
+    log::info!(
+        "Dispatching {:?} as {} shards to {} workers",
+        request.job,
+        shards.len(),
+        config.workers().len()
+    );
+
+    let start = Instant::now();
+    let aggregates = (!request.job.is_element_wise()).then_some(groups);
+    let outputs = dispatch(&shards, request.stream, aggregates, config).await?;
+    log::info!("Shards processed in {:?}", start.elapsed());
+
+    let start = Instant::now();
+    let mut stats = ServerStats {
+        receive,
+        decode: split,
+        ..ServerStats::default()
+    };
+    for shard_stats in outputs.iter().filter_map(|output| output.stats.as_ref()) {
+        stats.merge(shard_stats);
+    }
+    let stats = request.stats.then_some(&mut stats);
+
+    // Streamed element-wise results are sent shard by shard, everything else in one payload.
+    let mut payloads = if request.job.is_element_wise() {
+        if request.stream {
+            outputs
+                .iter()
+                .filter(|output| !output.results.is_empty())
+                .map(|output| bincode::encode_to_vec(&output.results, crate::BINCODE_CONFIG))
+                .collect::<Result<Vec<_>, _>>()?
+        } else {
+            let results: Vec<Vec<u8>> = outputs.into_iter().flat_map(|o| o.results).collect();
+            vec![bincode::encode_to_vec(results, crate::BINCODE_CONFIG)?]
+        }
+    } else {
+        let bfv_ctx = protocol::bfv_context();
+        let bfv_cs = SealBfvCS::new(&bfv_ctx);
+
+        // Each shard returns one partial result per group, or none if it was empty, as
+        // checked by `run_shard`.
+        let mut levels = vec![Vec::new(); groups];
+        for output in &outputs {
+            for (level, raw) in levels.iter_mut().zip(&output.results) {
+                level.push(bfv_ctx.load_ciphertext(raw)?);
+            }
+        }
+        let sum: Vec<Ciphertext> = levels
+            .into_iter()
+            .filter_map(|level| add_tree(level, &bfv_cs))
+            .collect();
+
+        if request.stream && sum.is_empty() {
+            Vec::new()
+        } else {
+            vec![bincode::encode_to_vec(sum, crate::BINCODE_CONFIG)?]
+        }
+    };
+    if request.stream {
+        payloads.push(protocol::encode_end_frame(None)?);
+    }
+
+    if let Some(stats) = stats {
+        stats.encode += start.elapsed();
+        log::info!("Request statistics: {stats}");
+        protocol::encode_trailer_into(payloads.last_mut().unwrap(), Some(&*stats))?;
+    }
+
+    Ok(payloads)
+}
+
+pub async fn handle_client(mut stream: Stream, config: Arc<CoordinatorConfig>) {
+    let start = Instant::now();
+    let Ok(request) = stream.recv().await else {
+        log::error!("Failed to receive data from client");
+        return;
+    };
+
+    if *request == *mux::HELLO {
+        log::info!("Serving a multiplexed session");
+        mux::serve(stream, |channel| {
+            handle_stream(channel, Arc::clone(&config))
+        })
+        .await;
+        return;
+    }
+
+    respond(
+        &request,
+        start.elapsed(),
+        &config,
+        &mut Responder::Stream(&mut stream),
+    )
+    .await;
+}
+
+/// Answer the request sent on a stream of a multiplexed session.
+async fn handle_stream(mut channel: Channel, config: Arc<CoordinatorConfig>) {
+    let start = Instant::now();
+    let Ok(Some(request)) = channel.recv().await else {
+        log::error!("Failed to receive data on stream {}", channel.id());
+        return;
+    };
+
+    respond(
+        &request,
+        start.elapsed(),
+        &config,
+        &mut Responder::Channel(&mut channel),
+    )
+    .await;
+}
+
+/// Run a job, and send its response.
+async fn respond(
+    request: &[u8],
+    receive: Duration,
+    config: &CoordinatorConfig,
+    responder: &mut Responder<'_>,
+) {
+    // Dropping the job closes its connections to the workers.
+    let payloads = tokio::select! {
+        payloads = run_job(request, config, receive) => payloads,
+        () = responder.cancelled() => {
+            log::info!("Job cancelled by the client");
+            return;
+        }
+    };
+    let payloads = match payloads {
+        Ok(payloads) => payloads,
+        Err(err) => {
+            log::error!("Failed to run job: {err}");
+            return;
+        }
+    };
+
+    for payload in payloads {
+        if let Err(e) = responder.send(&payload).await {
+            log::error!("Failed to send data back to client: {e}");
+            return;
+        }
+    }
+    responder.finish();
+}
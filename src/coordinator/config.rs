@@ -0,0 +1,123 @@
+use crate::client::config::ConfigError;
+use core::net::SocketAddr;
+use std::path::Path;
+use toml::Table;
+
+const DEFAULT_SHARDS_PER_WORKER: usize = 1;
+const DEFAULT_STRAGGLER_FACTOR: f64 = 2.0;
+
+#[derive(Debug)]
+pub struct CoordinatorConfig {
+    workers: Vec<SocketAddr>,
+    shards_per_worker: usize,
+    straggler_factor: f64,
+}
+
+impl CoordinatorConfig {
+    pub async fn load_config(config_file: &Path) -> Result<Self, ConfigError> {
+        let file = tokio::fs::read_to_string(config_file)
+            .await
+            .map_err(ConfigError::LoadError)?;
+
+        Self::parse(&file)
+    }
+
+    fn parse(str_file: &str) -> Result<Self, ConfigError> {
+        let table = str_file.parse::<Table>().map_err(ConfigError::ParseError)?;
+
+        let workers = table
+            .get("workers")
+            .ok_or(ConfigError::MissingKey("workers"))?
+            .as_array()
+            .ok_or(ConfigError::InvalidValue("workers"))?
+            .iter()
+            .map(|worker| {
+                worker
+                    .as_str()
+                    .and_then(|worker| worker.parse().ok())
+                    .ok_or(ConfigError::InvalidValue("workers"))
+            })
+            .collect::<Result<Vec<SocketAddr>, _>>()?;
+        if workers.is_empty() {
+            return Err(ConfigError::InvalidValue("workers"));
+        }
+
+        let shards_per_worker = match table.get("shards_per_worker") {
+            None => DEFAULT_SHARDS_PER_WORKER,
+            Some(value) => value
+                .as_integer()
+                .and_then(|value| usize::try_from(value).ok())
+                .filter(|&value| value > 0)
+                .ok_or(ConfigError::InvalidValue("shards_per_worker"))?,
+        };
+
+        let straggler_factor = match table.get("straggler_factor") {
+            None => DEFAULT_STRAGGLER_FACTOR,
+            Some(value) => value
+                .as_float()
+                .filter(|&value| value >= 1.0)
+                .ok_or(ConfigError::InvalidValue("straggler_factor"))?,
+        };
+
+        Ok(Self {
+            workers,
+            shards_per_worker,
+            straggler_factor,
+        })
+    }
+
+    #[must_use]
+    #[inline]
+    /// Addresses of the worker servers.
+    pub fn workers(&self) -> &[SocketAddr] {
+        &self.workers
+    }
+
+    #[must_use]
+    #[inline]
+    /// Number of shards each job is split into.
+    pub const fn shards(&self) -> usize {
+        self.workers.len() * self.shards_per_worker
+    }
+
+    #[must_use]
+    #[inline]
+    /// A shard running for longer than this factor times the median shard duration
+    /// is speculatively dispatched to another worker.
+    pub const fn straggler_factor(&self) -> f64 {
+        self.straggler_factor
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_parse() {
+        let config = CoordinatorConfig::parse(
+            r#"
+            workers = ["127.0.0.1:8081", "127.0.0.1:8082"]
+            shards_per_worker = 3
+            "#,
+        )
+        .unwrap();
+
+        assert_eq!(config.workers().len(), 2);
+        assert_eq!(config.shards(), 6);
+        assert!((config.straggler_factor() - DEFAULT_STRAGGLER_FACTOR).abs() < f64::EPSILON);
+    }
+
+    #[test]
+    fn test_parse_invalid() {
+        assert!(CoordinatorConfig::parse("workers = []").is_err());
+        assert!(CoordinatorConfig::parse(r#"workers = ["not an address"]"#).is_err());
+        assert!(
+            CoordinatorConfig::parse(
+                r#"workers = ["127.0.0.1:8081"]
+straggler_factor = 0.5"#
+            )
+            .is_err()
+        );
+    }
+}
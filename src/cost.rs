@@ -0,0 +1,352 @@
+//! Cost model of homomorphic operations.
+//!
+//! Operations differ widely in cost: with BFV, a `Mul` costs 50 to 100 times an `Add`. Cutting a
+//! job into chunks of as many items, and sharing items evenly between threads, thus leaves
+//! threads idle when the costly operations are clustered. Servers instead cut jobs into chunks
+//! of similar cost, and run the items of a chunk costliest first: each thread takes the
+//! costliest item left, so that cheap items fill the gaps at the end (longest processing time
+//! first).
+//!
+//! Backends whose operations are themselves parallel, e.g. TFHE, would use more threads than
+//! there are cores if every item ran on its own thread: the threads are then shared between the
+//! items and their operations, see [`par_map_budgeted`]. The operations of the items run at
+//! once get their own pools of threads, built once per scheduler shard, see [`OpPools`].
+//!
+//! Costs are measured, in nanoseconds, when the server starts, or loaded from a file, e.g.
+//! written by `cargo bench --bench partitioning`.
+
+use crate::numa::{self, Node};
+use core::cmp::Reverse;
+use core::fmt::{Debug, Write as _};
+use fhe_core::parallelism::ThreadBudget;
+use rayon::{ThreadPool, ThreadPoolBuilder};
+use std::collections::HashMap;
+use std::path::Path;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex, OnceLock};
+use std::time::Instant;
+use thiserror::Error;
+use toml::Table;
+
+/// Runs of each operation averaged when measuring costs.
+const MEASURE_RUNS: u32 = 16;
+
+#[derive(Error, Debug)]
+pub enum CostModelError {
+    #[error("Failed to load cost model: {0}")]
+    LoadError(#[from] std::io::Error),
+    #[error("Failed to parse cost model: {0}")]
+    ParseError(#[from] toml::de::Error),
+    #[error("Missing cost of operation: {0}")]
+    MissingKey(String),
+    #[error("Invalid cost of operation: {0}")]
+    InvalidValue(String),
+}
+
+/// Relative cost of each operation of a backend.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct CostModel<Op> {
+    costs: Vec<(Op, u64)>,
+}
+
+impl<Op: Copy + Debug> CostModel<Op> {
+    #[must_use]
+    /// Every operation costs the same.
+    pub fn uniform(ops: &[Op]) -> Self {
+        Self {
+            costs: ops.iter().map(|&op| (op, 1)).collect(),
+        }
+    }
+
+    #[must_use]
+    /// Measure the cost of each operation, in nanoseconds, with `run` executing it once.
+    pub fn measure(ops: &[Op], mut run: impl FnMut(Op)) -> Self {
+        let costs = ops
+            .iter()
+            .map(|&op| {
+                // Warm up caches and lazily allocated memory.
+                run(op);
+                let start = Instant::now();
+                for _ in 0..MEASURE_RUNS {
+                    run(op);
+                }
+                let nanos = start.elapsed().as_nanos() / u128::from(MEASURE_RUNS);
+                (op, u64::try_from(nanos).unwrap_or(u64::MAX).max(1))
+            })
+            .collect();
+        Self { costs }
+    }
+
+    /// Load the costs of `ops` from a TOML file, each under the name of its operation,
+    /// e.g. `Add = 40` and `Mul = 3000`.
+    pub fn load(path: &Path, ops: &[Op]) -> Result<Self, CostModelError> {
+        let table = std::fs::read_to_string(path)?.parse::<Table>()?;
+        let costs = ops
+            .iter()
+            .map(|&op| {
+                let name = format!("{op:?}");
+                let cost = table
+                    .get(&name)
+                    .ok_or_else(|| CostModelError::MissingKey(name.clone()))?
+                    .as_integer()
+                    .and_then(|cost| u64::try_from(cost).ok())
+                    .filter(|&cost| cost > 0)
+                    .ok_or(CostModelError::InvalidValue(name))?;
+                Ok((op, cost))
+            })
+            .collect::<Result<_, CostModelError>>()?;
+        Ok(Self { costs })
+    }
+
+    #[must_use]
+    /// The costs as TOML, in the format read by [`CostModel::load`].
+    pub fn to_toml(&self) -> String {
+        self.costs
+            .iter()
+            .fold(String::new(), |mut toml, (op, cost)| {
+                let _ = writeln!(toml, "{op:?} = {cost}");
+                toml
+            })
+    }
+
+    #[must_use]
+    #[inline]
+    /// Cost of an operation, that of the costliest one if unknown.
+    pub fn cost(&self, op: &Op) -> u64 {
+        let op = core::mem::discriminant(op);
+        self.costs
+            .iter()
+            .find(|(known, _)| core::mem::discriminant(known) == op)
+            .map_or_else(|| self.max_cost(), |&(_, cost)| cost)
+    }
+
+    #[must_use]
+    #[inline]
+    /// Cost of the costliest operation.
+    pub fn max_cost(&self) -> u64 {
+        self.costs.iter().map(|&(_, cost)| cost).max().unwrap_or(1)
+    }
+}
+
+impl<Op: Debug> core::fmt::Display for CostModel<Op> {
+    fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+        let min = self.costs.iter().map(|&(_, cost)| cost).min().unwrap_or(1);
+        for (i, (op, cost)) in self.costs.iter().enumerate() {
+            if i > 0 {
+                f.write_str(", ")?;
+            }
+            #[allow(clippy::cast_precision_loss)] // Only displayed
+            let relative = *cost as f64 / min as f64;
+            write!(f, "{op:?} {relative:.1}")?;
+        }
+        Ok(())
+    }
+}
+
+/// Map `items` on the rayon pool, costliest first, and return the results in order.
+///
+/// Each thread of the pool takes the costliest item left, until none is.
+pub fn par_map_costliest_first<T, R, F>(items: &[T], cost: impl Fn(&T) -> u64, map: F) -> Vec<R>
+where
+    T: Sync,
+    R: Send + Sync,
+    F: Fn(&T) -> R + Sync,
+{
+    let mut order = (0..items.len()).collect::<Vec<_>>();
+    order.sort_by_cached_key(|&i| Reverse(cost(&items[i])));
+
+    let results = items.iter().map(|_| OnceLock::new()).collect::<Vec<_>>();
+    let next = AtomicUsize::new(0);
+    rayon::broadcast(|_| {
+        while let Some(&i) = order.get(next.fetch_add(1, Ordering::Relaxed)) {
+            let _ = results[i].set(map(&items[i]));
+        }
+    });
+
+    results
+        .into_iter()
+        .map(|result| result.into_inner().expect("every item is mapped"))
+        .collect()
+}
+
+/// Pools of threads for the operations of the items [`par_map_budgeted`] runs at once.
+///
+/// For each number of threads per operation, `threads` are cut into pools of this many threads
+/// on first use, pinned to the CPUs of the node if any, and reused by every later call.
+pub struct OpPools {
+    threads: usize,
+    node: Option<Node>,
+    pools: Mutex<HashMap<usize, Arc<[ThreadPool]>>>,
+}
+
+impl OpPools {
+    #[must_use]
+    #[inline]
+    /// Pools sharing `threads` threads, pinned to `node` if any.
+    pub fn new(threads: usize, node: Option<Node>) -> Self {
+        Self {
+            threads: threads.max(1),
+            node,
+            pools: Mutex::default(),
+        }
+    }
+
+    /// The pools of `op_threads` threads each, built on first use.
+    fn get(&self, op_threads: usize) -> Arc<[ThreadPool]> {
+        let mut pools = self.pools.lock().unwrap();
+        let pools = pools.entry(op_threads).or_insert_with(|| {
+            (0..(self.threads / op_threads).max(1))
+                .map(|index| self.build(op_threads, index))
+                .collect()
+        });
+        Arc::clone(pools)
+    }
+
+    fn build(&self, op_threads: usize, index: usize) -> ThreadPool {
+        let mut builder = ThreadPoolBuilder::new().num_threads(op_threads);
+        if let Some(node) = &self.node {
+            let Node { id, cpus } = node.clone();
+            builder = builder
+                .thread_name(move |thread| format!("node{id}-op{op_threads}.{index}-{thread}"))
+                .start_handler(move |_| {
+                    if let Err(err) = numa::pin(&cpus) {
+                        log::warn!("Failed to pin operation thread to node {id}: {err}");
+                    }
+                });
+        }
+        builder
+            .build()
+            .expect("failed to build the pool of an operation")
+    }
+}
+
+/// Map `items` like [`par_map_costliest_first`], for operations that can each keep `op_threads`
+/// threads busy (see [`CryptoSystem::op_threads`](fhe_core::api::CryptoSystem::op_threads)).
+///
+/// The threads of the rayon pool are shared between items and operations by a
+/// [`ThreadBudget`]: when operations get several threads, each item running at once has its
+/// own pool of this many threads from `op_pools`, and the operation's parallel iterators run
+/// on it rather than on the threads of the other items.
+pub fn par_map_budgeted<T, R, F>(
+    items: &[T],
+    cost: impl Fn(&T) -> u64,
+    op_threads: usize,
+    op_pools: &OpPools,
+    map: F,
+) -> Vec<R>
+where
+    T: Sync,
+    R: Send + Sync,
+    F: Fn(&T) -> R + Sync,
+{
+    let op_cost = items.iter().map(&cost).max().unwrap_or(0);
+    let budget = ThreadBudget::split(
+        rayon::current_num_threads(),
+        items.len(),
+        op_threads,
+        op_cost,
+    );
+    if budget.op_threads == 1 {
+        return par_map_costliest_first(items, cost, map);
+    }
+
+    let mut order = (0..items.len()).collect::<Vec<_>>();
+    order.sort_by_cached_key(|&i| Reverse(cost(&items[i])));
+
+    let results = items.iter().map(|_| OnceLock::new()).collect::<Vec<_>>();
+    let next = AtomicUsize::new(0);
+    let pools = op_pools.get(budget.op_threads);
+    rayon::scope(|scope| {
+        for pool in pools.iter().take(budget.items) {
+            scope.spawn(|_| {
+                pool.install(|| {
+                    while let Some(&i) = order.get(next.fetch_add(1, Ordering::Relaxed)) {
+                        let _ = results[i].set(map(&items[i]));
+                    }
+                });
+            });
+        }
+    });
+
+    results
+        .into_iter()
+        .map(|result| result.into_inner().expect("every item is mapped"))
+        .collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[derive(Clone, Copy, Debug, PartialEq, Eq)]
+    enum Op {
+        Add,
+        Mul,
+    }
+
+    #[test]
+    fn test_costs() {
+        let path = std::env::temp_dir().join(format!("bpce-fhe-costs-{}.toml", std::process::id()));
+        std::fs::write(&path, "Add = 2\nMul = 150\n").unwrap();
+        let model = CostModel::load(&path, &[Op::Add, Op::Mul]).unwrap();
+        assert_eq!(model.cost(&Op::Add), 2);
+        assert_eq!(model.cost(&Op::Mul), 150);
+        assert_eq!(model.to_string(), "Add 1.0, Mul 75.0");
+
+        std::fs::write(&path, model.to_toml()).unwrap();
+        assert_eq!(CostModel::load(&path, &[Op::Add, Op::Mul]).unwrap(), model);
+
+        std::fs::write(&path, model.to_toml().replace("Mul", "Sub")).unwrap();
+        assert!(matches!(
+            CostModel::load(&path, &[Op::Add, Op::Mul]),
+            Err(CostModelError::MissingKey(_))
+        ));
+        std::fs::remove_file(path).unwrap();
+
+        // Unknown operations are assumed to be the costliest.
+        assert_eq!(CostModel::uniform(&[Op::Add]).cost(&Op::Mul), 1);
+        let measured = CostModel::measure(&[Op::Add, Op::Mul], |op| {
+            if op == Op::Mul {
+                std::thread::sleep(core::time::Duration::from_millis(1));
+            }
+        });
+        assert!(measured.cost(&Op::Mul) > measured.cost(&Op::Add));
+    }
+
+    #[test]
+    fn test_costliest_first_keeps_order() {
+        let items = (0..1000_u64).collect::<Vec<_>>();
+        let results = par_map_costliest_first(&items, |&i| i % 7, |&i| i * 2);
+        assert_eq!(results, items.iter().map(|i| i * 2).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn test_budgeted_operations_get_threads() {
+        let items = (0..2_u64).collect::<Vec<_>>();
+        let pool = rayon::ThreadPoolBuilder::new()
+            .num_threads(8)
+            .build()
+            .unwrap();
+
+        // Two costly operations that parallelize: 4 threads each.
+        let op_pools = OpPools::new(8, None);
+        let threads = pool.install(|| {
+            par_map_budgeted(
+                &items,
+                |_| 10_000_000,
+                8,
+                &op_pools,
+                |_| rayon::current_num_threads(),
+            )
+        });
+        assert_eq!(threads, [4, 4]);
+        // Their pools are built once, and reused by later calls.
+        assert_eq!(op_pools.get(4).len(), 2);
+        assert!(Arc::ptr_eq(&op_pools.get(4), &op_pools.get(4)));
+
+        // Operations on the calling thread only.
+        let results =
+            pool.install(|| par_map_budgeted(&items, |_| 10_000_000, 1, &op_pools, |&i| i * 2));
+        assert_eq!(results, [0, 2]);
+    }
+}
@@ -1,20 +1,34 @@
-#![forbid(unsafe_code)]
+#![deny(unsafe_code)]
 #![warn(clippy::nursery, clippy::pedantic)]
-#![allow(clippy::missing_panics_doc)]
+#![allow(clippy::missing_panics_doc, clippy::missing_errors_doc)]
 
+use budget::MemoryBudget;
 use client::config::ClientConfig;
-use core::net::SocketAddr;
+use client::upload::CachedRequest;
+use coordinator::config::CoordinatorConfig;
 use fhe_core::api::CryptoSystem;
+use fhe_operations::seq_ops::SeqOpsColumns;
 use load::DataLoader as _;
-use seal_lib::context::SealBFVContext;
-use seal_lib::{Ciphertext, SealBfvCS};
+use seal_lib::SealBfvCS;
 use std::path::PathBuf;
-use tokio::io::{AsyncReadExt, AsyncWriteExt};
-use tokio::net::{TcpListener, TcpStream};
+use std::sync::Arc;
+use transport::{Endpoint, Listener, Stream};
 
+pub mod budget;
+pub mod buffers;
+mod cache;
 mod client;
+pub mod coordinator;
+pub mod cost;
 mod load;
+pub mod mux;
+pub mod numa;
+mod output;
+pub mod protocol;
+pub mod scheduler;
 mod server;
+pub mod transport;
+pub mod upload;
 
 const BINCODE_CONFIG: bincode::config::Configuration = bincode::config::standard();
 
@@ -44,83 +58,257 @@ macro_rules! faillible {
     };
 }
 
-pub async fn start_client(socket_addr: SocketAddr, config_file: String) {
+pub async fn start_client(endpoint: Endpoint, config_file: String) {
     let path = PathBuf::from(config_file);
     let config = ensure!(ClientConfig::load_config(&path).await);
 
     log::debug!("Client configuration: {config:?}");
 
-    let file = ensure!(std::fs::File::open(config.data()));
-
-    let mut stream = ensure!(TcpStream::connect(socket_addr).await);
-
-    let bfv_ctx = SealBFVContext::new(
-        seal_lib::DegreeType::D4096,
-        seal_lib::SecurityLevel::TC128,
-        16,
-    );
+    let bfv_ctx = protocol::bfv_context();
     let bfv_cs = SealBfvCS::new(&bfv_ctx);
 
-    let exch_data = ensure!(load::csv::CsvLoader::<SealBfvCS>::load(file, &bfv_cs));
-    let exch_data_bytes = ensure!(bincode::encode_to_vec(exch_data, BINCODE_CONFIG));
+    // A request uploaded in resumable chunks is cached, and only built again if the data changed.
+    let start = std::time::Instant::now();
+    let cached = config.upload_cache().map(|cache| {
+        ensure!(CachedRequest::load(cache, config.data(), config.request())).map_or_else(
+            || {
+                let request = build_request(&config, &bfv_cs);
+                ensure!(CachedRequest::store(cache, config.data(), request))
+            },
+            |cached| {
+                log::info!("Reusing the request cached in {}", cache.display());
+                cached
+            },
+        )
+    });
+    let request = match cached {
+        Some(_) => Vec::new(),
+        None => build_request(&config, &bfv_cs),
+    };
+    let encode = start.elapsed();
+    // Sending the same ciphertexts again lets the server find the results of a named dataset in
+    // its cache.
+    let keep_cached = !config.request().dataset.is_empty();
 
-    ensure!(unsized_data_send(exch_data_bytes, &mut stream).await);
+    let start = std::time::Instant::now();
+    let mut stream = match &cached {
+        Some(cached) => ensure!(cached.upload(&endpoint).await),
+        None => {
+            let mut stream = ensure!(Stream::connect(&endpoint).await);
+            ensure!(stream.send(&request).await);
+            stream
+        }
+    };
 
     log::debug!("Data sent to server.");
-    let start = std::time::Instant::now();
 
-    let results = ensure!(unsized_data_recv(&mut stream).await);
+    if let Some(output) = config.output() {
+        let writer = ensure!(output::create(output));
+        let download = ensure!(client::download::download(
+            &mut stream,
+            &bfv_ctx,
+            &bfv_cs,
+            writer
+        ));
+        let total = start.elapsed();
+        if let Some(cached) = cached
+            && !keep_cached
+        {
+            faillible!(cached.remove(), ());
+        }
 
-    log::info!("Data received from server in {:?}", start.elapsed());
+        log::info!(
+            "Wrote {} results to {} in {total:?}",
+            download.results,
+            output.display()
+        );
+        if let Some(server_stats) = download.server_stats {
+            log::info!("Server: {server_stats}");
+        }
+        log::info!(
+            "Client: load and encode {encode:?}, first result after {:?}, decrypt {:?} (over all threads)",
+            download.first_result.unwrap_or(total),
+            download.decrypt,
+        );
+        return;
+    }
 
-    let results: (Vec<Ciphertext>, usize) = ensure!(bincode::decode_from_slice_with_context(
-        &results,
-        BINCODE_CONFIG,
-        bfv_ctx
-    ));
+    let response = ensure!(stream.recv().await);
+    let round_trip = start.elapsed();
+    if let Some(cached) = cached
+        && !keep_cached
+    {
+        faillible!(cached.remove(), ());
+    }
+
+    log::info!("Data received from server in {round_trip:?}");
+
+    let start = std::time::Instant::now();
+    let (results, read) = ensure!(tokio::task::block_in_place(|| {
+        protocol::decode_ciphertexts(&response, &bfv_ctx)
+    }));
+    let server_stats = ensure!(protocol::decode_trailer(&response[read..]));
+    let decode = start.elapsed();
 
-    let deciphered_results = results
-        .0
-        .iter()
-        .map(|cipher| bfv_cs.decipher(cipher))
-        .collect::<Vec<_>>();
+    let start = std::time::Instant::now();
+    let deciphered_results = if config.request().job == protocol::Job::Repack {
+        // Slots past the values of the last packed ciphertext are 0.
+        results
+            .iter()
+            .flat_map(|cipher| bfv_cs.decipher_slots(cipher))
+            .collect::<Vec<_>>()
+    } else {
+        results
+            .iter()
+            .map(|cipher| bfv_cs.decipher(cipher))
+            .collect::<Vec<_>>()
+    };
+    let decrypt = start.elapsed();
 
     log::info!("Received {:?} from server.", &deciphered_results);
+
+    if let Some(server_stats) = server_stats {
+        // The server's receive time overlaps with the upload, it is counted as network time.
+        let server_busy = server_stats.total() - server_stats.receive;
+        log::info!("Server: {server_stats}");
+        log::info!(
+            "Client: load and encode {encode:?}, decode {decode:?}, decrypt {decrypt:?}; network and transfers {:?}; server {server_busy:?}",
+            round_trip.saturating_sub(server_busy),
+        );
+    }
+}
+
+/// Load and encrypt the data of the client, and encode it after the request header.
+fn build_request(config: &ClientConfig, bfv_cs: &SealBfvCS) -> Vec<u8> {
+    let file = ensure!(std::fs::File::open(config.data()));
+    let exch_data_bytes = if config.request().job == protocol::Job::Program {
+        let columns = ensure!(load::csv::CsvLoader::<SealBfvCS>::load_columns(
+            file, bfv_cs
+        ));
+        let data = ensure!(protocol::BfvProgram::new(
+            config.program().to_vec(),
+            columns
+        ));
+        ensure!(bincode::encode_to_vec(data, BINCODE_CONFIG))
+    } else if let Some(query) = config.query()
+        && config.request().job == protocol::Job::Query
+    {
+        let (plan, collection): (_, protocol::BfvCollection) = ensure!(
+            load::csv::CsvLoader::load_query(file, query, &protocol::query_limits(), bfv_cs)
+        );
+        log::info!(
+            "Query planned with {} flags, depth {}, {:?} strategy",
+            plan.flags.len(),
+            plan.wire().depth(),
+            plan.strategy
+        );
+        if query.group_by().is_some() {
+            let labels = plan
+                .groups
+                .iter()
+                .filter_map(|group| group.label.as_deref());
+            log::info!(
+                "Results by group: {}",
+                labels.collect::<Vec<_>>().join(", ")
+            );
+        }
+        ensure!(protocol::encode_query(&plan, &collection))
+    } else if config.request().job == protocol::Job::Repack {
+        // The values of every column, one after the other.
+        let columns = ensure!(load::csv::CsvLoader::<SealBfvCS>::load_columns(
+            file, bfv_cs
+        ));
+        let scalars = columns.into_iter().flatten().collect::<Vec<_>>();
+        let keys = bfv_cs.galois_keys(&protocol::bfv_context());
+        log::info!(
+            "Sending {} ciphertexts to pack, with {} KiB of Galois keys",
+            scalars.len(),
+            keys.len() >> 10
+        );
+        ensure!(bincode::encode_to_vec((keys, scalars), BINCODE_CONFIG))
+    } else if !config.shared_operands().is_empty() {
+        let columns = ensure!(load::csv::CsvLoader::<SealBfvCS>::load_shared(
+            file,
+            config.shared_operands(),
+            bfv_cs
+        ));
+        ensure!(bincode::encode_to_vec(columns, BINCODE_CONFIG))
+    } else {
+        let exch_data = ensure!(load::csv::CsvLoader::<SealBfvCS>::load(file, bfv_cs));
+        match config.request().layout {
+            protocol::Layout::Rows => ensure!(bincode::encode_to_vec(exch_data, BINCODE_CONFIG)),
+            protocol::Layout::Columns => ensure!(bincode::encode_to_vec(
+                SeqOpsColumns::from(exch_data),
+                BINCODE_CONFIG
+            )),
+        }
+    };
+    ensure!(protocol::encode_request(config.request(), &exch_data_bytes))
 }
 
-pub async fn start_server(socket_addr: SocketAddr) {
-    let listener = ensure!(TcpListener::bind(socket_addr).await);
+pub async fn start_server(
+    endpoint: Endpoint,
+    budget: MemoryBudget,
+    upload_dir: PathBuf,
+    cost_model: Option<PathBuf>,
+    result_cache: u64,
+    numa: bool,
+) {
+    let listener = ensure!(Listener::bind(&endpoint).await);
+
+    let nodes = if numa { numa::nodes() } else { Vec::new() };
+    let scheduler = if nodes.is_empty() {
+        if numa {
+            log::warn!("NUMA topology unknown, running jobs on a single pool");
+        }
+        scheduler::Scheduler::start()
+    } else {
+        for node in &nodes {
+            log::info!("Running jobs on node {} with CPUs {:?}", node.id, node.cpus);
+        }
+        ensure!(scheduler::Scheduler::start_numa(&nodes))
+    };
+
+    let costs = match cost_model {
+        Some(path) => ensure!(cost::CostModel::load(&path, &server::OPERATIONS)),
+        None => server::measure_costs(),
+    };
+    log::info!("Relative cost of operations: {costs}");
+
+    let server = Arc::new(server::ServerContext {
+        scheduler,
+        budget: Arc::new(budget),
+        uploads: ensure!(upload::UploadStore::new(upload_dir)),
+        costs: Arc::new(costs),
+        results: cache::ResultCache::new(result_cache),
+    });
 
     loop {
         let (stream, client_addr) = faillible!(listener.accept().await, continue);
+        let server = Arc::clone(&server);
 
         tokio::spawn(async move {
             log::info!("Accepted connection from {client_addr}");
-            server::handle_client(stream).await;
+            server::handle_client(stream, server).await;
         });
     }
 }
 
-async fn unsized_data_send(data: Vec<u8>, stream: &mut TcpStream) -> Result<(), std::io::Error> {
-    let total_size = data.len();
-
-    stream.write_all(&total_size.to_le_bytes()).await?;
-
-    stream.write_all(&data).await?;
-
-    Ok(())
-}
-
-async fn unsized_data_recv(stream: &mut TcpStream) -> Result<Vec<u8>, std::io::Error> {
-    let mut size_buf = [0u8; std::mem::size_of::<u64>()];
-
-    stream.read_exact(&mut size_buf).await?;
+pub async fn start_coordinator(endpoint: Endpoint, config_file: String) {
+    let path = PathBuf::from(config_file);
+    let config = Arc::new(ensure!(CoordinatorConfig::load_config(&path).await));
 
-    let total_size = usize::from_le_bytes(size_buf);
+    log::debug!("Coordinator configuration: {config:?}");
 
-    let mut buf = vec![0u8; total_size];
+    let listener = ensure!(Listener::bind(&endpoint).await);
 
-    stream.read_exact(&mut buf).await?;
+    loop {
+        let (stream, client_addr) = faillible!(listener.accept().await, continue);
+        let config = Arc::clone(&config);
 
-    Ok(buf)
+        tokio::spawn(async move {
+            log::info!("Accepted connection from {client_addr}");
+            coordinator::handle_client(stream, config).await;
+        });
+    }
 }
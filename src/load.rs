@@ -19,6 +19,10 @@ pub enum DataError {
     Parsing,
     #[error("Unsupported format")]
     UnsupportedFormat,
+    #[error("Unknown column: {0}")]
+    UnknownColumn(String),
+    #[error("Invalid query: {0}")]
+    Query(#[from] fhe_operations::sql::SqlError),
     #[error("Unknown error")]
     Unknown,
 }
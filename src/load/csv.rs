@@ -3,8 +3,14 @@
 use bincode::Encode;
 use csv::Reader;
 use fhe_core::api::CryptoSystem;
-use fhe_operations::seq_ops::{SeqOpItem, SeqOpsData};
-use seal_lib::BfvHOperation2; // Mock implementation tied to seal-lib (temporary)
+use fhe_operations::selectable_collection::{
+    Flag, SelectableCS, SelectableCollection, SelectableItem,
+};
+use fhe_operations::seq_ops::{SeqOpItem, SeqOpsColumns, SeqOpsData};
+use fhe_operations::sql::{Limits, Query, QueryPlan};
+// Mock implementation tied to seal-lib (temporary)
+use seal_lib::BfvHOperation2;
+use std::collections::{BTreeSet, HashMap};
 
 const SIZE_LIMIT: u64 = 1024 * 1024;
 
@@ -25,24 +31,188 @@ where
 
         for result in rdr.records() {
             let record = result.map_err(|_| super::DataError::Parsing)?;
-            if record.len() != 3 {
-                return Err(super::DataError::Parsing);
-            }
-            let lhs = record[0]
-                .parse::<u64>()
-                .map_err(|_| super::DataError::Parsing)?;
-            let rhs = record[1]
-                .parse::<u64>()
-                .map_err(|_| super::DataError::Parsing)?;
-            let op = match &record[2] {
-                "+" => BfvHOperation2::Add,
-                "*" => BfvHOperation2::Mul,
-                _ => return Err(super::DataError::Parsing),
-            };
-
+            let (lhs, rhs, op) = parse_record(&record)?;
             items.push(SeqOpItem::new(cs.cipher(&lhs), cs.cipher(&rhs), op));
         }
 
         Ok(items)
     }
 }
+
+impl<C: CryptoSystem<Plaintext = u64, Operation2 = BfvHOperation2>> CsvLoader<C>
+where
+    C::Ciphertext: Clone,
+{
+    /// Load the data by column, encrypting each of the `shared` values once and sharing its
+    /// ciphertext between the items using it, e.g. a rate applied to many items. Every other
+    /// operand is encrypted on its own.
+    ///
+    /// The server can then tell which items use a shared value, but not which other operands
+    /// are equal.
+    pub fn load_shared(
+        file: std::fs::File,
+        shared: &[u64],
+        cs: &C,
+    ) -> super::DataResult<SeqOpsColumns<C>> {
+        let mut rdr = Reader::from_reader(file);
+
+        let mut columns = SeqOpsColumns::new();
+        // Index of the ciphertext of each shared value, once encrypted.
+        let mut shared: HashMap<u64, Option<usize>> =
+            shared.iter().map(|&value| (value, None)).collect();
+
+        for result in rdr.records() {
+            let record = result.map_err(|_| super::DataError::Parsing)?;
+            let (lhs, rhs, op) = parse_record(&record)?;
+            let mut operand = |value: u64| match shared.get_mut(&value) {
+                Some(index) => {
+                    *index.get_or_insert_with(|| columns.push_operand(cs.cipher(&value)))
+                }
+                None => columns.push_operand(cs.cipher(&value)),
+            };
+            let (lhs, rhs) = (operand(lhs), operand(rhs));
+            columns.push_indexed(lhs, rhs, op);
+        }
+
+        Ok(columns)
+    }
+}
+
+impl<C: CryptoSystem<Plaintext = u64>> CsvLoader<C> {
+    /// Load every field of the records as a column of ciphertexts, e.g. for a program.
+    pub fn load_columns(file: std::fs::File, cs: &C) -> super::DataResult<Vec<Vec<C::Ciphertext>>> {
+        let mut rdr = Reader::from_reader(file);
+
+        let mut columns: Vec<Vec<C::Ciphertext>> = Vec::new();
+
+        for result in rdr.records() {
+            let record = result.map_err(|_| super::DataError::Parsing)?;
+            if columns.is_empty() {
+                columns = record.iter().map(|_| Vec::new()).collect();
+            }
+            for (column, field) in columns.iter_mut().zip(&record) {
+                let value = field
+                    .trim()
+                    .parse::<u64>()
+                    .map_err(|_| super::DataError::Parsing)?;
+                column.push(cs.cipher(&value));
+            }
+        }
+
+        Ok(columns)
+    }
+}
+
+impl<C: SelectableCS<Plaintext = u64, Ciphertext: Clone>> CsvLoader<C> {
+    /// Load a table with a header row for a query, planned within the given `limits`: each row
+    /// becomes an item holding the summed column (or 1 to count it), and a flag per condition
+    /// of the plan.
+    pub fn load_query<const F: usize>(
+        file: std::fs::File,
+        query: &Query,
+        limits: &Limits,
+        cs: &C,
+    ) -> super::DataResult<(QueryPlan, SelectableCollection<F, C>)> {
+        let mut rdr = Reader::from_reader(file);
+
+        let header = rdr
+            .headers()
+            .map_err(|_| super::DataError::Parsing)?
+            .clone();
+        let column = |name: &str| {
+            header
+                .iter()
+                .position(|field| field.trim() == name)
+                .ok_or_else(|| super::DataError::UnknownColumn(name.to_string()))
+        };
+        let records = rdr
+            .records()
+            .collect::<Result<Vec<_>, _>>()
+            .map_err(|_| super::DataError::Parsing)?;
+
+        let mut group_values = Vec::new();
+        if let Some(group_by) = query.group_by() {
+            let group_by = column(group_by)?;
+            let values: BTreeSet<&str> = records
+                .iter()
+                .map(|record| record[group_by].trim())
+                .collect();
+            group_values = values.into_iter().map(str::to_string).collect();
+        }
+        let plan = query.plan(&group_values, records.len(), limits)?;
+
+        let value = query.column().map(column).transpose()?;
+        let flags = plan
+            .flags
+            .iter()
+            .map(|condition| Ok((condition, column(&condition.column)?)))
+            .collect::<super::DataResult<Vec<_>>>()?;
+
+        let mut collection = SelectableCollection::new();
+        for record in &records {
+            let value = match value {
+                Some(value) => record[value]
+                    .trim()
+                    .parse::<u64>()
+                    .map_err(|_| super::DataError::Parsing)?,
+                None => 1,
+            };
+            let mut item = SelectableItem::new(&value, cs);
+            // Flags are off by default.
+            for (index, (condition, column)) in flags.iter().enumerate() {
+                if condition.holds(&record[*column]) {
+                    item.set_flag_plain(index, Flag::On, cs);
+                }
+            }
+            collection.push(item);
+        }
+
+        Ok((plan, collection))
+    }
+}
+
+/// Parse the operands and the operation of a record.
+fn parse_record(record: &csv::StringRecord) -> super::DataResult<(u64, u64, BfvHOperation2)> {
+    if record.len() != 3 {
+        return Err(super::DataError::Parsing);
+    }
+    let lhs = record[0]
+        .parse::<u64>()
+        .map_err(|_| super::DataError::Parsing)?;
+    let rhs = record[1]
+        .parse::<u64>()
+        .map_err(|_| super::DataError::Parsing)?;
+    let op = match &record[2] {
+        "+" => BfvHOperation2::Add,
+        "*" => BfvHOperation2::Mul,
+        _ => return Err(super::DataError::Parsing),
+    };
+    Ok((lhs, rhs, op))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use seal_lib::SealBfvCS;
+
+    #[test]
+    fn test_load_shared() {
+        let path = std::env::temp_dir().join(format!("bpce-fhe-shared-{}.csv", std::process::id()));
+        std::fs::write(&path, "1,105,*\n1,105,*\n2,3,+\n").unwrap();
+        let bfv_cs = SealBfvCS::new(&crate::protocol::bfv_context());
+
+        let file = std::fs::File::open(&path).unwrap();
+        let columns = CsvLoader::load_shared(file, &[105], &bfv_cs).unwrap();
+        std::fs::remove_file(&path).unwrap();
+
+        // Only the rate is shared: the equal left-hand operands are encrypted apart.
+        assert_eq!(columns.len(), 3);
+        assert_eq!(columns.operands().len(), 5);
+        let results = columns
+            .execute(&bfv_cs)
+            .iter()
+            .map(|result| bfv_cs.decipher(result))
+            .collect::<Vec<_>>();
+        assert_eq!(results, [105, 105, 5]);
+    }
+}
@@ -1,6 +1,11 @@
-use bpce_fhe::{start_client, start_server};
-use clap::{Parser, Subcommand};
+use bpce_fhe::budget::MemoryBudget;
+use bpce_fhe::transport::{Endpoint, Transport};
+use bpce_fhe::{start_client, start_coordinator, start_server};
+use clap::{CommandFactory as _, Parser, Subcommand, error::ErrorKind};
 use core::net::{IpAddr, Ipv4Addr, SocketAddr};
+use std::path::PathBuf;
+
+const DEFAULT_SOCKET: &str = "/tmp/bpce-fhe.sock";
 
 #[global_allocator]
 static GLOBAL_ALLOCATOR: mimalloc::MiMalloc = mimalloc::MiMalloc;
@@ -15,10 +20,19 @@ struct Cli {
 #[derive(Subcommand)]
 enum Mode {
     Client {
-        #[arg(short, long, help = "IP address of the server")]
-        address: IpAddr,
+        #[arg(short, long, help = "IP address of the server (TCP transport)")]
+        address: Option<IpAddr>,
         #[arg(short, long, default_value_t = 8080, help = "Server port")]
         port: u16,
+        #[arg(
+            long,
+            value_enum,
+            default_value_t,
+            help = "Transport used to reach the server"
+        )]
+        transport: Transport,
+        #[arg(long, default_value = DEFAULT_SOCKET, help = "Server socket path (Unix transport)")]
+        socket: PathBuf,
         #[arg(
             long = "conf",
             default_value = "fhe.toml",
@@ -32,6 +46,63 @@ enum Mode {
         address: IpAddr,
         #[arg(short, long, default_value_t = 8080, help = "Server port")]
         port: u16,
+        #[arg(long, value_enum, default_value_t, help = "Transport to listen on")]
+        transport: Transport,
+        #[arg(long, default_value = DEFAULT_SOCKET, help = "Socket path (Unix transport)")]
+        socket: PathBuf,
+        #[arg(
+            long,
+            help = "Memory all the jobs held in memory may use together, in MiB (unlimited by default)"
+        )]
+        memory_budget: Option<u64>,
+        #[arg(
+            long,
+            help = "Memory a single job held in memory may use, in MiB (unlimited by default)"
+        )]
+        job_memory_budget: Option<u64>,
+        #[arg(
+            long,
+            help = "Directory of the jobs spilled to disk (system temporary directory by default)"
+        )]
+        spill_dir: Option<PathBuf>,
+        #[arg(
+            long,
+            help = "Directory of the chunks of resumable uploads (bpce-fhe-uploads in the system temporary directory by default)"
+        )]
+        upload_dir: Option<PathBuf>,
+        #[arg(
+            long,
+            help = "Cost of each operation, as written by `cargo bench --bench partitioning` (measured at startup by default)"
+        )]
+        cost_model: Option<PathBuf>,
+        #[arg(
+            long,
+            default_value_t = 256,
+            help = "Memory the cached results of jobs on named datasets may use, in MiB (0 to disable the cache)"
+        )]
+        result_cache: u64,
+        #[arg(
+            long,
+            help = "Run jobs on a pool of threads pinned to each NUMA node, with its own copy of the keys"
+        )]
+        numa: bool,
+    },
+
+    Coordinator {
+        #[arg(short, long, default_value_t = IpAddr::V4(Ipv4Addr::new(0, 0, 0, 0)), help = "Coordinator address")]
+        address: IpAddr,
+        #[arg(short, long, default_value_t = 8080, help = "Coordinator port")]
+        port: u16,
+        #[arg(long, value_enum, default_value_t, help = "Transport to listen on")]
+        transport: Transport,
+        #[arg(long, default_value = DEFAULT_SOCKET, help = "Socket path (Unix transport)")]
+        socket: PathBuf,
+        #[arg(
+            long = "conf",
+            default_value = "coordinator.toml",
+            help = "Path to the configuration file, listing the workers"
+        )]
+        config_file: String,
     },
 }
 
@@ -52,16 +123,90 @@ async fn main() {
         Mode::Client {
             address,
             port,
+            transport,
+            socket,
             config_file,
         } => {
-            let socker_addr = SocketAddr::new(address, port);
-            log::info!("Starting client.. Connecting to {}.", socker_addr);
-            start_client(socker_addr, config_file).await;
+            let endpoint = match transport {
+                Transport::Tcp => {
+                    let Some(address) = address else {
+                        Cli::command()
+                            .error(
+                                ErrorKind::MissingRequiredArgument,
+                                "--address is required with the TCP transport",
+                            )
+                            .exit();
+                    };
+                    Endpoint::Tcp(SocketAddr::new(address, port))
+                }
+                Transport::Unix => Endpoint::Unix(socket),
+                Transport::Uring => {
+                    let Some(address) = address else {
+                        Cli::command()
+                            .error(
+                                ErrorKind::MissingRequiredArgument,
+                                "--address is required with the io_uring transport",
+                            )
+                            .exit();
+                    };
+                    Endpoint::Uring(SocketAddr::new(address, port))
+                }
+            };
+            log::info!("Starting client.. Connecting to {}.", endpoint);
+            start_client(endpoint, config_file).await;
         }
-        Mode::Server { address, port } => {
-            let socker_addr = SocketAddr::new(address, port);
-            log::info!("Starting server on port {}.", port);
-            start_server(socker_addr).await;
+        Mode::Server {
+            address,
+            port,
+            transport,
+            socket,
+            memory_budget,
+            job_memory_budget,
+            spill_dir,
+            upload_dir,
+            cost_model,
+            result_cache,
+            numa,
+        } => {
+            let endpoint = match transport {
+                Transport::Tcp => Endpoint::Tcp(SocketAddr::new(address, port)),
+                Transport::Unix => Endpoint::Unix(socket),
+                Transport::Uring => Endpoint::Uring(SocketAddr::new(address, port)),
+            };
+            let mebibytes =
+                |budget: Option<u64>| budget.map_or(u64::MAX, |mib| mib.saturating_mul(1 << 20));
+            let budget = MemoryBudget::new(
+                mebibytes(memory_budget),
+                mebibytes(job_memory_budget),
+                spill_dir.unwrap_or_else(std::env::temp_dir),
+            );
+            log::info!("Starting server on {}.", endpoint);
+            let upload_dir =
+                upload_dir.unwrap_or_else(|| std::env::temp_dir().join("bpce-fhe-uploads"));
+            start_server(
+                endpoint,
+                budget,
+                upload_dir,
+                cost_model,
+                result_cache.saturating_mul(1 << 20),
+                numa,
+            )
+            .await;
+        }
+        Mode::Coordinator {
+            address,
+            port,
+            transport,
+            socket,
+            config_file,
+        } => {
+            let endpoint = match transport {
+                Transport::Tcp => Endpoint::Tcp(SocketAddr::new(address, port)),
+                Transport::Unix => Endpoint::Unix(socket),
+                Transport::Uring => Endpoint::Uring(SocketAddr::new(address, port)),
+            };
+            log::info!("Starting coordinator on {}.", endpoint);
+            start_coordinator(endpoint, config_file).await;
         }
     }
 }
@@ -0,0 +1,781 @@
+//! Multiplexing of concurrent requests over one connection.
+//!
+//! A multiplexed session starts with the client sending the [`HELLO`] payload. Every later
+//! payload, in both directions, is a frame: an encoded [`Frame`] header followed by its body.
+//! Frames of different streams are freely interleaved, so that a client can keep several
+//! requests in flight and receive each response as soon as it is ready.
+//!
+//! A stream carries one request from the client, then the payloads of its response from the
+//! server, followed by [`Frame::End`]. Payloads are cut into [`Frame::Data`] fragments of at most
+//! [`MAX_FRAGMENT`] bytes, so that a large payload does not hold back the other streams.
+//!
+//! Flow control is per stream: a side may only send [`INITIAL_WINDOW`] bytes of fragments on a
+//! stream until the peer grants more with [`Frame::Window`]. The receiver grants the bytes of a
+//! fragment back once the application takes it, and resets a stream whose peer sends more than
+//! it was granted. A slow reader thus buffers at most a window of fragments, and only holds
+//! back its own stream. Payloads are assembled by the application as it takes their fragments,
+//! which lets the server reserve memory for them, or spill them, as they grow.
+//!
+//! A server keeps at most [`MAX_STREAMS`] streams of a session open, and resets the streams
+//! opened beyond them.
+//!
+//! Either side can abort a stream with [`Frame::Reset`], the server then cancels the job.
+
+use crate::transport::spill::{SpillPolicy, SpillWriter};
+use crate::transport::{Endpoint, Payload, RecvHalf, SendHalf, Stream};
+use bincode::{Decode, Encode};
+use std::collections::HashMap;
+use std::sync::{Arc, Mutex, Weak};
+use tokio::sync::{Notify, Semaphore, mpsc};
+
+/// First payload of a multiplexed session, sent by the client.
+pub const HELLO: &[u8] = b"bpce-fhe/mux";
+
+/// Largest fragment of a payload.
+pub const MAX_FRAGMENT: usize = 256 << 10; // 256 KiB
+
+/// Bytes of fragments that can be sent on a new stream before the peer grants more.
+pub const INITIAL_WINDOW: usize = 4 << 20; // 4 MiB
+
+/// Streams a client may keep open at once on a session: the fragments a server buffers for a
+/// session are bounded by as many windows.
+pub const MAX_STREAMS: usize = 64;
+
+/// Header of a frame.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Encode, Decode)]
+pub enum Frame {
+    /// A fragment of a payload, which is complete if this fragment is the `last` one.
+    Data { stream: u32, last: bool },
+    /// No other payload will be sent on the stream.
+    End { stream: u32 },
+    /// The peer may send `bytes` more bytes of fragments on the stream.
+    Window { stream: u32, bytes: u64 },
+    /// The stream is aborted.
+    Reset { stream: u32 },
+}
+
+/// What the receiving side of a stream can get.
+enum Inbound {
+    /// A fragment of a payload, which is complete if this fragment is the last one.
+    Fragment(Vec<u8>, bool),
+    Reset,
+}
+
+struct StreamState {
+    /// Where received fragments go, `None` once the peer ended or reset the stream.
+    inbound: Option<mpsc::UnboundedSender<Inbound>>,
+    /// Bytes of fragments the peer may still send on the stream.
+    credit: u64,
+    /// Bytes that can still be sent on the stream, as permits.
+    window: Arc<Semaphore>,
+    reset: Arc<Notify>,
+}
+
+impl StreamState {
+    /// Abort the stream: pending and later sends fail, and receives report the reset.
+    fn abort(&mut self) {
+        if let Some(inbound) = self.inbound.take() {
+            let _ = inbound.send(Inbound::Reset);
+        }
+        self.window.close();
+        self.reset.notify_one();
+    }
+}
+
+#[derive(Default)]
+struct Streams {
+    states: HashMap<u32, StreamState>,
+    /// Highest stream id opened so far.
+    last_id: u32,
+    /// Whether the connection is closed.
+    closed: bool,
+}
+
+struct Shared {
+    streams: Mutex<Streams>,
+    /// Encoded frames waiting to be written.
+    outgoing: mpsc::UnboundedSender<Vec<u8>>,
+}
+
+impl Shared {
+    /// Queue a frame to be written.
+    fn send_frame(&self, frame: Frame, body: &[u8]) -> Result<(), std::io::Error> {
+        let mut payload =
+            bincode::encode_to_vec(frame, crate::BINCODE_CONFIG).map_err(std::io::Error::other)?;
+        payload.extend_from_slice(body);
+        self.outgoing
+            .send(payload)
+            .map_err(|_| std::io::ErrorKind::BrokenPipe.into())
+    }
+
+    /// Register a new stream, and return its handle.
+    fn register(self: &Arc<Self>, streams: &mut Streams, id: u32) -> Channel {
+        let (sender, receiver) = mpsc::unbounded_channel();
+        let mut state = StreamState {
+            inbound: Some(sender),
+            credit: INITIAL_WINDOW as u64,
+            window: Arc::new(Semaphore::new(INITIAL_WINDOW)),
+            reset: Arc::new(Notify::new()),
+        };
+        if streams.closed {
+            state.abort();
+        }
+
+        let channel = Channel {
+            id,
+            shared: Arc::clone(self),
+            inbound: receiver,
+            window: Arc::clone(&state.window),
+            reset: Arc::clone(&state.reset),
+            done: false,
+        };
+        streams.states.insert(id, state);
+        channel
+    }
+
+    /// Grant the peer `bytes` more bytes of fragments on a stream.
+    fn grant(&self, stream: u32, bytes: usize) {
+        if bytes == 0 {
+            return;
+        }
+        let mut streams = self.streams.lock().unwrap();
+        if let Some(state) = streams.states.get_mut(&stream) {
+            state.credit += bytes as u64;
+            let _ = self.send_frame(
+                Frame::Window {
+                    stream,
+                    bytes: bytes as u64,
+                },
+                &[],
+            );
+        }
+    }
+
+    /// Handle a frame received from the peer, and return the stream it opened, if any.
+    ///
+    /// Streams are only opened by the peer when `accept` is set, up to [`MAX_STREAMS`] at once.
+    fn receive(self: &Arc<Self>, frame: Frame, body: &[u8], accept: bool) -> Option<Channel> {
+        let mut streams = self.streams.lock().unwrap();
+        let mut opened = None;
+
+        match frame {
+            Frame::Data { stream, last } => {
+                if !streams.states.contains_key(&stream) {
+                    // Opened streams have increasing ids, anything else is a late fragment
+                    // of a stream that was dropped.
+                    if !accept || stream <= streams.last_id {
+                        return None;
+                    }
+                    streams.last_id = stream;
+                    if streams.states.len() >= MAX_STREAMS {
+                        log::warn!("Too many open streams, resetting stream {stream}");
+                        let _ = self.send_frame(Frame::Reset { stream }, &[]);
+                        return None;
+                    }
+                    opened = Some(self.register(&mut streams, stream));
+                }
+
+                if let Some(state) = streams.states.get_mut(&stream)
+                    && let Some(inbound) = &state.inbound
+                {
+                    let len = body.len() as u64;
+                    if body.len() > MAX_FRAGMENT || len > state.credit {
+                        log::warn!("Stream {stream} overran its window, resetting it");
+                        state.abort();
+                        let _ = self.send_frame(Frame::Reset { stream }, &[]);
+                    } else {
+                        state.credit -= len;
+                        let _ = inbound.send(Inbound::Fragment(body.to_vec(), last));
+                    }
+                }
+            }
+            Frame::End { stream } => {
+                if let Some(state) = streams.states.get_mut(&stream) {
+                    state.inbound = None;
+                }
+            }
+            Frame::Window { stream, bytes } => {
+                if let Some(state) = streams.states.get(&stream) {
+                    let room = Semaphore::MAX_PERMITS - state.window.available_permits();
+                    let bytes = usize::try_from(bytes).unwrap_or(usize::MAX);
+                    state.window.add_permits(bytes.min(room));
+                }
+            }
+            Frame::Reset { stream } => {
+                if let Some(state) = streams.states.get_mut(&stream) {
+                    state.abort();
+                }
+            }
+        }
+
+        opened
+    }
+
+    /// Abort every stream, once the connection is closed.
+    fn close(&self) {
+        let mut streams = self.streams.lock().unwrap();
+        streams.closed = true;
+        for state in streams.states.values_mut() {
+            state.abort();
+        }
+    }
+}
+
+/// One stream of a session.
+///
+/// Dropping a stream before it is done resets it.
+pub struct Channel {
+    id: u32,
+    shared: Arc<Shared>,
+    inbound: mpsc::UnboundedReceiver<Inbound>,
+    window: Arc<Semaphore>,
+    reset: Arc<Notify>,
+    /// Whether the stream was ended, by either side, or reset.
+    done: bool,
+}
+
+impl Channel {
+    #[must_use]
+    #[inline]
+    pub const fn id(&self) -> u32 {
+        self.id
+    }
+
+    /// Send a payload on the stream, as soon as the peer grants enough credit.
+    pub async fn send(&mut self, payload: &[u8]) -> Result<(), std::io::Error> {
+        let mut rest = payload;
+        loop {
+            let (fragment, tail) = rest.split_at(rest.len().min(MAX_FRAGMENT));
+            rest = tail;
+
+            self.window
+                .acquire_many(u32::try_from(fragment.len()).unwrap_or(u32::MAX))
+                .await
+                .map_err(|_| std::io::Error::from(std::io::ErrorKind::ConnectionReset))?
+                .forget();
+            self.shared.send_frame(
+                Frame::Data {
+                    stream: self.id,
+                    last: rest.is_empty(),
+                },
+                fragment,
+            )?;
+
+            if rest.is_empty() {
+                return Ok(());
+            }
+        }
+    }
+
+    /// Receive the next payload of the stream, or `None` once the peer ended it.
+    pub async fn recv(&mut self) -> Result<Option<Vec<u8>>, std::io::Error> {
+        let mut payload = Vec::new();
+        let mut started = false;
+        loop {
+            let Some((fragment, last)) = self.recv_fragment().await? else {
+                return if started {
+                    Err(std::io::ErrorKind::UnexpectedEof.into())
+                } else {
+                    Ok(None)
+                };
+            };
+            started = true;
+            payload.extend_from_slice(&fragment);
+            if last {
+                return Ok(Some(payload));
+            }
+        }
+    }
+
+    /// Receive the next payload of the stream, or `None` once the peer ended it, spilling it
+    /// to disk once the policy rejects the size it has grown to.
+    ///
+    /// The policy is asked again each time the payload grows, as long as it is held in memory.
+    pub async fn recv_or_spill(
+        &mut self,
+        policy: SpillPolicy<'_>,
+    ) -> Result<Option<Payload>, std::io::Error> {
+        let mut payload = Vec::new();
+        let mut spilled: Option<SpillWriter> = None;
+        let mut started = false;
+        loop {
+            let Some((fragment, last)) = self.recv_fragment().await? else {
+                return if started {
+                    Err(std::io::ErrorKind::UnexpectedEof.into())
+                } else {
+                    Ok(None)
+                };
+            };
+            started = true;
+            match &mut spilled {
+                Some(writer) => writer.write(&fragment).await?,
+                None if (policy.in_memory)(payload.len() + fragment.len()) => {
+                    payload.extend_from_slice(&fragment);
+                }
+                None => {
+                    let mut writer = SpillWriter::create(policy.dir)?;
+                    writer.write(&payload).await?;
+                    writer.write(&fragment).await?;
+                    payload = Vec::new();
+                    spilled = Some(writer);
+                }
+            }
+            if last {
+                return Ok(Some(match spilled {
+                    Some(writer) => Payload::Spilled(writer.finish().await?),
+                    None => Payload::Owned(payload.into()),
+                }));
+            }
+        }
+    }
+
+    /// Take the next fragment of the stream and whether it is the last of its payload,
+    /// granting its bytes back to the peer, or `None` once the peer ended the stream.
+    async fn recv_fragment(&mut self) -> Result<Option<(Vec<u8>, bool)>, std::io::Error> {
+        match self.inbound.recv().await {
+            Some(Inbound::Fragment(fragment, last)) => {
+                self.shared.grant(self.id, fragment.len());
+                Ok(Some((fragment, last)))
+            }
+            Some(Inbound::Reset) => {
+                self.done = true;
+                Err(std::io::ErrorKind::ConnectionReset.into())
+            }
+            None => {
+                self.done = true;
+                Ok(None)
+            }
+        }
+    }
+
+    /// Tell the peer that no other payload will be sent on the stream.
+    pub fn finish(&mut self) {
+        if !self.done {
+            let _ = self.shared.send_frame(Frame::End { stream: self.id }, &[]);
+            self.done = true;
+        }
+    }
+
+    /// Wait until the peer resets the stream, or the connection is closed.
+    pub async fn cancelled(&self) {
+        self.reset.notified().await;
+    }
+}
+
+impl Drop for Channel {
+    fn drop(&mut self) {
+        self.shared.streams.lock().unwrap().states.remove(&self.id);
+        if !self.done && !self.window.is_closed() {
+            let _ = self
+                .shared
+                .send_frame(Frame::Reset { stream: self.id }, &[]);
+        }
+    }
+}
+
+/// A multiplexed connection.
+///
+/// The connection is closed once the session and all its streams are dropped.
+pub struct Session {
+    shared: Arc<Shared>,
+    /// Streams opened by the client.
+    incoming: mpsc::UnboundedReceiver<Channel>,
+}
+
+impl Session {
+    /// Connect to a server, and start a session.
+    ///
+    /// The connection cannot be driven by `io_uring`.
+    pub async fn connect(endpoint: &Endpoint) -> Result<Self, std::io::Error> {
+        let mut stream = Stream::connect(endpoint).await?;
+        stream.send(HELLO).await?;
+        Self::start(stream, false)
+    }
+
+    /// Serve a session on a connection whose first payload was [`HELLO`].
+    pub fn accept_on(stream: Stream) -> Result<Self, std::io::Error> {
+        Self::start(stream, true)
+    }
+
+    fn start(stream: Stream, accept: bool) -> Result<Self, std::io::Error> {
+        let (recv, send) = stream.into_split()?;
+        let (outgoing, outgoing_rx) = mpsc::unbounded_channel();
+        let (incoming_tx, incoming) = mpsc::unbounded_channel();
+
+        let shared = Arc::new(Shared {
+            streams: Mutex::default(),
+            outgoing,
+        });
+
+        tokio::spawn(write_frames(send, outgoing_rx));
+        tokio::spawn(read_frames(
+            recv,
+            Arc::downgrade(&shared),
+            accept.then_some(incoming_tx),
+        ));
+
+        Ok(Self { shared, incoming })
+    }
+
+    #[must_use]
+    /// Open a new stream, to send a request on.
+    pub fn open(&self) -> Channel {
+        let mut streams = self.shared.streams.lock().unwrap();
+        streams.last_id += 1;
+        let id = streams.last_id;
+        let channel = self.shared.register(&mut streams, id);
+        drop(streams);
+        channel
+    }
+
+    /// Wait for the next stream opened by the client, or `None` once the connection is closed.
+    pub async fn accept(&mut self) -> Option<Channel> {
+        self.incoming.recv().await
+    }
+}
+
+/// Where the response to a request goes: a whole connection, or a stream of a session.
+pub enum Responder<'a> {
+    Stream(&'a mut Stream),
+    Channel(&'a mut Channel),
+}
+
+impl Responder<'_> {
+    /// Send a payload of the response.
+    pub async fn send(&mut self, payload: &[u8]) -> Result<(), std::io::Error> {
+        match self {
+            Self::Stream(stream) => stream.send(payload).await,
+            Self::Channel(channel) => channel.send(payload).await,
+        }
+    }
+
+    /// Send a payload of the response mapped from disk, without copying it to memory.
+    ///
+    /// Streams of a session still copy it, one fragment at a time.
+    pub async fn send_inline(&mut self, payload: &[u8]) -> Result<(), std::io::Error> {
+        match self {
+            Self::Stream(stream) => stream.send_inline(payload).await,
+            Self::Channel(channel) => channel.send(payload).await,
+        }
+    }
+
+    /// Mark the response as complete.
+    pub fn finish(&mut self) {
+        if let Self::Channel(channel) = self {
+            channel.finish();
+        }
+    }
+
+    /// Wait until the client gives up on the request.
+    ///
+    /// A closed connection is only noticed when sending to it.
+    pub fn cancelled(&self) -> impl Future<Output = ()> + use<> {
+        let reset = match self {
+            Self::Stream(_) => None,
+            Self::Channel(channel) => Some(Arc::clone(&channel.reset)),
+        };
+        async move {
+            match reset {
+                Some(reset) => reset.notified().await,
+                None => core::future::pending().await,
+            }
+        }
+    }
+}
+
+/// Serve a session on a connection whose first payload was [`HELLO`], running `handler`
+/// concurrently on each stream opened by the client.
+pub async fn serve<F, Fut>(stream: Stream, mut handler: F)
+where
+    F: FnMut(Channel) -> Fut,
+    Fut: Future<Output = ()> + Send + 'static,
+{
+    let mut session = match Session::accept_on(stream) {
+        Ok(session) => session,
+        Err(err) => {
+            log::error!("Failed to start session: {err}");
+            return;
+        }
+    };
+
+    while let Some(channel) = session.accept().await {
+        log::debug!("Stream {} opened", channel.id());
+        tokio::spawn(handler(channel));
+    }
+}
+
+async fn write_frames(mut send: SendHalf, mut outgoing: mpsc::UnboundedReceiver<Vec<u8>>) {
+    while let Some(payload) = outgoing.recv().await {
+        if let Err(err) = send.send(&payload).await {
+            log::error!("Failed to send frame: {err}");
+            return;
+        }
+    }
+}
+
+async fn read_frames(
+    mut recv: RecvHalf,
+    shared: Weak<Shared>,
+    incoming: Option<mpsc::UnboundedSender<Channel>>,
+) {
+    loop {
+        let payload = match recv.recv().await {
+            Ok(payload) => payload,
+            Err(err) => {
+                if err.kind() != std::io::ErrorKind::UnexpectedEof {
+                    log::error!("Session closed: {err}");
+                }
+                break;
+            }
+        };
+        let Some(shared) = shared.upgrade() else {
+            return;
+        };
+
+        let Ok((frame, read)) =
+            bincode::decode_from_slice::<Frame, _>(&payload, crate::BINCODE_CONFIG)
+        else {
+            log::error!("Invalid frame received, closing the session");
+            shared.close();
+            return;
+        };
+
+        let opened = shared.receive(frame, &payload[read..], incoming.is_some());
+        if let (Some(channel), Some(incoming)) = (opened, &incoming) {
+            let _ = incoming.send(channel);
+        }
+    }
+
+    if let Some(shared) = shared.upgrade() {
+        shared.close();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// A session over a pair of connected sockets, whose server echoes every payload back.
+    fn echo_session() -> Session {
+        let (client, server) = tokio::net::UnixStream::pair().unwrap();
+        let unix = |stream| Stream::Unix {
+            stream,
+            shm_threshold: usize::MAX,
+        };
+
+        tokio::spawn(serve(unix(server), |mut channel| async move {
+            while let Ok(Some(payload)) = channel.recv().await {
+                if channel.send(&payload).await.is_err() {
+                    return;
+                }
+            }
+        }));
+
+        Session::start(unix(client), false).unwrap()
+    }
+
+    #[tokio::test]
+    async fn test_concurrent_streams() {
+        let session = Arc::new(echo_session());
+
+        let tasks = (0..8u8)
+            .map(|i| {
+                let session = Arc::clone(&session);
+                tokio::spawn(async move {
+                    let mut channel = session.open();
+                    // Larger than a fragment, so that fragments of streams interleave.
+                    let payload = vec![i; MAX_FRAGMENT * 3 + usize::from(i)];
+                    channel.send(&payload).await.unwrap();
+                    assert_eq!(channel.recv().await.unwrap(), Some(payload));
+                })
+            })
+            .collect::<Vec<_>>();
+
+        for task in tasks {
+            task.await.unwrap();
+        }
+    }
+
+    #[tokio::test]
+    async fn test_payload_larger_than_window() {
+        let session = echo_session();
+        let mut channel = session.open();
+
+        let payload = (0..=u8::MAX)
+            .cycle()
+            .take(INITIAL_WINDOW * 3)
+            .collect::<Vec<_>>();
+        channel.send(&payload).await.unwrap();
+        assert_eq!(channel.recv().await.unwrap(), Some(payload));
+
+        channel.send(&[]).await.unwrap();
+        assert_eq!(channel.recv().await.unwrap(), Some(Vec::new()));
+    }
+
+    #[tokio::test]
+    async fn test_window_holds_back_slow_reader() {
+        let session = echo_session();
+        let mut slow = session.open();
+        let mut fast = session.open();
+
+        // The echoes of `slow` are never read, so its window is exhausted...
+        let fragment = vec![0; MAX_FRAGMENT];
+        let fill = async {
+            loop {
+                slow.send(&fragment).await.unwrap();
+            }
+        };
+        let blocked = tokio::time::timeout(core::time::Duration::from_millis(500), fill).await;
+        assert!(blocked.is_err());
+
+        // ... which does not hold back the other streams.
+        fast.send(b"ping").await.unwrap();
+        assert_eq!(fast.recv().await.unwrap(), Some(b"ping".to_vec()));
+    }
+
+    /// A session whose server holds every stream open, without reading it, until it is reset.
+    fn idle_session() -> Session {
+        let (client, server) = tokio::net::UnixStream::pair().unwrap();
+        let unix = |stream| Stream::Unix {
+            stream,
+            shm_threshold: usize::MAX,
+        };
+        tokio::spawn(serve(unix(server), |channel| async move {
+            channel.cancelled().await;
+        }));
+        Session::start(unix(client), false).unwrap()
+    }
+
+    #[tokio::test]
+    async fn test_unread_payloads_are_bounded() {
+        let session = idle_session();
+        let mut channel = session.open();
+
+        // No fragment is granted back before it is read.
+        let payload = vec![0; MAX_FRAGMENT * 2];
+        let mut sent = 0;
+        let fill = async {
+            loop {
+                channel.send(&payload).await.unwrap();
+                sent += payload.len();
+            }
+        };
+        let blocked = tokio::time::timeout(core::time::Duration::from_millis(500), fill).await;
+        assert!(blocked.is_err());
+        assert!(sent <= INITIAL_WINDOW);
+    }
+
+    #[tokio::test]
+    async fn test_overrun_resets_stream() {
+        let session = idle_session();
+        let mut channel = session.open();
+
+        // Fragments sent past the window, as a peer ignoring it would.
+        let fragment = vec![0; MAX_FRAGMENT];
+        for _ in 0..=INITIAL_WINDOW / MAX_FRAGMENT {
+            let frame = Frame::Data {
+                stream: channel.id(),
+                last: false,
+            };
+            session.shared.send_frame(frame, &fragment).unwrap();
+        }
+        assert_eq!(
+            channel.recv().await.unwrap_err().kind(),
+            std::io::ErrorKind::ConnectionReset
+        );
+    }
+
+    #[tokio::test]
+    async fn test_open_streams_are_bounded() {
+        let session = idle_session();
+        let mut channels = Vec::new();
+        for _ in 0..MAX_STREAMS {
+            let mut channel = session.open();
+            channel.send(b"open").await.unwrap();
+            channels.push(channel);
+        }
+
+        let mut extra = session.open();
+        extra.send(b"open").await.unwrap();
+        assert_eq!(
+            extra.recv().await.unwrap_err().kind(),
+            std::io::ErrorKind::ConnectionReset
+        );
+
+        // Once a stream is reset and its handler done, another can be opened.
+        drop(channels.pop());
+        tokio::time::sleep(core::time::Duration::from_millis(100)).await;
+        let mut next = session.open();
+        next.send(b"open").await.unwrap();
+        let pending = tokio::time::timeout(core::time::Duration::from_millis(200), next.recv());
+        assert!(pending.await.is_err());
+    }
+
+    #[tokio::test]
+    async fn test_recv_or_spill() {
+        let session = echo_session();
+        let mut channel = session.open();
+        let payload = (0..=u8::MAX)
+            .cycle()
+            .take(MAX_FRAGMENT * 3)
+            .collect::<Vec<_>>();
+
+        // Held in memory while it fits, then spilled as a whole.
+        for (limit, spilled) in [(usize::MAX, false), (MAX_FRAGMENT * 2, true)] {
+            channel.send(&payload).await.unwrap();
+            let mut asked = Vec::new();
+            let mut in_memory = |len: usize| {
+                asked.push(len);
+                len <= limit
+            };
+            let received = channel
+                .recv_or_spill(SpillPolicy {
+                    dir: &std::env::temp_dir(),
+                    in_memory: &mut in_memory,
+                })
+                .await
+                .unwrap()
+                .unwrap();
+            assert_eq!(&*received, &payload[..]);
+            assert_eq!(matches!(received, Payload::Spilled(_)), spilled);
+            assert_eq!(asked.last(), Some(&(MAX_FRAGMENT * asked.len())));
+        }
+    }
+
+    #[tokio::test]
+    async fn test_reset() {
+        let (client, server) = tokio::net::UnixStream::pair().unwrap();
+        let unix = |stream| Stream::Unix {
+            stream,
+            shm_threshold: usize::MAX,
+        };
+        let (cancelled_tx, mut cancelled) = mpsc::unbounded_channel();
+
+        tokio::spawn(serve(unix(server), move |mut channel| {
+            let cancelled_tx = cancelled_tx.clone();
+            async move {
+                let request = channel.recv().await.unwrap().unwrap();
+                if request == b"fail" {
+                    return; // Dropped without finishing: reset.
+                }
+                channel.cancelled().await;
+                cancelled_tx.send(channel.id()).unwrap();
+            }
+        }));
+        let session = Session::start(unix(client), false).unwrap();
+
+        let mut failing = session.open();
+        failing.send(b"fail").await.unwrap();
+        assert_eq!(
+            failing.recv().await.unwrap_err().kind(),
+            std::io::ErrorKind::ConnectionReset
+        );
+        assert!(failing.send(b"again").await.is_err());
+
+        let mut dropped = session.open();
+        dropped.send(b"wait").await.unwrap();
+        let id = dropped.id();
+        drop(dropped);
+        assert_eq!(cancelled.recv().await, Some(id));
+    }
+}
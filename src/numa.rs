@@ -0,0 +1,96 @@
+//! NUMA topology of the host, and pinning of threads to the CPUs of a node.
+//!
+//! On hosts with several sockets, memory is attached to a node and reading it from the CPUs of
+//! another node is slower. Linux places a page on the node of the thread that first writes it:
+//! keys and ciphertexts written by the threads of a node, and only used by them, stay local.
+
+use rustix::thread::{CpuSet, sched_getaffinity, sched_setaffinity};
+use std::path::Path;
+
+/// Where the kernel describes the NUMA nodes.
+const NODES: &str = "/sys/devices/system/node";
+
+/// A NUMA node, and the CPUs of this node the process may run on.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct Node {
+    pub id: usize,
+    pub cpus: Vec<usize>,
+}
+
+#[must_use]
+/// NUMA nodes with CPUs the process may run on, by id.
+///
+/// Empty if the topology is unknown, e.g. on kernels without NUMA support.
+pub fn nodes() -> Vec<Node> {
+    let Ok(entries) = std::fs::read_dir(NODES) else {
+        return Vec::new();
+    };
+    let allowed = sched_getaffinity(None).ok();
+
+    let mut nodes = entries
+        .filter_map(|entry| {
+            let entry = entry.ok()?;
+            let id = entry
+                .file_name()
+                .to_str()?
+                .strip_prefix("node")?
+                .parse()
+                .ok()?;
+            let mut cpus = cpu_list(&entry.path().join("cpulist"))?;
+            if let Some(allowed) = &allowed {
+                cpus.retain(|&cpu| cpu < CpuSet::MAX_CPU && allowed.is_set(cpu));
+            }
+            (!cpus.is_empty()).then_some(Node { id, cpus })
+        })
+        .collect::<Vec<_>>();
+    nodes.sort_by_key(|node| node.id);
+    nodes
+}
+
+/// Read a list of CPUs, as written by the kernel, e.g. `0-3,8-11`.
+fn cpu_list(path: &Path) -> Option<Vec<usize>> {
+    parse_cpu_list(&std::fs::read_to_string(path).ok()?)
+}
+
+fn parse_cpu_list(list: &str) -> Option<Vec<usize>> {
+    let mut cpus = Vec::new();
+    for range in list.trim().split(',').filter(|range| !range.is_empty()) {
+        match range.split_once('-') {
+            Some((first, last)) => cpus.extend(first.parse::<usize>().ok()?..=last.parse().ok()?),
+            None => cpus.push(range.parse().ok()?),
+        }
+    }
+    Some(cpus)
+}
+
+/// Restrict the calling thread to the given CPUs.
+pub fn pin(cpus: &[usize]) -> std::io::Result<()> {
+    let mut set = CpuSet::new();
+    for &cpu in cpus.iter().filter(|&&cpu| cpu < CpuSet::MAX_CPU) {
+        set.set(cpu);
+    }
+    sched_setaffinity(None, &set)?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_parse_cpu_list() {
+        assert_eq!(
+            parse_cpu_list("0-3,8-9,12\n"),
+            Some(vec![0, 1, 2, 3, 8, 9, 12])
+        );
+        assert_eq!(parse_cpu_list("\n"), Some(Vec::new()));
+        assert_eq!(parse_cpu_list("0-x"), None);
+    }
+
+    #[test]
+    fn test_nodes_have_cpus() {
+        let nodes = nodes();
+        assert!(nodes.iter().all(|node| !node.cpus.is_empty()));
+        assert!(nodes.windows(2).all(|pair| pair[0].id < pair[1].id));
+    }
+}
@@ -0,0 +1,46 @@
+//! Result writing utilities.
+
+pub mod csv;
+#[cfg(feature = "parquet")]
+pub mod parquet;
+
+use std::path::Path;
+use thiserror::Error;
+
+#[derive(Error, Debug)]
+pub enum OutputError {
+    #[error("IO error: {0}")]
+    Io(#[from] std::io::Error),
+    #[error("CSV error: {0}")]
+    Csv(#[from] ::csv::Error),
+    #[cfg(feature = "parquet")]
+    #[error("Parquet error: {0}")]
+    Parquet(#[from] ::parquet::errors::ParquetError),
+    #[cfg(feature = "parquet")]
+    #[error("Arrow error: {0}")]
+    Arrow(#[from] arrow::error::ArrowError),
+    #[error("Unsupported format")]
+    UnsupportedFormat,
+}
+
+pub type OutputResult<T> = Result<T, OutputError>;
+
+/// Writes deciphered results, in order, as they are received.
+pub trait ResultWriter: Send {
+    /// Write the next results.
+    fn write(&mut self, results: &[u64]) -> OutputResult<()>;
+    /// Flush and close the output.
+    fn finish(self: Box<Self>) -> OutputResult<()>;
+}
+
+/// Create a writer for the given file, whose format is given by its extension.
+pub fn create(path: &Path) -> OutputResult<Box<dyn ResultWriter>> {
+    match path.extension().and_then(|ext| ext.to_str()) {
+        Some("csv") => Ok(Box::new(csv::CsvWriter::new(std::fs::File::create(path)?)?)),
+        #[cfg(feature = "parquet")]
+        Some("parquet") => Ok(Box::new(parquet::ParquetWriter::new(
+            std::fs::File::create(path)?,
+        )?)),
+        _ => Err(OutputError::UnsupportedFormat),
+    }
+}
@@ -0,0 +1,31 @@
+//! Results written in CSV format.
+
+use super::{OutputResult, ResultWriter};
+use csv::Writer;
+
+/// Writes results as a single `result` column.
+pub struct CsvWriter {
+    writer: Writer<std::fs::File>,
+}
+
+impl CsvWriter {
+    pub fn new(file: std::fs::File) -> OutputResult<Self> {
+        let mut writer = Writer::from_writer(file);
+        writer.write_record(["result"])?;
+        Ok(Self { writer })
+    }
+}
+
+impl ResultWriter for CsvWriter {
+    fn write(&mut self, results: &[u64]) -> OutputResult<()> {
+        for result in results {
+            self.writer.write_record([result.to_string()])?;
+        }
+        Ok(())
+    }
+
+    fn finish(mut self: Box<Self>) -> OutputResult<()> {
+        self.writer.flush()?;
+        Ok(())
+    }
+}
@@ -0,0 +1,40 @@
+//! Results written in Parquet format.
+
+use super::{OutputResult, ResultWriter};
+use arrow::array::UInt64Array;
+use arrow::datatypes::{DataType, Field, Schema, SchemaRef};
+use arrow::record_batch::RecordBatch;
+use parquet::arrow::ArrowWriter;
+use std::sync::Arc;
+
+/// Writes results as a single `result` column.
+pub struct ParquetWriter {
+    schema: SchemaRef,
+    writer: ArrowWriter<std::fs::File>,
+}
+
+impl ParquetWriter {
+    pub fn new(file: std::fs::File) -> OutputResult<Self> {
+        let schema = Arc::new(Schema::new(vec![Field::new(
+            "result",
+            DataType::UInt64,
+            false,
+        )]));
+        let writer = ArrowWriter::try_new(file, Arc::clone(&schema), None)?;
+        Ok(Self { schema, writer })
+    }
+}
+
+impl ResultWriter for ParquetWriter {
+    fn write(&mut self, results: &[u64]) -> OutputResult<()> {
+        let column = Arc::new(UInt64Array::from(results.to_vec()));
+        let batch = RecordBatch::try_new(Arc::clone(&self.schema), vec![column])?;
+        self.writer.write(&batch)?;
+        Ok(())
+    }
+
+    fn finish(self: Box<Self>) -> OutputResult<()> {
+        self.writer.close()?;
+        Ok(())
+    }
+}
@@ -0,0 +1,579 @@
+//! Requests exchanged between clients, coordinators and servers.
+//!
+//! A request payload is an encoded [`Request`] header directly followed by the encoded job data,
+//! so that the data can be forwarded (or split) without decoding the header again.
+//! The response is always an encoded `Vec<Ciphertext>`: one ciphertext per item for
+//! element-wise jobs, a single one for aggregates. When requested, it is followed by an
+//! encoded [`ServerStats`] trailer.
+//!
+//! When the request asks for it, the response is streamed instead: it is a sequence of
+//! payloads (frames), each an encoded `Vec<Ciphertext>` holding the next results in order.
+//! The last frame holds no result, and carries the trailer if any.
+
+use crate::buffers::{Buffer, BufferPool};
+use bincode::{Decode, Encode};
+use core::time::Duration;
+use fhe_core::api::CryptoSystem as _;
+use fhe_operations::sql::{Limits, QueryPlan};
+use rayon::prelude::*;
+use seal_lib::context::SealBFVContext;
+use seal_lib::{BfvHOperation2, Ciphertext, SealBfvCS};
+use std::collections::BTreeMap;
+use std::sync::OnceLock;
+
+/// Number of flags carried by each item of a collection.
+pub const COLLECTION_FLAGS: usize = 4;
+
+/// The collection sent along with collection jobs.
+pub type BfvCollection =
+    fhe_operations::selectable_collection::SelectableCollection<COLLECTION_FLAGS, SealBfvCS>;
+
+/// The program and columns sent along with program jobs.
+pub type BfvProgram = fhe_operations::program::ProgramData<SealBfvCS>;
+
+/// Bits of noise budget a query result must keep at its depth, for the sums of its rows: summing
+/// twice as many rows costs up to a bit.
+const QUERY_NOISE_MARGIN: u32 = 16;
+
+#[must_use]
+/// What the parameters of [`bfv_context`] allow queries to compute.
+///
+/// The depth is measured once per process, from the noise budget: it is the number of
+/// successive multiplications of flags, each squaring the product as the deepest predicates
+/// do, after which a ciphertext still keeps `QUERY_NOISE_MARGIN` bits.
+pub fn query_limits() -> Limits {
+    static LIMITS: OnceLock<Limits> = OnceLock::new();
+    *LIMITS.get_or_init(|| Limits {
+        flags: COLLECTION_FLAGS,
+        depth: measure_query_depth(&bfv_context()),
+        parallel_rows: 64,
+    })
+}
+
+/// Multiply a fresh flag by itself until its noise budget runs out, see [`query_limits`].
+fn measure_query_depth(bfv_ctx: &SealBFVContext) -> u32 {
+    let bfv_cs = SealBfvCS::new(bfv_ctx);
+    let mut product = bfv_cs.cipher(&1);
+    let mut depth = 0;
+    loop {
+        product = bfv_cs.operate2(BfvHOperation2::Mul, &product, &product);
+        if bfv_cs.noise_budget(&product) < QUERY_NOISE_MARGIN {
+            return depth;
+        }
+        depth += 1;
+    }
+}
+
+/// A job submitted to a server or a coordinator.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Hash, Encode, Decode)]
+pub enum Job {
+    /// Execute every operation of a `SeqOpsData` (or `SeqOpsColumns`, see [`Layout`]), results
+    /// are returned in order.
+    SeqOps,
+    /// Execute every operation of a `SeqOpsData` (or `SeqOpsColumns`, see [`Layout`]), and return
+    /// the sum of the results.
+    SeqOpsSum,
+    /// Sum the items of a collection, optionally only those whose flag at the given index is on.
+    CollectionSum { flag: Option<u8> },
+    /// Run the program of a [`BfvProgram`] on each of its rows, results are returned in order.
+    Program,
+    /// Aggregate the groups of a `WirePlan` over the [`BfvCollection`] encoded after it, one
+    /// result per group in order (see [`encode_query`]).
+    Query,
+    /// Pack a `Vec<Ciphertext>` of values each encrypted alone, encoded after the Galois keys
+    /// of the client (see `SealBfvCS::galois_keys`), into ciphertexts holding
+    /// [`repack_width`] values each, returned in order.
+    Repack,
+}
+
+impl Job {
+    #[must_use]
+    #[inline]
+    /// Whether the job returns its results in order, one ciphertext per item (or per packed
+    /// group of items for `Repack`), rather than aggregates.
+    pub const fn is_element_wise(self) -> bool {
+        matches!(self, Self::SeqOps | Self::Program | Self::Repack)
+    }
+}
+
+/// Priority class of a job, from the most to the least urgent.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq, PartialOrd, Ord, Encode, Decode)]
+pub enum Priority {
+    /// Small queries waited on by a user.
+    Interactive,
+    #[default]
+    Normal,
+    /// Large jobs that only need to be done eventually, e.g. nightly batches.
+    Batch,
+}
+
+impl Priority {
+    /// Every class, from the most to the least urgent.
+    pub const ALL: [Self; 3] = [Self::Interactive, Self::Normal, Self::Batch];
+
+    #[must_use]
+    #[inline]
+    /// Position of the class in [`Priority::ALL`].
+    pub const fn index(self) -> usize {
+        self as usize
+    }
+}
+
+impl core::fmt::Display for Priority {
+    fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+        match self {
+            Self::Interactive => f.write_str("interactive"),
+            Self::Normal => f.write_str("normal"),
+            Self::Batch => f.write_str("batch"),
+        }
+    }
+}
+
+impl core::str::FromStr for Priority {
+    type Err = ();
+
+    fn from_str(s: &str) -> Result<Self, Self::Err> {
+        match s {
+            "interactive" => Ok(Self::Interactive),
+            "normal" => Ok(Self::Normal),
+            "batch" => Ok(Self::Batch),
+            _ => Err(()),
+        }
+    }
+}
+
+/// How the data of `SeqOps` and `SeqOpsSum` jobs is encoded.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq, Hash, Encode, Decode)]
+pub enum Layout {
+    /// A `SeqOpsData`, item by item.
+    #[default]
+    Rows,
+    /// A `SeqOpsColumns`, column by column, so that the server can run the items of each
+    /// operation as a batch.
+    Columns,
+}
+
+impl core::str::FromStr for Layout {
+    type Err = ();
+
+    fn from_str(s: &str) -> Result<Self, Self::Err> {
+        match s {
+            "rows" => Ok(Self::Rows),
+            "columns" => Ok(Self::Columns),
+            _ => Err(()),
+        }
+    }
+}
+
+/// Header of a request.
+#[derive(Clone, Debug, PartialEq, Eq, Encode, Decode)]
+pub struct Request {
+    pub job: Job,
+    pub priority: Priority,
+    /// Jobs are shared fairly between tenants of the same priority class.
+    pub tenant: String,
+    /// Time allowed to the server to complete the job, from the moment it receives it.
+    pub deadline_ms: Option<u64>,
+    /// Whether the response should end with a [`ServerStats`] trailer.
+    pub stats: bool,
+    /// Whether the results should be streamed in frames, as they are computed.
+    pub stream: bool,
+    pub layout: Layout,
+    /// Name of the dataset of the job, for the server to cache its results until the data
+    /// changes. Empty if the results are not worth caching.
+    pub dataset: String,
+}
+
+impl Request {
+    #[must_use]
+    #[inline]
+    /// Create a request for a job, with a normal priority, a default tenant and no deadline.
+    pub const fn new(job: Job) -> Self {
+        Self {
+            job,
+            priority: Priority::Normal,
+            tenant: String::new(),
+            deadline_ms: None,
+            stats: false,
+            stream: false,
+            layout: Layout::Rows,
+            dataset: String::new(),
+        }
+    }
+}
+
+/// Where a server spent its time on a request, and what it computed.
+#[derive(Clone, Debug, Default, PartialEq, Eq, Encode, Decode)]
+pub struct ServerStats {
+    /// Receiving the request: from the moment the server starts reading it, on a connection it
+    /// just accepted or on a stream the client opened in a multiplexed session, until the whole
+    /// request, or the last chunk of an upload, is received.
+    pub receive: Duration,
+    pub decode: Duration,
+    /// Waiting for other jobs, between the chunks of this one.
+    pub queue: Duration,
+    pub compute: Duration,
+    pub encode: Duration,
+    /// Number of homomorphic operations, by type.
+    pub ops: BTreeMap<String, u64>,
+    /// Number of threads computing the job.
+    pub threads: u32,
+    /// Memory reserved for the job from the memory budget of the server, in bytes. Jobs over
+    /// the budget reserve none, and are processed from disk a window at a time.
+    pub job_memory: u64,
+    /// Bytes of the request and of its results spilled to disk, over the memory budget.
+    pub spilled: u64,
+}
+
+impl ServerStats {
+    #[must_use]
+    #[inline]
+    /// Total time spent by the server on the request.
+    pub fn total(&self) -> Duration {
+        self.receive + self.decode + self.queue + self.compute + self.encode
+    }
+
+    /// Count `count` operations of the given type, e.g. `AddPlain` for `AddPlain(5)`.
+    pub fn count_ops(&mut self, op: impl core::fmt::Debug, count: u64) {
+        if count > 0 {
+            let mut name = format!("{op:?}");
+            if let Some(arguments) = name.find('(') {
+                name.truncate(arguments);
+            }
+            *self.ops.entry(name).or_default() += count;
+        }
+    }
+
+    /// Add the statistics of another server, e.g. a worker that ran a shard of the request.
+    ///
+    /// Durations, threads, job memory and spilled bytes add up.
+    pub fn merge(&mut self, other: &Self) {
+        self.receive += other.receive;
+        self.decode += other.decode;
+        self.queue += other.queue;
+        self.compute += other.compute;
+        self.encode += other.encode;
+        for (op, count) in &other.ops {
+            *self.ops.entry(op.clone()).or_default() += count;
+        }
+        self.threads += other.threads;
+        self.job_memory += other.job_memory;
+        self.spilled += other.spilled;
+    }
+}
+
+impl core::fmt::Display for ServerStats {
+    fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+        write!(
+            f,
+            "receive {:?}, decode {:?}, queue {:?}, compute {:?}, encode {:?} (total {:?}); ops {:?}; {} threads; job memory {} MiB; spilled {} MiB",
+            self.receive,
+            self.decode,
+            self.queue,
+            self.compute,
+            self.encode,
+            self.total(),
+            self.ops,
+            self.threads,
+            self.job_memory >> 20,
+            self.spilled >> 20,
+        )
+    }
+}
+
+#[must_use]
+/// Create the BFV context shared by every process.
+///
+/// Ciphertexts can only be decoded with a context built from the same parameters.
+pub fn bfv_context() -> SealBFVContext {
+    SealBFVContext::new(
+        seal_lib::DegreeType::D4096,
+        seal_lib::SecurityLevel::TC128,
+        16,
+    )
+}
+
+#[must_use]
+/// Number of values packed in each ciphertext returned by `Repack` jobs, i.e. the slot count of
+/// [`bfv_context`].
+///
+/// Shards of a `Repack` job hold a multiple of it, so that the packed ciphertexts of every
+/// shard are full but the last.
+pub fn repack_width() -> usize {
+    bfv_context().slot_count()
+}
+
+/// Build a request payload from its header and its already encoded data.
+pub fn encode_request(
+    request: &Request,
+    data: &[u8],
+) -> Result<Vec<u8>, bincode::error::EncodeError> {
+    let mut payload = bincode::encode_to_vec(request, crate::BINCODE_CONFIG)?;
+    payload.extend_from_slice(data);
+    Ok(payload)
+}
+
+/// Build a response payload from the results, followed by the statistics trailer if any.
+pub fn encode_response<R: Encode>(
+    results: &R,
+    stats: Option<&ServerStats>,
+) -> Result<Vec<u8>, bincode::error::EncodeError> {
+    let mut payload = bincode::encode_to_vec(results, crate::BINCODE_CONFIG)?;
+    encode_trailer_into(&mut payload, stats)?;
+    Ok(payload)
+}
+
+/// Append the statistics trailer, if any, to a response payload whose results are already
+/// encoded, e.g. by [`encode_ciphertexts`].
+pub fn encode_trailer_into(
+    payload: &mut Vec<u8>,
+    stats: Option<&ServerStats>,
+) -> Result<(), bincode::error::EncodeError> {
+    if let Some(stats) = stats {
+        payload.extend(bincode::encode_to_vec(stats, crate::BINCODE_CONFIG)?);
+    }
+    Ok(())
+}
+
+/// Build the data of a `Query` job: the [wire plan](QueryPlan::wire) of the query, followed by
+/// its collection. The conditions of the flags and the labels of the groups stay with the
+/// client.
+pub fn encode_query(
+    plan: &QueryPlan,
+    collection: &BfvCollection,
+) -> Result<Vec<u8>, bincode::error::EncodeError> {
+    let mut data = bincode::encode_to_vec(plan.wire(), crate::BINCODE_CONFIG)?;
+    data.extend(bincode::encode_to_vec(collection, crate::BINCODE_CONFIG)?);
+    Ok(data)
+}
+
+/// Encode ciphertexts as a `Vec<Ciphertext>`, serializing them in parallel.
+///
+/// The payload is the one of `bincode::encode_to_vec`, but serializing ciphertexts (compressing
+/// them) costs far more than copying them: see [`encode_ciphertexts_into`]. It is written to a
+/// [pooled buffer](crate::buffers) of its final size.
+pub fn encode_ciphertexts(
+    ciphertexts: &[Ciphertext],
+) -> Result<Buffer, bincode::error::EncodeError> {
+    let len = bincode::encode_to_vec(ciphertexts.len() as u64, crate::BINCODE_CONFIG)?;
+    let encoded = serialize_ciphertexts(ciphertexts)?;
+    let mut payload =
+        BufferPool::global().take(len.len() + encoded.iter().map(Vec::len).sum::<usize>());
+    payload.extend_from_slice(&len);
+    copy_ciphertexts(&mut payload, &encoded);
+    Ok(payload)
+}
+
+/// Append the encoded ciphertexts to `payload`, one after the other, without their number.
+///
+/// Every thread serializes ciphertexts, whose sizes then give their offsets in `payload`, which
+/// is grown once. Every thread then copies ciphertexts to their own region of `payload`.
+pub fn encode_ciphertexts_into(
+    payload: &mut Vec<u8>,
+    ciphertexts: &[Ciphertext],
+) -> Result<(), bincode::error::EncodeError> {
+    copy_ciphertexts(payload, &serialize_ciphertexts(ciphertexts)?);
+    Ok(())
+}
+
+fn serialize_ciphertexts(
+    ciphertexts: &[Ciphertext],
+) -> Result<Vec<Vec<u8>>, bincode::error::EncodeError> {
+    ciphertexts
+        .par_iter()
+        .map(|ciphertext| bincode::encode_to_vec(ciphertext, crate::BINCODE_CONFIG))
+        .collect()
+}
+
+fn copy_ciphertexts(payload: &mut Vec<u8>, encoded: &[Vec<u8>]) {
+    let start = payload.len();
+    payload.resize(start + encoded.iter().map(Vec::len).sum::<usize>(), 0);
+    let mut regions = Vec::with_capacity(encoded.len());
+    let mut rest = &mut payload[start..];
+    for ciphertext in encoded {
+        let (region, tail) = core::mem::take(&mut rest).split_at_mut(ciphertext.len());
+        regions.push(region);
+        rest = tail;
+    }
+    regions
+        .into_par_iter()
+        .zip(encoded)
+        .for_each(|(region, ciphertext)| region.copy_from_slice(ciphertext));
+}
+
+/// Decode an encoded `Vec<Ciphertext>`, loading the ciphertexts in parallel. Returns them with
+/// the number of bytes read, like `bincode::decode_from_slice`.
+///
+/// The length prefixes of the ciphertexts are walked first, which indexes them in `bytes`
+/// without reading them, then every thread loads (decompresses and validates) ciphertexts
+/// from their offsets.
+pub fn decode_ciphertexts(
+    bytes: &[u8],
+    bfv_ctx: &SealBFVContext,
+) -> Result<(Vec<Ciphertext>, usize), bincode::error::DecodeError> {
+    let (raw, read): (Vec<&[u8]>, _) =
+        bincode::borrow_decode_from_slice(bytes, crate::BINCODE_CONFIG)?;
+    Ok((load_ciphertexts(raw, bfv_ctx)?, read))
+}
+
+/// Load serialized ciphertexts, in parallel.
+pub fn load_ciphertexts(
+    raw: Vec<&[u8]>,
+    bfv_ctx: &SealBFVContext,
+) -> Result<Vec<Ciphertext>, bincode::error::DecodeError> {
+    raw.into_par_iter()
+        .map(|raw| bfv_ctx.load_ciphertext(raw))
+        .collect::<Result<_, _>>()
+        .map_err(|_| bincode::error::DecodeError::Other("invalid ciphertext"))
+}
+
+/// Build the last frame of a streamed response.
+pub fn encode_end_frame(
+    stats: Option<&ServerStats>,
+) -> Result<Vec<u8>, bincode::error::EncodeError> {
+    encode_response(&Vec::<Vec<u8>>::new(), stats)
+}
+
+/// Decode the statistics trailer, i.e. what remains of a response after its results.
+pub fn decode_trailer(trailer: &[u8]) -> Result<Option<ServerStats>, bincode::error::DecodeError> {
+    if trailer.is_empty() {
+        return Ok(None);
+    }
+    let (stats, _) = bincode::decode_from_slice(trailer, crate::BINCODE_CONFIG)?;
+    Ok(Some(stats))
+}
+
+/// Split a request payload into its header and its encoded data.
+pub fn decode_request(request: &[u8]) -> Result<(Request, &[u8]), bincode::error::DecodeError> {
+    let (header, read) = bincode::decode_from_slice(request, crate::BINCODE_CONFIG)?;
+    Ok((header, &request[read..]))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use fhe_core::api::CryptoSystem as _;
+
+    #[test]
+    fn test_request_roundtrip() {
+        let data = [1, 2, 3, 4];
+        for job in [
+            Job::SeqOps,
+            Job::SeqOpsSum,
+            Job::CollectionSum { flag: None },
+            Job::CollectionSum { flag: Some(2) },
+            Job::Program,
+            Job::Query,
+            Job::Repack,
+        ] {
+            let request = Request {
+                priority: Priority::Batch,
+                tenant: String::from("risk"),
+                deadline_ms: Some(1000),
+                stats: true,
+                stream: true,
+                layout: Layout::Columns,
+                dataset: String::from("sales"),
+                ..Request::new(job)
+            };
+            let payload = encode_request(&request, &data).unwrap();
+            let (decoded, rest) = decode_request(&payload).unwrap();
+            assert_eq!(decoded, request);
+            assert_eq!(rest, data);
+        }
+    }
+
+    #[test]
+    fn test_response_trailer() {
+        let results: Vec<Vec<u8>> = vec![vec![1, 2], vec![3]];
+        let mut stats = ServerStats {
+            compute: Duration::from_millis(5),
+            threads: 4,
+            job_memory: 3 << 20,
+            ..ServerStats::default()
+        };
+        stats.count_ops(seal_lib::BfvHOperation2::Add, 2);
+
+        let without = encode_response(&results, None).unwrap();
+        let (_, read): (Vec<Vec<u8>>, _) =
+            bincode::decode_from_slice(&without, crate::BINCODE_CONFIG).unwrap();
+        assert_eq!(decode_trailer(&without[read..]).unwrap(), None);
+
+        let with = encode_response(&results, Some(&stats)).unwrap();
+        let (decoded, read): (Vec<Vec<u8>>, _) =
+            bincode::decode_from_slice(&with, crate::BINCODE_CONFIG).unwrap();
+        assert_eq!(decoded, results);
+        assert_eq!(decode_trailer(&with[read..]).unwrap(), Some(stats.clone()));
+
+        stats.merge(&stats.clone());
+        assert_eq!(stats.compute, Duration::from_millis(10));
+        assert_eq!(stats.ops["Add"], 4);
+        assert_eq!(stats.threads, 8);
+        assert_eq!(stats.job_memory, 6 << 20);
+    }
+
+    #[test]
+    fn test_query_without_plaintext() {
+        let limits = Limits {
+            flags: COLLECTION_FLAGS,
+            depth: 8,
+            parallel_rows: 64,
+        };
+        let plan = fhe_operations::sql::Query::parse(
+            "SELECT SUM(amount) FROM sales WHERE region = 'Northern Europe' GROUP BY country",
+        )
+        .unwrap()
+        .plan(
+            &[String::from("Portugal"), String::from("Iceland")],
+            2,
+            &limits,
+        )
+        .unwrap();
+
+        let data = encode_query(&plan, &BfvCollection::new()).unwrap();
+        for text in [
+            "Northern Europe",
+            "Portugal",
+            "Iceland",
+            "region",
+            "country",
+        ] {
+            assert!(
+                !data
+                    .windows(text.len())
+                    .any(|bytes| bytes == text.as_bytes()),
+                "{text}"
+            );
+        }
+        let (wire, _): (fhe_operations::sql::WirePlan, _) =
+            bincode::decode_from_slice(&data, crate::BINCODE_CONFIG).unwrap();
+        assert_eq!(wire, plan.wire());
+        assert_eq!(wire.predicates.len(), 2);
+    }
+
+    #[test]
+    fn test_parallel_ciphertexts() {
+        let bfv_ctx = bfv_context();
+        let bfv_cs = SealBfvCS::new(&bfv_ctx);
+        let ciphertexts = (0..100).map(|i| bfv_cs.cipher(&i)).collect::<Vec<_>>();
+
+        // Both ways give the payload of bincode.
+        let encoded = encode_ciphertexts(&ciphertexts).unwrap().into_vec();
+        assert_eq!(
+            encoded,
+            bincode::encode_to_vec(&ciphertexts, crate::BINCODE_CONFIG).unwrap()
+        );
+
+        let mut payload = encoded.clone();
+        payload.extend([1, 2, 3]);
+        let (decoded, read) = decode_ciphertexts(&payload, &bfv_ctx).unwrap();
+        assert_eq!(read, encoded.len());
+        let values = decoded
+            .iter()
+            .map(|c| bfv_cs.decipher(c))
+            .collect::<Vec<_>>();
+        assert_eq!(values, (0..100).collect::<Vec<_>>());
+
+        assert!(decode_ciphertexts(&encoded[..encoded.len() - 1], &bfv_ctx).is_err());
+    }
+}
@@ -0,0 +1,833 @@
+//! Scheduler sharing the rayon pool between the concurrent jobs of a server.
+//!
+//! Jobs are cut into chunks, and a dispatcher thread runs one chunk at a time on the whole
+//! pool. Before each chunk, it picks:
+//! - the most urgent priority class with pending work,
+//! - within this class, the next tenant in round-robin order, so that a tenant submitting
+//!   many jobs does not starve the others,
+//! - within this tenant, the job with the earliest deadline.
+//!
+//! Large jobs thus yield to more urgent work between chunks. Jobs whose deadline has passed,
+//! or that were cancelled, are dropped between chunks too.
+//!
+//! The results of a chunk can be streamed as soon as it is done, instead of being kept
+//! until the whole job is. A streamed job whose consumer lags behind is set aside once
+//! [`STREAMED_CHUNKS`] results wait to be taken, and other jobs run in the meantime.
+//!
+//! On hosts with several NUMA nodes, the scheduler can instead run a pool of threads pinned to
+//! each node, with its own queues and dispatcher. Each job is placed on a node as a whole, so
+//! that its keys and ciphertexts are only read by the threads of this node.
+
+use crate::cost::OpPools;
+use crate::numa::{self, Node};
+use crate::protocol::Priority;
+use core::time::Duration;
+use rayon::{ThreadPool, ThreadPoolBuildError, ThreadPoolBuilder};
+use seal_lib::{Ciphertext, MemoryPool};
+use std::collections::VecDeque;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::{Arc, Condvar, Mutex};
+use std::time::Instant;
+use thiserror::Error;
+use tokio::sync::{mpsc, oneshot};
+
+/// Number of items processed by each chunk of a job, when they all are of the costliest operation.
+///
+/// Each chunk runs on the whole pool: this bounds the time more urgent work has to wait.
+pub const CHUNK_SIZE: usize = 256;
+
+/// Results of chunks a streamed job holds before its consumer takes them: the capacity of the
+/// channel of [`JobSpec::stream`].
+pub const STREAMED_CHUNKS: usize = 4;
+
+/// A part of a job, returning its partial results.
+pub type Chunk = Box<dyn FnOnce() -> Vec<Ciphertext> + Send>;
+/// Combines the partial results of all the chunks of a job, in order.
+pub type Merge = Box<dyn FnOnce(Vec<Ciphertext>) -> Vec<Ciphertext> + Send>;
+
+#[derive(Error, Debug, PartialEq, Eq)]
+pub enum JobError {
+    #[error("Job deadline exceeded")]
+    DeadlineExceeded,
+    #[error("Job cancelled")]
+    Cancelled,
+}
+
+/// A job to be scheduled.
+pub struct JobSpec {
+    pub priority: Priority,
+    pub tenant: String,
+    pub deadline: Option<Instant>,
+    pub chunks: Vec<Chunk>,
+    pub merge: Merge,
+    /// Where to send the results of each chunk, as soon as it is done.
+    ///
+    /// These results are then not given to `merge`, which only makes sense for element-wise jobs.
+    /// The job waits while the channel is full: its consumer calls [`JobHandle::resume`] after
+    /// taking results.
+    pub stream: Option<mpsc::Sender<Vec<Ciphertext>>>,
+}
+
+/// Results of a completed job.
+pub struct JobOutput {
+    /// Merged results, without those that were streamed.
+    pub results: Vec<Ciphertext>,
+    /// Time spent waiting for other jobs, before and between the chunks of the job.
+    pub queued: Duration,
+    /// Time spent running the chunks of the job and merging their results.
+    pub compute: Duration,
+}
+
+/// Handle on a submitted job.
+///
+/// Dropping it cancels the job, even one set aside because its stream is full.
+pub struct JobHandle {
+    cancelled: Arc<AtomicBool>,
+    result: oneshot::Receiver<Result<JobOutput, JobError>>,
+    shared: Arc<Shared>,
+    shard: usize,
+}
+
+impl JobHandle {
+    #[inline]
+    /// Cancel the job. Its current chunk, if any, still runs to completion.
+    pub fn cancel(&self) {
+        self.cancelled.store(true, Ordering::Relaxed);
+        self.resume();
+    }
+
+    /// Run the job again if it waits for room in its stream, once results were taken from it.
+    pub fn resume(&self) {
+        let shard = &self.shared.shards[self.shard];
+        // Taking the lock orders this after the dispatcher checked the stream and waits.
+        drop(shard.queues.lock().unwrap());
+        shard.work.notify_one();
+    }
+
+    /// Wait for the results of the job.
+    pub async fn wait(mut self) -> Result<JobOutput, JobError> {
+        (&mut self.result).await.unwrap_or(Err(JobError::Cancelled))
+    }
+}
+
+impl Drop for JobHandle {
+    fn drop(&mut self) {
+        // A parked job is only dropped once its dispatcher wakes up.
+        self.cancel();
+    }
+}
+
+/// Time spent by the jobs of a class between their submission and their first chunk.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct WaitStats {
+    pub jobs: u32,
+    pub total: Duration,
+    pub max: Duration,
+}
+
+impl WaitStats {
+    #[must_use]
+    #[inline]
+    pub fn mean(&self) -> Duration {
+        self.total.checked_div(self.jobs).unwrap_or_default()
+    }
+
+    fn record(&mut self, wait: Duration) -> Self {
+        self.jobs += 1;
+        self.total += wait;
+        self.max = self.max.max(wait);
+        *self
+    }
+}
+
+struct Job {
+    tenant: String,
+    priority: Priority,
+    deadline: Option<Instant>,
+    /// Submission order, to run jobs without deadline first come, first served.
+    seq: u64,
+    submitted: Instant,
+    started: bool,
+    /// Last time the job was queued.
+    enqueued: Instant,
+    queued: Duration,
+    chunks: VecDeque<Chunk>,
+    outputs: Vec<Ciphertext>,
+    compute: Duration,
+    merge: Merge,
+    stream: Option<mpsc::Sender<Vec<Ciphertext>>>,
+    cancelled: Arc<AtomicBool>,
+    result: oneshot::Sender<Result<JobOutput, JobError>>,
+}
+
+impl Job {
+    fn interrupted(&self) -> Option<JobError> {
+        if self.cancelled.load(Ordering::Relaxed)
+            || self.result.is_closed()
+            || self.stream.as_ref().is_some_and(mpsc::Sender::is_closed)
+        {
+            Some(JobError::Cancelled)
+        } else if self
+            .deadline
+            .is_some_and(|deadline| Instant::now() > deadline)
+        {
+            Some(JobError::DeadlineExceeded)
+        } else {
+            None
+        }
+    }
+
+    /// Whether the job streams its results and its consumer has not taken the last ones.
+    fn stream_full(&self) -> bool {
+        self.stream
+            .as_ref()
+            .is_some_and(|stream| stream.capacity() == 0)
+    }
+}
+
+/// Pending jobs of a tenant.
+struct Tenant {
+    name: String,
+    jobs: Vec<Job>,
+}
+
+#[derive(Default)]
+struct Queues {
+    /// One round-robin queue of tenants per priority class.
+    classes: [VecDeque<Tenant>; Priority::ALL.len()],
+    /// Jobs whose stream is full, set aside until their consumer takes results.
+    parked: Vec<Job>,
+    next_seq: u64,
+    shutdown: bool,
+}
+
+impl Queues {
+    fn push(&mut self, mut job: Job) {
+        job.enqueued = Instant::now();
+        let class = &mut self.classes[job.priority.index()];
+        if let Some(tenant) = class.iter_mut().find(|t| t.name == job.tenant) {
+            tenant.jobs.push(job);
+        } else {
+            class.push_back(Tenant {
+                name: job.tenant.clone(),
+                jobs: vec![job],
+            });
+        }
+    }
+
+    /// Queue the parked jobs whose stream has room again, or that were interrupted.
+    fn unpark(&mut self) {
+        let (ready, parked): (Vec<_>, _) = core::mem::take(&mut self.parked)
+            .into_iter()
+            .partition(|job| !job.stream_full() || job.interrupted().is_some());
+        self.parked = parked;
+        for job in ready {
+            self.push(job);
+        }
+    }
+
+    fn pop(&mut self) -> Option<Job> {
+        let class = self.classes.iter_mut().find(|class| !class.is_empty())?;
+        let mut tenant = class.pop_front()?;
+
+        let (index, _) = tenant
+            .jobs
+            .iter()
+            .enumerate()
+            .min_by_key(|(_, job)| (job.deadline.is_none(), job.deadline, job.seq))?;
+        let mut job = tenant.jobs.swap_remove(index);
+        job.queued += job.enqueued.elapsed();
+
+        // The tenant goes to the back of the queue, its job is pushed back after its chunk.
+        if !tenant.jobs.is_empty() {
+            class.push_back(tenant);
+        }
+        Some(job)
+    }
+}
+
+/// Jobs placed on a set of threads, and these threads.
+struct Shard {
+    queues: Mutex<Queues>,
+    work: Condvar,
+    /// Threads running the chunks of the jobs, rayon's global pool if `None`.
+    pool: Option<ThreadPool>,
+    /// SEAL memory pool of the jobs, SEAL's global pool if `None`.
+    memory: Option<MemoryPool>,
+    /// Pools of the operations of the items run at once, on the same node as `pool`.
+    op_pools: Arc<OpPools>,
+    /// Jobs placed on the shard and not done yet.
+    load: AtomicUsize,
+}
+
+impl Shard {
+    fn new(pool: Option<ThreadPool>, memory: Option<MemoryPool>, node: Option<Node>) -> Self {
+        let threads = pool
+            .as_ref()
+            .map_or_else(rayon::current_num_threads, ThreadPool::current_num_threads);
+        Self {
+            queues: Mutex::new(Queues::default()),
+            work: Condvar::new(),
+            pool,
+            memory,
+            op_pools: Arc::new(OpPools::new(threads, node)),
+            load: AtomicUsize::new(0),
+        }
+    }
+
+    fn install<R: Send>(&self, op: impl FnOnce() -> R + Send) -> R {
+        match &self.pool {
+            Some(pool) => pool.install(op),
+            None => op(),
+        }
+    }
+}
+
+struct Shared {
+    shards: Vec<Shard>,
+    stats: Mutex<[WaitStats; Priority::ALL.len()]>,
+}
+
+/// Scheduler of the jobs of a server.
+pub struct Scheduler {
+    shared: Arc<Shared>,
+}
+
+impl Scheduler {
+    #[must_use]
+    /// Start the dispatcher thread, running jobs on rayon's global pool.
+    pub fn start() -> Self {
+        Self::spawn(vec![Shard::new(None, None, None)], &[None])
+    }
+
+    /// Start one pool of threads pinned to each NUMA node, and its dispatcher thread.
+    ///
+    /// Jobs are placed on the node with the fewest jobs, and all their work runs on its threads
+    /// and allocates from its SEAL memory pool, so that their data stays on this node.
+    pub fn start_numa(nodes: &[Node]) -> Result<Self, ThreadPoolBuildError> {
+        assert!(!nodes.is_empty(), "no NUMA node to run jobs on");
+        let shards = nodes
+            .iter()
+            .map(|node| {
+                let cpus = node.cpus.clone();
+                let id = node.id;
+                let pool = ThreadPoolBuilder::new()
+                    .num_threads(node.cpus.len())
+                    .thread_name(move |index| format!("node{id}-worker{index}"))
+                    .start_handler(move |_| {
+                        if let Err(err) = numa::pin(&cpus) {
+                            log::warn!("Failed to pin worker to node {id}: {err}");
+                        }
+                    })
+                    .build()?;
+                // The pool is first written by the threads of the node.
+                let memory = pool.install(|| MemoryPool::new().ok());
+                Ok(Shard::new(Some(pool), memory, Some(node.clone())))
+            })
+            .collect::<Result<Vec<_>, _>>()?;
+        let pinned = nodes.iter().cloned().map(Some).collect::<Vec<_>>();
+
+        Ok(Self::spawn(shards, &pinned))
+    }
+
+    fn spawn(shards: Vec<Shard>, nodes: &[Option<Node>]) -> Self {
+        let shared = Arc::new(Shared {
+            shards,
+            stats: Mutex::new([WaitStats::default(); Priority::ALL.len()]),
+        });
+
+        for (index, node) in nodes.iter().enumerate() {
+            let dispatcher = Arc::clone(&shared);
+            let node = node.clone();
+            let name = node.as_ref().map_or_else(
+                || String::from("scheduler"),
+                |node| format!("scheduler{}", node.id),
+            );
+            std::thread::Builder::new()
+                .name(name)
+                .spawn(move || {
+                    if let Some(node) = node
+                        && let Err(err) = numa::pin(&node.cpus)
+                    {
+                        log::warn!("Failed to pin scheduler to node {}: {err}", node.id);
+                    }
+                    dispatch(&dispatcher, index);
+                })
+                .expect("failed to spawn the scheduler thread");
+        }
+
+        Self { shared }
+    }
+
+    #[must_use]
+    /// Choose the threads a job will run on, before submitting it.
+    pub fn place(&self) -> Placement {
+        let (shard, _) = self
+            .shared
+            .shards
+            .iter()
+            .enumerate()
+            .min_by_key(|(_, shard)| shard.load.load(Ordering::Relaxed))
+            .expect("a scheduler has at least one shard");
+        self.shared.shards[shard]
+            .load
+            .fetch_add(1, Ordering::Relaxed);
+
+        Placement {
+            shared: Arc::clone(&self.shared),
+            shard,
+            submitted: false,
+        }
+    }
+
+    /// Queue a job.
+    pub fn submit(&self, spec: JobSpec) -> JobHandle {
+        self.place().submit(spec)
+    }
+
+    #[must_use]
+    /// Queue wait time of the jobs of each class, in the order of [`Priority::ALL`].
+    pub fn wait_stats(&self) -> [WaitStats; Priority::ALL.len()] {
+        *self.shared.stats.lock().unwrap()
+    }
+}
+
+impl Drop for Scheduler {
+    fn drop(&mut self) {
+        for shard in &self.shared.shards {
+            shard.queues.lock().unwrap().shutdown = true;
+            shard.work.notify_one();
+        }
+    }
+}
+
+/// Threads a job will run on, e.g. to load its ciphertexts and create its keys on the NUMA
+/// node that will compute it.
+///
+/// Dropping it without submitting the job releases the threads.
+pub struct Placement {
+    shared: Arc<Shared>,
+    shard: usize,
+    submitted: bool,
+}
+
+impl Placement {
+    fn shard(&self) -> &Shard {
+        &self.shared.shards[self.shard]
+    }
+
+    #[inline]
+    /// Run `op` on the threads of the job, and in particular its parallel iterators.
+    pub fn install<R: Send>(&self, op: impl FnOnce() -> R + Send) -> R {
+        self.shard().install(op)
+    }
+
+    #[must_use]
+    #[inline]
+    /// Number of threads of the job.
+    pub fn threads(&self) -> usize {
+        self.shard()
+            .pool
+            .as_ref()
+            .map_or_else(rayon::current_num_threads, ThreadPool::current_num_threads)
+    }
+
+    #[must_use]
+    #[inline]
+    /// SEAL memory pool to allocate the ciphertexts of the job from, SEAL's global pool if
+    /// `None`.
+    pub fn memory_pool(&self) -> Option<&MemoryPool> {
+        self.shard().memory.as_ref()
+    }
+
+    #[must_use]
+    #[inline]
+    /// Pools of threads the operations of the job run on, when they get several threads each,
+    /// see [`par_map_budgeted`](crate::cost::par_map_budgeted).
+    pub fn op_pools(&self) -> &Arc<OpPools> {
+        &self.shard().op_pools
+    }
+
+    /// Queue the job.
+    pub fn submit(mut self, spec: JobSpec) -> JobHandle {
+        self.submitted = true;
+        let cancelled = Arc::new(AtomicBool::new(false));
+        let (sender, receiver) = oneshot::channel();
+
+        let shard = self.shard();
+        let mut queues = shard.queues.lock().unwrap();
+        let job = Job {
+            tenant: spec.tenant,
+            priority: spec.priority,
+            deadline: spec.deadline,
+            seq: queues.next_seq,
+            submitted: Instant::now(),
+            started: false,
+            enqueued: Instant::now(),
+            queued: Duration::ZERO,
+            chunks: spec.chunks.into(),
+            outputs: Vec::new(),
+            compute: Duration::ZERO,
+            merge: spec.merge,
+            stream: spec.stream,
+            cancelled: Arc::clone(&cancelled),
+            result: sender,
+        };
+        queues.next_seq += 1;
+        queues.push(job);
+        drop(queues);
+        shard.work.notify_one();
+
+        JobHandle {
+            cancelled,
+            result: receiver,
+            shared: Arc::clone(&self.shared),
+            shard: self.shard,
+        }
+    }
+}
+
+impl Drop for Placement {
+    fn drop(&mut self) {
+        if !self.submitted {
+            self.shard().load.fetch_sub(1, Ordering::Relaxed);
+        }
+    }
+}
+
+fn dispatch(shared: &Shared, shard: usize) {
+    let stats = &shared.stats;
+    let shard = &shared.shards[shard];
+    loop {
+        let mut job = {
+            let mut queues = shard.queues.lock().unwrap();
+            loop {
+                if queues.shutdown {
+                    return;
+                }
+                queues.unpark();
+                if let Some(job) = queues.pop() {
+                    if job.stream_full() && job.interrupted().is_none() {
+                        queues.parked.push(job);
+                        continue;
+                    }
+                    break job;
+                }
+                queues = shard.work.wait(queues).unwrap();
+            }
+        };
+
+        if let Some(err) = job.interrupted() {
+            log::warn!("Dropping {} job from '{}': {err}", job.priority, job.tenant);
+            shard.load.fetch_sub(1, Ordering::Relaxed);
+            let _ = job.result.send(Err(err));
+            continue;
+        }
+
+        if !job.started {
+            job.started = true;
+            let wait = job.submitted.elapsed();
+            let class = stats.lock().unwrap()[job.priority.index()].record(wait);
+            log::info!(
+                "Starting {} job from '{}' after {wait:?} in queue ({} jobs of this class, mean wait {:?}, max {:?})",
+                job.priority,
+                job.tenant,
+                class.jobs,
+                class.mean(),
+                class.max,
+            );
+        }
+
+        let start = Instant::now();
+        if let Some(chunk) = job.chunks.pop_front() {
+            let outputs = shard.install(chunk);
+            match &job.stream {
+                // A closed stream cancels the job before its next chunk. The stream had room,
+                // and the dispatcher is its only sender.
+                Some(stream) => _ = stream.try_send(outputs),
+                None => job.outputs.extend(outputs),
+            }
+        }
+
+        if job.chunks.is_empty() {
+            let outputs = job.outputs;
+            let results = shard.install(move || (job.merge)(outputs));
+            let compute = job.compute + start.elapsed();
+            shard.load.fetch_sub(1, Ordering::Relaxed);
+            let _ = job.result.send(Ok(JobOutput {
+                results,
+                queued: job.queued,
+                compute,
+            }));
+        } else {
+            job.compute += start.elapsed();
+            shard.queues.lock().unwrap().push(job);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn job(queues: &mut Queues, tenant: &str, priority: Priority, deadline: Option<Instant>) {
+        let (result, _) = oneshot::channel();
+        let seq = queues.next_seq;
+        queues.next_seq += 1;
+        queues.push(Job {
+            tenant: tenant.to_string(),
+            priority,
+            deadline,
+            seq,
+            submitted: Instant::now(),
+            started: false,
+            enqueued: Instant::now(),
+            queued: Duration::ZERO,
+            chunks: VecDeque::new(),
+            outputs: Vec::new(),
+            compute: Duration::ZERO,
+            merge: Box::new(|outputs| outputs),
+            stream: None,
+            cancelled: Arc::new(AtomicBool::new(false)),
+            result,
+        });
+    }
+
+    fn order(queues: &mut Queues) -> Vec<(String, u64)> {
+        core::iter::from_fn(|| queues.pop())
+            .map(|job| (job.tenant, job.seq))
+            .collect()
+    }
+
+    #[test]
+    fn test_priority_classes() {
+        let mut queues = Queues::default();
+        job(&mut queues, "a", Priority::Batch, None);
+        job(&mut queues, "a", Priority::Normal, None);
+        job(&mut queues, "a", Priority::Interactive, None);
+
+        assert_eq!(
+            order(&mut queues),
+            vec![("a".into(), 2), ("a".into(), 1), ("a".into(), 0)]
+        );
+    }
+
+    #[test]
+    fn test_tenants_round_robin() {
+        let mut queues = Queues::default();
+        job(&mut queues, "a", Priority::Normal, None);
+        job(&mut queues, "a", Priority::Normal, None);
+        job(&mut queues, "a", Priority::Normal, None);
+        job(&mut queues, "b", Priority::Normal, None);
+
+        assert_eq!(
+            order(&mut queues),
+            vec![
+                ("a".into(), 0),
+                ("b".into(), 3),
+                ("a".into(), 1),
+                ("a".into(), 2)
+            ]
+        );
+    }
+
+    #[test]
+    fn test_earliest_deadline_first() {
+        let now = Instant::now();
+        let mut queues = Queues::default();
+        job(&mut queues, "a", Priority::Normal, None);
+        job(
+            &mut queues,
+            "a",
+            Priority::Normal,
+            Some(now + Duration::from_secs(10)),
+        );
+        job(
+            &mut queues,
+            "a",
+            Priority::Normal,
+            Some(now + Duration::from_secs(1)),
+        );
+
+        assert_eq!(
+            order(&mut queues),
+            vec![("a".into(), 2), ("a".into(), 1), ("a".into(), 0)]
+        );
+    }
+
+    fn spec(priority: Priority, chunks: Vec<Chunk>) -> JobSpec {
+        JobSpec {
+            priority,
+            tenant: String::new(),
+            deadline: None,
+            chunks,
+            merge: Box::new(|outputs| outputs),
+            stream: None,
+        }
+    }
+
+    #[tokio::test]
+    async fn test_urgent_job_runs_between_chunks() {
+        let scheduler = Scheduler::start();
+        let done = Arc::new(Mutex::new(Vec::new()));
+
+        let chunk = |name: &'static str| -> Chunk {
+            let done = Arc::clone(&done);
+            Box::new(move || {
+                std::thread::sleep(Duration::from_millis(5));
+                done.lock().unwrap().push(name);
+                Vec::new()
+            })
+        };
+
+        let batch = scheduler.submit(spec(
+            Priority::Batch,
+            (0..50).map(|_| chunk("batch")).collect(),
+        ));
+        tokio::time::sleep(Duration::from_millis(20)).await;
+        let interactive = scheduler.submit(spec(Priority::Interactive, vec![chunk("interactive")]));
+
+        interactive.wait().await.unwrap();
+        batch.wait().await.unwrap();
+
+        let done = done.lock().unwrap().clone();
+        let position = done.iter().position(|&name| name == "interactive").unwrap();
+        assert!(position < done.len() - 1);
+
+        let stats = scheduler.wait_stats();
+        assert_eq!(stats[Priority::Batch.index()].jobs, 1);
+        assert_eq!(stats[Priority::Interactive.index()].jobs, 1);
+    }
+
+    #[tokio::test]
+    async fn test_deadline_exceeded() {
+        let scheduler = Scheduler::start();
+
+        let mut late = spec(Priority::Normal, vec![Box::new(Vec::new)]);
+        late.deadline = Some(Instant::now());
+        std::thread::sleep(Duration::from_millis(1));
+
+        assert!(matches!(
+            scheduler.submit(late).wait().await,
+            Err(JobError::DeadlineExceeded)
+        ));
+    }
+
+    #[tokio::test]
+    async fn test_stream_chunks() {
+        let scheduler = Scheduler::start();
+        let (sender, mut receiver) = mpsc::channel(1);
+
+        let mut streamed = spec(
+            Priority::Normal,
+            (0..3).map(|_| Box::new(Vec::new) as Chunk).collect(),
+        );
+        streamed.stream = Some(sender);
+        let handle = scheduler.submit(streamed);
+
+        // The stream is full after the first chunk: the job waits, and the others run.
+        let other = scheduler.submit(spec(Priority::Batch, vec![Box::new(Vec::new)]));
+        assert!(other.wait().await.is_ok());
+
+        let mut frames = 0;
+        while receiver.recv().await.is_some() {
+            frames += 1;
+            handle.resume();
+        }
+        assert_eq!(frames, 3);
+        assert!(handle.wait().await.is_ok());
+    }
+
+    #[tokio::test]
+    async fn test_drop_cancels_parked_job() {
+        let scheduler = Scheduler::start();
+        let (sender, _receiver) = mpsc::channel(1);
+        let data = Arc::new(());
+
+        let chunks = (0..3)
+            .map(|_| {
+                let data = Arc::clone(&data);
+                Box::new(move || {
+                    drop(data);
+                    Vec::new()
+                }) as Chunk
+            })
+            .collect();
+        let mut streamed = spec(Priority::Normal, chunks);
+        streamed.stream = Some(sender);
+        let handle = scheduler.submit(streamed);
+
+        // The results of the first chunk fill the stream, which is never read: the job parks.
+        while Arc::strong_count(&data) > 3 {
+            tokio::time::sleep(Duration::from_millis(5)).await;
+        }
+        tokio::time::sleep(Duration::from_millis(20)).await;
+
+        // Dropping the handle drops the job, and its remaining chunks.
+        drop(handle);
+        for _ in 0..100 {
+            if Arc::strong_count(&data) == 1 {
+                return;
+            }
+            tokio::time::sleep(Duration::from_millis(10)).await;
+        }
+        panic!("the parked job was not dropped");
+    }
+
+    fn two_nodes() -> Scheduler {
+        let node = |id| Node { id, cpus: vec![0] };
+        Scheduler::start_numa(&[node(0), node(1)]).unwrap()
+    }
+
+    #[test]
+    fn test_place_on_least_loaded_node() {
+        let scheduler = two_nodes();
+        let first = scheduler.place();
+        let second = scheduler.place();
+        assert_ne!(first.shard, second.shard);
+        assert_eq!(first.threads(), 1);
+        assert!(first.memory_pool().is_some());
+
+        // An unsubmitted placement releases its node.
+        let shard = first.shard;
+        drop(first);
+        assert_eq!(scheduler.place().shard, shard);
+    }
+
+    #[tokio::test]
+    async fn test_numa_jobs_run_on_their_node() {
+        let scheduler = two_nodes();
+        let threads = Arc::new(Mutex::new(Vec::new()));
+
+        let handles = (0..4)
+            .map(|_| {
+                let placement = scheduler.place();
+                let threads = Arc::clone(&threads);
+                let node = format!("node{}-", placement.shard);
+                let chunk: Chunk = Box::new(move || {
+                    let name = std::thread::current().name().map(String::from);
+                    threads.lock().unwrap().push((node, name));
+                    Vec::new()
+                });
+                placement.submit(spec(Priority::Normal, vec![chunk]))
+            })
+            .collect::<Vec<_>>();
+        for handle in handles {
+            handle.wait().await.unwrap();
+        }
+
+        let threads = threads.lock().unwrap();
+        assert_eq!(threads.len(), 4);
+        assert!(
+            threads
+                .iter()
+                .all(|(node, name)| name.as_ref().is_some_and(|name| name.starts_with(node)))
+        );
+        let loads = scheduler.shared.shards.iter();
+        assert!(
+            loads
+                .into_iter()
+                .all(|shard| shard.load.load(Ordering::Relaxed) == 0)
+        );
+    }
+}
@@ -1,55 +1,1321 @@
-use super::{unsized_data_recv, unsized_data_send};
+use crate::budget::{MemoryBudget, Reservation};
+use crate::cache::{self, CachedResults, ResultCache};
+use crate::cost::{self, CostModel, OpPools};
+use crate::mux::{self, Channel, Responder};
+use crate::protocol::{
+    self, BfvCollection, BfvProgram, COLLECTION_FLAGS, Job, Layout, Request, ServerStats,
+};
+use crate::scheduler::{CHUNK_SIZE, Chunk, JobSpec, Merge, STREAMED_CHUNKS, Scheduler};
+use crate::transport::spill::{MappedFile, SpillPolicy, SpillWriter};
+use crate::transport::{Payload, Stream};
+use crate::upload::{self, CompleteUpload, UploadError, UploadStore};
+use bincode::de::BorrowDecode;
+use core::ops::Range;
 use fhe_core::api::CryptoSystem;
-use fhe_operations::seq_ops::SeqOpsData;
+use fhe_operations::program::Instruction;
+use fhe_operations::selectable_collection::{Predicate, SelectableCS, SelectableItem};
+use fhe_operations::seq_ops::{SeqOpItem, SeqOpsColumns, SeqOpsData};
+use fhe_operations::sql::{Strategy, WirePlan};
 use rayon::prelude::*;
-use seal_lib::{SealBfvCS, context::SealBFVContext};
-use tokio::net::TcpStream;
+use seal_lib::context::SealBFVContext;
+use seal_lib::{BfvHOperation1, BfvHOperation2, Ciphertext, GaloisKeys, SealBfvCS};
+use std::collections::HashMap;
+use std::sync::Arc;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::time::{Duration, Instant};
 
-pub async fn handle_client(mut stream: TcpStream) {
-    let bfv_ctx = SealBFVContext::new(
-        seal_lib::DegreeType::D4096,
-        seal_lib::SecurityLevel::TC128,
-        16,
-    );
+/// What the connections of a server share.
+pub struct ServerContext {
+    pub scheduler: Scheduler,
+    pub budget: Arc<MemoryBudget>,
+    pub uploads: UploadStore,
+    pub costs: Arc<CostModel<BfvHOperation2>>,
+    pub results: ResultCache,
+}
+
+/// Operations of the jobs run by a server.
+pub const OPERATIONS: [BfvHOperation2; 2] = [BfvHOperation2::Add, BfvHOperation2::Mul];
+
+#[must_use]
+/// Measure the cost of the operations of the jobs, with the parameters of every process.
+pub fn measure_costs() -> CostModel<BfvHOperation2> {
+    let bfv_ctx = protocol::bfv_context();
     let bfv_cs = SealBfvCS::new(&bfv_ctx);
+    let (lhs, rhs) = (bfv_cs.cipher(&3), bfv_cs.cipher(&5));
+    CostModel::measure(&OPERATIONS, |op| {
+        bfv_cs.operate2(op, &lhs, &rhs);
+    })
+}
+
+/// A job cut into chunks, ready to be scheduled.
+struct Plan {
+    chunks: Vec<Chunk>,
+    merge: Merge,
+    /// Number of items of the job.
+    items: usize,
+}
+
+pub async fn handle_client(mut stream: Stream, server: Arc<ServerContext>) {
+    let start = Instant::now();
 
-    let Ok(data) = unsized_data_recv(&mut stream).await else {
+    // Requests too large for the memory budget are spilled to disk as they are received.
+    let mut reservation = None;
+    let mut in_memory = |len: usize| {
+        let reserved = server.budget.try_reserve(len);
+        let fits = reserved.is_some();
+        reservation = Some(reserved);
+        fits
+    };
+    let data = stream
+        .recv_or_spill(SpillPolicy {
+            dir: server.budget.spill_dir(),
+            in_memory: &mut in_memory,
+        })
+        .await;
+    let Ok(data) = data else {
         log::error!("Failed to receive data from client");
         return;
     };
 
-    let Ok(exch_data) =
-        bincode::decode_from_slice_with_context(&data, super::BINCODE_CONFIG, bfv_ctx)
-    else {
-        log::error!("Failed to decode data from client");
+    if *data == *mux::HELLO {
+        log::info!("Serving a multiplexed session");
+        mux::serve(stream, |channel| {
+            handle_stream(channel, Arc::clone(&server))
+        })
+        .await;
         return;
+    }
+
+    if let Some(manifest) = data.strip_prefix(upload::HELLO) {
+        let (request, upload) = match receive_upload(&mut stream, manifest, &server.uploads).await {
+            Ok(upload) => upload,
+            Err(err) => {
+                log::error!("Upload failed: {err}");
+                return;
+            }
+        };
+        let reservation = server.budget.try_reserve(request.len());
+        let answered = handle_request(
+            Payload::Spilled(request),
+            reservation,
+            start.elapsed(),
+            &server,
+            &mut Responder::Stream(&mut stream),
+        )
+        .await;
+        if answered && let Err(err) = upload.remove() {
+            log::error!("Failed to remove upload: {err}");
+        }
+        return;
+    }
+
+    // Payloads mapped from shared memory are never spilled, but may still be too large to be
+    // decoded at once.
+    let reservation = reservation.unwrap_or_else(|| server.budget.try_reserve(data.len()));
+
+    handle_request(
+        data,
+        reservation,
+        start.elapsed(),
+        &server,
+        &mut Responder::Stream(&mut stream),
+    )
+    .await;
+}
+
+/// Answer the request sent on a stream of a multiplexed session.
+///
+/// Memory is reserved for the request as its fragments are received, and it is spilled to
+/// disk once it no longer fits in the memory budget, like requests sent on a whole connection.
+async fn handle_stream(mut channel: Channel, server: Arc<ServerContext>) {
+    let start = Instant::now();
+
+    let mut reservation = None;
+    let mut in_memory = |len: usize| {
+        reservation = None;
+        reservation = server.budget.try_reserve(len);
+        reservation.is_some()
+    };
+    let data = channel
+        .recv_or_spill(SpillPolicy {
+            dir: server.budget.spill_dir(),
+            in_memory: &mut in_memory,
+        })
+        .await;
+    let Ok(Some(data)) = data else {
+        log::error!("Failed to receive data on stream {}", channel.id());
+        return;
+    };
+
+    handle_request(
+        data,
+        reservation,
+        start.elapsed(),
+        &server,
+        &mut Responder::Channel(&mut channel),
+    )
+    .await;
+}
+
+/// Run a request, and send its response.
+///
+/// Without a memory `reservation`, the job is loaded and computed a window at a time, and
+/// element-wise results are spilled to disk unless streamed. The reservation is released once
+/// the response is sent. `receive` is the time it took to receive the request, reported in
+/// the statistics. Returns whether the response was sent.
+async fn handle_request(
+    data: Payload,
+    reservation: Option<Reservation>,
+    receive: Duration,
+    server: &ServerContext,
+    responder: &mut Responder<'_>,
+) -> bool {
+    // Keys are created, and ciphertexts loaded, by the threads that will compute the job, from
+    // the memory pool of their NUMA node.
+    let placement = server.scheduler.place();
+    let (bfv_ctx, bfv_cs) = tokio::task::block_in_place(|| {
+        placement.install(|| {
+            let bfv_ctx = protocol::bfv_context();
+            match placement.memory_pool() {
+                Some(pool) => {
+                    let bfv_ctx = bfv_ctx.with_pool(pool);
+                    let bfv_cs = SealBfvCS::with_pool(&bfv_ctx, pool);
+                    (bfv_ctx, Arc::new(bfv_cs))
+                }
+                None => {
+                    let bfv_cs = SealBfvCS::new(&bfv_ctx);
+                    (bfv_ctx, Arc::new(bfv_cs))
+                }
+            }
+        })
+    });
+
+    let mut stats = ServerStats {
+        receive,
+        job_memory: reservation.as_ref().map_or(0, Reservation::bytes),
+        ..ServerStats::default()
+    };
+    let received = Instant::now();
+
+    let windowed = reservation.is_none();
+    if windowed && matches!(data, Payload::Spilled(_)) {
+        stats.spilled += data.len() as u64;
+    }
+
+    let Ok((request, body)) = protocol::decode_request(&data) else {
+        log::error!("Failed to decode request from client");
+        return false;
+    };
+    let offset = data.len() - body.len();
+
+    // Digesting the job data takes a while on large requests.
+    let cache_key = (!request.dataset.is_empty())
+        .then(|| tokio::task::block_in_place(|| cache::Key::new(&request, body)))
+        .flatten();
+    if let Some(key) = &cache_key
+        && let Some(results) = server.results.get(key)
+    {
+        log::info!("Results of dataset {} found in the cache", request.dataset);
+        stats.decode = received.elapsed();
+        return send_cached(&results, &request, stats, responder).await;
+    }
+
+    if let Job::CollectionSum { flag: Some(flag) } = request.job
+        && usize::from(flag) >= COLLECTION_FLAGS
+    {
+        log::error!("Invalid flag index requested by client: {flag}");
+        return false;
+    }
+
+    let columnar =
+        request.layout == Layout::Columns && matches!(request.job, Job::SeqOps | Job::SeqOpsSum);
+    if windowed && (columnar || matches!(request.job, Job::Program | Job::Query | Job::Repack)) {
+        log::error!("Job over the memory budget, which can only be loaded item by item");
+        return false;
+    }
+
+    let data = Arc::new(data);
+    let failed = Arc::new(AtomicBool::new(false));
+
+    let plan = if windowed {
+        log::info!("Job over the memory budget, processing it {CHUNK_SIZE} items at a time");
+        let windows = Windows {
+            payload: Arc::clone(&data),
+            offset,
+            bfv_ctx: Arc::new(bfv_ctx),
+            failed: Arc::clone(&failed),
+        };
+        match request.job {
+            Job::SeqOps | Job::SeqOpsSum => seq_ops_windowed(
+                request.job,
+                &windows,
+                &bfv_cs,
+                &server.costs,
+                placement.op_pools(),
+                &mut stats,
+            ),
+            Job::CollectionSum { flag } => {
+                collection_sum_windowed(flag, &windows, &bfv_cs, &mut stats)
+            }
+            Job::Program | Job::Query | Job::Repack => {
+                unreachable!("programs, queries and repacking over the memory budget are refused")
+            }
+        }
+    } else {
+        let body = &data[offset..];
+        // Ciphertexts are found in the body first, then loaded by all threads.
+        tokio::task::block_in_place(|| {
+            placement.install(|| match request.job {
+                Job::SeqOps | Job::SeqOpsSum if columnar => {
+                    decode_columns(body, &bfv_ctx).map(|columns| {
+                        seq_columns(request.job, columns, &bfv_cs, &server.costs, &mut stats)
+                    })
+                }
+                Job::SeqOps | Job::SeqOpsSum => {
+                    decode_items(body, &bfv_ctx, load_seq_items).map(|items| {
+                        let exch_data = SeqOpsData::from_vec(items);
+                        seq_ops(
+                            request.job,
+                            exch_data,
+                            &bfv_cs,
+                            &server.costs,
+                            placement.op_pools(),
+                            &mut stats,
+                        )
+                    })
+                }
+                Job::CollectionSum { flag } => decode_items(body, &bfv_ctx, load_collection_items)
+                    .map(|collection| collection_sum(flag, collection, &bfv_cs, &mut stats)),
+                Job::Program => decode_program(body, &bfv_ctx)
+                    .map(|data| program(data, &bfv_cs, &server.costs, &mut stats)),
+                Job::Query => decode_query(body, &bfv_ctx).map(|(plan, collection)| {
+                    query(plan, collection, &bfv_cs, &server.costs, &mut stats)
+                }),
+                Job::Repack => decode_repack(body, &bfv_ctx)
+                    .map(|(keys, scalars)| repack(keys, scalars, &bfv_cs, &mut stats)),
+            })
+        })
+    };
+    let Ok(plan) = plan else {
+        log::error!("Failed to decode data from client");
+        return false;
+    };
+
+    stats.decode = received.elapsed();
+
+    // Element-wise results of jobs over budget go to disk as they are computed, unless the
+    // client receives them as they are computed anyway.
+    let element_wise = request.job.is_element_wise();
+    let mut spill = None;
+    if windowed && element_wise && !request.stream {
+        match ResultSpill::create(server.budget.spill_dir(), plan.items).await {
+            Ok(created) => spill = Some(created),
+            Err(err) => {
+                log::error!("Failed to spill results: {err}");
+                return false;
+            }
+        }
+    }
+
+    // Only element-wise results can be sent before the whole job is done. The job waits while
+    // a few chunks of results are not sent or spilled yet.
+    let (frames, mut frames_rx) = if element_wise && (request.stream || spill.is_some()) {
+        let (sender, receiver) = tokio::sync::mpsc::channel(STREAMED_CHUNKS);
+        (Some(sender), Some(receiver))
+    } else {
+        (None, None)
+    };
+
+    let threads = placement.threads();
+    let handle = placement.submit(JobSpec {
+        priority: request.priority,
+        tenant: request.tenant,
+        deadline: request
+            .deadline_ms
+            .map(|deadline| received + Duration::from_millis(deadline)),
+        chunks: plan.chunks,
+        merge: plan.merge,
+        stream: frames,
+    });
+
+    // The channel is closed once the job is done, or dropped.
+    if let Some(frames_rx) = &mut frames_rx {
+        loop {
+            let frame = tokio::select! {
+                frame = frames_rx.recv() => frame,
+                () = responder.cancelled() => {
+                    log::info!("Job cancelled by the client");
+                    handle.cancel();
+                    return false;
+                }
+            };
+            let Some(frame) = frame else {
+                break;
+            };
+            handle.resume();
+            // An empty frame would end the stream for the client.
+            if frame.is_empty() {
+                continue;
+            }
+
+            if let Some(spill) = &mut spill {
+                let start = Instant::now();
+                if let Err(e) = spill.write(&frame).await {
+                    log::error!("Failed to spill results: {e}");
+                    handle.cancel();
+                    return false;
+                }
+                stats.encode += start.elapsed();
+                continue;
+            }
+
+            let start = Instant::now();
+            let bytes =
+                tokio::task::block_in_place(|| protocol::encode_ciphertexts(&frame)).unwrap();
+            stats.encode += start.elapsed();
+
+            if let Err(e) = responder.send(&bytes).await {
+                log::error!("Failed to stream data back to client: {e}");
+                handle.cancel();
+                return false;
+            }
+        }
+    }
+
+    // Dropping the handle cancels the job.
+    let output = tokio::select! {
+        output = handle.wait() => output,
+        () = responder.cancelled() => {
+            log::info!("Job cancelled by the client");
+            return false;
+        }
+    };
+    let output = match output {
+        Ok(output) => output,
+        Err(err) => {
+            log::error!("Job failed: {err}");
+            return false;
+        }
+    };
+    if failed.load(Ordering::Relaxed) {
+        log::error!("Failed to load data from client");
+        return false;
+    }
+    stats.compute = output.compute;
+    stats.queue = output.queued;
+
+    log::info!("Data processed in {:?}", received.elapsed());
+
+    let start = Instant::now();
+    let encode = || tokio::task::block_in_place(|| protocol::encode_ciphertexts(&output.results));
+    let mut frames = Vec::new();
+    if request.stream && !output.results.is_empty() {
+        frames.push(encode().unwrap());
+    }
+    let mut last = if request.stream {
+        protocol::encode_end_frame(None).unwrap().into()
+    } else if spill.is_some() {
+        Vec::new().into()
+    } else {
+        encode().unwrap()
+    };
+    // Results sent as they were computed are not all kept until the end.
+    if let Some(key) = cache_key
+        && frames_rx.is_none()
+    {
+        let encoded = match frames.first() {
+            Some(frame) => frame.to_vec(),
+            None if request.stream => {
+                bincode::encode_to_vec(Vec::<Ciphertext>::new(), super::BINCODE_CONFIG).unwrap()
+            }
+            None => last.to_vec(),
+        };
+        let len = output.results.len();
+        server.results.insert(key, CachedResults { encoded, len });
+    }
+    stats.encode += start.elapsed();
+
+    if request.stats {
+        stats.threads = u32::try_from(threads).unwrap_or(u32::MAX);
+        if let Some(spill) = &spill {
+            stats.spilled += spill.len();
+        }
+        log::info!("Request statistics: {stats}");
+        protocol::encode_trailer_into(&mut last, Some(&stats)).unwrap();
+    }
+
+    let spilled = match spill {
+        Some(spill) => match spill.finish(&last).await {
+            Ok(spilled) => Some(spilled),
+            Err(err) => {
+                log::error!("Failed to spill results: {err}");
+                return false;
+            }
+        },
+        None => {
+            frames.push(last);
+            None
+        }
+    };
+
+    log::info!("Sending data back to client");
+
+    for frame in frames {
+        if let Err(e) = responder.send(&frame).await {
+            log::error!("Failed to send data back to client: {e}");
+            return false;
+        }
+    }
+    if let Some(spilled) = spilled
+        && let Err(e) = responder.send_inline(&spilled).await
+    {
+        log::error!("Failed to send data back to client: {e}");
+        return false;
+    }
+    responder.finish();
+    true
+}
+
+/// Answer a request with results found in the cache. Returns whether the response was sent.
+async fn send_cached(
+    results: &CachedResults,
+    request: &Request,
+    mut stats: ServerStats,
+    responder: &mut Responder<'_>,
+) -> bool {
+    let start = Instant::now();
+    let mut frames = Vec::new();
+    if request.stream && results.len > 0 {
+        frames.push(results.encoded.clone());
+    }
+    let mut last = if request.stream {
+        protocol::encode_end_frame(None).unwrap()
+    } else {
+        results.encoded.clone()
+    };
+    stats.encode = start.elapsed();
+
+    if request.stats {
+        log::info!("Request statistics: {stats}");
+        protocol::encode_trailer_into(&mut last, Some(&stats)).unwrap();
+    }
+    frames.push(last);
+
+    for frame in frames {
+        if let Err(e) = responder.send(&frame).await {
+            log::error!("Failed to send data back to client: {e}");
+            return false;
+        }
+    }
+    responder.finish();
+    true
+}
+
+/// Receive the chunks of an upload whose first payload held `manifest`, and map its request
+/// once complete.
+async fn receive_upload(
+    stream: &mut Stream,
+    manifest: &[u8],
+    store: &UploadStore,
+) -> Result<(MappedFile, CompleteUpload), UploadError> {
+    let (manifest, _) = bincode::decode_from_slice(manifest, super::BINCODE_CONFIG)?;
+    let mut upload = store.open(manifest)?;
+
+    loop {
+        let ack = upload.ack();
+        stream
+            .send(&bincode::encode_to_vec(ack, super::BINCODE_CONFIG).unwrap())
+            .await?;
+        if upload.is_complete() {
+            break;
+        }
+        log::debug!("Holding {} chunks of the upload", ack.next);
+
+        let chunk = tokio::time::timeout(upload::CHUNK_TIMEOUT, stream.recv())
+            .await
+            .map_err(|_| UploadError::Timeout(upload::CHUNK_TIMEOUT))??;
+        tokio::task::block_in_place(|| upload.write(&chunk))?;
+    }
+
+    tokio::task::block_in_place(|| upload.map())
+}
+
+/// Element-wise results written to disk as they are computed, laid out as their encoded `Vec`.
+struct ResultSpill(SpillWriter);
+
+impl ResultSpill {
+    async fn create(dir: &std::path::Path, results: usize) -> Result<Self, std::io::Error> {
+        let mut writer = SpillWriter::create(dir)?;
+        let len = bincode::encode_to_vec(results as u64, super::BINCODE_CONFIG)
+            .map_err(std::io::Error::other)?;
+        writer.write(&len).await?;
+        Ok(Self(writer))
+    }
+
+    /// Append the next results.
+    async fn write(&mut self, results: &[Ciphertext]) -> Result<(), std::io::Error> {
+        let mut bytes = Vec::new();
+        tokio::task::block_in_place(|| protocol::encode_ciphertexts_into(&mut bytes, results))
+            .map_err(std::io::Error::other)?;
+        self.0.write(&bytes).await
+    }
+
+    /// Number of bytes spilled so far.
+    const fn len(&self) -> u64 {
+        self.0.len()
+    }
+
+    /// Append the trailer of the response, and map it whole.
+    async fn finish(mut self, trailer: &[u8]) -> Result<MappedFile, std::io::Error> {
+        self.0.write(trailer).await?;
+        self.0.finish().await
+    }
+}
+
+/// Sum the partial results of the chunks of an aggregate.
+fn sum(bfv_cs: Arc<SealBfvCS>) -> Merge {
+    Box::new(move |partials| {
+        partials
+            .into_iter()
+            .reduce(|lhs, rhs| bfv_cs.operate2(SealBfvCS::ADD_OPP, &lhs, &rhs))
+            .into_iter()
+            .collect()
+    })
+}
+
+/// Sum the partial results of the chunks of a `Query` job group by group, each chunk holding
+/// one partial result per group.
+fn sum_groups(groups: usize, bfv_cs: Arc<SealBfvCS>) -> Merge {
+    Box::new(move |partials| {
+        let mut sums: Vec<Option<Ciphertext>> = vec![None; groups];
+        for (index, partial) in partials.into_iter().enumerate() {
+            let sum = &mut sums[index % groups];
+            *sum = Some(match sum.take() {
+                Some(sum) => bfv_cs.operate2(SealBfvCS::ADD_OPP, &sum, &partial),
+                None => partial,
+            });
+        }
+        sums.into_iter().flatten().collect()
+    })
+}
+
+/// Rotations of the slots of ciphertexts, counted in the statistics of `Repack` jobs.
+#[derive(Debug)]
+enum Rotation {
+    /// Moves the values of both rows by a number of slots.
+    RotateRows,
+    /// Swaps both rows.
+    SwapRows,
+}
+
+/// Count the operations of a `SeqOps` or `SeqOpsSum` job.
+fn count_seq_ops<'a>(
+    job: Job,
+    ops: impl Iterator<Item = &'a BfvHOperation2>,
+    stats: &mut ServerStats,
+) {
+    let mut counts = HashMap::new();
+    let mut items = 0;
+    for op in ops {
+        counts
+            .entry(core::mem::discriminant(op))
+            .or_insert((*op, 0))
+            .1 += 1;
+        items += 1;
+    }
+    for (op, count) in counts.into_values() {
+        stats.count_ops(op, count);
+    }
+    if job == Job::SeqOpsSum {
+        stats.count_ops(SealBfvCS::ADD_OPP, items.saturating_sub(1));
+    }
+}
+
+/// Count the operations of a `CollectionSum` job over `items` items.
+fn count_collection_ops(flag: Option<u8>, items: usize, stats: &mut ServerStats) {
+    let items = items as u64;
+    stats.count_ops(SealBfvCS::ADD_OPP, items.saturating_sub(1));
+    if flag.is_some() {
+        stats.count_ops(SealBfvCS::MUL_OPP, items);
+    }
+}
+
+/// Run the items of a chunk of a `SeqOps` or `SeqOpsSum` job, costliest first.
+fn execute_seq_ops(
+    job: Job,
+    items: &[SeqOpItem<SealBfvCS>],
+    bfv_cs: &SealBfvCS,
+    costs: &CostModel<BfvHOperation2>,
+    op_pools: &OpPools,
+) -> Vec<Ciphertext> {
+    let results = cost::par_map_budgeted(
+        items,
+        |item| costs.cost(item.op()),
+        bfv_cs.op_threads(),
+        op_pools,
+        |item| item.execute(bfv_cs),
+    );
+    seq_results(job, results, bfv_cs)
+}
+
+/// Run the items of a chunk of a columnar `SeqOps` or `SeqOpsSum` job, one operation at a
+/// time, as a batch per thread.
+fn execute_seq_columns(
+    job: Job,
+    columns: &SeqOpsColumns<SealBfvCS>,
+    bfv_cs: &SealBfvCS,
+) -> Vec<Ciphertext> {
+    let threads = rayon::current_num_threads();
+    let results = columns.execute_with(|op, pairs| {
+        pairs
+            .par_chunks(pairs.len().div_ceil(threads).max(1))
+            .flat_map_iter(|batch| bfv_cs.operate2_many(op, batch))
+            .collect()
+    });
+    seq_results(job, results, bfv_cs)
+}
+
+/// The results of a chunk of a `SeqOps` job, or their sum for a `SeqOpsSum` job.
+fn seq_results(job: Job, results: Vec<Ciphertext>, bfv_cs: &SealBfvCS) -> Vec<Ciphertext> {
+    if job == Job::SeqOpsSum {
+        results
+            .into_par_iter()
+            .reduce_with(|lhs, rhs| bfv_cs.operate2(SealBfvCS::ADD_OPP, &lhs, &rhs))
+            .into_iter()
+            .collect()
+    } else {
+        results
+    }
+}
+
+/// Run the program of a chunk of a `Program` job on its rows, with a stack allocated once per
+/// batch of rows.
+fn execute_program(data: &BfvProgram, bfv_cs: &SealBfvCS) -> Vec<Ciphertext> {
+    let program = data.program();
+    (0..data.rows())
+        .into_par_iter()
+        .map_init(
+            || Vec::with_capacity(program.depth()),
+            |stack, row| program.run(bfv_cs, data.columns(), row, stack),
+        )
+        .collect()
+}
+
+/// Sum the items of a chunk of a `CollectionSum` job.
+fn execute_collection_sum(
+    flag: Option<u8>,
+    collection: &BfvCollection,
+    bfv_cs: &SealBfvCS,
+) -> Vec<Ciphertext> {
+    let partial = match flag {
+        Some(flag) => collection.operate_many_where_flag(usize::from(flag), bfv_cs),
+        None => collection.operate_many(SealBfvCS::ADD_OPP, bfv_cs),
     };
+    vec![partial]
+}
 
-    let exch_data: SeqOpsData<SealBfvCS> = exch_data.0;
+/// Aggregate every group of a `Query` job over the rows of a chunk.
+fn execute_query(
+    plan: &WirePlan,
+    collection: BfvCollection,
+    bfv_cs: &SealBfvCS,
+) -> Vec<Ciphertext> {
+    let aggregate = |collection: &BfvCollection, predicate: Option<&Predicate>| {
+        collection
+            .aggregate_where(plan.aggregate, predicate, bfv_cs)
+            .expect("chunks are not empty")
+    };
+    match plan.strategy {
+        Strategy::Sequential => plan
+            .predicates
+            .par_iter()
+            .map(|predicate| aggregate(&collection, predicate.as_ref()))
+            .collect(),
+        Strategy::Parallel => collection
+            .split(rayon::current_num_threads())
+            .into_par_iter()
+            .filter(|part| !part.is_empty())
+            .map(|part| {
+                plan.predicates
+                    .iter()
+                    .map(|predicate| aggregate(&part, predicate.as_ref()))
+                    .collect::<Vec<_>>()
+            })
+            .reduce_with(|lhs, rhs| {
+                lhs.iter()
+                    .zip(&rhs)
+                    .map(|(lhs, rhs)| bfv_cs.operate2(SealBfvCS::ADD_OPP, lhs, rhs))
+                    .collect()
+            })
+            .unwrap_or_default(),
+    }
+}
 
+/// Pack ciphertexts each holding a value alone in their first slot into the first slots of a
+/// single ciphertext, in order. They must fit in a row.
+///
+/// Both halves are packed in parallel, the first one holding a power of 2 of values, so that the
+/// second is moved after it with a single rotation, whose Galois key the client sent.
+fn pack_row(mut scalars: Vec<Ciphertext>, keys: &GaloisKeys, bfv_cs: &SealBfvCS) -> Ciphertext {
+    if scalars.len() == 1 {
+        return scalars.pop().unwrap();
+    }
+    let half = scalars.len().next_power_of_two() / 2;
+    let second = scalars.split_off(half);
+    let (first, second) = rayon::join(
+        || pack_row(scalars, keys, bfv_cs),
+        || pack_row(second, keys, bfv_cs),
+    );
+    bfv_cs.pack_rows(&first, &second, half, keys)
+}
+
+/// Pack the ciphertexts of a chunk of a `Repack` job into one, the first row holding the values
+/// of the first half of the chunk, and the second row those of the rest.
+fn execute_repack(
+    mut scalars: Vec<Ciphertext>,
+    keys: &GaloisKeys,
+    bfv_cs: &SealBfvCS,
+) -> Vec<Ciphertext> {
+    let row = bfv_cs.slot_count() / 2;
+    if scalars.len() <= row {
+        return vec![pack_row(scalars, keys, bfv_cs)];
+    }
+    let second = scalars.split_off(row);
+    let (first, second) = rayon::join(
+        || pack_row(scalars, keys, bfv_cs),
+        || pack_row(second, keys, bfv_cs),
+    );
+    vec![bfv_cs.pack_columns(&first, &second, keys)]
+}
+
+fn seq_merge(job: Job, bfv_cs: &Arc<SealBfvCS>) -> Merge {
+    if job == Job::SeqOpsSum {
+        sum(Arc::clone(bfv_cs))
+    } else {
+        Box::new(|results| results)
+    }
+}
+
+fn seq_ops(
+    job: Job,
+    exch_data: SeqOpsData<SealBfvCS>,
+    bfv_cs: &Arc<SealBfvCS>,
+    costs: &Arc<CostModel<BfvHOperation2>>,
+    op_pools: &Arc<OpPools>,
+    stats: &mut ServerStats,
+) -> Plan {
     log::info!(
         "Operating on {} data pairs with {} threads",
         exch_data.len(),
         rayon::current_num_threads()
     );
 
-    let start = std::time::Instant::now();
+    count_seq_ops(job, exch_data.iter_over_data().map(SeqOpItem::op), stats);
 
-    let results = exch_data
-        .iter_over_data()
-        .par_bridge() // FIXME: Results are unordered
-        .map(|item| bfv_cs.operate2(*item.op(), item.lhs(), item.rhs()))
-        .collect::<Vec<_>>();
+    // A chunk takes at most as long as `CHUNK_SIZE` of the costliest operation, but holds more
+    // items when they are cheaper.
+    let items = exch_data.len();
+    let chunks = exch_data
+        .split_by_cost(CHUNK_SIZE as u64 * costs.max_cost(), |item| {
+            costs.cost(item.op())
+        })
+        .into_iter()
+        .map(|chunk| {
+            let bfv_cs = Arc::clone(bfv_cs);
+            let costs = Arc::clone(costs);
+            let op_pools = Arc::clone(op_pools);
+            Box::new(move || execute_seq_ops(job, chunk.as_slice(), &bfv_cs, &costs, &op_pools))
+                as Chunk
+        })
+        .collect();
 
-    log::info!("Data processed in {:?}", start.elapsed());
+    Plan {
+        chunks,
+        merge: seq_merge(job, bfv_cs),
+        items,
+    }
+}
 
-    let bytes = bincode::encode_to_vec(results, super::BINCODE_CONFIG).unwrap();
+fn seq_columns(
+    job: Job,
+    columns: SeqOpsColumns<SealBfvCS>,
+    bfv_cs: &Arc<SealBfvCS>,
+    costs: &CostModel<BfvHOperation2>,
+    stats: &mut ServerStats,
+) -> Plan {
+    log::info!(
+        "Operating on {} data pairs by column with {} threads",
+        columns.len(),
+        rayon::current_num_threads()
+    );
 
-    log::info!("Sending data back to client");
+    count_seq_ops(job, columns.ops().iter(), stats);
 
-    let send_res = unsized_data_send(bytes, &mut stream).await;
+    let items = columns.len();
+    let chunks = columns
+        .split_by_cost(CHUNK_SIZE as u64 * costs.max_cost(), |op| costs.cost(op))
+        .into_iter()
+        .map(|chunk| {
+            let bfv_cs = Arc::clone(bfv_cs);
+            Box::new(move || execute_seq_columns(job, &chunk, &bfv_cs)) as Chunk
+        })
+        .collect();
 
-    if let Err(e) = send_res {
-        log::error!("Failed to send data back to client: {e}");
+    Plan {
+        chunks,
+        merge: seq_merge(job, bfv_cs),
+        items,
+    }
+}
+
+fn collection_sum(
+    flag: Option<u8>,
+    collection: BfvCollection,
+    bfv_cs: &Arc<SealBfvCS>,
+    stats: &mut ServerStats,
+) -> Plan {
+    log::info!("Summing a collection of {} items", collection.len());
+
+    let items = collection.len();
+    count_collection_ops(flag, items, stats);
+
+    let chunk_count = items.div_ceil(CHUNK_SIZE);
+    let chunks = collection
+        .split(chunk_count)
+        .into_iter()
+        .filter(|chunk| !chunk.is_empty())
+        .map(|chunk| {
+            let bfv_cs = Arc::clone(bfv_cs);
+            Box::new(move || execute_collection_sum(flag, &chunk, &bfv_cs)) as Chunk
+        })
+        .collect();
+
+    Plan {
+        chunks,
+        merge: sum(Arc::clone(bfv_cs)),
+        items,
+    }
+}
+
+fn program(
+    data: BfvProgram,
+    bfv_cs: &Arc<SealBfvCS>,
+    costs: &CostModel<BfvHOperation2>,
+    stats: &mut ServerStats,
+) -> Plan {
+    let instructions = data.program().instructions();
+    log::info!(
+        "Running a program of {} instructions on {} rows with {} threads",
+        instructions.len(),
+        data.rows(),
+        rayon::current_num_threads()
+    );
+
+    // Operations on one ciphertext are not in the cost model: count them as the costliest.
+    let rows = data.rows();
+    let mut row_cost = 0_u64;
+    for instruction in instructions {
+        match instruction {
+            Instruction::Op1(op) => {
+                stats.count_ops(op, rows as u64);
+                row_cost += costs.max_cost();
+            }
+            Instruction::Op2(op) => {
+                stats.count_ops(op, rows as u64);
+                row_cost += costs.cost(op);
+            }
+            Instruction::Load(_) | Instruction::Relinearize => {}
+        }
+    }
+
+    // A chunk takes about as long as `CHUNK_SIZE` of the costliest operation.
+    let rows_per_chunk = (CHUNK_SIZE as u64 * costs.max_cost() / row_cost.max(1)).max(1);
+    let chunk_count = (rows as u64).div_ceil(rows_per_chunk);
+    let chunks = data
+        .split(usize::try_from(chunk_count).unwrap_or(usize::MAX))
+        .into_iter()
+        .map(|chunk| {
+            let bfv_cs = Arc::clone(bfv_cs);
+            Box::new(move || execute_program(&chunk, &bfv_cs)) as Chunk
+        })
+        .collect();
+
+    Plan {
+        chunks,
+        merge: Box::new(|results| results),
+        items: rows,
+    }
+}
+
+/// Decode the plan of a `Query` job and the collection following it, refusing plans the
+/// parameters cannot run.
+fn decode_query(
+    body: &[u8],
+    bfv_ctx: &SealBFVContext,
+) -> Result<(WirePlan, BfvCollection), bincode::error::DecodeError> {
+    let (plan, read): (WirePlan, _) = bincode::decode_from_slice(body, super::BINCODE_CONFIG)?;
+    if plan.predicates.is_empty()
+        || plan
+            .max_flag()
+            .is_some_and(|flag| usize::from(flag) >= COLLECTION_FLAGS)
+        || plan.depth() > protocol::query_limits().depth
+    {
+        log::error!(
+            "Invalid query plan: {} groups, depth {}",
+            plan.predicates.len(),
+            plan.depth()
+        );
+        return Err(bincode::error::DecodeError::Other("invalid query plan"));
+    }
+    let collection = decode_items(&body[read..], bfv_ctx, load_collection_items)?;
+    Ok((plan, collection))
+}
+
+fn query(
+    plan: WirePlan,
+    collection: BfvCollection,
+    bfv_cs: &Arc<SealBfvCS>,
+    costs: &CostModel<BfvHOperation2>,
+    stats: &mut ServerStats,
+) -> Plan {
+    let groups = plan.predicates.len();
+    let items = collection.len();
+    log::info!(
+        "Running a query of {groups} groups on {items} rows with {} threads ({:?})",
+        rayon::current_num_threads(),
+        plan.strategy
+    );
+
+    // Each group sums its rows with one addition less than it has rows.
+    let (muls, adds) = plan.operations_per_row();
+    stats.count_ops(SealBfvCS::MUL_OPP, muls * items as u64);
+    stats.count_ops(
+        SealBfvCS::ADD_OPP,
+        (adds * items as u64).saturating_sub(groups as u64),
+    );
+
+    // A chunk takes about as long as `CHUNK_SIZE` of the costliest operation. Negations are
+    // counted as additions.
+    let row_cost = muls * costs.cost(&SealBfvCS::MUL_OPP) + adds * costs.cost(&SealBfvCS::ADD_OPP);
+    let rows_per_chunk = (CHUNK_SIZE as u64 * costs.max_cost() / row_cost.max(1)).max(1);
+    let chunk_count = (items as u64).div_ceil(rows_per_chunk);
+    let plan = Arc::new(plan);
+    let chunks = collection
+        .split(usize::try_from(chunk_count).unwrap_or(usize::MAX))
+        .into_iter()
+        .filter(|chunk| !chunk.is_empty())
+        .map(|chunk| {
+            let bfv_cs = Arc::clone(bfv_cs);
+            let plan = Arc::clone(&plan);
+            Box::new(move || execute_query(&plan, chunk, &bfv_cs)) as Chunk
+        })
+        .collect();
+
+    Plan {
+        chunks,
+        merge: sum_groups(groups, Arc::clone(bfv_cs)),
+        items,
+    }
+}
+
+fn repack(
+    keys: GaloisKeys,
+    scalars: Vec<Ciphertext>,
+    bfv_cs: &Arc<SealBfvCS>,
+    stats: &mut ServerStats,
+) -> Plan {
+    let items = scalars.len();
+    let width = bfv_cs.slot_count();
+    log::info!(
+        "Packing {items} ciphertexts by {width} with {} threads",
+        rayon::current_num_threads()
+    );
+
+    // Every value but the first of a packed ciphertext is moved once, and added to the others.
+    let mut rotations = 0;
+    let mut swaps = 0;
+    for chunk in scalars.chunks(width) {
+        let swap = usize::from(chunk.len() > width / 2);
+        rotations += (chunk.len() - 1 - swap) as u64;
+        swaps += swap as u64;
     }
+    stats.count_ops(Rotation::RotateRows, rotations);
+    stats.count_ops(Rotation::SwapRows, swaps);
+    stats.count_ops(SealBfvCS::ADD_OPP, rotations + swaps);
+
+    // Each chunk packs one ciphertext: its rotations are already spread over the threads.
+    let keys = Arc::new(keys);
+    let mut scalars = scalars.into_iter();
+    let chunks = (0..items.div_ceil(width))
+        .map(|_| {
+            let chunk = scalars.by_ref().take(width).collect::<Vec<_>>();
+            let keys = Arc::clone(&keys);
+            let bfv_cs = Arc::clone(bfv_cs);
+            Box::new(move || execute_repack(chunk, &keys, &bfv_cs)) as Chunk
+        })
+        .collect();
+
+    Plan {
+        chunks,
+        merge: Box::new(|results| results),
+        items,
+    }
+}
+
+/// A request over the memory budget, whose ciphertexts are only loaded a window of
+/// [`CHUNK_SIZE`] items at a time, by the chunk computing them.
+struct Windows {
+    payload: Arc<Payload>,
+    /// Start of the job data in the payload.
+    offset: usize,
+    bfv_ctx: Arc<SealBFVContext>,
+    /// Set when a ciphertext fails to load, in which case the results are not sent.
+    failed: Arc<AtomicBool>,
+}
+
+impl Windows {
+    /// Job data of the request.
+    fn body(&self) -> &[u8] {
+        &self.payload[self.offset..]
+    }
+
+    /// Cut the job data, an encoded `Vec` of `T`, into windows of [`CHUNK_SIZE`] items,
+    /// visiting each item on the way. Returns the byte ranges of the windows in the job data,
+    /// and the number of items.
+    fn scan<'a, T: BorrowDecode<'a, ()>>(
+        &'a self,
+        mut visit: impl FnMut(T),
+    ) -> Result<(Vec<Range<usize>>, usize), bincode::error::DecodeError> {
+        let body = self.body();
+        let (items, mut read): (u64, _) = bincode::decode_from_slice(body, super::BINCODE_CONFIG)?;
+        let items = usize::try_from(items)
+            .map_err(|_| bincode::error::DecodeError::Other("too many items"))?;
+
+        let mut windows = Vec::new();
+        let mut start = read;
+        for i in 1..=items {
+            let (item, size) =
+                bincode::borrow_decode_from_slice(&body[read..], super::BINCODE_CONFIG)?;
+            visit(item);
+            read += size;
+            if i % CHUNK_SIZE == 0 || i == items {
+                windows.push(start..read);
+                start = read;
+            }
+        }
+
+        Ok((windows, items))
+    }
+
+    /// Create a chunk loading the items of a window with `load`, then computing them with
+    /// `execute`.
+    fn chunk<I, E>(
+        &self,
+        window: Range<usize>,
+        load: fn(&SealBFVContext, &[u8]) -> Result<I, seal_lib::Error>,
+        execute: E,
+    ) -> Chunk
+    where
+        E: FnOnce(I) -> Vec<Ciphertext> + Send + 'static,
+    {
+        let payload = Arc::clone(&self.payload);
+        let window = self.offset + window.start..self.offset + window.end;
+        let bfv_ctx = Arc::clone(&self.bfv_ctx);
+        let failed = Arc::clone(&self.failed);
+
+        Box::new(move || match load(&bfv_ctx, &payload[window]) {
+            Ok(items) => execute(items),
+            Err(err) => {
+                log::error!("Failed to load a ciphertext: {err}");
+                failed.store(true, Ordering::Relaxed);
+                Vec::new()
+            }
+        })
+    }
+}
+
+/// Decode the raw items of a window found by [`Windows::scan`].
+fn decode_window<'a, T: BorrowDecode<'a, ()>>(mut bytes: &'a [u8]) -> Vec<T> {
+    let mut items = Vec::with_capacity(CHUNK_SIZE);
+    while !bytes.is_empty() {
+        let (item, size) = bincode::borrow_decode_from_slice(bytes, super::BINCODE_CONFIG)
+            .expect("window was scanned");
+        items.push(item);
+        bytes = &bytes[size..];
+    }
+    items
+}
+
+/// A `SeqOps` item, with its ciphertexts still encoded.
+type RawSeqOpItem<'a> = (&'a [u8], &'a [u8], BfvHOperation2);
+
+/// A `CollectionSum` item, with its ciphertexts still encoded.
+type RawSelectableItem<'a> = (&'a [u8], [&'a [u8]; COLLECTION_FLAGS]);
+
+/// The columns of a columnar job, with their operands still encoded.
+type RawColumns<'a> = (Vec<BfvHOperation2>, Vec<&'a [u8]>, Vec<usize>, Vec<usize>);
+
+/// The program and columns of a `Program` job, with their ciphertexts still encoded.
+type RawProgram<'a> = (
+    Vec<Instruction<BfvHOperation1, BfvHOperation2>>,
+    Vec<Vec<&'a [u8]>>,
+);
+
+/// Decode job data encoded as a `Vec` of items, whose ciphertexts `load` loads in parallel.
+fn decode_items<'a, T: BorrowDecode<'a, ()>, I>(
+    body: &'a [u8],
+    bfv_ctx: &SealBFVContext,
+    load: fn(&SealBFVContext, Vec<T>) -> Result<I, seal_lib::Error>,
+) -> Result<I, bincode::error::DecodeError> {
+    let (items, _): (Vec<T>, _) = bincode::borrow_decode_from_slice(body, super::BINCODE_CONFIG)?;
+    load(bfv_ctx, items).map_err(|_| bincode::error::DecodeError::Other("invalid ciphertext"))
+}
+
+fn decode_columns(
+    body: &[u8],
+    bfv_ctx: &SealBFVContext,
+) -> Result<SeqOpsColumns<SealBfvCS>, bincode::error::DecodeError> {
+    let ((ops, operands, lhs, rhs), _): (RawColumns, _) =
+        bincode::borrow_decode_from_slice(body, super::BINCODE_CONFIG)?;
+    let operands = protocol::load_ciphertexts(operands, bfv_ctx)?;
+    SeqOpsColumns::from_parts(ops, operands, lhs, rhs)
+        .map_err(|_| bincode::error::DecodeError::Other("invalid columns"))
+}
+
+fn decode_program(
+    body: &[u8],
+    bfv_ctx: &SealBFVContext,
+) -> Result<BfvProgram, bincode::error::DecodeError> {
+    let ((instructions, columns), _): (RawProgram, _) =
+        bincode::borrow_decode_from_slice(body, super::BINCODE_CONFIG)?;
+    let columns = columns
+        .into_iter()
+        .map(|column| protocol::load_ciphertexts(column, bfv_ctx))
+        .collect::<Result<Vec<_>, _>>()?;
+    BfvProgram::new(instructions, columns)
+        .map_err(|_| bincode::error::DecodeError::Other("invalid program"))
+}
+
+fn decode_repack(
+    body: &[u8],
+    bfv_ctx: &SealBFVContext,
+) -> Result<(GaloisKeys, Vec<Ciphertext>), bincode::error::DecodeError> {
+    let ((keys, scalars), _): ((&[u8], Vec<&[u8]>), _) =
+        bincode::borrow_decode_from_slice(body, super::BINCODE_CONFIG)?;
+    let keys = bfv_ctx
+        .load_galois_keys(keys)
+        .map_err(|_| bincode::error::DecodeError::Other("invalid Galois keys"))?;
+    Ok((keys, protocol::load_ciphertexts(scalars, bfv_ctx)?))
+}
+
+fn load_seq_ops(
+    bfv_ctx: &SealBFVContext,
+    window: &[u8],
+) -> Result<Vec<SeqOpItem<SealBfvCS>>, seal_lib::Error> {
+    load_seq_items(bfv_ctx, decode_window(window))
+}
+
+fn load_seq_items(
+    bfv_ctx: &SealBFVContext,
+    items: Vec<RawSeqOpItem>,
+) -> Result<Vec<SeqOpItem<SealBfvCS>>, seal_lib::Error> {
+    items
+        .into_par_iter()
+        .map(|(lhs, rhs, op)| {
+            Ok(SeqOpItem::new(
+                bfv_ctx.load_ciphertext(lhs)?,
+                bfv_ctx.load_ciphertext(rhs)?,
+                op,
+            ))
+        })
+        .collect()
+}
+
+fn load_collection(
+    bfv_ctx: &SealBFVContext,
+    window: &[u8],
+) -> Result<BfvCollection, seal_lib::Error> {
+    load_collection_items(bfv_ctx, decode_window(window))
+}
+
+fn load_collection_items(
+    bfv_ctx: &SealBFVContext,
+    items: Vec<RawSelectableItem>,
+) -> Result<BfvCollection, seal_lib::Error> {
+    let items = items
+        .into_par_iter()
+        .map(|(ciphertext, flags)| {
+            let flags = flags
+                .into_iter()
+                .map(|flag| bfv_ctx.load_ciphertext(flag))
+                .collect::<Result<Vec<_>, _>>()?;
+            Ok(SelectableItem::from_parts(
+                bfv_ctx.load_ciphertext(ciphertext)?,
+                flags.try_into().unwrap_or_else(|_| unreachable!()),
+            ))
+        })
+        .collect::<Result<Vec<_>, seal_lib::Error>>()?;
+    Ok(BfvCollection::from_vec(items))
+}
+
+fn seq_ops_windowed(
+    job: Job,
+    windows: &Windows,
+    bfv_cs: &Arc<SealBfvCS>,
+    costs: &Arc<CostModel<BfvHOperation2>>,
+    op_pools: &Arc<OpPools>,
+    stats: &mut ServerStats,
+) -> Result<Plan, bincode::error::DecodeError> {
+    let mut ops = Vec::new();
+    let (ranges, items) = windows.scan::<RawSeqOpItem<'_>>(|(_, _, op)| ops.push(op))?;
+    log::info!(
+        "Operating on {items} data pairs with {} threads, {CHUNK_SIZE} at a time",
+        rayon::current_num_threads()
+    );
+    count_seq_ops(job, ops.iter(), stats);
+
+    let chunks = ranges
+        .into_iter()
+        .map(|window| {
+            let bfv_cs = Arc::clone(bfv_cs);
+            let costs = Arc::clone(costs);
+            let op_pools = Arc::clone(op_pools);
+            windows.chunk(window, load_seq_ops, move |items| {
+                execute_seq_ops(job, &items, &bfv_cs, &costs, &op_pools)
+            })
+        })
+        .collect();
+
+    Ok(Plan {
+        chunks,
+        merge: seq_merge(job, bfv_cs),
+        items,
+    })
+}
+
+fn collection_sum_windowed(
+    flag: Option<u8>,
+    windows: &Windows,
+    bfv_cs: &Arc<SealBfvCS>,
+    stats: &mut ServerStats,
+) -> Result<Plan, bincode::error::DecodeError> {
+    let (ranges, items) = windows.scan::<RawSelectableItem<'_>>(|_| ())?;
+    log::info!("Summing a collection of {items} items, {CHUNK_SIZE} at a time");
+    count_collection_ops(flag, items, stats);
+
+    let chunks = ranges
+        .into_iter()
+        .map(|window| {
+            let bfv_cs = Arc::clone(bfv_cs);
+            windows.chunk(window, load_collection, move |collection| {
+                execute_collection_sum(flag, &collection, &bfv_cs)
+            })
+        })
+        .collect();
+
+    Ok(Plan {
+        chunks,
+        merge: sum(Arc::clone(bfv_cs)),
+        items,
+    })
 }
@@ -0,0 +1,428 @@
+//! Transports used to exchange length-prefixed payloads between the client and the server.
+//!
+//! Every payload is sent as a little-endian `u64` size followed by the raw bytes.
+//! On the Unix transport, large payloads are not written to the socket: they are
+//! stored in a sealed `memfd` region whose descriptor is passed alongside the size,
+//! so that the peer can decode them in place from the mapping.
+//!
+//! With the `io-uring` feature, TCP streams can also be driven by Linux `io_uring`.
+//!
+//! Payloads received on TCP or Unix sockets can be [spilled](spill) to disk instead of memory.
+//! In memory, they are received into [pooled buffers](crate::buffers).
+
+pub mod shm;
+pub mod spill;
+#[cfg(feature = "io-uring")]
+pub mod uring;
+
+use crate::buffers::{Buffer, BufferPool};
+use core::net::SocketAddr;
+use core::ops::Deref;
+use std::path::{Path, PathBuf};
+use tokio::io::{AsyncRead, AsyncReadExt, AsyncWrite, AsyncWriteExt};
+use tokio::net::{TcpListener, TcpStream, UnixListener, UnixStream, tcp, unix};
+
+/// Payloads of at least this size are sent through shared memory on the Unix transport.
+pub const DEFAULT_SHM_THRESHOLD: usize = 1 << 20; // 1 MB
+
+/// Transport used to reach the server.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq, clap::ValueEnum)]
+pub enum Transport {
+    /// TCP socket, usable across hosts.
+    #[default]
+    Tcp,
+    /// Unix domain socket with shared-memory payloads, for co-located client and server.
+    Unix,
+    /// TCP socket driven by `io_uring` (requires the `io-uring` feature).
+    Uring,
+}
+
+/// Address of a server, for a given transport.
+#[derive(Clone, Debug)]
+pub enum Endpoint {
+    Tcp(SocketAddr),
+    Unix(PathBuf),
+    Uring(SocketAddr),
+}
+
+impl core::fmt::Display for Endpoint {
+    fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+        match self {
+            Self::Tcp(addr) => write!(f, "tcp://{addr}"),
+            Self::Unix(path) => write!(f, "unix://{}", path.display()),
+            Self::Uring(addr) => write!(f, "tcp+uring://{addr}"),
+        }
+    }
+}
+
+/// A received payload.
+///
+/// Dereferences to the payload bytes, wherever they live.
+pub enum Payload {
+    /// Bytes read from the socket.
+    Owned(Buffer),
+    /// Bytes mapped from a shared-memory region sent by the peer.
+    Mapped(shm::SharedRegion),
+    /// Bytes written to disk as they were read, and mapped.
+    Spilled(spill::MappedFile),
+}
+
+impl Deref for Payload {
+    type Target = [u8];
+
+    #[inline]
+    fn deref(&self) -> &[u8] {
+        match self {
+            Self::Owned(buf) => buf,
+            Self::Mapped(region) => region,
+            Self::Spilled(file) => file,
+        }
+    }
+}
+
+/// A connected stream, on any transport.
+pub enum Stream {
+    Tcp(TcpStream),
+    Unix {
+        stream: UnixStream,
+        /// Payloads of at least this size are sent through shared memory.
+        shm_threshold: usize,
+    },
+    #[cfg(feature = "io-uring")]
+    Uring(uring::UringStream),
+}
+
+impl Stream {
+    /// Connect to the given endpoint.
+    pub async fn connect(endpoint: &Endpoint) -> Result<Self, std::io::Error> {
+        match endpoint {
+            Endpoint::Tcp(addr) => Ok(Self::Tcp(TcpStream::connect(addr).await?)),
+            Endpoint::Unix(path) => Ok(Self::unix(UnixStream::connect(path).await?)),
+            Endpoint::Uring(addr) => Self::uring(TcpStream::connect(addr).await?),
+        }
+    }
+
+    #[cfg(feature = "io-uring")]
+    fn uring(stream: TcpStream) -> Result<Self, std::io::Error> {
+        uring::UringStream::new(stream.into_std()?).map(Self::Uring)
+    }
+
+    #[cfg(not(feature = "io-uring"))]
+    fn uring(_stream: TcpStream) -> Result<Self, std::io::Error> {
+        Err(uring_unsupported())
+    }
+
+    #[must_use]
+    #[inline]
+    const fn unix(stream: UnixStream) -> Self {
+        Self::Unix {
+            stream,
+            shm_threshold: DEFAULT_SHM_THRESHOLD,
+        }
+    }
+
+    #[must_use]
+    #[inline]
+    /// Set the size from which payloads are sent through shared memory.
+    ///
+    /// This has no effect on TCP streams. Use `usize::MAX` to always write to the socket.
+    pub const fn with_shm_threshold(mut self, threshold: usize) -> Self {
+        if let Self::Unix { shm_threshold, .. } = &mut self {
+            *shm_threshold = threshold;
+        }
+        self
+    }
+
+    /// Send a payload to the peer.
+    pub async fn send(&mut self, data: &[u8]) -> Result<(), std::io::Error> {
+        match self {
+            Self::Tcp(stream) => unsized_data_send(data, stream).await,
+            Self::Unix {
+                stream,
+                shm_threshold,
+            } => unix_send(data, stream, *shm_threshold).await,
+            #[cfg(feature = "io-uring")]
+            Self::Uring(stream) => {
+                // The ring owns what the kernel reads, whatever becomes of this future.
+                let mut owned = BufferPool::global().take(data.len());
+                owned.extend_from_slice(data);
+                stream.send(owned).await
+            }
+        }
+    }
+
+    /// Send the first `len` bytes of a file as a payload.
+    ///
+    /// With `io_uring`, the file is spliced into the socket without being copied to user space.
+    pub async fn send_file(
+        &mut self,
+        file: &std::fs::File,
+        len: u64,
+    ) -> Result<(), std::io::Error> {
+        #[cfg(feature = "io-uring")]
+        if let Self::Uring(stream) = self {
+            return stream.send_file(file, len).await;
+        }
+
+        let len = usize::try_from(len).map_err(std::io::Error::other)?;
+        let mut data = BufferPool::global().take(len);
+        data.resize(len, 0);
+        std::os::unix::fs::FileExt::read_exact_at(file, &mut data, 0)?;
+        self.send(&data).await
+    }
+
+    /// Send a payload on the socket itself, never through shared memory.
+    ///
+    /// This is meant for payloads mapped from disk, which copying to memory would defeat.
+    pub async fn send_inline(&mut self, data: &[u8]) -> Result<(), std::io::Error> {
+        match self {
+            Self::Unix { stream, .. } => shm::send_inline(data, stream).await,
+            Self::Tcp(_) => self.send(data).await,
+            #[cfg(feature = "io-uring")]
+            Self::Uring(_) => self.send(data).await,
+        }
+    }
+
+    /// Receive a payload from the peer.
+    pub async fn recv(&mut self) -> Result<Payload, std::io::Error> {
+        match self {
+            Self::Tcp(stream) => unsized_data_recv(stream).await.map(Payload::Owned),
+            Self::Unix { stream, .. } => shm::recv(stream, None).await,
+            #[cfg(feature = "io-uring")]
+            Self::Uring(stream) => stream.recv().await,
+        }
+    }
+
+    /// Receive a payload from the peer, spilling it to disk if the policy rejects its size.
+    ///
+    /// Payloads sent through shared memory are already mapped, and payloads received with
+    /// `io_uring` are always held in memory.
+    pub async fn recv_or_spill(
+        &mut self,
+        policy: spill::SpillPolicy<'_>,
+    ) -> Result<Payload, std::io::Error> {
+        match self {
+            Self::Tcp(stream) => {
+                let len = recv_size(stream).await?;
+                recv_body(stream, len, Some(policy)).await
+            }
+            Self::Unix { stream, .. } => shm::recv(stream, Some(policy)).await,
+            #[cfg(feature = "io-uring")]
+            Self::Uring(stream) => stream.recv().await,
+        }
+    }
+
+    /// Split the stream into halves, so that payloads can be received while others are sent.
+    ///
+    /// Streams driven by `io_uring` cannot be split.
+    pub fn into_split(self) -> Result<(RecvHalf, SendHalf), std::io::Error> {
+        match self {
+            Self::Tcp(stream) => {
+                let (recv, send) = stream.into_split();
+                Ok((RecvHalf::Tcp(recv), SendHalf::Tcp(send)))
+            }
+            Self::Unix {
+                stream,
+                shm_threshold,
+            } => {
+                let (recv, send) = stream.into_split();
+                Ok((
+                    RecvHalf::Unix(recv),
+                    SendHalf::Unix {
+                        stream: send,
+                        shm_threshold,
+                    },
+                ))
+            }
+            #[cfg(feature = "io-uring")]
+            Self::Uring(_) => Err(std::io::Error::new(
+                std::io::ErrorKind::Unsupported,
+                "io_uring streams cannot be split",
+            )),
+        }
+    }
+}
+
+/// The receiving half of a [`Stream`].
+pub enum RecvHalf {
+    Tcp(tcp::OwnedReadHalf),
+    Unix(unix::OwnedReadHalf),
+}
+
+impl RecvHalf {
+    /// Receive a payload from the peer.
+    pub async fn recv(&mut self) -> Result<Payload, std::io::Error> {
+        match self {
+            Self::Tcp(stream) => unsized_data_recv(stream).await.map(Payload::Owned),
+            Self::Unix(stream) => shm::recv(stream, None).await,
+        }
+    }
+}
+
+/// The sending half of a [`Stream`].
+pub enum SendHalf {
+    Tcp(tcp::OwnedWriteHalf),
+    Unix {
+        stream: unix::OwnedWriteHalf,
+        shm_threshold: usize,
+    },
+}
+
+impl SendHalf {
+    /// Send a payload to the peer.
+    pub async fn send(&mut self, data: &[u8]) -> Result<(), std::io::Error> {
+        match self {
+            Self::Tcp(stream) => unsized_data_send(data, stream).await,
+            Self::Unix {
+                stream,
+                shm_threshold,
+            } => unix_send(data, stream, *shm_threshold).await,
+        }
+    }
+}
+
+/// Send a payload on a Unix socket, through shared memory if it is large enough.
+async fn unix_send<S: shm::UnixSocket + AsyncWrite + Unpin>(
+    data: &[u8],
+    stream: &mut S,
+    shm_threshold: usize,
+) -> Result<(), std::io::Error> {
+    if data.len() >= shm_threshold {
+        shm::send(data, stream).await
+    } else {
+        shm::send_inline(data, stream).await
+    }
+}
+
+/// A listening socket, on any transport.
+pub enum Listener {
+    Tcp(TcpListener),
+    Unix(UnixListener),
+    Uring(TcpListener),
+}
+
+impl Listener {
+    /// Listen on the given endpoint.
+    ///
+    /// A stale Unix socket file left by a previous server is replaced.
+    pub async fn bind(endpoint: &Endpoint) -> Result<Self, std::io::Error> {
+        match endpoint {
+            Endpoint::Tcp(addr) => Ok(Self::Tcp(TcpListener::bind(addr).await?)),
+            Endpoint::Unix(path) => {
+                remove_stale_socket(path)?;
+                Ok(Self::Unix(UnixListener::bind(path)?))
+            }
+            Endpoint::Uring(addr) => {
+                if cfg!(not(feature = "io-uring")) {
+                    return Err(uring_unsupported());
+                }
+                Ok(Self::Uring(TcpListener::bind(addr).await?))
+            }
+        }
+    }
+
+    /// Accept a new connection, along with a printable description of the peer.
+    pub async fn accept(&self) -> Result<(Stream, String), std::io::Error> {
+        match self {
+            Self::Tcp(listener) => {
+                let (stream, addr) = listener.accept().await?;
+                Ok((Stream::Tcp(stream), addr.to_string()))
+            }
+            Self::Unix(listener) => {
+                let (stream, _) = listener.accept().await?;
+                let peer = stream.peer_cred().map_or_else(
+                    |_| String::from("unix peer"),
+                    |cred| format!("unix peer (pid {:?})", cred.pid()),
+                );
+                Ok((Stream::unix(stream), peer))
+            }
+            Self::Uring(listener) => {
+                let (stream, addr) = listener.accept().await?;
+                Ok((Stream::uring(stream)?, addr.to_string()))
+            }
+        }
+    }
+}
+
+#[cfg_attr(feature = "io-uring", allow(dead_code))]
+fn uring_unsupported() -> std::io::Error {
+    std::io::Error::new(
+        std::io::ErrorKind::Unsupported,
+        "io_uring transport requires the `io-uring` feature",
+    )
+}
+
+fn remove_stale_socket(path: &Path) -> Result<(), std::io::Error> {
+    match std::fs::remove_file(path) {
+        Err(err) if err.kind() != std::io::ErrorKind::NotFound => Err(err),
+        _ => Ok(()),
+    }
+}
+
+/// Send a length-prefixed payload.
+pub(crate) async fn unsized_data_send<S: AsyncWrite + Unpin>(
+    data: &[u8],
+    stream: &mut S,
+) -> Result<(), std::io::Error> {
+    let total_size = data.len();
+
+    stream.write_all(&total_size.to_le_bytes()).await?;
+
+    stream.write_all(data).await?;
+
+    Ok(())
+}
+
+/// Receive a length-prefixed payload.
+pub(crate) async fn unsized_data_recv<S: AsyncRead + Unpin>(
+    stream: &mut S,
+) -> Result<Buffer, std::io::Error> {
+    let total_size = recv_size(stream).await?;
+
+    recv_pooled(stream, total_size).await
+}
+
+/// Receive `len` bytes into a pooled buffer.
+///
+/// They are read into the spare capacity of the buffer, which is not zeroed first.
+async fn recv_pooled<S: AsyncRead + Unpin>(
+    stream: &mut S,
+    len: usize,
+) -> Result<Buffer, std::io::Error> {
+    let mut buf = BufferPool::global().take(len);
+    // Bytes past the payload belong to the next one.
+    let mut body = AsyncReadExt::take(stream, len as u64);
+    while buf.len() < len {
+        if body.read_buf(&mut *buf).await? == 0 {
+            return Err(std::io::ErrorKind::UnexpectedEof.into());
+        }
+    }
+    Ok(buf)
+}
+
+/// Receive the size prefix of a payload.
+async fn recv_size<S: AsyncRead + Unpin>(stream: &mut S) -> Result<usize, std::io::Error> {
+    let mut size_buf = [0u8; std::mem::size_of::<u64>()];
+
+    stream.read_exact(&mut size_buf).await?;
+
+    Ok(usize::from_le_bytes(size_buf))
+}
+
+/// Receive the `len` bytes of a payload, in memory unless the spill policy rejects its size.
+pub(crate) async fn recv_body<S: AsyncRead + Unpin>(
+    stream: &mut S,
+    len: usize,
+    policy: Option<spill::SpillPolicy<'_>>,
+) -> Result<Payload, std::io::Error> {
+    if let Some(policy) = policy
+        && !(policy.in_memory)(len)
+    {
+        log::info!("Spilling a payload of {} MiB to disk", len >> 20);
+        return spill::recv(stream, len, policy.dir)
+            .await
+            .map(Payload::Spilled);
+    }
+
+    recv_pooled(stream, len).await.map(Payload::Owned)
+}
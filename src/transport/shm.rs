@@ -0,0 +1,275 @@
+//! Shared-memory payloads over Unix domain sockets.
+//!
+//! A large payload is copied once into an anonymous `memfd` file, which is then sealed
+//! against any further modification and passed to the peer with `SCM_RIGHTS`, next to
+//! the usual size prefix. The peer maps the region read-only and decodes from it directly.
+//!
+//! The size prefix of a shared-memory payload has its most significant bit set, so that
+//! both kinds of payloads can be interleaved on the same socket.
+#![allow(unsafe_code)]
+
+use super::Payload;
+use super::spill::SpillPolicy;
+use core::mem::MaybeUninit;
+use core::ops::Deref;
+use core::ptr::NonNull;
+use rustix::fd::{AsFd, OwnedFd};
+use rustix::fs::{MemfdFlags, SealFlags};
+use rustix::mm::{MapFlags, ProtFlags};
+use rustix::net::{
+    RecvAncillaryBuffer, RecvAncillaryMessage, RecvFlags, SendAncillaryBuffer,
+    SendAncillaryMessage, SendFlags,
+};
+use std::io::{IoSlice, IoSliceMut, Write as _};
+use tokio::io::{AsyncRead, AsyncReadExt, AsyncWrite, AsyncWriteExt, Interest};
+use tokio::net::UnixStream;
+use tokio::net::unix::{OwnedReadHalf, OwnedWriteHalf};
+
+const SHM_FLAG: u64 = 1 << 63;
+const HEADER_SIZE: usize = std::mem::size_of::<u64>();
+
+/// A Unix socket, or one of its halves.
+pub trait UnixSocket {
+    /// The underlying socket, used to pass descriptors.
+    fn socket(&self) -> &UnixStream;
+}
+
+impl UnixSocket for UnixStream {
+    #[inline]
+    fn socket(&self) -> &UnixStream {
+        self
+    }
+}
+
+impl UnixSocket for OwnedReadHalf {
+    #[inline]
+    fn socket(&self) -> &UnixStream {
+        self.as_ref()
+    }
+}
+
+impl UnixSocket for OwnedWriteHalf {
+    #[inline]
+    fn socket(&self) -> &UnixStream {
+        self.as_ref()
+    }
+}
+
+/// A read-only shared-memory region received from the peer.
+pub struct SharedRegion {
+    ptr: NonNull<u8>,
+    len: usize,
+}
+
+// SAFETY: The region is sealed against writes and mapped read-only, it is never mutated.
+unsafe impl Send for SharedRegion {}
+// SAFETY: See above.
+unsafe impl Sync for SharedRegion {}
+
+impl SharedRegion {
+    fn map(fd: &OwnedFd, len: usize) -> Result<Self, std::io::Error> {
+        let seals = rustix::fs::fcntl_get_seals(fd)?;
+        if !seals.contains(SealFlags::WRITE | SealFlags::SHRINK) {
+            return Err(std::io::Error::new(
+                std::io::ErrorKind::InvalidData,
+                "shared-memory payload is not sealed",
+            ));
+        }
+
+        let stat = rustix::fs::fstat(fd)?;
+        if u64::try_from(stat.st_size).ok() != Some(len as u64) {
+            return Err(std::io::Error::new(
+                std::io::ErrorKind::InvalidData,
+                "shared-memory payload size mismatch",
+            ));
+        }
+
+        if len == 0 {
+            return Ok(Self {
+                ptr: NonNull::dangling(),
+                len,
+            });
+        }
+
+        // SAFETY: We map a fresh region of the size of the file, which cannot shrink
+        // nor be written to anymore thanks to the seals checked above.
+        let ptr = unsafe {
+            rustix::mm::mmap(
+                core::ptr::null_mut(),
+                len,
+                ProtFlags::READ,
+                MapFlags::SHARED,
+                fd,
+                0,
+            )?
+        };
+
+        Ok(Self {
+            ptr: NonNull::new(ptr.cast()).expect("mmap returned a null pointer"),
+            len,
+        })
+    }
+}
+
+impl Deref for SharedRegion {
+    type Target = [u8];
+
+    #[inline]
+    fn deref(&self) -> &[u8] {
+        // SAFETY: The mapping is valid for `len` bytes for the lifetime of `self`.
+        unsafe { core::slice::from_raw_parts(self.ptr.as_ptr(), self.len) }
+    }
+}
+
+impl Drop for SharedRegion {
+    fn drop(&mut self) {
+        if self.len == 0 {
+            return;
+        }
+        // SAFETY: The region was mapped by `SharedRegion::map` with this exact length.
+        if let Err(err) = unsafe { rustix::mm::munmap(self.ptr.as_ptr().cast(), self.len) } {
+            log::error!("Failed to unmap shared-memory payload: {err}");
+        }
+    }
+}
+
+/// Send a payload through a sealed shared-memory region.
+pub async fn send<S: UnixSocket + AsyncWrite + Unpin>(
+    data: &[u8],
+    stream: &mut S,
+) -> Result<(), std::io::Error> {
+    let fd = rustix::fs::memfd_create(
+        "bpce-fhe-payload",
+        MemfdFlags::CLOEXEC | MemfdFlags::ALLOW_SEALING,
+    )?;
+    rustix::fs::ftruncate(&fd, data.len() as u64)?;
+
+    let mut file = std::fs::File::from(fd);
+    file.write_all(data)?;
+    rustix::fs::fcntl_add_seals(
+        &file,
+        SealFlags::SEAL | SealFlags::SHRINK | SealFlags::GROW | SealFlags::WRITE,
+    )?;
+
+    let header = (data.len() as u64 | SHM_FLAG).to_le_bytes();
+    send_header(&header, Some(file.as_fd()), stream).await
+}
+
+/// Send a payload on the socket itself.
+pub async fn send_inline<S: UnixSocket + AsyncWrite + Unpin>(
+    data: &[u8],
+    stream: &mut S,
+) -> Result<(), std::io::Error> {
+    super::unsized_data_send(data, stream).await
+}
+
+/// Receive a payload, either inline or through shared memory.
+///
+/// Inline payloads are spilled to disk if the spill policy, if any, rejects their size.
+pub async fn recv<S: UnixSocket + AsyncRead + Unpin>(
+    stream: &mut S,
+    policy: Option<SpillPolicy<'_>>,
+) -> Result<Payload, std::io::Error> {
+    let (header, fd) = recv_header(stream).await?;
+    let header = u64::from_le_bytes(header);
+
+    if header & SHM_FLAG == 0 {
+        let len = usize::try_from(header).map_err(invalid_data)?;
+        return super::recv_body(stream, len, policy).await;
+    }
+
+    let len = usize::try_from(header & !SHM_FLAG).map_err(invalid_data)?;
+    let fd = fd.ok_or_else(|| {
+        std::io::Error::new(
+            std::io::ErrorKind::InvalidData,
+            "shared-memory payload without file descriptor",
+        )
+    })?;
+
+    SharedRegion::map(&fd, len).map(Payload::Mapped)
+}
+
+async fn send_header<S: UnixSocket + AsyncWrite + Unpin>(
+    header: &[u8; HEADER_SIZE],
+    fd: Option<rustix::fd::BorrowedFd<'_>>,
+    stream: &mut S,
+) -> Result<(), std::io::Error> {
+    let fds = fd.as_slice();
+    let mut space = [MaybeUninit::uninit(); rustix::cmsg_space!(ScmRights(1))];
+    let socket = stream.socket();
+
+    let sent = loop {
+        socket.writable().await?;
+
+        let res = socket.try_io(Interest::WRITABLE, || {
+            let mut control = SendAncillaryBuffer::new(&mut space);
+            if !fds.is_empty() {
+                control.push(SendAncillaryMessage::ScmRights(fds));
+            }
+            rustix::net::sendmsg(
+                socket,
+                &[IoSlice::new(header)],
+                &mut control,
+                SendFlags::NOSIGNAL,
+            )
+            .map_err(std::io::Error::from)
+        });
+
+        match res {
+            Ok(sent) => break sent,
+            Err(err) if err.kind() == std::io::ErrorKind::WouldBlock => {}
+            Err(err) => return Err(err),
+        }
+    };
+
+    // The descriptor travels with the first byte, the rest of the header may follow.
+    stream.write_all(&header[sent..]).await
+}
+
+async fn recv_header<S: UnixSocket + AsyncRead + Unpin>(
+    stream: &mut S,
+) -> Result<([u8; HEADER_SIZE], Option<OwnedFd>), std::io::Error> {
+    let mut header = [0u8; HEADER_SIZE];
+    let mut space = [MaybeUninit::uninit(); rustix::cmsg_space!(ScmRights(1))];
+    let mut received_fd = None;
+    let socket = stream.socket();
+
+    let received = loop {
+        socket.readable().await?;
+
+        let res = socket.try_io(Interest::READABLE, || {
+            let mut control = RecvAncillaryBuffer::new(&mut space);
+            let msg = rustix::net::recvmsg(
+                socket,
+                &mut [IoSliceMut::new(&mut header)],
+                &mut control,
+                RecvFlags::CMSG_CLOEXEC,
+            )?;
+            for message in control.drain() {
+                if let RecvAncillaryMessage::ScmRights(fds) = message {
+                    // Any extra descriptor is dropped, hence closed.
+                    for fd in fds {
+                        received_fd.get_or_insert(fd);
+                    }
+                }
+            }
+            Ok(msg.bytes)
+        });
+
+        match res {
+            Ok(0) => return Err(std::io::ErrorKind::UnexpectedEof.into()),
+            Ok(received) => break received,
+            Err(err) if err.kind() == std::io::ErrorKind::WouldBlock => {}
+            Err(err) => return Err(err),
+        }
+    };
+
+    stream.read_exact(&mut header[received..]).await?;
+
+    Ok((header, received_fd))
+}
+
+#[inline]
+fn invalid_data<E: Into<Box<dyn std::error::Error + Send + Sync>>>(err: E) -> std::io::Error {
+    std::io::Error::new(std::io::ErrorKind::InvalidData, err)
+}
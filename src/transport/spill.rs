@@ -0,0 +1,193 @@
+//! Payloads spilled to disk.
+//!
+//! A payload too large to be held in memory is written to an anonymous temporary file
+//! (`O_TMPFILE`, removed as soon as it is closed) and mapped read-only. Its pages are then
+//! backed by the file rather than by memory, so that the kernel can evict them under memory
+//! pressure instead of killing the process.
+#![allow(unsafe_code)]
+
+use core::ops::Deref;
+use core::ptr::NonNull;
+use rustix::fs::{Mode, OFlags};
+use rustix::mm::{MapFlags, ProtFlags};
+use std::path::Path;
+use tokio::io::{AsyncRead, AsyncReadExt, AsyncWriteExt};
+
+/// Decides whether incoming payloads are held in memory or spilled.
+pub struct SpillPolicy<'a> {
+    /// Directory of the temporary files.
+    pub dir: &'a Path,
+    /// Whether a payload of the given size may be held in memory.
+    pub in_memory: &'a mut (dyn FnMut(usize) -> bool + Send),
+}
+
+/// A read-only mapping of a spilled file.
+pub struct MappedFile {
+    ptr: NonNull<u8>,
+    len: usize,
+}
+
+// SAFETY: The file is private to this process and is not written to anymore once mapped.
+unsafe impl Send for MappedFile {}
+// SAFETY: See above.
+unsafe impl Sync for MappedFile {}
+
+impl MappedFile {
+    /// Map a whole file, private to this process, that is not written to anymore.
+    pub fn from_file(file: &std::fs::File) -> Result<Self, std::io::Error> {
+        let len = usize::try_from(file.metadata()?.len()).map_err(std::io::Error::other)?;
+        Self::map(file, len)
+    }
+
+    /// Map the first `len` bytes of a file that is not written to anymore.
+    fn map(file: &std::fs::File, len: usize) -> Result<Self, std::io::Error> {
+        if len == 0 {
+            return Ok(Self {
+                ptr: NonNull::dangling(),
+                len,
+            });
+        }
+
+        // SAFETY: The file is private to this process, and it is not written to nor truncated
+        // anymore: the mapping stays valid for `len` bytes.
+        let ptr = unsafe {
+            rustix::mm::mmap(
+                core::ptr::null_mut(),
+                len,
+                ProtFlags::READ,
+                MapFlags::SHARED,
+                file,
+                0,
+            )?
+        };
+
+        Ok(Self {
+            ptr: NonNull::new(ptr.cast()).expect("mmap returned a null pointer"),
+            len,
+        })
+    }
+}
+
+impl Deref for MappedFile {
+    type Target = [u8];
+
+    #[inline]
+    fn deref(&self) -> &[u8] {
+        // SAFETY: The mapping is valid for `len` bytes for the lifetime of `self`.
+        unsafe { core::slice::from_raw_parts(self.ptr.as_ptr(), self.len) }
+    }
+}
+
+impl Drop for MappedFile {
+    fn drop(&mut self) {
+        if self.len == 0 {
+            return;
+        }
+        // SAFETY: The file was mapped by `MappedFile::map` with this exact length.
+        if let Err(err) = unsafe { rustix::mm::munmap(self.ptr.as_ptr().cast(), self.len) } {
+            log::error!("Failed to unmap spilled payload: {err}");
+        }
+    }
+}
+
+/// Writes a payload to an anonymous temporary file, to be mapped once complete.
+pub struct SpillWriter {
+    file: tokio::fs::File,
+    len: u64,
+}
+
+impl SpillWriter {
+    /// Create an anonymous temporary file in `dir`.
+    pub fn create(dir: &Path) -> Result<Self, std::io::Error> {
+        let fd = rustix::fs::open(
+            dir,
+            OFlags::TMPFILE | OFlags::RDWR | OFlags::CLOEXEC,
+            Mode::RUSR | Mode::WUSR,
+        )?;
+        Ok(Self {
+            file: tokio::fs::File::from_std(std::fs::File::from(fd)),
+            len: 0,
+        })
+    }
+
+    #[must_use]
+    #[inline]
+    /// Number of bytes written so far.
+    pub const fn len(&self) -> u64 {
+        self.len
+    }
+
+    #[must_use]
+    #[inline]
+    pub const fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Append bytes to the file.
+    pub async fn write(&mut self, data: &[u8]) -> Result<(), std::io::Error> {
+        self.file.write_all(data).await?;
+        self.len += data.len() as u64;
+        Ok(())
+    }
+
+    /// Append the next `len` bytes of `reader` to the file.
+    pub async fn copy_from<R: AsyncRead + Unpin>(
+        &mut self,
+        reader: &mut R,
+        len: usize,
+    ) -> Result<(), std::io::Error> {
+        let copied = tokio::io::copy(&mut reader.take(len as u64), &mut self.file).await?;
+        self.len += copied;
+        if copied == len as u64 {
+            Ok(())
+        } else {
+            Err(std::io::ErrorKind::UnexpectedEof.into())
+        }
+    }
+
+    /// Map the whole file, which cannot be written to anymore.
+    pub async fn finish(mut self) -> Result<MappedFile, std::io::Error> {
+        self.file.flush().await?;
+        let file = self.file.into_std().await;
+        MappedFile::map(
+            &file,
+            usize::try_from(self.len).map_err(std::io::Error::other)?,
+        )
+    }
+}
+
+/// Receive the `len` bytes of a payload from `reader` into a spilled file.
+pub async fn recv<R: AsyncRead + Unpin>(
+    reader: &mut R,
+    len: usize,
+    dir: &Path,
+) -> Result<MappedFile, std::io::Error> {
+    let mut writer = SpillWriter::create(dir)?;
+    writer.copy_from(reader, len).await?;
+    writer.finish().await
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[tokio::test]
+    async fn test_spill_roundtrip() {
+        let data = (0..=u8::MAX).cycle().take(3 << 20).collect::<Vec<_>>();
+
+        let mut reader = &data[..];
+        let mapped = recv(&mut reader, data.len(), &std::env::temp_dir())
+            .await
+            .unwrap();
+        assert_eq!(&*mapped, &data[..]);
+
+        let mut writer = SpillWriter::create(&std::env::temp_dir()).unwrap();
+        writer.write(&data[..10]).await.unwrap();
+        writer.write(&data[10..]).await.unwrap();
+        assert_eq!(writer.len(), data.len() as u64);
+        assert_eq!(&*writer.finish().await.unwrap(), &data[..]);
+
+        let mut short = &data[..10];
+        assert!(recv(&mut short, 20, &std::env::temp_dir()).await.is_err());
+    }
+}
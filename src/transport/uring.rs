@@ -0,0 +1,413 @@
+//! TCP transport driven by Linux `io_uring`.
+//!
+//! - Receives go through a small pool of buffers registered with the ring, so the kernel
+//!   does not have to pin and map pages on every read. Two buffers are used in turn: the
+//!   next read is already in flight while the previous buffer is being drained.
+//! - Payloads are sent with a single vectored zero-copy send of the size prefix and the
+//!   payload, falling back to a regular vectored send on kernels that lack it. The payload is
+//!   owned by the ring while the kernel reads it, in a [pooled buffer](crate::buffers).
+//! - Files are sent with `splice`, through a pipe, without ever reaching user space.
+//!
+//! Each stream has its own ring, driven by a dedicated thread that waits for its completions.
+//! Async callers hand operations to that thread and await their results, so no runtime worker
+//! is blocked, whatever the flavor of the runtime.
+#![allow(unsafe_code)]
+
+use super::Payload;
+use crate::buffers::{Buffer, BufferPool};
+use io_uring::{IoUring, cqueue, opcode, squeue, types};
+use std::io::{Error, ErrorKind};
+use std::net::Shutdown;
+use std::os::fd::{AsRawFd, RawFd};
+use std::sync::mpsc;
+use tokio::sync::oneshot;
+
+/// Number of entries of the submission queue.
+const RING_ENTRIES: u32 = 32;
+/// Number of registered receive buffers.
+const POOL_BUFFERS: usize = 2;
+/// Size of each registered receive buffer.
+const POOL_BUFFER_SIZE: usize = 1 << 20; // 1 MB
+/// Size of the pipe used to splice files into the socket.
+const SPLICE_PIPE_SIZE: usize = 1 << 20; // 1 MB
+/// `user_data` of operations whose completion is awaited right away.
+const SINGLE_OP: u64 = 0;
+
+/// A TCP stream whose I/O is submitted through its own `io_uring` instance.
+pub struct UringStream {
+    /// Operations for the thread driving the ring, which exits once this is dropped.
+    ops: mpsc::Sender<Op>,
+    /// The socket the ring reads and writes, shut down when the stream is dropped so that a
+    /// pending receive returns.
+    socket: std::net::TcpStream,
+}
+
+/// An operation handed to the thread driving a ring.
+enum Op {
+    Send {
+        data: Buffer,
+        reply: oneshot::Sender<Result<(), Error>>,
+    },
+    SendFile {
+        file: std::fs::File,
+        len: u64,
+        reply: oneshot::Sender<Result<(), Error>>,
+    },
+    Recv {
+        reply: oneshot::Sender<Result<Payload, Error>>,
+    },
+}
+
+impl UringStream {
+    /// Wrap a connected TCP stream, and start the thread driving its ring.
+    pub fn new(socket: std::net::TcpStream) -> Result<Self, Error> {
+        let handle = socket.try_clone()?;
+        let mut ring = Ring::new(socket)?;
+        let (ops, receiver) = mpsc::channel();
+        std::thread::Builder::new()
+            .name("io-uring".into())
+            .spawn(move || {
+                for op in receiver {
+                    ring.run(op);
+                }
+            })?;
+        Ok(Self {
+            ops,
+            socket: handle,
+        })
+    }
+
+    /// Hand an operation to the driving thread.
+    fn submit(&self, op: Op) -> Result<(), Error> {
+        self.ops
+            .send(op)
+            .map_err(|_| Error::other("io_uring driver thread exited"))
+    }
+
+    /// Receive a length-prefixed payload.
+    pub async fn recv(&mut self) -> Result<Payload, Error> {
+        let (reply, result) = oneshot::channel();
+        self.submit(Op::Recv { reply })?;
+        result.await.map_err(Error::other)?
+    }
+
+    /// Send a length-prefixed payload, as one vectored (zero-copy if possible) send.
+    ///
+    /// The payload is moved to the driving thread, which frees it once the kernel is done with
+    /// it, even if the returned future is dropped before.
+    pub async fn send(&mut self, data: Buffer) -> Result<(), Error> {
+        let (reply, result) = oneshot::channel();
+        self.submit(Op::Send { data, reply })?;
+        result.await.map_err(Error::other)?
+    }
+
+    /// Send `len` bytes of a file as a length-prefixed payload, splicing them
+    /// from the page cache into the socket.
+    pub async fn send_file(&mut self, file: &std::fs::File, len: u64) -> Result<(), Error> {
+        let (reply, result) = oneshot::channel();
+        self.submit(Op::SendFile {
+            file: file.try_clone()?,
+            len,
+            reply,
+        })?;
+        result.await.map_err(Error::other)?
+    }
+}
+
+impl Drop for UringStream {
+    fn drop(&mut self) {
+        let _ = self.socket.shutdown(Shutdown::Both);
+    }
+}
+
+impl AsRawFd for UringStream {
+    fn as_raw_fd(&self) -> RawFd {
+        self.socket.as_raw_fd()
+    }
+}
+
+/// A ring and the socket it reads and writes, driven synchronously.
+struct Ring {
+    ring: IoUring,
+    socket: std::net::TcpStream,
+    /// Registered receive buffers. Their addresses must not change while registered.
+    pool: Vec<Box<[u8]>>,
+    /// Cleared once the kernel rejects zero-copy sends.
+    zerocopy: bool,
+}
+
+impl Ring {
+    fn new(socket: std::net::TcpStream) -> Result<Self, Error> {
+        socket.set_nonblocking(false)?;
+        socket.set_nodelay(true)?;
+
+        let ring = IoUring::new(RING_ENTRIES)?;
+        let pool: Vec<Box<[u8]>> = (0..POOL_BUFFERS)
+            .map(|_| vec![0u8; POOL_BUFFER_SIZE].into_boxed_slice())
+            .collect();
+
+        let iovecs: Vec<libc::iovec> = pool
+            .iter()
+            .map(|buf| libc::iovec {
+                iov_base: buf.as_ptr().cast_mut().cast(),
+                iov_len: buf.len(),
+            })
+            .collect();
+
+        // SAFETY: The buffers are heap allocated and owned by the stream, they outlive
+        // the registration, which ends when the ring is dropped.
+        unsafe { ring.submitter().register_buffers(&iovecs)? };
+
+        Ok(Self {
+            ring,
+            socket,
+            pool,
+            zerocopy: true,
+        })
+    }
+
+    /// Run an operation, and send its result back.
+    fn run(&mut self, op: Op) {
+        match op {
+            Op::Send { data, reply } => {
+                let _ = reply.send(self.send(&data));
+            }
+            Op::SendFile { file, len, reply } => {
+                let _ = reply.send(self.send_file(&file, len));
+            }
+            Op::Recv { reply } => {
+                let _ = reply.send(self.recv());
+            }
+        }
+    }
+
+    #[inline]
+    fn fd(&self) -> types::Fd {
+        types::Fd(self.socket.as_raw_fd())
+    }
+
+    /// Submit one operation and wait for its completion.
+    ///
+    /// ## Safety
+    ///
+    /// The buffers referenced by `entry` must stay valid until this function returns.
+    unsafe fn submit_one(&mut self, entry: &squeue::Entry) -> Result<i32, Error> {
+        // SAFETY: Guaranteed by the caller.
+        unsafe { self.push(entry)? };
+        self.ring.submit_and_wait(1)?;
+        self.pop().map(|cqe| cqe.result())
+    }
+
+    unsafe fn push(&mut self, entry: &squeue::Entry) -> Result<(), Error> {
+        // SAFETY: Guaranteed by the caller.
+        unsafe { self.ring.submission().push(entry) }
+            .map_err(|_| Error::other("io_uring submission queue is full"))
+    }
+
+    fn pop(&mut self) -> Result<cqueue::Entry, Error> {
+        self.ring
+            .completion()
+            .next()
+            .ok_or_else(|| Error::other("io_uring completion queue is empty"))
+    }
+
+    /// Receive `len` bytes into the registered buffer `index`.
+    fn read_fixed_entry(&mut self, index: usize, len: usize) -> squeue::Entry {
+        let buf = &mut self.pool[index];
+        opcode::ReadFixed::new(
+            self.fd(),
+            buf.as_mut_ptr(),
+            u32::try_from(len).unwrap(),
+            u16::try_from(index).unwrap(),
+        )
+        .offset(u64::MAX) // Current position, sockets are not seekable.
+        .build()
+        .user_data(index as u64)
+    }
+
+    /// Receive exactly `out.len()` bytes.
+    fn recv_exact(&mut self, out: &mut [u8]) -> Result<(), Error> {
+        let mut filled = 0;
+        let mut current = 0;
+
+        if out.is_empty() {
+            return Ok(());
+        }
+
+        let entry = self.read_fixed_entry(current, out.len().min(POOL_BUFFER_SIZE));
+        // SAFETY: Registered buffers live as long as `self`.
+        unsafe { self.push(&entry)? };
+
+        while filled < out.len() {
+            self.ring.submit_and_wait(1)?;
+            let cqe = self.pop()?;
+            let read = check(cqe.result())?;
+            if read == 0 {
+                return Err(ErrorKind::UnexpectedEof.into());
+            }
+
+            // Queue the next read into the other buffer before draining this one.
+            let next = (current + 1) % POOL_BUFFERS;
+            let remaining = out.len() - filled - read;
+            if remaining > 0 {
+                let entry = self.read_fixed_entry(next, remaining.min(POOL_BUFFER_SIZE));
+                // SAFETY: Registered buffers live as long as `self`.
+                unsafe { self.push(&entry)? };
+                self.ring.submit()?;
+            }
+
+            out[filled..filled + read].copy_from_slice(&self.pool[current][..read]);
+            filled += read;
+            current = next;
+        }
+
+        Ok(())
+    }
+
+    /// Receive a length-prefixed payload.
+    fn recv(&mut self) -> Result<Payload, Error> {
+        let mut size_buf = [0u8; std::mem::size_of::<u64>()];
+        self.recv_exact(&mut size_buf)?;
+
+        let total_size = usize::from_le_bytes(size_buf);
+        let mut buf = BufferPool::global().take(total_size);
+        buf.resize(total_size, 0);
+        self.recv_exact(&mut buf)?;
+
+        Ok(Payload::Owned(buf))
+    }
+
+    /// Send a length-prefixed payload, as one vectored (zero-copy if possible) send.
+    fn send(&mut self, data: &[u8]) -> Result<(), Error> {
+        let header = data.len().to_le_bytes();
+        let mut parts: [&[u8]; 2] = [&header, data];
+
+        while !parts[1].is_empty() || !parts[0].is_empty() {
+            let iovecs = parts.map(|part| libc::iovec {
+                iov_base: part.as_ptr().cast_mut().cast(),
+                iov_len: part.len(),
+            });
+            // SAFETY: An all-zero `msghdr` is a valid empty message header.
+            let mut msg: libc::msghdr = unsafe { std::mem::zeroed() };
+            msg.msg_iov = iovecs.as_ptr().cast_mut();
+            msg.msg_iovlen = iovecs.len();
+
+            // SAFETY: `msg`, `iovecs` and the payload outlive the operation, which is
+            // fully completed (including the zero-copy notification) when this returns.
+            let sent = unsafe { self.sendmsg(&msg)? };
+
+            let from_header = sent.min(parts[0].len());
+            parts[0] = &parts[0][from_header..];
+            parts[1] = &parts[1][sent - from_header..];
+        }
+
+        Ok(())
+    }
+
+    /// Send one message and wait until the kernel is done with its buffers.
+    unsafe fn sendmsg(&mut self, msg: &libc::msghdr) -> Result<usize, Error> {
+        if self.zerocopy {
+            let entry = opcode::SendMsgZc::new(self.fd(), msg)
+                .build()
+                .user_data(SINGLE_OP);
+            // SAFETY: Guaranteed by the caller.
+            unsafe { self.push(&entry)? };
+
+            let mut sent = None;
+            let mut pending_notif = false;
+            while sent.is_none() || pending_notif {
+                self.ring.submit_and_wait(1)?;
+                let cqe = self.pop()?;
+                if cqueue::notif(cqe.flags()) {
+                    pending_notif = false;
+                    continue;
+                }
+                pending_notif = cqueue::more(cqe.flags());
+                sent = Some(cqe.result());
+            }
+
+            match sent.unwrap() {
+                res if res == -libc::EINVAL || res == -libc::EOPNOTSUPP => {
+                    log::warn!("Zero-copy sends are not supported, falling back to copies");
+                    self.zerocopy = false;
+                }
+                res => return check(res),
+            }
+        }
+
+        let entry = opcode::SendMsg::new(self.fd(), msg)
+            .build()
+            .user_data(SINGLE_OP);
+        // SAFETY: Guaranteed by the caller.
+        check(unsafe { self.submit_one(&entry)? })
+    }
+
+    /// Send `len` bytes of a file as a length-prefixed payload, splicing them
+    /// from the page cache into the socket.
+    fn send_file(&mut self, file: &std::fs::File, len: u64) -> Result<(), Error> {
+        let header = usize::try_from(len).map_err(Error::other)?.to_le_bytes();
+        let mut rest = &header[..];
+        while !rest.is_empty() {
+            let header_entry =
+                opcode::Send::new(self.fd(), rest.as_ptr(), u32::try_from(rest.len()).unwrap())
+                    .build()
+                    .user_data(SINGLE_OP);
+            // SAFETY: `header` outlives the operation.
+            let sent = check(unsafe { self.submit_one(&header_entry)? })?;
+            if sent == 0 {
+                return Err(ErrorKind::WriteZero.into());
+            }
+            rest = &rest[sent..];
+        }
+
+        let (pipe_out, pipe_in) = std::io::pipe()?;
+        let pipe_size =
+            rustix::pipe::fcntl_setpipe_size(&pipe_in, SPLICE_PIPE_SIZE).unwrap_or(1 << 16);
+        let file_fd = types::Fd(file.as_raw_fd());
+
+        let mut offset = 0_u64;
+        while offset < len {
+            let chunk = u32::try_from((len - offset).min(pipe_size as u64)).unwrap();
+
+            let to_pipe = opcode::Splice::new(
+                file_fd,
+                i64::try_from(offset).map_err(Error::other)?,
+                types::Fd(pipe_in.as_raw_fd()),
+                -1,
+                chunk,
+            )
+            .flags(libc::SPLICE_F_MOVE)
+            .build()
+            .user_data(SINGLE_OP);
+            // SAFETY: No user-space buffer is involved.
+            let mut in_pipe = check(unsafe { self.submit_one(&to_pipe)? })?;
+            if in_pipe == 0 {
+                return Err(ErrorKind::UnexpectedEof.into());
+            }
+            offset += in_pipe as u64;
+
+            while in_pipe > 0 {
+                let to_socket = opcode::Splice::new(
+                    types::Fd(pipe_out.as_raw_fd()),
+                    -1,
+                    self.fd(),
+                    -1,
+                    u32::try_from(in_pipe).unwrap(),
+                )
+                .flags(libc::SPLICE_F_MOVE)
+                .build()
+                .user_data(SINGLE_OP);
+                // SAFETY: No user-space buffer is involved.
+                in_pipe -= check(unsafe { self.submit_one(&to_socket)? })?;
+            }
+        }
+
+        Ok(())
+    }
+}
+
+/// Convert an `io_uring` result into a byte count.
+#[inline]
+fn check(res: i32) -> Result<usize, Error> {
+    usize::try_from(res).map_err(|_| Error::from_raw_os_error(-res))
+}
@@ -0,0 +1,401 @@
+//! Resumable uploads of large requests.
+//!
+//! Instead of sending a request as a single payload, a client can upload it in chunks that the
+//! server persists as they arrive, so that an interrupted upload resumes from the last
+//! acknowledged chunk instead of starting over.
+//!
+//! An upload starts with the client sending [`HELLO`] directly followed by an encoded
+//! [`Manifest`]. The server answers with an [`Ack`] of the chunks it already holds for this
+//! upload, and the client sends the missing ones in order, each as an encoded [`ChunkHeader`]
+//! followed by the chunk. The server acknowledges every chunk once it is written to its store
+//! and synced, and closes the connection on any invalid chunk. Once the last chunk is
+//! acknowledged, the server checks the request assembled from the chunks against the digest of
+//! the manifest, runs it, and answers it on the same connection as if it had been sent whole.
+//! The upload is removed from the store once the response is sent.
+//!
+//! An upload is held by a single connection at a time. The server gives up on a connection
+//! that sends no chunk for [`CHUNK_TIMEOUT`], so that a half-open one does not keep the upload
+//! from being resumed, and removes the chunks of uploads untouched for [`ABANDONED_AFTER`].
+
+use crate::transport::spill::MappedFile;
+use bincode::{Decode, Encode};
+use core::cmp::Ordering;
+use core::time::Duration;
+use sha3::{Digest as _, Sha3_256};
+use std::collections::HashSet;
+use std::fs::File;
+use std::io::Write as _;
+use std::path::PathBuf;
+use std::sync::{Arc, Mutex};
+use std::time::SystemTime;
+use thiserror::Error;
+
+/// First bytes of the first payload of an upload, sent by the client.
+pub const HELLO: &[u8] = b"bpce-fhe/upload";
+
+/// Size of the chunks sent by the client.
+pub const CHUNK_SIZE: u32 = 8 << 20; // 8 MiB
+
+/// Largest chunk accepted by the server.
+pub const MAX_CHUNK_SIZE: u32 = 64 << 20; // 64 MiB
+
+/// Longest wait of the server for the next chunk, before it drops the connection.
+///
+/// Shorter than the backoff of the client, so that its last attempts find the upload released.
+pub const CHUNK_TIMEOUT: Duration = Duration::from_secs(20);
+
+/// Age of the last chunk of an upload after which it is considered abandoned.
+pub const ABANDONED_AFTER: Duration = Duration::from_secs(24 * 60 * 60);
+
+/// SHA3-256 of a request.
+pub type Digest = [u8; 32];
+
+#[must_use]
+#[inline]
+/// The digest of a request, as sent in its [`Manifest`].
+pub fn digest(request: &[u8]) -> Digest {
+    Sha3_256::digest(request).into()
+}
+
+/// Describes an upload.
+#[derive(Clone, Debug, PartialEq, Eq, Encode, Decode)]
+pub struct Manifest {
+    /// Identifies the upload across connections, made of ASCII letters, digits and dashes.
+    pub id: String,
+    /// Length of the request, in bytes.
+    pub len: u64,
+    /// Length of every chunk but the last one.
+    pub chunk_size: u32,
+    /// Digest of the request, which chunks held under the same id must match.
+    pub digest: Digest,
+}
+
+impl Manifest {
+    #[must_use]
+    #[inline]
+    /// Number of chunks of the upload.
+    pub fn chunks(&self) -> u64 {
+        self.len.div_ceil(u64::from(self.chunk_size))
+    }
+
+    #[must_use]
+    #[inline]
+    /// Length of the chunk with the given sequence number.
+    pub fn chunk_len(&self, seq: u64) -> u64 {
+        (self.len - seq * u64::from(self.chunk_size)).min(u64::from(self.chunk_size))
+    }
+}
+
+/// Header of a chunk.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Encode, Decode)]
+pub struct ChunkHeader {
+    /// Position of the chunk in the upload, from 0.
+    pub seq: u64,
+    /// CRC-32 of the chunk.
+    pub checksum: u32,
+}
+
+/// Number of chunks the server holds, all of those before `next`.
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Encode, Decode)]
+pub struct Ack {
+    pub next: u64,
+}
+
+#[derive(Error, Debug)]
+pub enum UploadError {
+    #[error("IO error: {0}")]
+    Io(#[from] std::io::Error),
+    #[error("Failed to decode upload: {0}")]
+    Decode(#[from] bincode::error::DecodeError),
+    #[error("Invalid upload manifest: {0:?}")]
+    InvalidManifest(Manifest),
+    #[error("Upload '{0}' is already in progress")]
+    InProgress(String),
+    #[error("Expected chunk {expected}, got chunk {got}")]
+    OutOfOrder { expected: u64, got: u64 },
+    #[error("Invalid chunk {0}: wrong length or checksum")]
+    InvalidChunk(u64),
+    #[error("No chunk received for {0:?}")]
+    Timeout(Duration),
+    #[error("Upload '{0}' does not match the digest of its manifest")]
+    Mismatch(String),
+}
+
+/// Where a server persists the chunks of uploads, one file per upload.
+#[derive(Debug)]
+pub struct UploadStore {
+    dir: PathBuf,
+    /// Uploads currently received or run, which cannot be resumed by another connection.
+    active: Arc<Mutex<HashSet<String>>>,
+}
+
+/// An upload being received, or whose request is running.
+#[derive(Debug)]
+pub struct Upload {
+    manifest: Manifest,
+    file: File,
+    path: PathBuf,
+    next: u64,
+    active: Arc<Mutex<HashSet<String>>>,
+}
+
+impl UploadStore {
+    /// Use the given directory, creating it if needed, and remove the abandoned uploads it holds.
+    pub fn new(dir: PathBuf) -> Result<Self, std::io::Error> {
+        std::fs::create_dir_all(&dir)?;
+        let store = Self {
+            dir,
+            active: Arc::default(),
+        };
+        store.remove_abandoned()?;
+        Ok(store)
+    }
+
+    /// Remove the uploads not written to for [`ABANDONED_AFTER`], and not held by a connection.
+    fn remove_abandoned(&self) -> Result<(), std::io::Error> {
+        let now = SystemTime::now();
+        let active = self.active.lock().unwrap();
+        for entry in std::fs::read_dir(&self.dir)? {
+            let entry = entry?;
+            let modified = entry.metadata()?.modified()?;
+            let abandoned = now
+                .duration_since(modified)
+                .is_ok_and(|age| age > ABANDONED_AFTER);
+            if abandoned && !active.contains(&*entry.file_name().to_string_lossy()) {
+                log::info!("Removing abandoned upload {}", entry.path().display());
+                std::fs::remove_file(entry.path())?;
+            }
+        }
+        Ok(())
+    }
+
+    /// Start or resume an upload from the chunks held for it.
+    pub fn open(&self, manifest: Manifest) -> Result<Upload, UploadError> {
+        let valid_id = !manifest.id.is_empty()
+            && manifest.id.len() <= 64
+            && manifest
+                .id
+                .bytes()
+                .all(|c| c.is_ascii_alphanumeric() || c == b'-');
+        if !valid_id || manifest.chunk_size == 0 || manifest.chunk_size > MAX_CHUNK_SIZE {
+            return Err(UploadError::InvalidManifest(manifest));
+        }
+
+        // Abandoned uploads are few, and every upload opened replaces one.
+        self.remove_abandoned()?;
+        if !self.active.lock().unwrap().insert(manifest.id.clone()) {
+            return Err(UploadError::InProgress(manifest.id));
+        }
+        // From now on, dropping the upload releases its id.
+        let path = self.dir.join(&manifest.id);
+        let mut upload = Upload {
+            file: File::options()
+                .read(true)
+                .append(true)
+                .create(true)
+                .open(&path)?,
+            path,
+            next: 0,
+            active: Arc::clone(&self.active),
+            manifest,
+        };
+
+        // Only whole chunks count, a partial one was not acknowledged.
+        let held = upload.file.metadata()?.len();
+        let chunk_size = u64::from(upload.manifest.chunk_size);
+        upload.next = match held.cmp(&upload.manifest.len) {
+            Ordering::Equal => upload.manifest.chunks(),
+            Ordering::Less => held / chunk_size,
+            // Held for another request under the same id.
+            Ordering::Greater => 0,
+        };
+        upload.file.set_len(if upload.is_complete() {
+            upload.manifest.len
+        } else {
+            upload.next * chunk_size
+        })?;
+
+        Ok(upload)
+    }
+}
+
+impl Upload {
+    #[must_use]
+    #[inline]
+    /// The acknowledgement of the chunks held so far.
+    pub const fn ack(&self) -> Ack {
+        Ack { next: self.next }
+    }
+
+    #[must_use]
+    #[inline]
+    /// Whether every chunk is held.
+    pub fn is_complete(&self) -> bool {
+        self.next == self.manifest.chunks()
+    }
+
+    /// Persist the next chunk, sent as `payload`.
+    pub fn write(&mut self, payload: &[u8]) -> Result<(), UploadError> {
+        let (header, read): (ChunkHeader, _) =
+            bincode::decode_from_slice(payload, crate::BINCODE_CONFIG)?;
+        if header.seq != self.next {
+            return Err(UploadError::OutOfOrder {
+                expected: self.next,
+                got: header.seq,
+            });
+        }
+
+        let chunk = &payload[read..];
+        if self.is_complete()
+            || chunk.len() as u64 != self.manifest.chunk_len(header.seq)
+            || crc32fast::hash(chunk) != header.checksum
+        {
+            return Err(UploadError::InvalidChunk(header.seq));
+        }
+
+        // Chunks arrive in order, and the file was truncated after the last whole one.
+        self.file.write_all(chunk)?;
+        self.file.sync_data()?;
+        self.next += 1;
+        Ok(())
+    }
+
+    /// Map the request assembled from the chunks, once the upload is complete.
+    ///
+    /// No chunk can be written anymore, so the mapping stays valid. Chunks held for another
+    /// request under the same id are removed, so that the upload starts over.
+    pub fn map(self) -> Result<(MappedFile, CompleteUpload), UploadError> {
+        let mapped = MappedFile::from_file(&self.file)?;
+        if digest(&mapped) != self.manifest.digest {
+            drop(mapped);
+            self.file.set_len(0)?;
+            return Err(UploadError::Mismatch(self.manifest.id.clone()));
+        }
+        Ok((mapped, CompleteUpload(self)))
+    }
+}
+
+/// An upload whose request is running, which keeps its id reserved.
+#[derive(Debug)]
+pub struct CompleteUpload(Upload);
+
+impl CompleteUpload {
+    /// Remove the upload from the store, once its request is answered.
+    pub fn remove(self) -> Result<(), std::io::Error> {
+        std::fs::remove_file(&self.0.path)
+    }
+}
+
+impl Drop for Upload {
+    fn drop(&mut self) {
+        self.active.lock().unwrap().remove(&self.manifest.id);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn chunk(seq: u64, data: &[u8]) -> Vec<u8> {
+        let header = ChunkHeader {
+            seq,
+            checksum: crc32fast::hash(data),
+        };
+        let mut payload = bincode::encode_to_vec(header, crate::BINCODE_CONFIG).unwrap();
+        payload.extend_from_slice(data);
+        payload
+    }
+
+    #[test]
+    fn test_resume() {
+        let store = UploadStore::new(std::env::temp_dir().join("bpce-fhe-upload-test")).unwrap();
+        let data = (0..=u8::MAX).cycle().take(25).collect::<Vec<_>>();
+        let manifest = Manifest {
+            id: format!("test-{}", std::process::id()),
+            len: data.len() as u64,
+            chunk_size: 10,
+            digest: digest(&data),
+        };
+
+        let mut upload = store.open(manifest.clone()).unwrap();
+        assert_eq!(upload.ack(), Ack { next: 0 });
+        assert!(matches!(
+            store.open(manifest.clone()),
+            Err(UploadError::InProgress(_))
+        ));
+        upload.write(&chunk(0, &data[..10])).unwrap();
+        assert!(matches!(
+            upload.write(&chunk(2, &data[20..])),
+            Err(UploadError::OutOfOrder {
+                expected: 1,
+                got: 2
+            })
+        ));
+        let mut corrupted = chunk(1, &data[10..20]);
+        *corrupted.last_mut().unwrap() ^= 1;
+        assert!(matches!(
+            upload.write(&corrupted),
+            Err(UploadError::InvalidChunk(1))
+        ));
+        drop(upload);
+
+        // The connection was lost: resume from the acknowledged chunk.
+        let mut upload = store.open(manifest).unwrap();
+        assert_eq!(upload.ack(), Ack { next: 1 });
+        upload.write(&chunk(1, &data[10..20])).unwrap();
+        upload.write(&chunk(2, &data[20..])).unwrap();
+        assert!(upload.is_complete());
+        let (mapped, upload) = upload.map().unwrap();
+        assert_eq!(&*mapped, &data[..]);
+        upload.remove().unwrap();
+    }
+
+    #[test]
+    fn test_mismatch() {
+        let store = UploadStore::new(std::env::temp_dir().join("bpce-fhe-upload-test")).unwrap();
+        let data = [1; 10];
+        let manifest = Manifest {
+            id: format!("test-mismatch-{}", std::process::id()),
+            len: data.len() as u64,
+            chunk_size: 10,
+            digest: digest(&data),
+        };
+        let mut upload = store.open(manifest.clone()).unwrap();
+        upload.write(&chunk(0, &data)).unwrap();
+        drop(upload);
+
+        // Another request of the same length reuses the id: its chunks are not those held.
+        let other = Manifest {
+            digest: digest(&[2; 10]),
+            ..manifest
+        };
+        let upload = store.open(other.clone()).unwrap();
+        assert!(upload.is_complete());
+        assert!(matches!(upload.map(), Err(UploadError::Mismatch(_))));
+        let mut upload = store.open(other).unwrap();
+        assert_eq!(upload.ack(), Ack { next: 0 });
+        upload.write(&chunk(0, &[2; 10])).unwrap();
+        let (mapped, upload) = upload.map().unwrap();
+        assert_eq!(&*mapped, &[2; 10]);
+        drop(mapped);
+        upload.remove().unwrap();
+    }
+
+    #[test]
+    fn test_remove_abandoned() {
+        let dir = std::env::temp_dir().join(format!("bpce-fhe-upload-gc-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let old = SystemTime::now() - ABANDONED_AFTER - Duration::from_secs(60);
+        for (name, modified) in [("abandoned", old), ("recent", SystemTime::now())] {
+            File::create(dir.join(name))
+                .unwrap()
+                .set_modified(modified)
+                .unwrap();
+        }
+
+        UploadStore::new(dir.clone()).unwrap();
+        assert!(!dir.join("abandoned").exists());
+        assert!(dir.join("recent").exists());
+        std::fs::remove_dir_all(dir).unwrap();
+    }
+}
@@ -0,0 +1,64 @@
+//! Runs jobs over the memory budget of a server, which spills them to disk.
+
+mod common;
+
+use bpce_fhe::budget::MemoryBudget;
+use bpce_fhe::protocol::{self, Job, Request};
+use bpce_fhe::transport::{Endpoint, Stream};
+use common::CONFIGURATION;
+use fhe_core::api::CryptoSystem as _;
+use seal_lib::{Ciphertext, SealBfvCS};
+
+/// More than a window of items.
+const ITEMS: u64 = 300;
+
+/// Start a server whose jobs may only use 1 MiB of memory each.
+async fn start_server(port: u16) -> Endpoint {
+    let budget = MemoryBudget::new(u64::MAX, 1 << 20, std::env::temp_dir());
+    common::start_server(port, budget, 0).await
+}
+
+async fn run(endpoint: &Endpoint, job: Job) -> (Vec<u64>, protocol::ServerStats) {
+    let bfv_ctx = protocol::bfv_context();
+    let bfv_cs = SealBfvCS::new(&bfv_ctx);
+
+    let data = common::encrypt_products(&bfv_cs, ITEMS);
+    let request = Request {
+        stats: true,
+        ..Request::new(job)
+    };
+
+    let mut stream = Stream::connect(endpoint).await.unwrap();
+    stream
+        .send(&protocol::encode_request(&request, &data).unwrap())
+        .await
+        .unwrap();
+    let response = stream.recv().await.unwrap();
+
+    let (results, read): (Vec<Ciphertext>, _) =
+        bincode::decode_from_slice_with_context(&response, CONFIGURATION, bfv_ctx).unwrap();
+    let stats = protocol::decode_trailer(&response[read..])
+        .unwrap()
+        .unwrap();
+    (results.iter().map(|r| bfv_cs.decipher(r)).collect(), stats)
+}
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_spilled_element_wise_job() {
+    let endpoint = start_server(18220).await;
+
+    let (results, stats) = run(&endpoint, Job::SeqOps).await;
+
+    assert_eq!(results, (0..ITEMS).map(|i| i * 2).collect::<Vec<_>>());
+    assert!(stats.spilled > 0);
+}
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_spilled_aggregate_job() {
+    let endpoint = start_server(18230).await;
+
+    let (results, stats) = run(&endpoint, Job::SeqOpsSum).await;
+
+    assert_eq!(results, vec![(0..ITEMS).map(|i| i * 2).sum()]);
+    assert_eq!(stats.ops["Mul"], ITEMS);
+}
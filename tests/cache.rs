@@ -0,0 +1,64 @@
+//! Repeats a job on a named dataset, whose results are cached by the server.
+
+mod common;
+
+use bpce_fhe::budget::MemoryBudget;
+use bpce_fhe::protocol::{self, Job, Request};
+use bpce_fhe::transport::{Endpoint, Stream};
+use common::{CONFIGURATION, encrypt_products};
+use fhe_core::api::CryptoSystem as _;
+use seal_lib::{Ciphertext, SealBfvCS};
+
+const ITEMS: u64 = 10;
+
+async fn run(
+    endpoint: &Endpoint,
+    data: &[u8],
+    bfv_cs: &SealBfvCS,
+) -> (Vec<u64>, protocol::ServerStats) {
+    let bfv_ctx = protocol::bfv_context();
+    let request = Request {
+        stats: true,
+        tenant: String::from("dashboards"),
+        dataset: String::from("products"),
+        ..Request::new(Job::SeqOpsSum)
+    };
+
+    let mut stream = Stream::connect(endpoint).await.unwrap();
+    stream
+        .send(&protocol::encode_request(&request, data).unwrap())
+        .await
+        .unwrap();
+    let response = stream.recv().await.unwrap();
+
+    let (results, read): (Vec<Ciphertext>, _) =
+        bincode::decode_from_slice_with_context(&response, CONFIGURATION, bfv_ctx).unwrap();
+    let stats = protocol::decode_trailer(&response[read..])
+        .unwrap()
+        .unwrap();
+    (results.iter().map(|r| bfv_cs.decipher(r)).collect(), stats)
+}
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_repeated_job_is_cached() {
+    let endpoint = common::start_server(18250, MemoryBudget::unlimited(), 1 << 20).await;
+    let bfv_ctx = protocol::bfv_context();
+    let bfv_cs = SealBfvCS::new(&bfv_ctx);
+    let sum = |items: u64| vec![(0..items).map(|i| i * 2).sum::<u64>()];
+
+    let data = encrypt_products(&bfv_cs, ITEMS);
+    let (results, stats) = run(&endpoint, &data, &bfv_cs).await;
+    assert_eq!(results, sum(ITEMS));
+    assert_eq!(stats.ops["Mul"], ITEMS);
+
+    // Nothing is computed again.
+    let (results, stats) = run(&endpoint, &data, &bfv_cs).await;
+    assert_eq!(results, sum(ITEMS));
+    assert!(stats.ops.is_empty());
+
+    // Rows were appended: the dataset has a new version.
+    let data = encrypt_products(&bfv_cs, ITEMS + 1);
+    let (results, stats) = run(&endpoint, &data, &bfv_cs).await;
+    assert_eq!(results, sum(ITEMS + 1));
+    assert_eq!(stats.ops["Mul"], ITEMS + 1);
+}
@@ -0,0 +1,86 @@
+//! Fixtures shared by the integration tests.
+
+// Each test crate only uses some of them.
+#![allow(dead_code)]
+
+use bpce_fhe::budget::MemoryBudget;
+use bpce_fhe::transport::Endpoint;
+use core::net::SocketAddr;
+use core::time::Duration;
+use fhe_core::api::CryptoSystem as _;
+use fhe_operations::seq_ops::{SeqOpItem, SeqOpsData};
+use seal_lib::{BfvHOperation2, SealBfvCS};
+use std::process::{Child, Command};
+
+pub const CONFIGURATION: bincode::config::Configuration = bincode::config::standard();
+
+/// Wait until something listens on `addr`, for up to 10 seconds.
+pub async fn wait_for(addr: SocketAddr) {
+    for _ in 0..100 {
+        if tokio::net::TcpStream::connect(addr).await.is_ok() {
+            return;
+        }
+        tokio::time::sleep(Duration::from_millis(100)).await;
+    }
+    panic!("{addr} is not listening");
+}
+
+/// Start a server in this process, on localhost, with the given memory budget and result
+/// cache size in bytes.
+pub async fn start_server(port: u16, budget: MemoryBudget, result_cache: u64) -> Endpoint {
+    let addr = SocketAddr::from(([127, 0, 0, 1], port));
+    tokio::spawn(bpce_fhe::start_server(
+        Endpoint::Tcp(addr),
+        budget,
+        std::env::temp_dir().join(format!("bpce-fhe-uploads-{port}")),
+        None,
+        result_cache,
+        false,
+    ));
+
+    wait_for(addr).await;
+    Endpoint::Tcp(addr)
+}
+
+/// A server process, killed when dropped.
+pub struct ServerProcess(Child);
+
+impl ServerProcess {
+    /// Spawn a server process listening on localhost, without waiting for it.
+    pub fn spawn(port: u16) -> Self {
+        Self(
+            Command::new(env!("CARGO_BIN_EXE_bpce-fhe"))
+                .args(["server", "-a", "127.0.0.1", "-p", &port.to_string()])
+                .spawn()
+                .unwrap(),
+        )
+    }
+
+    /// Spawn a server process listening on localhost, and wait for it.
+    pub async fn start(port: u16) -> (Self, Endpoint) {
+        let server = Self::spawn(port);
+        let addr = SocketAddr::from(([127, 0, 0, 1], port));
+        wait_for(addr).await;
+        (server, Endpoint::Tcp(addr))
+    }
+}
+
+impl Drop for ServerProcess {
+    fn drop(&mut self) {
+        let _ = self.0.kill();
+        let _ = self.0.wait();
+    }
+}
+
+/// Encrypt the products of `0..items` by 2, as the job data of a `SeqOps` request.
+pub fn encrypt_products(bfv_cs: &SealBfvCS, items: u64) -> Vec<u8> {
+    let mut data = SeqOpsData::<SealBfvCS>::new();
+    for i in 0..items {
+        data.push(SeqOpItem::new(
+            bfv_cs.cipher(&i),
+            bfv_cs.cipher(&2),
+            BfvHOperation2::Mul,
+        ));
+    }
+    bincode::encode_to_vec(data, CONFIGURATION).unwrap()
+}
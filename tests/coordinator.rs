@@ -0,0 +1,120 @@
+//! Runs jobs through a coordinator and several worker processes on localhost.
+
+mod common;
+
+use bpce_fhe::protocol::{self, Job, Request};
+use bpce_fhe::transport::{Endpoint, Listener, Stream};
+use common::{CONFIGURATION, ServerProcess, wait_for};
+use core::net::SocketAddr;
+use fhe_core::api::CryptoSystem as _;
+use seal_lib::{Ciphertext, SealBfvCS};
+
+const WORKERS: u16 = 3;
+const ITEMS: u64 = 20;
+
+/// Start a worker answering every request with two partial results, which no shard of a
+/// `SeqOpsSum` job returns.
+async fn start_faulty_worker(addr: SocketAddr) {
+    let listener = Listener::bind(&Endpoint::Tcp(addr)).await.unwrap();
+    tokio::spawn(async move {
+        while let Ok((mut stream, _)) = listener.accept().await {
+            tokio::spawn(async move {
+                if stream.recv().await.is_ok() {
+                    let results = vec![vec![0_u8; 16]; 2];
+                    let response = protocol::encode_response(&results, None).unwrap();
+                    let _ = stream.send(&response).await;
+                }
+            });
+        }
+    });
+}
+
+/// Start the workers and a coordinator in front of them, and return the coordinator address.
+///
+/// With `faulty`, a faulty worker is listed first.
+async fn start_cluster(base_port: u16, faulty: bool) -> (Vec<ServerProcess>, SocketAddr) {
+    let mut workers_addr: Vec<SocketAddr> = (1..=WORKERS)
+        .map(|i| SocketAddr::from(([127, 0, 0, 1], base_port + i)))
+        .collect();
+
+    let workers = workers_addr
+        .iter()
+        .map(|addr| ServerProcess::spawn(addr.port()))
+        .collect();
+
+    if faulty {
+        let addr = SocketAddr::from(([127, 0, 0, 1], base_port + WORKERS + 1));
+        start_faulty_worker(addr).await;
+        workers_addr.insert(0, addr);
+    }
+
+    let config_file = std::env::temp_dir().join(format!("bpce-fhe-coordinator-{base_port}.toml"));
+    let workers_list = workers_addr
+        .iter()
+        .map(|addr| format!("\"{addr}\""))
+        .collect::<Vec<_>>()
+        .join(", ");
+    std::fs::write(
+        &config_file,
+        format!("workers = [{workers_list}]\nshards_per_worker = 2\n"),
+    )
+    .unwrap();
+
+    let coordinator_addr = SocketAddr::from(([127, 0, 0, 1], base_port));
+    tokio::spawn(bpce_fhe::start_coordinator(
+        Endpoint::Tcp(coordinator_addr),
+        config_file.to_string_lossy().into_owned(),
+    ));
+
+    for addr in workers_addr.iter().chain([&coordinator_addr]) {
+        wait_for(*addr).await;
+    }
+
+    (workers, coordinator_addr)
+}
+
+async fn run(coordinator: SocketAddr, job: Job) -> Vec<u64> {
+    let bfv_ctx = protocol::bfv_context();
+    let bfv_cs = SealBfvCS::new(&bfv_ctx);
+
+    let data = common::encrypt_products(&bfv_cs, ITEMS);
+
+    let mut stream = Stream::connect(&Endpoint::Tcp(coordinator)).await.unwrap();
+    stream
+        .send(&protocol::encode_request(&Request::new(job), &data).unwrap())
+        .await
+        .unwrap();
+    let response = stream.recv().await.unwrap();
+
+    let (results, _): (Vec<Ciphertext>, _) =
+        bincode::decode_from_slice_with_context(&response, CONFIGURATION, bfv_ctx).unwrap();
+    results.iter().map(|r| bfv_cs.decipher(r)).collect()
+}
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_element_wise_results_are_ordered() {
+    let (_workers, coordinator) = start_cluster(18180, false).await;
+
+    let results = run(coordinator, Job::SeqOps).await;
+
+    assert_eq!(results, (0..ITEMS).map(|i| i * 2).collect::<Vec<_>>());
+}
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_aggregate_is_summed() {
+    let (_workers, coordinator) = start_cluster(18190, false).await;
+
+    let results = run(coordinator, Job::SeqOpsSum).await;
+
+    assert_eq!(results, vec![(0..ITEMS).map(|i| i * 2).sum()]);
+}
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_unexpected_partials_are_run_again() {
+    let (_workers, coordinator) = start_cluster(18290, true).await;
+
+    // The shards of the faulty worker are run again by the others.
+    let results = run(coordinator, Job::SeqOpsSum).await;
+
+    assert_eq!(results, vec![(0..ITEMS).map(|i| i * 2).sum()]);
+}
@@ -0,0 +1,96 @@
+//! Runs concurrent queries over a single multiplexed connection to a server process.
+
+mod common;
+
+use bpce_fhe::mux::Session;
+use bpce_fhe::protocol::{self, Job, Priority, Request};
+use common::{CONFIGURATION, ServerProcess};
+use fhe_core::api::CryptoSystem as _;
+use seal_lib::{Ciphertext, SealBfvCS};
+use std::sync::Arc;
+
+/// Encode a request multiplying each of `items` by 2.
+fn request(request: &Request, items: u64, bfv_cs: &SealBfvCS) -> Vec<u8> {
+    let data = common::encrypt_products(bfv_cs, items);
+    protocol::encode_request(request, &data).unwrap()
+}
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_concurrent_queries() {
+    let (_server, endpoint) = ServerProcess::start(18200).await;
+    let session = Arc::new(Session::connect(&endpoint).await.unwrap());
+
+    let queries = [
+        (Request::new(Job::SeqOps), 600),
+        (
+            Request {
+                priority: Priority::Interactive,
+                ..Request::new(Job::SeqOpsSum)
+            },
+            10,
+        ),
+        (Request::new(Job::SeqOps), 3),
+    ];
+
+    let tasks = queries
+        .into_iter()
+        .map(|(header, items)| {
+            let session = Arc::clone(&session);
+            tokio::spawn(async move {
+                let bfv_ctx = protocol::bfv_context();
+                let bfv_cs = SealBfvCS::new(&bfv_ctx);
+
+                let mut channel = session.open();
+                channel
+                    .send(&request(&header, items, &bfv_cs))
+                    .await
+                    .unwrap();
+                let response = channel.recv().await.unwrap().unwrap();
+                assert_eq!(channel.recv().await.unwrap(), None);
+
+                let (results, _): (Vec<Ciphertext>, _) =
+                    bincode::decode_from_slice_with_context(&response, CONFIGURATION, bfv_ctx)
+                        .unwrap();
+                let results: Vec<u64> = results.iter().map(|r| bfv_cs.decipher(r)).collect();
+
+                let expected = (0..items).map(|i| i * 2);
+                if header.job.is_element_wise() {
+                    assert_eq!(results, expected.collect::<Vec<_>>());
+                } else {
+                    assert_eq!(results, vec![expected.sum()]);
+                }
+            })
+        })
+        .collect::<Vec<_>>();
+
+    for task in tasks {
+        task.await.unwrap();
+    }
+}
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_cancelled_query_does_not_break_session() {
+    let (_server, endpoint) = ServerProcess::start(18210).await;
+    let session = Session::connect(&endpoint).await.unwrap();
+
+    let bfv_ctx = protocol::bfv_context();
+    let bfv_cs = SealBfvCS::new(&bfv_ctx);
+
+    let mut cancelled = session.open();
+    cancelled
+        .send(&request(&Request::new(Job::SeqOps), 600, &bfv_cs))
+        .await
+        .unwrap();
+    drop(cancelled);
+
+    let mut channel = session.open();
+    channel
+        .send(&request(&Request::new(Job::SeqOpsSum), 4, &bfv_cs))
+        .await
+        .unwrap();
+    let response = channel.recv().await.unwrap().unwrap();
+
+    let (results, _): (Vec<Ciphertext>, _) =
+        bincode::decode_from_slice_with_context(&response, CONFIGURATION, bfv_ctx).unwrap();
+    assert_eq!(bfv_cs.decipher(&results[0]), 12);
+}
@@ -0,0 +1,108 @@
+//! Runs queries on a server, whose keys are not the client's, and decrypts their results.
+
+mod common;
+
+use bpce_fhe::budget::MemoryBudget;
+use bpce_fhe::protocol::{self, BfvCollection, Job, Request};
+use bpce_fhe::transport::{Endpoint, Stream};
+use common::CONFIGURATION;
+use fhe_core::api::CryptoSystem as _;
+use fhe_operations::selectable_collection::{Aggregate, Flag, SelectableItem};
+use fhe_operations::sql::{Query, SqlError};
+use seal_lib::{Ciphertext, SealBfvCS};
+
+/// (amount, paid)
+const SALES: [(u64, bool); 5] = [
+    (10, true),
+    (20, false),
+    (30, true),
+    (40, false),
+    (50, false),
+];
+
+/// Run a query over `SALES`, whose rows are encrypted like the client does: the summed column,
+/// or 1 to count them, and the flags of the conditions of the plan.
+async fn run(endpoint: &Endpoint, query: &str, bfv_cs: &SealBfvCS) -> Vec<u64> {
+    let bfv_ctx = protocol::bfv_context();
+    let query = Query::parse(query).unwrap();
+    let plan = query
+        .plan(&[], SALES.len(), &protocol::query_limits())
+        .unwrap();
+
+    let mut collection = BfvCollection::new();
+    for (amount, paid) in SALES {
+        let value = match query.aggregate() {
+            Aggregate::Sum => amount,
+            Aggregate::Count => 1,
+        };
+        let mut item = SelectableItem::new(&value, bfv_cs);
+        for (index, condition) in plan.flags.iter().enumerate() {
+            if condition.holds(if paid { "true" } else { "false" }) {
+                item.set_flag_plain(index, Flag::On, bfv_cs);
+            }
+        }
+        collection.push(item);
+    }
+
+    let data = protocol::encode_query(&plan, &collection).unwrap();
+    let mut stream = Stream::connect(endpoint).await.unwrap();
+    stream
+        .send(&protocol::encode_request(&Request::new(Job::Query), &data).unwrap())
+        .await
+        .unwrap();
+    let response = stream.recv().await.unwrap();
+
+    let (results, _): (Vec<Ciphertext>, _) =
+        bincode::decode_from_slice_with_context(&response, CONFIGURATION, bfv_ctx).unwrap();
+    results
+        .iter()
+        .map(|result| bfv_cs.decipher(result))
+        .collect()
+}
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_query_without_server_keys() {
+    let endpoint = common::start_server(18270, MemoryBudget::unlimited(), 0).await;
+    let bfv_cs = SealBfvCS::new(&protocol::bfv_context());
+
+    // `NOT` adds a plaintext 1, and `COUNT(*)` sums the values: neither is encrypted by the
+    // server, whose keys could not be decrypted by the client.
+    for (query, expected) in [
+        ("SELECT COUNT(*) FROM sales", 5),
+        ("SELECT COUNT(*) FROM sales WHERE NOT paid", 3),
+        ("SELECT SUM(amount) FROM sales WHERE NOT paid", 110),
+        ("SELECT SUM(amount) FROM sales WHERE paid", 40),
+    ] {
+        assert_eq!(run(&endpoint, query, &bfv_cs).await, [expected], "{query}");
+    }
+}
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_query_at_depth_limit() {
+    let endpoint = common::start_server(18280, MemoryBudget::unlimited(), 0).await;
+    let bfv_cs = SealBfvCS::new(&protocol::bfv_context());
+    let depth = protocol::query_limits().depth;
+
+    // Each `AND` costs a multiplication, and so does summing the selected values.
+    let filter = |depth| {
+        (0..depth).fold("paid".to_string(), |filter, _| {
+            format!("paid AND ({filter})")
+        })
+    };
+    let (query, expected) = match depth.checked_sub(1) {
+        Some(ands) => (
+            format!("SELECT SUM(amount) FROM sales WHERE {}", filter(ands)),
+            40,
+        ),
+        None => ("SELECT COUNT(*) FROM sales WHERE paid".to_string(), 2),
+    };
+    assert_eq!(run(&endpoint, &query, &bfv_cs).await, [expected], "{query}");
+
+    let deeper = format!("SELECT SUM(amount) FROM sales WHERE {}", filter(depth));
+    assert_eq!(
+        Query::parse(&deeper)
+            .unwrap()
+            .plan(&[], SALES.len(), &protocol::query_limits()),
+        Err(SqlError::TooDeep(depth + 1))
+    );
+}
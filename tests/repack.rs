@@ -0,0 +1,56 @@
+//! Packs values encrypted one per ciphertext into ciphertexts holding many of them.
+
+mod common;
+
+use bpce_fhe::budget::MemoryBudget;
+use bpce_fhe::protocol::{self, Job, Request};
+use bpce_fhe::transport::Stream;
+use common::CONFIGURATION;
+use fhe_core::api::CryptoSystem as _;
+use seal_lib::{Ciphertext, SealBfvCS};
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_repack() {
+    let endpoint = common::start_server(18260, MemoryBudget::unlimited(), 0).await;
+    let bfv_ctx = protocol::bfv_context();
+    let bfv_cs = SealBfvCS::new(&bfv_ctx);
+    let width = bfv_cs.slot_count();
+
+    // A full ciphertext, then one whose second row is partly used.
+    let items = (width + width / 2 + 3) as u64;
+    let scalars = (0..items).map(|i| bfv_cs.cipher(&i)).collect::<Vec<_>>();
+    let data =
+        bincode::encode_to_vec((bfv_cs.galois_keys(&bfv_ctx), scalars), CONFIGURATION).unwrap();
+    let request = Request {
+        stats: true,
+        ..Request::new(Job::Repack)
+    };
+
+    let mut stream = Stream::connect(&endpoint).await.unwrap();
+    stream
+        .send(&protocol::encode_request(&request, &data).unwrap())
+        .await
+        .unwrap();
+    let response = stream.recv().await.unwrap();
+
+    let (results, read): (Vec<Ciphertext>, _) =
+        bincode::decode_from_slice_with_context(&response, CONFIGURATION, bfv_ctx).unwrap();
+    let stats = protocol::decode_trailer(&response[read..])
+        .unwrap()
+        .unwrap();
+    assert_eq!(results.len(), 2);
+
+    let mut values = results
+        .iter()
+        .flat_map(|packed| bfv_cs.decipher_slots(packed))
+        .collect::<Vec<_>>();
+    assert!(
+        values
+            .split_off(items as usize)
+            .iter()
+            .all(|&value| value == 0)
+    );
+    assert_eq!(values, (0..items).collect::<Vec<_>>());
+    assert_eq!(stats.ops["SwapRows"], 2);
+    assert_eq!(stats.ops["RotateRows"] + 2, items - 2);
+}
@@ -0,0 +1,89 @@
+//! Resumes an interrupted upload to a server.
+
+mod common;
+
+use bpce_fhe::budget::MemoryBudget;
+use bpce_fhe::protocol::{self, Job, Request};
+use bpce_fhe::transport::{Endpoint, Stream};
+use bpce_fhe::upload::{self, Ack, ChunkHeader, HELLO, Manifest};
+use common::CONFIGURATION;
+use core::time::Duration;
+use fhe_core::api::CryptoSystem as _;
+use seal_lib::{Ciphertext, SealBfvCS};
+
+const ITEMS: u64 = 10;
+/// Small enough to cut the request in several chunks.
+const CHUNK_SIZE: u32 = 64 << 10;
+
+/// Open the upload, and return the connection and the chunks the server already holds,
+/// unless the server refuses it.
+async fn open(endpoint: &Endpoint, manifest: &Manifest) -> Option<(Stream, u64)> {
+    let mut stream = Stream::connect(endpoint).await.unwrap();
+    let mut hello = HELLO.to_vec();
+    hello.extend(bincode::encode_to_vec(manifest, CONFIGURATION).unwrap());
+    stream.send(&hello).await.unwrap();
+    let payload = stream.recv().await.ok()?;
+    let (ack, _): (Ack, _) = bincode::decode_from_slice(&payload, CONFIGURATION).unwrap();
+    Some((stream, ack.next))
+}
+
+async fn recv_ack(stream: &mut Stream) -> Ack {
+    let payload = stream.recv().await.unwrap();
+    bincode::decode_from_slice(&payload, CONFIGURATION)
+        .unwrap()
+        .0
+}
+
+async fn send_chunk(stream: &mut Stream, seq: u64, data: &[u8]) {
+    let header = ChunkHeader {
+        seq,
+        checksum: crc32fast::hash(data),
+    };
+    let mut chunk = bincode::encode_to_vec(header, CONFIGURATION).unwrap();
+    chunk.extend_from_slice(data);
+    stream.send(&chunk).await.unwrap();
+    assert_eq!(recv_ack(stream).await, Ack { next: seq + 1 });
+}
+
+#[tokio::test(flavor = "multi_thread")]
+async fn test_interrupted_upload_resumes() {
+    let endpoint = common::start_server(18240, MemoryBudget::unlimited(), 0).await;
+
+    let bfv_ctx = protocol::bfv_context();
+    let bfv_cs = SealBfvCS::new(&bfv_ctx);
+    let data = common::encrypt_products(&bfv_cs, ITEMS);
+    let request = protocol::encode_request(&Request::new(Job::SeqOps), &data).unwrap();
+
+    let manifest = Manifest {
+        id: format!("test-{}", std::process::id()),
+        len: request.len() as u64,
+        chunk_size: CHUNK_SIZE,
+        digest: upload::digest(&request),
+    };
+    let chunks = request.chunks(CHUNK_SIZE as usize).collect::<Vec<_>>();
+    assert!(chunks.len() > 2);
+
+    // Lose the connection after the first chunk.
+    let (mut stream, next) = open(&endpoint, &manifest).await.unwrap();
+    assert_eq!(next, 0);
+    send_chunk(&mut stream, 0, chunks[0]).await;
+    drop(stream);
+
+    // The upload stays in progress until the server notices the lost connection.
+    let (mut stream, next) = loop {
+        if let Some(opened) = open(&endpoint, &manifest).await {
+            break opened;
+        }
+        tokio::time::sleep(Duration::from_millis(100)).await;
+    };
+    assert_eq!(next, 1);
+    for (seq, chunk) in (1..).zip(&chunks[1..]) {
+        send_chunk(&mut stream, seq, chunk).await;
+    }
+
+    let response = stream.recv().await.unwrap();
+    let (results, _): (Vec<Ciphertext>, _) =
+        bincode::decode_from_slice_with_context(&response, CONFIGURATION, bfv_ctx).unwrap();
+    let results: Vec<u64> = results.iter().map(|r| bfv_cs.decipher(r)).collect();
+    assert_eq!(results, (0..ITEMS).map(|i| i * 2).collect::<Vec<_>>());
+}
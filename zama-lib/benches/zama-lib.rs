@@ -1,6 +1,10 @@
 use criterion::{Criterion, criterion_group, criterion_main};
 use fhe_core::api::CryptoSystem;
-use zama_lib::{FheUint32, TfheHOperation2, ZamaTfheCS, config::ZamaTfheContext};
+use fhe_operations::selectable_collection::{
+    Aggregate, Flag, Predicate, SelectableCollection, SelectableItem,
+};
+use zama_lib::selectable::{TfheSelectableCollection, TfheSelectableItem};
+use zama_lib::{FheUint32, FheUint64, TfheHOperation2, ZamaTfheCS, config::ZamaTfheContext};
 
 fn benchmark_tfhe(c: &mut Criterion) {
     let ctx = ZamaTfheContext::new();
@@ -37,9 +41,42 @@ fn benchmark_tfhe(c: &mut Criterion) {
     });
 }
 
+/// Items of the collections of the `where` benchmark.
+const ITEMS: u64 = 4;
+
+/// Sums the items of a collection whose flag is on, with flags stored as `FheUint64`s applied
+/// by multiplication, or as `FheBool`s applied with `if_then_else`.
+fn benchmark_where(c: &mut Criterion) {
+    let ctx = ZamaTfheContext::new();
+    let cs = ZamaTfheCS::<u64, FheUint64>::new(&ctx);
+    let flag = |i| if i % 2 == 0 { Flag::On } else { Flag::Off };
+
+    let mut integer_flags = SelectableCollection::<1, _>::new();
+    let mut bool_flags = TfheSelectableCollection::<1, _, _>::new();
+    for i in 0..ITEMS {
+        let mut item = SelectableItem::new(&i, &cs);
+        item.set_flag_plain(0, flag(i), &cs);
+        integer_flags.push(item);
+        let mut item = TfheSelectableItem::new(&i, &cs);
+        item.set_flag_plain(0, flag(i), &cs);
+        bool_flags.push(item);
+    }
+    let predicate = Predicate::Flag(0);
+
+    let mut group = c.benchmark_group("tfhe where");
+    group.sample_size(10);
+    group.bench_function(format!("sum of {ITEMS} u64 (FheUint64 flags)"), |b| {
+        b.iter(|| integer_flags.aggregate_where(Aggregate::Sum, Some(&predicate), &cs));
+    });
+    group.bench_function(format!("sum of {ITEMS} u64 (FheBool flags)"), |b| {
+        b.iter(|| bool_flags.aggregate_where(Aggregate::Sum, Some(&predicate), &cs));
+    });
+    group.finish();
+}
+
 criterion_group!(
     name = zama_lib_benchmarks;
     config = Criterion::default().measurement_time(core::time::Duration::from_secs(5));
-    targets = benchmark_tfhe
+    targets = benchmark_tfhe, benchmark_where
 );
 criterion_main!(zama_lib_benchmarks);
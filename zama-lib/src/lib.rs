@@ -10,9 +10,10 @@ use core::ops::{Add, BitAnd, BitOr, BitXor, Div, Mul, Neg, Not, Rem, Sub};
 use fhe_core::api::{Arity1Operation, Arity2Operation, CryptoSystem, Operation};
 use fhe_operations::selectable_collection::SelectableCS;
 use serde::{Deserialize, Serialize};
+pub use tfhe::FheBool;
 use tfhe::{
     ClientKey,
-    prelude::{FheDecrypt, FheEncrypt},
+    prelude::{FheDecrypt, FheEncrypt, FheTrivialEncrypt},
     set_server_key,
 };
 pub use tfhe::{
@@ -24,6 +25,7 @@ pub use tfhe::{
 };
 
 pub mod config;
+pub mod selectable;
 
 #[derive(Clone)]
 /// Ciphertext from Zama TFHE
@@ -32,6 +34,17 @@ pub struct Ciphertext<T, I: FheEncrypt<T, tfhe::ClientKey>> {
     _phantom: core::marker::PhantomData<T>,
 }
 
+impl<T, I: FheEncrypt<T, tfhe::ClientKey>> Ciphertext<T, I> {
+    #[must_use]
+    #[inline]
+    const fn new(value: I) -> Self {
+        Self {
+            value,
+            _phantom: core::marker::PhantomData,
+        }
+    }
+}
+
 impl<T, I: FheEncrypt<T, tfhe::ClientKey> + Serialize> Encode for Ciphertext<T, I> {
     fn encode<E: bincode::enc::Encoder>(
         &self,
@@ -59,22 +72,35 @@ where
     }
 }
 
+/// Bits of the message held by each block of a radix integer, with the default parameters.
+const MESSAGE_BITS_PER_BLOCK: usize = 2;
+
 /// The TFHE CryptoSystem backed by Zama, for integers.
 pub struct ZamaTfheCS<T, I: FheEncrypt<T, tfhe::ClientKey>> {
     client_key: Option<tfhe::ClientKey>,
+    /// TFHE reads the server key from a thread local: it is set on the calling thread before
+    /// each operation, so that operations can run on any thread.
+    server_key: tfhe::ServerKey,
     _phantom: core::marker::PhantomData<(T, I)>,
 }
 
 impl<T, I: FheEncrypt<T, tfhe::ClientKey>> ZamaTfheCS<T, I> {
     #[must_use]
     pub fn new(context: &config::ZamaTfheContext) -> Self {
-        let (client_key, secret_key) = context.generate_keys();
-        set_server_key(secret_key.0);
+        let (client_key, server_key) = context.generate_keys();
+        set_server_key(server_key.0.clone());
         Self {
             client_key,
+            server_key: server_key.0,
             _phantom: core::marker::PhantomData,
         }
     }
+
+    #[inline]
+    /// Set the server key of the calling thread. The key is shared, not copied.
+    fn set_thread_key(&self) {
+        set_server_key(self.server_key.clone());
+    }
 }
 
 impl<T: Copy, I: FheEncrypt<T, ClientKey> + FheDecrypt<T> + Clone> CryptoSystem for ZamaTfheCS<T, I>
@@ -108,6 +134,7 @@ where
     }
 
     fn operate1(&self, operation: Self::Operation1, lhs: &Self::Ciphertext) -> Self::Ciphertext {
+        self.set_thread_key();
         match operation {
             TfheHOperation1::Neg => {
                 let result = -lhs.value.clone();
@@ -132,6 +159,7 @@ where
         lhs: &Self::Ciphertext,
         rhs: &Self::Ciphertext,
     ) -> Self::Ciphertext {
+        self.set_thread_key();
         match operation {
             TfheHOperation2::Add => {
                 let result = lhs.value.clone() + rhs.value.clone();
@@ -196,6 +224,12 @@ where
     fn relinearize(&self, _ciphertext: &mut Self::Ciphertext) {
         // No-op
     }
+
+    #[inline]
+    /// TFHE processes the blocks of a radix integer in parallel.
+    fn op_threads(&self) -> usize {
+        (core::mem::size_of::<T>() * 8).div_ceil(MESSAGE_BITS_PER_BLOCK)
+    }
 }
 
 macro_rules! impl_selectable_cs {
@@ -203,7 +237,8 @@ macro_rules! impl_selectable_cs {
         impl<I: FheEncrypt<$ty, ClientKey> + FheDecrypt<$ty> + Clone> SelectableCS
             for ZamaTfheCS<$ty, I>
         where
-            I: Add<Output = I>
+            I: FheTrivialEncrypt<$ty>
+                + Add<Output = I>
                 + Mul<Output = I>
                 + Neg<Output = I>
                 + Div<Output = I>
@@ -219,6 +254,20 @@ macro_rules! impl_selectable_cs {
 
             const NEUTRAL_ADD: Self::Plaintext = 0;
             const NEUTRAL_MUL: Self::Plaintext = 1;
+
+            #[inline]
+            fn negate(&self, ciphertext: &Self::Ciphertext) -> Self::Ciphertext {
+                self.operate1(TfheHOperation1::Neg, ciphertext)
+            }
+
+            fn add_plain(
+                &self,
+                ciphertext: &Self::Ciphertext,
+                plaintext: &Self::Plaintext,
+            ) -> Self::Ciphertext {
+                self.set_thread_key();
+                Ciphertext::new(ciphertext.value.clone() + I::encrypt_trivial(*plaintext))
+            }
         }
     };
 }
@@ -264,6 +313,8 @@ impl Arity2Operation for TfheHOperation2 {}
 
 #[cfg(test)]
 mod tests {
+    extern crate std;
+
     use super::*;
     use crate::config::ZamaTfheContext;
 
@@ -303,6 +354,25 @@ mod tests {
         assert_eq!(decrypted_result, clear_result);
     }
 
+    #[test]
+    fn test_tfhe_any_thread() {
+        let context = ZamaTfheContext::new();
+        let cs = ZamaTfheCS::<u16, FheUint16>::new(&context);
+        assert_eq!(cs.op_threads(), 8);
+
+        let a = cs.cipher(&300);
+        let b = cs.cipher(&2);
+        // The server key was only set on this thread by `new`.
+        let result = std::thread::scope(|scope| {
+            scope
+                .spawn(|| cs.operate2(TfheHOperation2::Mul, &a, &b))
+                .join()
+                .unwrap()
+        });
+
+        assert_eq!(cs.decipher(&result), 600);
+    }
+
     #[test]
     fn test_tfhe_encode_decode() {
         let context = ZamaTfheContext::new();
@@ -0,0 +1,303 @@
+//! Collections of TFHE integers selected by encrypted booleans.
+//!
+//! A [`SelectableCollection`](fhe_operations::selectable_collection::SelectableCollection) of
+//! [`ZamaTfheCS`] stores each flag as an integer of the system holding 0 or 1, e.g. the 32
+//! blocks of a `FheUint64`, and applies it with a multiplication. Here flags are `FheBool`s,
+//! of a single block: predicates are evaluated with boolean gates, and values are selected
+//! with `if_then_else`, which costs about as much as an addition.
+
+use crate::{Ciphertext, ZamaTfheCS};
+use alloc::vec::Vec;
+use bincode::{Decode, Encode};
+use core::ops::Add;
+use fhe_operations::selectable_collection::{Aggregate, Flag, Predicate};
+use fhe_operations::shared::Shared;
+use tfhe::prelude::{CastFrom, FheEncrypt, FheTrivialEncrypt, IfThenElse};
+use tfhe::{ClientKey, FheBool};
+
+/// An encrypted flag.
+pub type BoolFlag = Ciphertext<bool, FheBool>;
+
+/// An item of a [`TfheSelectableCollection`].
+///
+/// Like [`SelectableItem`](fhe_operations::selectable_collection::SelectableItem), its
+/// ciphertexts are [`Shared`].
+pub struct TfheSelectableItem<const F: usize, T, I: FheEncrypt<T, ClientKey>> {
+    value: Shared<Ciphertext<T, I>>,
+    flags: [Shared<BoolFlag>; F],
+}
+
+impl<const F: usize, T, I: FheEncrypt<T, ClientKey>> Clone for TfheSelectableItem<F, T, I> {
+    fn clone(&self) -> Self {
+        Self {
+            value: self.value.clone(),
+            flags: self.flags.clone(),
+        }
+    }
+}
+
+impl<const F: usize, T, I: FheEncrypt<T, ClientKey>> Encode for TfheSelectableItem<F, T, I>
+where
+    Ciphertext<T, I>: Encode,
+{
+    fn encode<E: bincode::enc::Encoder>(
+        &self,
+        encoder: &mut E,
+    ) -> Result<(), bincode::error::EncodeError> {
+        self.value.encode(encoder)?;
+        self.flags.encode(encoder)
+    }
+}
+
+impl<const F: usize, T, I: FheEncrypt<T, ClientKey>, Context> Decode<Context>
+    for TfheSelectableItem<F, T, I>
+where
+    Ciphertext<T, I>: Decode<Context>,
+{
+    fn decode<D: bincode::de::Decoder<Context = Context>>(
+        decoder: &mut D,
+    ) -> Result<Self, bincode::error::DecodeError> {
+        let value = Shared::decode(decoder)?;
+        let flags = <[Shared<BoolFlag>; F]>::decode(decoder)?;
+        Ok(Self { value, flags })
+    }
+}
+
+impl<const F: usize, T, I: FheEncrypt<T, ClientKey>> TfheSelectableItem<F, T, I> {
+    #[must_use]
+    #[inline]
+    /// Create an item from its already ciphered value and flags.
+    pub fn from_parts(value: Ciphertext<T, I>, flags: [BoolFlag; F]) -> Self {
+        Self {
+            value: Shared::new(value),
+            flags: flags.map(Shared::new),
+        }
+    }
+
+    #[must_use]
+    /// Cipher an item, its flags [`Flag::Off`].
+    pub fn new(value: &T, cs: &ZamaTfheCS<T, I>) -> Self
+    where
+        T: Copy,
+    {
+        let client_key = cs.client_key.as_ref().unwrap();
+        Self::from_parts(
+            Ciphertext::new(I::encrypt(*value, client_key)),
+            core::array::from_fn(|_| Ciphertext::new(FheBool::encrypt(false, client_key))),
+        )
+    }
+
+    #[inline]
+    pub fn set_flag_plain(&mut self, index: usize, flag: Flag, cs: &ZamaTfheCS<T, I>) {
+        let client_key = cs.client_key.as_ref().unwrap();
+        self.flags[index] = Shared::new(Ciphertext::new(FheBool::encrypt(
+            flag == Flag::On,
+            client_key,
+        )));
+    }
+}
+
+/// A collection of [`TfheSelectableItem`]s.
+pub struct TfheSelectableCollection<const F: usize, T, I: FheEncrypt<T, ClientKey>> {
+    items: Vec<TfheSelectableItem<F, T, I>>,
+}
+
+impl<const F: usize, T, I: FheEncrypt<T, ClientKey>> Encode for TfheSelectableCollection<F, T, I>
+where
+    Ciphertext<T, I>: Encode,
+{
+    fn encode<E: bincode::enc::Encoder>(
+        &self,
+        encoder: &mut E,
+    ) -> Result<(), bincode::error::EncodeError> {
+        self.items.encode(encoder)
+    }
+}
+
+impl<const F: usize, T, I: FheEncrypt<T, ClientKey>, Context> Decode<Context>
+    for TfheSelectableCollection<F, T, I>
+where
+    Ciphertext<T, I>: Decode<Context>,
+{
+    fn decode<D: bincode::de::Decoder<Context = Context>>(
+        decoder: &mut D,
+    ) -> Result<Self, bincode::error::DecodeError> {
+        let items = Vec::decode(decoder)?;
+        Ok(Self { items })
+    }
+}
+
+impl<const F: usize, T, I: FheEncrypt<T, ClientKey>> Default for TfheSelectableCollection<F, T, I> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl<const F: usize, T, I: FheEncrypt<T, ClientKey>> TfheSelectableCollection<F, T, I> {
+    #[must_use]
+    #[inline]
+    /// Create a new empty collection.
+    pub const fn new() -> Self {
+        Self { items: Vec::new() }
+    }
+
+    #[must_use]
+    #[inline]
+    /// Create a collection from its items.
+    pub const fn from_vec(items: Vec<TfheSelectableItem<F, T, I>>) -> Self {
+        Self { items }
+    }
+
+    #[must_use]
+    #[inline]
+    /// Get the number of items in the collection.
+    pub fn len(&self) -> usize {
+        self.items.len()
+    }
+
+    #[must_use]
+    #[inline]
+    /// Check if the collection is empty.
+    pub fn is_empty(&self) -> bool {
+        self.items.is_empty()
+    }
+
+    #[inline]
+    /// Add an item to the collection.
+    pub fn push(&mut self, item: TfheSelectableItem<F, T, I>) {
+        self.items.push(item);
+    }
+
+    #[inline]
+    /// Add a plaintext item to the collection, ciphered with the given `CryptoSystem`.
+    pub fn push_plain(&mut self, item: &T, cs: &ZamaTfheCS<T, I>)
+    where
+        T: Copy,
+    {
+        self.items.push(TfheSelectableItem::new(item, cs));
+    }
+
+    #[must_use]
+    /// Aggregates the items for which `predicate` holds, or every item without a predicate,
+    /// like the `aggregate_where` of a `SelectableCollection`.
+    ///
+    /// Returns `None` if the collection is empty.
+    ///
+    /// ## Panics
+    ///
+    /// Panics if the predicate reads a flag the items do not have.
+    pub fn aggregate_where(
+        &self,
+        aggregate: Aggregate,
+        predicate: Option<&Predicate>,
+        cs: &ZamaTfheCS<T, I>,
+    ) -> Option<Ciphertext<T, I>>
+    where
+        T: Default,
+        I: FheTrivialEncrypt<T> + CastFrom<FheBool> + Clone + Add<Output = I>,
+        FheBool: IfThenElse<I>,
+    {
+        assert!(predicate.is_none_or(|predicate| usize::from(predicate.max_flag()) < F));
+
+        cs.set_thread_key();
+        let zero = I::encrypt_trivial(T::default());
+        self.items
+            .iter()
+            .map(|item| {
+                let selected = predicate.map(|predicate| evaluate(predicate, &item.flags));
+                match (aggregate, selected) {
+                    (Aggregate::Sum, None) => item.value.value.clone(),
+                    (Aggregate::Sum, Some(selected)) => {
+                        selected.if_then_else(&item.value.value, &zero)
+                    }
+                    (Aggregate::Count, None) => I::cast_from(FheBool::encrypt_trivial(true)),
+                    (Aggregate::Count, Some(selected)) => I::cast_from(selected),
+                }
+            })
+            .reduce(|sum, value| sum + value)
+            .map(Ciphertext::new)
+    }
+}
+
+/// Evaluates a predicate on the flags of an item.
+fn evaluate(predicate: &Predicate, flags: &[Shared<BoolFlag>]) -> FheBool {
+    match predicate {
+        Predicate::Flag(index) => flags[usize::from(*index)].value.clone(),
+        Predicate::Not(predicate) => !evaluate(predicate, flags),
+        Predicate::And(lhs, rhs) => evaluate(lhs, flags) & evaluate(rhs, flags),
+        Predicate::Or(lhs, rhs) => evaluate(lhs, flags) | evaluate(rhs, flags),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    extern crate std;
+
+    use super::*;
+    use crate::config::ZamaTfheContext;
+    use crate::{FheUint8, FheUint64};
+    use alloc::boxed::Box;
+    use fhe_core::api::CryptoSystem;
+
+    const CONFIG: bincode::config::Configuration = bincode::config::standard();
+
+    #[test]
+    fn test_aggregate_where() {
+        let context = ZamaTfheContext::new();
+        let cs = ZamaTfheCS::<u8, FheUint8>::new(&context);
+        let mut collection = TfheSelectableCollection::<2, _, _>::new();
+        // (value, flag 0, flag 1)
+        for (value, flags) in [
+            (1, [true, false]),
+            (2, [true, true]),
+            (4, [false, true]),
+            (8, [false, false]),
+        ] {
+            let mut item = TfheSelectableItem::new(&value, &cs);
+            for (index, on) in flags.into_iter().enumerate() {
+                let flag = if on { Flag::On } else { Flag::Off };
+                item.set_flag_plain(index, flag, &cs);
+            }
+            collection.push(item);
+        }
+
+        let flag = |index| Box::new(Predicate::Flag(index));
+        let sum = |predicate: Option<Predicate>| {
+            let sum = collection.aggregate_where(Aggregate::Sum, predicate.as_ref(), &cs);
+            cs.decipher(&sum.unwrap())
+        };
+        assert_eq!(sum(None), 15);
+        assert_eq!(sum(Some(Predicate::Flag(0))), 3);
+        assert_eq!(sum(Some(Predicate::Not(flag(0)))), 12);
+        assert_eq!(sum(Some(Predicate::And(flag(0), flag(1)))), 2);
+        assert_eq!(sum(Some(Predicate::Or(flag(0), flag(1)))), 7);
+
+        let count = |predicate: Option<Predicate>| {
+            let count = collection.aggregate_where(Aggregate::Count, predicate.as_ref(), &cs);
+            cs.decipher(&count.unwrap())
+        };
+        assert_eq!(count(None), 4);
+        assert_eq!(count(Some(Predicate::Or(flag(0), flag(1)))), 3);
+        assert!(
+            TfheSelectableCollection::<2, u8, FheUint8>::new()
+                .aggregate_where(Aggregate::Sum, None, &cs)
+                .is_none()
+        );
+    }
+
+    #[test]
+    fn test_flag_size() {
+        let context = ZamaTfheContext::new();
+        let cs = ZamaTfheCS::<u64, FheUint64>::new(&context);
+        let item = TfheSelectableItem::<1, _, _>::new(&42, &cs);
+
+        let flag = bincode::encode_to_vec(&*item.flags[0], CONFIG).unwrap();
+        let integer_flag = bincode::encode_to_vec(cs.cipher(&1), CONFIG).unwrap();
+        assert!(flag.len() * 16 < integer_flag.len());
+
+        let encoded = bincode::encode_to_vec(&item, CONFIG).unwrap();
+        let (decoded, _): (TfheSelectableItem<1, u64, FheUint64>, _) =
+            bincode::decode_from_slice(&encoded, CONFIG).unwrap();
+        assert_eq!(cs.decipher(&decoded.value), 42);
+    }
+}